@@ -0,0 +1,90 @@
+#pragma once
+
+#include "StringUtils.hpp"
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <cstdint>
+#include <cstring>
+
+
+// Deferred formatting, used by the asynchronous logger and the flight recorder. The arguments of format are captured
+// when the message is logged, and formatted later with the same rules as format, eg on another thread or when dumping.
+//
+// Numbers, enums, pointers, and ENUMs are copied as is, since formatting them later doesn't allocate. Char pointers may
+// not outlive the call, so they are copied into the string type S. Other small types that don't need destroying are
+// copied if S::CopySmallTypes is true, anything else is formatted right away into S. S is constructed from a pointer
+// and a length, and formatted with operator<<.
+template<typename T, typename S>
+struct CapturedArg
+{
+    typedef typename std::decay<const T>::type D;
+
+    static const bool isChars = ( std::is_same<D, char *>::value || std::is_same<D, const char *>::value );
+
+    static const bool isPlain = ( std::is_arithmetic<D>::value || std::is_enum<D>::value || std::is_pointer<D>::value
+                                  || std::is_base_of<EnumBase, D>::value );
+
+    static const bool isSmall = ( std::is_trivially_destructible<D>::value && sizeof ( D ) <= 32
+                                  && alignof ( D ) <= alignof ( uint64_t ) );
+
+    static const bool isCopied = ( ! isChars && isSmall && ( isPlain || S::CopySmallTypes ) );
+
+    typedef typename std::conditional<isCopied, D, S>::type type;
+
+    static type capture ( const T& val ) { return capture ( val, bool2type<isCopied>(), bool2type<isChars>() ); }
+
+private:
+
+    template<bool B>
+    static D capture ( const T& val, bool2type<true>, bool2type<B> ) { return val; }
+
+    static S capture ( const T& val, bool2type<false>, bool2type<true> )
+    {
+        const char *str = val;
+
+        if ( ! str )
+            str = "(null)";
+
+        return S ( str, strlen ( str ) );
+    }
+
+    // Strings are formatted too, which unescapes %% the same way as format
+    static S capture ( const T& val, bool2type<false>, bool2type<false> )
+    {
+        const std::string str = format ( val );
+        return S ( str.c_str(), str.size() );
+    }
+};
+
+// Format string literal and the captured arguments
+template<typename ... C>
+struct CapturedFormat
+{
+    const char *fmt;
+
+    std::tuple<C ...> args;
+
+    CapturedFormat ( const char *fmt, C&& ... args ) : fmt ( fmt ), args ( std::move ( args ) ... ) {}
+
+    void formatTo ( FormatBuffer& out ) const { formatArgs ( out, typename MakeIndices<sizeof ... ( C )>::type() ); }
+
+    std::string str() const
+    {
+        FormatBuffer out;
+        formatTo ( out );
+        return out.str();
+    }
+
+private:
+
+    // Without arguments the format is printed as is, like format ( fmt )
+    void formatArgs ( FormatBuffer& out, Indices<> ) const { out.append ( fmt, strlen ( fmt ) ); }
+
+    template<size_t ... I>
+    void formatArgs ( FormatBuffer& out, Indices<I ...> ) const
+    {
+        ::formatTo ( out, fmt, fmt + strlen ( fmt ), std::get<I> ( args ) ... );
+    }
+};
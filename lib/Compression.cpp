@@ -6,6 +6,8 @@
 #include <md5.h>
 
 #include <cstring>
+#include <cstdint>
+#include <algorithm>
 
 using namespace std;
 
@@ -36,6 +38,164 @@ bool checkMD5 ( const string& str, const char md5[16] )
 }
 
 
+static const uint64_t XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl64 ( uint64_t x, int r )
+{
+    return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline uint64_t read64 ( const char *src )
+{
+    uint64_t value;
+    memcpy ( &value, src, sizeof ( value ) );
+    return value;
+}
+
+static inline uint32_t read32 ( const char *src )
+{
+    uint32_t value;
+    memcpy ( &value, src, sizeof ( value ) );
+    return value;
+}
+
+static inline uint64_t xxhRound ( uint64_t acc, uint64_t input )
+{
+    acc += input * XXH_PRIME64_2;
+    acc = rotl64 ( acc, 31 );
+    return acc * XXH_PRIME64_1;
+}
+
+static inline uint64_t xxhMergeRound ( uint64_t hash, uint64_t acc )
+{
+    hash ^= xxhRound ( 0, acc );
+    return hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// Consume as many 32 byte stripes as possible, returns the number of bytes consumed
+static inline size_t xxhStripes ( uint64_t acc[4], const char *bytes, size_t len )
+{
+    const char *const start = bytes;
+    const char *const limit = bytes + len - ( len % 32 );
+
+    uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+
+    for ( ; bytes < limit; bytes += 32 )
+    {
+        a0 = xxhRound ( a0, read64 ( bytes ) );
+        a1 = xxhRound ( a1, read64 ( bytes + 8 ) );
+        a2 = xxhRound ( a2, read64 ( bytes + 16 ) );
+        a3 = xxhRound ( a3, read64 ( bytes + 24 ) );
+    }
+
+    acc[0] = a0;
+    acc[1] = a1;
+    acc[2] = a2;
+    acc[3] = a3;
+
+    return bytes - start;
+}
+
+static inline uint64_t xxhFinalize ( uint64_t hash, const char *bytes, size_t len )
+{
+    for ( ; len >= 8; bytes += 8, len -= 8 )
+    {
+        hash ^= xxhRound ( 0, read64 ( bytes ) );
+        hash = rotl64 ( hash, 27 ) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+
+    if ( len >= 4 )
+    {
+        hash ^= read32 ( bytes ) * XXH_PRIME64_1;
+        hash = rotl64 ( hash, 23 ) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        bytes += 4;
+        len -= 4;
+    }
+
+    for ( ; len > 0; ++bytes, --len )
+    {
+        hash ^= ( uint8_t ) *bytes * XXH_PRIME64_5;
+        hash = rotl64 ( hash, 11 ) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static inline uint64_t xxhMergeAccumulators ( const uint64_t acc[4] )
+{
+    uint64_t hash = rotl64 ( acc[0], 1 ) + rotl64 ( acc[1], 7 ) + rotl64 ( acc[2], 12 ) + rotl64 ( acc[3], 18 );
+
+    for ( size_t i = 0; i < 4; ++i )
+        hash = xxhMergeRound ( hash, acc[i] );
+
+    return hash;
+}
+
+uint64_t getHash64 ( const char *bytes, size_t len, uint64_t seed )
+{
+    Hash64 hash ( seed );
+    hash.update ( bytes, len );
+    return hash.digest();
+}
+
+Hash64::Hash64 ( uint64_t seed ) : _seed ( seed ), _totalLen ( 0 ), _bufferLen ( 0 )
+{
+    _acc[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    _acc[1] = seed + XXH_PRIME64_2;
+    _acc[2] = seed;
+    _acc[3] = seed - XXH_PRIME64_1;
+}
+
+void Hash64::update ( const char *bytes, size_t len )
+{
+    _totalLen += len;
+
+    // Complete the partially buffered stripe first
+    if ( _bufferLen )
+    {
+        const size_t count = min ( len, sizeof ( _buffer ) - _bufferLen );
+        memcpy ( _buffer + _bufferLen, bytes, count );
+        _bufferLen += count;
+        bytes += count;
+        len -= count;
+
+        if ( _bufferLen < sizeof ( _buffer ) )
+            return;
+
+        xxhStripes ( _acc, _buffer, sizeof ( _buffer ) );
+        _bufferLen = 0;
+    }
+
+    const size_t consumed = xxhStripes ( _acc, bytes, len );
+
+    _bufferLen = len - consumed;
+    memcpy ( _buffer, bytes + consumed, _bufferLen );
+}
+
+uint64_t Hash64::digest() const
+{
+    uint64_t hash;
+
+    if ( _totalLen >= 32 )
+        hash = xxhMergeAccumulators ( _acc );
+    else
+        hash = _seed + XXH_PRIME64_5;
+
+    hash += _totalLen;
+
+    return xxhFinalize ( hash, _buffer, _bufferLen );
+}
+
+
 size_t compress ( const char *src, size_t srcLen, char *dst, size_t dstLen, int level )
 {
     mz_ulong len = dstLen;
@@ -62,3 +222,138 @@ size_t compressBound ( size_t srcLen )
 {
     return mz_compressBound ( srcLen );
 }
+
+
+// Zero runs are detected one word at a time, so runs shorter than a word are stored as literals
+typedef uint64_t ZeroRunWord;
+
+static inline bool isZeroWord ( const char *src )
+{
+    ZeroRunWord word;
+    memcpy ( &word, src, sizeof ( word ) );
+    return ( word == 0 );
+}
+
+static inline char *writeVarint ( char *dst, const char *dstEnd, size_t value )
+{
+    do
+    {
+        if ( dst == dstEnd )
+            return 0;
+
+        *dst++ = ( char ) ( ( value & 0x7F ) | ( value > 0x7F ? 0x80 : 0 ) );
+        value >>= 7;
+    }
+    while ( value );
+
+    return dst;
+}
+
+static inline const char *readVarint ( const char *src, const char *srcEnd, size_t& value )
+{
+    value = 0;
+
+    for ( size_t shift = 0; shift < 8 * sizeof ( size_t ); shift += 7 )
+    {
+        if ( src == srcEnd )
+            return 0;
+
+        const uint8_t byte = ( uint8_t ) *src++;
+        value |= ( size_t ) ( byte & 0x7F ) << shift;
+
+        if ( ! ( byte & 0x80 ) )
+            return src;
+    }
+
+    return 0;
+}
+
+size_t compressZeroRuns ( const char *src, size_t srcLen, char *dst, size_t dstLen )
+{
+    const char *dstEnd = dst + dstLen;
+    char *out = dst;
+    size_t i = 0;
+
+    do
+    {
+        // Scan past non-zero words, the remaining partial word is always a literal
+        const size_t literalStart = i;
+
+        while ( i + sizeof ( ZeroRunWord ) <= srcLen && ! isZeroWord ( src + i ) )
+            i += sizeof ( ZeroRunWord );
+
+        if ( i + sizeof ( ZeroRunWord ) > srcLen )
+            i = srcLen;
+
+        const size_t literalLen = i - literalStart;
+
+        // Scan past zero words
+        const size_t zerosStart = i;
+
+        while ( i + sizeof ( ZeroRunWord ) <= srcLen && isZeroWord ( src + i ) )
+            i += sizeof ( ZeroRunWord );
+
+        const size_t zerosLen = i - zerosStart;
+
+        if ( ! ( out = writeVarint ( out, dstEnd, literalLen ) ) )
+            break;
+
+        if ( ( size_t ) ( dstEnd - out ) < literalLen )
+            break;
+
+        memcpy ( out, src + literalStart, literalLen );
+        out += literalLen;
+
+        if ( ! ( out = writeVarint ( out, dstEnd, zerosLen ) ) )
+            break;
+
+        if ( i == srcLen )
+            return ( out - dst );
+    }
+    while ( true );
+
+    LOG ( "Insufficient buffer size: srcLen=%u; dstLen=%u", srcLen, dstLen );
+    return 0;
+}
+
+size_t uncompressZeroRuns ( const char *src, size_t srcLen, char *dst, size_t dstLen )
+{
+    const char *srcEnd = src + srcLen;
+    size_t i = 0;
+
+    while ( src < srcEnd )
+    {
+        size_t literalLen, zerosLen;
+
+        if ( ! ( src = readVarint ( src, srcEnd, literalLen ) ) )
+            break;
+
+        if ( ( size_t ) ( srcEnd - src ) < literalLen || dstLen - i < literalLen )
+            break;
+
+        memcpy ( dst + i, src, literalLen );
+        src += literalLen;
+        i += literalLen;
+
+        if ( ! ( src = readVarint ( src, srcEnd, zerosLen ) ) )
+            break;
+
+        if ( dstLen - i < zerosLen )
+            break;
+
+        memset ( dst + i, 0, zerosLen );
+        i += zerosLen;
+
+        if ( src == srcEnd )
+            return i;
+    }
+
+    LOG ( "Invalid zero-run data: srcLen=%u; dstLen=%u", srcLen, dstLen );
+    return 0;
+}
+
+size_t compressZeroRunsBound ( size_t srcLen )
+{
+    // Incompressible data is encoded as a single literal block
+    return srcLen + 2 * ( 1 + ( 8 * sizeof ( size_t ) ) / 7 );
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <cstdint>
 
 
 // MD5 calculation
@@ -10,7 +11,43 @@ bool checkMD5 ( const char *bytes, size_t len, const char md5[16] );
 bool checkMD5 ( const std::string& str, const char md5[16] );
 
 
+// 64-bit xxHash (XXH64) calculation, much faster than MD5 but not cryptographic
+uint64_t getHash64 ( const char *bytes, size_t len, uint64_t seed = 0 );
+
+
+// Incremental 64-bit xxHash calculation, for hashing non-contiguous data
+class Hash64
+{
+public:
+
+    Hash64 ( uint64_t seed = 0 );
+
+    // Hash more bytes
+    void update ( const char *bytes, size_t len );
+
+    // Get the hash of all the bytes so far
+    uint64_t digest() const;
+
+private:
+
+    uint64_t _seed, _totalLen;
+
+    uint64_t _acc[4];
+
+    char _buffer[32];
+
+    size_t _bufferLen;
+};
+
+
 // zlib compression
 size_t compress ( const char *src, size_t srcLen, char *dst, size_t dstLen, int level = 9 );
 size_t uncompress ( const char *src, size_t srcLen, char *dst, size_t dstLen );
 size_t compressBound ( size_t srcLen );
+
+
+// Zero-run compression, much faster than zlib, intended for mostly zero memory dumps.
+// The data is encoded as a sequence of [literal length][literal bytes][zero run length] blocks.
+size_t compressZeroRuns ( const char *src, size_t srcLen, char *dst, size_t dstLen );
+size_t uncompressZeroRuns ( const char *src, size_t srcLen, char *dst, size_t dstLen );
+size_t compressZeroRunsBound ( size_t srcLen );
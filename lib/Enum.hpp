@@ -4,19 +4,83 @@
 
 #include <vector>
 #include <string>
+#include <cstring>
 
 #include <cereal/archives/binary.hpp>
 
 
-// Enum type boilerplate code
+// Apply M ( N, X ) to each X, for up to 32 arguments
+#define ENUM_CONCAT(A, B) ENUM_CONCAT_ ( A, B )
+#define ENUM_CONCAT_(A, B) A ## B
+#define ENUM_NUM_ARGS(...) ENUM_NUM_ARGS_ ( __VA_ARGS__,                                                        \
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,                                             \
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 )
+#define ENUM_NUM_ARGS_(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16,                   \
+                       _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, N, ...) N
+#define ENUM_FOR_EACH(M, N, ...) ENUM_CONCAT ( ENUM_FOR_EACH_, ENUM_NUM_ARGS ( __VA_ARGS__ ) ) ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_1(M, N, X) M ( N, X )
+#define ENUM_FOR_EACH_2(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_1 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_3(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_2 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_4(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_3 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_5(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_4 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_6(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_5 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_7(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_6 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_8(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_7 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_9(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_8 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_10(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_9 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_11(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_10 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_12(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_11 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_13(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_12 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_14(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_13 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_15(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_14 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_16(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_15 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_17(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_16 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_18(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_17 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_19(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_18 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_20(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_19 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_21(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_20 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_22(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_21 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_23(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_22 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_24(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_23 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_25(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_24 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_26(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_25 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_27(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_26 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_28(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_27 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_29(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_28 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_30(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_29 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_31(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_30 ( M, N, __VA_ARGS__ )
+#define ENUM_FOR_EACH_32(M, N, X, ...) M ( N, X ) ENUM_FOR_EACH_31 ( M, N, __VA_ARGS__ )
+
+// Full name of a value, eg "NAME::Value"
+#define ENUM_NAME(NAME, VALUE) #NAME "::" #VALUE,
+
+
+// Enum type boilerplate code, the names are a static table built at compile time, so they don't need allocating
 #define ENUM_BOILERPLATE(NAME, ...)                                                                             \
     enum Enum : uint8_t { Unknown = 0, __VA_ARGS__ } value = Unknown;                                           \
     NAME ( Enum value ) : value ( value ) {}                                                                    \
+    static const char *const *names() {                                                                         \
+        static const char *const list[] =                                                                       \
+            { #NAME "::Unknown", ENUM_FOR_EACH ( ENUM_NAME, NAME, __VA_ARGS__ ) };                              \
+        return list;                                                                                            \
+    }                                                                                                           \
+    static size_t numNames() { return 1 + ENUM_NUM_ARGS ( __VA_ARGS__ ); }                                      \
+    static const char *name ( Enum value ) { return ( value < numNames() ? names()[value] : 0 ); }              \
+    const char *name() const { return name ( value ); }                                                         \
     std::string str() const override {                                                                          \
-        static const std::vector<std::string> list = split ( "Unknown, " #__VA_ARGS__, ", " );                  \
-        if ( value >= list.size() )                                                                             \
-            return format ( "Unknown (%u)", value );                                                            \
-        return #NAME "::" + list[value];                                                                        \
+        if ( const char *str = name() )                                                                         \
+            return str;                                                                                         \
+        return format ( "Unknown (%u)", ( uint32_t ) value );                                                   \
+    }                                                                                                           \
+    static bool parse ( const char *str, size_t len, Enum& value ) {                                            \
+        uint8_t index;                                                                                          \
+        if ( ! findEnumName ( names(), numNames(), sizeof ( #NAME "::" ) - 1, str, len, index ) )               \
+            return false;                                                                                       \
+        value = Enum ( index );                                                                                 \
+        return true;                                                                                            \
+    }                                                                                                           \
+    static bool parse ( const std::string& str, Enum& value ) {                                                 \
+        return parse ( str.c_str(), str.size(), value );                                                        \
     }                                                                                                           \
     bool operator== ( const NAME& other ) const { return value == other.value; }                                \
     bool operator!= ( const NAME& other ) const { return value != other.value; }                                \
@@ -24,6 +88,34 @@
     bool operator!= ( Enum other ) const { return value != other; }
 
 
+// Find the index of a name in an ENUM table, with or without the "NAME::" prefix
+inline bool findEnumName ( const char *const *names, size_t numNames, size_t prefixLen,
+                           const char *str, size_t len, uint8_t& index )
+{
+    if ( ! len )
+        return false;
+
+    if ( len > prefixLen && ! memcmp ( str, names[0], prefixLen ) )
+    {
+        str += prefixLen;
+        len -= prefixLen;
+    }
+
+    for ( size_t i = 0; i < numNames; ++i )
+    {
+        const char *name = names[i] + prefixLen;
+
+        if ( name[0] == str[0] && ! strncmp ( name, str, len ) && ! name[len] )
+        {
+            index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
 // Enum type with auto-generated string values
 #define ENUM(NAME, ...)                                                                                         \
     struct NAME : public EnumBase {                                                                             \
@@ -39,13 +131,20 @@
 struct EnumBase
 {
     virtual std::string str() const = 0;
+    virtual const char *name() const = 0;
     virtual void save ( cereal::BinaryOutputArchive& ar ) const = 0;
     virtual void load ( cereal::BinaryInputArchive& ar ) = 0;
 };
 
 
 // Stream operator
-inline std::ostream& operator<< ( std::ostream& os, const EnumBase& value ) { return ( os << value.str() ); }
+inline std::ostream& operator<< ( std::ostream& os, const EnumBase& value )
+{
+    if ( const char *name = value.name() )
+        return ( os << name );
+
+    return ( os << value.str() );
+}
 
 
 // Specialize format template function
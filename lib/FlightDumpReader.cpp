@@ -0,0 +1,63 @@
+#include "FlightRecorder.hpp"
+
+#include <fstream>
+#include <algorithm>
+
+using namespace std;
+
+
+bool FlightDumpReader::open ( const string& file, string& error )
+{
+    ifstream fin ( file.c_str(), ios::binary );
+
+    if ( ! fin.good() )
+    {
+        error = "Failed to open file";
+        return false;
+    }
+
+    FlightDumpHeader header;
+
+    if ( ! fin.read ( ( char * ) &header, sizeof ( header ) )
+            || memcmp ( header.magic, FLIGHT_DUMP_MAGIC, sizeof ( header.magic ) )
+            || header.version != FLIGHT_DUMP_VERSION )
+    {
+        error = "Invalid header";
+        return false;
+    }
+
+    header.reason[sizeof ( header.reason ) - 1] = 0;
+
+    reason = header.reason;
+    time = header.time;
+    records.clear();
+
+    for ( uint32_t i = 0; i < header.numRecords; ++i )
+    {
+        Record record;
+
+        if ( ! fin.read ( ( char * ) &record.header, sizeof ( record.header ) )
+                || record.header.size > FLIGHT_CHANNEL_SIZE )
+        {
+            error = "Truncated record";
+            return false;
+        }
+
+        record.payload.resize ( record.header.size );
+
+        if ( record.header.size && ! fin.read ( &record.payload[0], record.header.size ) )
+        {
+            error = "Truncated record";
+            return false;
+        }
+
+        records.push_back ( record );
+    }
+
+    stable_sort ( records.begin(), records.end(), [] ( const Record& a, const Record& b )
+    {
+        return ( a.header.sequence < b.header.sequence );
+    } );
+
+    return true;
+}
@@ -0,0 +1,206 @@
+#include "FlightRecorder.hpp"
+#include "TimerManager.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+// Records are aligned in the ring buffers, so a Padding record always fits before the end
+#define FLIGHT_ALIGN ( sizeof ( uint64_t ) )
+
+// The headers are copied byte for byte, so their layout is part of the dump format
+static_assert ( sizeof ( FlightRecordHeader ) == 24, "FlightRecordHeader layout changed" );
+static_assert ( sizeof ( FlightDumpHeader ) == 24 + FLIGHT_REASON_SIZE, "FlightDumpHeader layout changed" );
+static_assert ( FLIGHT_CHANNEL_SIZE % FLIGHT_ALIGN == 0, "Channel size must be aligned" );
+
+
+static size_t getTotalSize ( const FlightRecordHeader *header )
+{
+    if ( header->type == FlightType::Padding )
+        return header->size;
+
+    return ( sizeof ( FlightRecordHeader ) + header->size + FLIGHT_ALIGN - 1 ) & ~ ( FLIGHT_ALIGN - 1 );
+}
+
+
+void FlightRecorder::initialize()
+{
+    for ( Channel& channel : _channels )
+    {
+        Lock lock ( channel.mutex );
+
+        if ( ! channel.data )
+            channel.data.reset ( new uint64_t[FLIGHT_CHANNEL_SIZE / sizeof ( uint64_t )] );
+
+        channel.head = channel.tail = 0;
+    }
+
+    _enabled = true;
+}
+
+void FlightRecorder::deinitialize()
+{
+    _enabled = false;
+
+    for ( Channel& channel : _channels )
+    {
+        Lock lock ( channel.mutex );
+        channel.data.reset();
+        channel.head = channel.tail = 0;
+    }
+}
+
+char *FlightRecorder::reserve ( FlightChannel channelId, FlightType type, size_t size )
+{
+    Channel& channel = _channels[( size_t ) channelId];
+
+    // Check again now that the channel is locked
+    if ( ! channel.data )
+        return 0;
+
+    char *data = ( char * ) channel.data.get();
+
+    const FlightRecordHeader header = { ( uint32_t ) size, type, channelId, 0, _sequence++, 0,
+                                        TimerManager::get().getNow()
+                                      };
+
+    const size_t total = getTotalSize ( &header );
+
+    if ( total > FLIGHT_CHANNEL_SIZE )
+        return 0;
+
+    // Records are contiguous, so pad to the start of the buffer if it doesn't fit before the end
+    const size_t offset = channel.head % FLIGHT_CHANNEL_SIZE;
+    const size_t padding = ( offset + total > FLIGHT_CHANNEL_SIZE ? FLIGHT_CHANNEL_SIZE - offset : 0 );
+
+    // Overwrite the oldest records until there is enough space
+    while ( channel.tail < channel.head && channel.head + padding + total - channel.tail > FLIGHT_CHANNEL_SIZE )
+        channel.tail += getTotalSize ( ( FlightRecordHeader * ) ( data + channel.tail % FLIGHT_CHANNEL_SIZE ) );
+
+    if ( padding )
+    {
+        FlightRecordHeader *pad = ( FlightRecordHeader * ) ( data + offset );
+        pad->size = padding;
+        pad->type = FlightType::Padding;
+        channel.head += padding;
+    }
+
+    char *ptr = data + channel.head % FLIGHT_CHANNEL_SIZE;
+    memcpy ( ptr, &header, sizeof ( header ) );
+    channel.head += total;
+
+    return ptr + sizeof ( header );
+}
+
+void FlightRecorder::text ( FlightChannel channel, const char *text )
+{
+    if ( ! isEnabled() )
+        return;
+
+    const size_t len = min<size_t> ( strlen ( text ), FLIGHT_MAX_TEXT_SIZE );
+
+    Lock lock ( _channels[( size_t ) channel].mutex );
+
+    if ( char *ptr = reserve ( channel, FlightType::Text, len ) )
+        memcpy ( ptr, text, len );
+}
+
+void FlightRecorder::network ( const FlightNetworkEvent& event )
+{
+    if ( ! isEnabled() )
+        return;
+
+    Lock lock ( _channels[( size_t ) FlightChannel::Network].mutex );
+
+    if ( char *ptr = reserve ( FlightChannel::Network, FlightType::Network, sizeof ( event ) ) )
+        memcpy ( ptr, &event, sizeof ( event ) );
+}
+
+void FlightRecorder::frame ( const FlightFrameEvent& event )
+{
+    if ( ! isEnabled() )
+        return;
+
+    Lock lock ( _channels[( size_t ) FlightChannel::Frame].mutex );
+
+    if ( char *ptr = reserve ( FlightChannel::Frame, FlightType::Frame, sizeof ( event ) ) )
+        memcpy ( ptr, &event, sizeof ( event ) );
+}
+
+bool FlightRecorder::dump ( const char *file, const char *reason, bool lock )
+{
+    FILE *fd = fopen ( file, "wb" );
+
+    if ( ! fd )
+        return false;
+
+    // Buffer the file on the stack, instead of letting the C runtime allocate a buffer
+    char fileBuffer[4096];
+    setvbuf ( fd, fileBuffer, _IOFBF, sizeof ( fileBuffer ) );
+
+    char text[FLIGHT_MAX_TEXT_SIZE];
+
+    FlightDumpHeader header;
+    memset ( &header, 0, sizeof ( header ) );
+    memcpy ( header.magic, FLIGHT_DUMP_MAGIC, sizeof ( header.magic ) );
+    header.version = FLIGHT_DUMP_VERSION;
+    header.time = TimerManager::get().getNow();
+    strncpy ( header.reason, reason, sizeof ( header.reason ) - 1 );
+
+    // The number of records is written at the end
+    fwrite ( &header, sizeof ( header ), 1, fd );
+
+    for ( Channel& channel : _channels )
+    {
+        if ( lock )
+            channel.mutex.lock();
+
+        const char *data = ( const char * ) channel.data.get();
+
+        for ( size_t pos = channel.tail; data && pos < channel.head; )
+        {
+            const FlightRecordHeader *record = ( const FlightRecordHeader * ) ( data + pos % FLIGHT_CHANNEL_SIZE );
+            const char *payload = ( const char * ) ( record + 1 );
+
+            pos += getTotalSize ( record );
+
+            if ( record->type == FlightType::Padding )
+                continue;
+
+            if ( record->type == FlightType::Format )
+            {
+                // Format the arguments now, the format function and pointer are only valid in this process
+                const size_t len = ( * ( const FormatFunc * ) payload ) ( payload, text, sizeof ( text ) );
+
+                FlightRecordHeader formatted = *record;
+                formatted.type = FlightType::Text;
+                formatted.size = len;
+
+                fwrite ( &formatted, sizeof ( formatted ), 1, fd );
+                fwrite ( text, len, 1, fd );
+            }
+            else
+            {
+                fwrite ( record, sizeof ( *record ) + record->size, 1, fd );
+            }
+
+            ++header.numRecords;
+        }
+
+        if ( lock )
+            channel.mutex.unlock();
+    }
+
+    fseek ( fd, 0, SEEK_SET );
+    fwrite ( &header, sizeof ( header ), 1, fd );
+    fclose ( fd );
+    return true;
+}
+
+FlightRecorder& FlightRecorder::get()
+{
+    static FlightRecorder instance;
+    return instance;
+}
+
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "Thread.hpp"
+#include "StringUtils.hpp"
+#include "CapturedFormat.hpp"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include <cstring>
+
+
+// In-memory flight recorder of the most recent events, so there is detail after a desync or crash without logging.
+//
+// Each channel is a fixed size ring buffer of binary records, the oldest records are overwritten when it is full.
+// Log records only copy the format pointer and the arguments, which are formatted when dumping. The recorder
+// does nothing until initialized, and the dump is written only when asked to, see tools/FlightDecoder.cpp.
+
+
+// Size of each channel's ring buffer
+#define FLIGHT_CHANNEL_SIZE         ( 256 * 1024 )
+
+// Max length of strings captured in log records, and of text records
+#define FLIGHT_STRING_SIZE          ( 96 )
+#define FLIGHT_MAX_TEXT_SIZE        ( 512 )
+
+// Magic bytes and current version of the dump format
+#define FLIGHT_DUMP_MAGIC           "CCFLIGHT"
+#define FLIGHT_DUMP_VERSION         ( 1 )
+
+// Max size of the dump reason
+#define FLIGHT_REASON_SIZE          ( 64 )
+
+
+enum class FlightChannel : uint8_t
+{
+    // LOG messages, when logging is enabled
+    Log = 0,
+
+    // LOG_SYNC messages
+    Sync,
+
+    // Socket events
+    Network,
+
+    // Per frame inputs and rollbacks
+    Frame,
+
+    // Number of channels
+    Count
+};
+
+enum class FlightType : uint8_t
+{
+    // Pads a ring buffer to its end, never dumped
+    Padding = 0,
+
+    // Formatted text
+    Text,
+
+    // Format and arguments, these are dumped as Text
+    Format,
+
+    // FlightNetworkEvent
+    Network,
+
+    // FlightFrameEvent
+    Frame,
+};
+
+enum class FlightNetwork : uint8_t
+{
+    Send = 0,
+    Read,
+    Decoded,
+    Error,
+    Disconnected,
+};
+
+enum class FlightFrame : uint8_t
+{
+    Inputs = 0,
+    Reinputs,
+    Rollback,
+    RollbackFailed,
+    RngState,
+    SyncHash,
+    Desync,
+};
+
+struct FlightNetworkEvent
+{
+    // Socket address in memory, which identifies the socket
+    uint32_t socket;
+
+    // Number of bytes sent or read, the decoded MsgType, or the error code
+    uint32_t value;
+
+    uint16_t port;
+
+    FlightNetwork event;
+
+    // Socket::Protocol value
+    uint8_t protocol;
+
+    char address[24];
+};
+
+struct FlightFrameEvent
+{
+    uint32_t index, frame;
+
+    // For rollbacks, the frame that is re-run up to; for sync hashes and desyncs, the frame that was compared
+    uint32_t targetIndex, targetFrame;
+
+    uint16_t p1, p2;
+
+    FlightFrame event;
+};
+
+// Header of each record, in the ring buffers and in the dump
+struct FlightRecordHeader
+{
+    // Size of the payload that follows, or the total size of Padding records
+    uint32_t size;
+
+    FlightType type;
+
+    FlightChannel channel;
+
+    uint16_t reserved;
+
+    // Order of the record across all the channels
+    uint32_t sequence;
+
+    uint32_t reserved2;
+
+    // TimerManager time in milliseconds
+    uint64_t time;
+};
+
+struct FlightDumpHeader
+{
+    char magic[8];
+
+    uint32_t version;
+
+    uint32_t numRecords;
+
+    // TimerManager time when the dump was written
+    uint64_t time;
+
+    char reason[FLIGHT_REASON_SIZE];
+};
+
+
+// Captured string, see CapturedArg. It is truncated to a fixed size so records stay trivially copyable, and small types
+// are formatted right away, so dumping never allocates.
+struct FlightString
+{
+    static const bool CopySmallTypes = false;
+
+    char str[FLIGHT_STRING_SIZE];
+
+    FlightString ( const char *src, size_t len )
+    {
+        len = std::min<size_t> ( len, sizeof ( str ) - 1 );
+        memcpy ( str, src, len );
+        str[len] = 0;
+    }
+};
+
+inline std::ostream& operator<< ( std::ostream& os, const FlightString& str ) { return ( os << str.str ); }
+
+// Same as the stream operator, without the stream
+inline void formatValue ( FormatBuffer& out, const char *spec, const FlightString& val, int2type<FormatStream> )
+{
+    out.printString ( spec, val.str, strlen ( val.str ) );
+}
+
+
+class FlightRecorder
+{
+public:
+
+    // Allocate the ring buffers and start recording
+    void initialize();
+
+    // Stop recording and free the ring buffers
+    void deinitialize();
+
+    bool isEnabled() const { return _enabled.load ( std::memory_order_relaxed ); }
+
+    // Record a log message, the format must be a string literal
+    template<typename ... V>
+    void log ( FlightChannel channel, const char *fmt, const V& ... args )
+    {
+        if ( isEnabled() )
+            push<typename CapturedArg<V, FlightString>::type ...> ( channel, fmt,
+                    CapturedArg<V, FlightString>::capture ( args ) ... );
+    }
+
+    // Record formatted text, truncated to FLIGHT_MAX_TEXT_SIZE
+    void text ( FlightChannel channel, const char *text );
+
+    void network ( const FlightNetworkEvent& event );
+
+    void frame ( const FlightFrameEvent& event );
+
+    // Write all the recorded events to a file, returns false if it can't be written. Log records are formatted into
+    // a buffer on the stack, truncated to FLIGHT_MAX_TEXT_SIZE, so this doesn't allocate. This doesn't lock the
+    // channels when called from a crash handler, since the crashed thread may own them.
+    bool dump ( const char *file, const char *reason, bool lock = true );
+
+    // Get the singleton instance
+    static FlightRecorder& get();
+
+private:
+
+    // Format function stored at the start of Format records, which formats into the given buffer without allocating
+    // and returns the length
+    typedef size_t ( *FormatFunc ) ( const char *payload, char *buffer, size_t size );
+
+    template<typename ... C>
+    struct FormatPayload
+    {
+        FormatFunc func;
+
+        CapturedFormat<C ...> captured;
+
+        static size_t run ( const char *payload, char *buffer, size_t size )
+        {
+            FormatBuffer out ( buffer, size );
+            ( ( const FormatPayload * ) payload )->captured.formatTo ( out );
+            return out.size();
+        }
+    };
+
+    struct Channel
+    {
+        std::unique_ptr<uint64_t[]> data;
+
+        // Positions of the oldest record and the end of the newest, which only increase
+        size_t head = 0, tail = 0;
+
+        Mutex mutex;
+    };
+
+    Channel _channels[( size_t ) FlightChannel::Count];
+
+    std::atomic<bool> _enabled { false };
+
+    std::atomic<uint32_t> _sequence { 0 };
+
+    // Reserve space for a record, overwriting the oldest records. Only call this with the channel locked.
+    char *reserve ( FlightChannel channel, FlightType type, size_t size );
+
+    template<typename ... C>
+    void push ( FlightChannel channel, const char *fmt, C ... args )
+    {
+        typedef FormatPayload<C ...> Payload;
+
+        static_assert ( alignof ( Payload ) <= alignof ( uint64_t ), "Payload alignment is too large" );
+        static_assert ( std::is_trivially_destructible<Payload>::value, "Payload must not need destroying" );
+
+        Lock lock ( _channels[( size_t ) channel].mutex );
+
+        char *ptr = reserve ( channel, FlightType::Format, sizeof ( Payload ) );
+
+        if ( ! ptr )
+            return;
+
+        Payload *payload = new ( ptr ) Payload { &Payload::run, CapturedFormat<C ...> ( fmt, std::move ( args ) ... ) };
+        ( void ) payload;
+    }
+};
+
+
+// Reads a dump written by FlightRecorder, the records are sorted by sequence. This only depends on the header, so tools
+// can link it without the rest of the library.
+class FlightDumpReader
+{
+public:
+
+    struct Record
+    {
+        FlightRecordHeader header;
+
+        std::string payload;
+
+        template<typename T>
+        T get() const
+        {
+            T t;
+            memset ( &t, 0, sizeof ( t ) );
+            memcpy ( &t, &payload[0], std::min ( sizeof ( t ), payload.size() ) );
+            return t;
+        }
+    };
+
+    std::string reason;
+
+    uint64_t time = 0;
+
+    std::vector<Record> records;
+
+    // Read the whole file, returns false on error
+    bool open ( const std::string& file, std::string& error );
+};
@@ -1,21 +1,44 @@
 #include "Logger.hpp"
 #include "Algorithms.hpp"
 #include "TimerManager.hpp"
+#include "FlightRecorder.hpp"
 
 using namespace std;
 
 
+// Interval to check for new messages on the background thread
+#define ASYNC_POLL_INTERVAL ( 5 )
+
+// Number of buffers cached per thread, ie the number of loggers a thread can use without looking up its buffer
+#define ASYNC_BUFFER_CACHE_SIZE ( 4 )
+
+
+static atomic<uint32_t> nextAsyncId ( 1 );
+
+Logger::Logger() : _asyncId ( nextAsyncId++ ), _asyncWorker ( *this ) {}
+
+void Logger::AsyncWorker::run()
+{
+    context.runAsync();
+}
+
+
 #ifdef DISABLE_LOGGING
 
 void Logger::initialize ( const string& filePath, uint32_t _options ) {}
 void Logger::deinitialize() {}
 void Logger::flush() {}
 void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage ) {}
+void Logger::runAsync() {}
+void Logger::stopAsync() {}
 
 #else
 
 void Logger::initialize ( const string& filePath, uint32_t _options )
 {
+    // The background thread is restarted after changing the file
+    stopAsync();
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
@@ -58,6 +81,13 @@ void Logger::initialize ( const string& filePath, uint32_t _options )
         _logId = generateRandomId();
 
     _initialized = true;
+
+    if ( ( _options & LOG_ASYNC ) && _fd )
+    {
+        _asyncStop = false;
+        _asyncWorker.start();
+        _async = true;
+    }
 }
 
 void Logger::deinitialize()
@@ -65,6 +95,8 @@ void Logger::deinitialize()
     if ( ! _initialized )
         return;
 
+    stopAsync();
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
@@ -82,6 +114,21 @@ void Logger::deinitialize()
 
 void Logger::flush()
 {
+    if ( _async )
+    {
+        // Wait until the background thread has written everything logged before this
+        LOCK ( _asyncMutex );
+
+        const uint32_t request = ++_asyncFlushRequest;
+
+        _asyncFlushed.broadcast();
+
+        while ( _async && _asyncFlushDone < request )
+            _asyncFlushed.wait ( _asyncMutex );
+
+        return;
+    }
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
@@ -94,17 +141,36 @@ void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const
     if ( ! _fd )
         return;
 
+    if ( _async )
+    {
+        logAsync ( srcFile, srcLine, srcFunc, "%s", logMessage );
+        return;
+    }
+
+    time_t t = 0;
+    uint64_t now = 0;
+
+    if ( _options & ( LOG_GM_TIME | LOG_LOCAL_TIME ) )
+    {
+        time ( &t );
+        now = TimerManager::get().getNow ( true );
+    }
+
 #ifdef LOGGER_MUTEXED
     LOCK ( _mutex );
 #endif
 
+    write ( srcFile, srcLine, srcFunc, t, now, logMessage );
+    fflush ( _fd );
+}
+
+void Logger::write ( const char *srcFile, int srcLine, const char *srcFunc, time_t t, uint64_t now,
+                     const char *logMessage )
+{
     bool hasPrefix = false;
 
     if ( _options & ( LOG_GM_TIME | LOG_LOCAL_TIME ) )
     {
-        time_t t;
-        time ( &t );
-
         tm *ts;
         if ( _options & LOG_GM_TIME )
             ts = gmtime ( &t );
@@ -113,8 +179,6 @@ void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const
 
         strftime ( _buffer, sizeof ( _buffer ), "%H:%M:%S", ts );
 
-        const uint64_t now = TimerManager::get().getNow ( true );
-
         fprintf ( _fd, "%s.%03u:", _buffer, ( uint32_t ) ( now % 1000 ) );
         hasPrefix = true;
     }
@@ -134,7 +198,147 @@ void Logger::log ( const char *srcFile, int srcLine, const char *srcFunc, const
     }
 
     fprintf ( _fd, ( hasPrefix ? " %s\n" : "%s\n" ), logMessage );
-    fflush ( _fd );
+
+    if ( flightRecord )
+        FlightRecorder::get().text ( FlightChannel::Log, logMessage );
+}
+
+uint64_t Logger::getAsyncNow()
+{
+    return TimerManager::get().getNow ( true );
+}
+
+AsyncLog::Buffer *Logger::getAsyncBuffer()
+{
+    struct CachedBuffer
+    {
+        uint32_t asyncId;
+        AsyncLog::Buffer *buffer;
+    };
+
+    static thread_local CachedBuffer cache[ASYNC_BUFFER_CACHE_SIZE];
+
+    CachedBuffer& cached = cache[_asyncId % ASYNC_BUFFER_CACHE_SIZE];
+
+    if ( cached.asyncId == _asyncId )
+        return cached.buffer;
+
+    LOCK ( _asyncMutex );
+
+    _asyncBuffers.push_back ( make_shared<AsyncLog::Buffer>() );
+
+    cached.asyncId = _asyncId;
+    cached.buffer = _asyncBuffers.back().get();
+    return cached.buffer;
+}
+
+size_t Logger::drainAsync()
+{
+    vector<AsyncLog::Buffer *> buffers;
+
+    {
+        LOCK ( _asyncMutex );
+
+        for ( const auto& buffer : _asyncBuffers )
+            buffers.push_back ( buffer.get() );
+    }
+
+    string message;
+    size_t count = 0;
+
+    for ( ;; )
+    {
+        // Write the message with the lowest sequence number first, so the threads are interleaved in order
+        AsyncLog::Buffer *next = 0;
+        AsyncLog::Message *first = 0;
+
+        for ( AsyncLog::Buffer *buffer : buffers )
+        {
+            AsyncLog::Message *msg = buffer->peek();
+
+            if ( msg && ( ! first || msg->sequence < first->sequence ) )
+            {
+                next = buffer;
+                first = msg;
+            }
+        }
+
+        if ( ! first )
+            break;
+
+        first->run ( first, message );
+
+        write ( first->srcFile, first->srcLine, first->srcFunc, first->time, first->now, message.c_str() );
+
+        next->pop();
+        ++count;
+    }
+
+    for ( AsyncLog::Buffer *buffer : buffers )
+    {
+        const size_t dropped = buffer->dropped.exchange ( 0 );
+
+        if ( dropped )
+            fprintf ( _fd, "Dropped %u log messages because the buffer was full\n", ( uint32_t ) dropped );
+    }
+
+    if ( count )
+        fflush ( _fd );
+
+    return count;
+}
+
+void Logger::runAsync()
+{
+    for ( ;; )
+    {
+        bool stop;
+        uint32_t request;
+
+        {
+            LOCK ( _asyncMutex );
+            stop = _asyncStop;
+            request = _asyncFlushRequest;
+        }
+
+        // Messages pushed before reading the stop flag or the flush request are written by this pass
+        const size_t count = drainAsync();
+
+        LOCK ( _asyncMutex );
+
+        if ( _asyncFlushDone != request )
+        {
+            _asyncFlushDone = request;
+            _asyncFlushed.broadcast();
+        }
+
+        if ( stop )
+            return;
+
+        if ( ! count && _asyncFlushRequest == request )
+            _asyncFlushed.wait ( _asyncMutex, ASYNC_POLL_INTERVAL );
+    }
+}
+
+void Logger::stopAsync()
+{
+    if ( ! _async )
+        return;
+
+    _async = false;
+
+    {
+        LOCK ( _asyncMutex );
+        _asyncStop = true;
+        _asyncFlushed.broadcast();
+    }
+
+    _asyncWorker.join();
+
+    // Release any flush that was requested after the last pass
+    LOCK ( _asyncMutex );
+    _asyncFlushDone = _asyncFlushRequest;
+    _asyncFlushed.broadcast();
 }
 
 #endif // DISABLE_LOGGING
@@ -2,8 +2,13 @@
 
 #include "Thread.hpp"
 #include "StringUtils.hpp"
+#include "CapturedFormat.hpp"
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <new>
 #include <cstdio>
 #include <ctime>
 
@@ -13,10 +18,160 @@
 #define LOG_FILE_LINE   ( 0x04 )    // Log file:line per message
 #define LOG_FUNC_NAME   ( 0x08 )    // Log the function name per message
 #define PID_IN_FILENAME ( 0x10 )    // Add the PID to the log filename
+#define LOG_ASYNC       ( 0x20 )    // Format and write messages on a background thread
 
 #define LOG_DEFAULT_OPTIONS ( LOG_GM_TIME | LOG_FILE_LINE | LOG_FUNC_NAME )
 
 
+// Asynchronous logging, enabled with LOG_ASYNC.
+//
+// The calling thread only copies the format pointer and the arguments into a lock-free ring buffer owned by that
+// thread. A background thread formats the messages with the same format() as synchronous logging, merges the
+// buffers of all threads by sequence number, and writes to the file. Formats must be string literals, since only
+// the pointer is kept. If a buffer is full the message is dropped and counted, the logging thread never blocks.
+namespace AsyncLog
+{
+
+// Captured string, see CapturedArg. Small types are copied, since the background thread formats them.
+struct String
+{
+    static const bool CopySmallTypes = true;
+
+    std::string str;
+
+    String ( const char *str, size_t len ) : str ( str, len ) {}
+};
+
+inline std::ostream& operator<< ( std::ostream& os, const String& str ) { return ( os << str.str ); }
+
+// Header of each message in a buffer, followed by the captured arguments
+struct Message
+{
+    // Format the message and destroy the arguments, null if this only pads to the end of the buffer
+    void ( *run ) ( Message *message, std::string& out );
+
+    // Size of the message including the arguments, rounded up to Buffer::Align
+    uint32_t size;
+
+    int srcLine;
+
+    const char *srcFile, *srcFunc;
+
+    // Order of the message across all the threads
+    uint64_t sequence;
+
+    // Time when the message was logged, only set with LOG_GM_TIME or LOG_LOCAL_TIME
+    time_t time;
+    uint64_t now;
+};
+
+template<typename ... C>
+struct MessageOf : public Message
+{
+    CapturedFormat<C ...> captured;
+
+    MessageOf ( const char *fmt, C&& ... args ) : captured ( fmt, std::move ( args ) ... ) {}
+
+    static void formatAndDestroy ( Message *message, std::string& out )
+    {
+        MessageOf *self = static_cast<MessageOf *> ( message );
+        out = self->captured.str();
+        self->~MessageOf();
+    }
+};
+
+// Ring buffer of messages, written by exactly one logging thread and read by the background thread
+class Buffer
+{
+public:
+
+    static const size_t Size = 256 * 1024;
+
+    // Messages are aligned so that there is always room for the run and size fields of the padding
+    static const size_t Align = 16;
+
+    // Number of messages dropped because the buffer was full
+    std::atomic<size_t> dropped { 0 };
+
+    Buffer() : _data ( new uint64_t[Size / sizeof ( uint64_t )] ) {}
+
+    // Reserve space for a message, returns null if the buffer is full. Only call this from the logging thread.
+    void *reserve ( size_t size )
+    {
+        const size_t head = _head.load ( std::memory_order_relaxed );
+        const size_t offset = head % Size;
+
+        // Messages are contiguous, so pad to the start of the buffer if it doesn't fit before the end
+        const size_t padding = ( offset + size > Size ? Size - offset : 0 );
+
+        if ( head + padding + size - _tail.load ( std::memory_order_acquire ) > Size )
+            return 0;
+
+        if ( padding )
+        {
+            Message *pad = at ( offset );
+            pad->size = padding;
+            pad->run = 0;
+        }
+
+        _reserved = padding + size;
+        return at ( ( head + padding ) % Size );
+    }
+
+    // Publish the message written after reserve
+    void commit()
+    {
+        _head.store ( _head.load ( std::memory_order_relaxed ) + _reserved, std::memory_order_release );
+    }
+
+    // Get the next message, returns null if empty. Only call this from the background thread.
+    Message *peek()
+    {
+        for ( ;; )
+        {
+            const size_t tail = _tail.load ( std::memory_order_relaxed );
+
+            if ( _head.load ( std::memory_order_acquire ) == tail )
+                return 0;
+
+            Message *message = at ( tail % Size );
+
+            if ( message->run )
+                return message;
+
+            _tail.store ( tail + message->size, std::memory_order_release );
+        }
+    }
+
+    // Release the message returned by peek, after it has been formatted
+    void pop()
+    {
+        const size_t tail = _tail.load ( std::memory_order_relaxed );
+        _tail.store ( tail + at ( tail % Size )->size, std::memory_order_release );
+    }
+
+private:
+
+    std::unique_ptr<uint64_t[]> _data;
+
+    // Only used by the logging thread
+    size_t _reserved = 0;
+
+    // The producer and consumer positions are kept on separate cache lines, so they don't contend
+    char _pad0[64];
+
+    std::atomic<size_t> _head { 0 };
+
+    char _pad1[64];
+
+    std::atomic<size_t> _tail { 0 };
+
+    Message *at ( size_t offset ) { return ( Message * ) ( ( char * ) _data.get() + offset ); }
+};
+
+} // namespace AsyncLog
+
+
 class Logger
 {
 public:
@@ -24,8 +179,11 @@ public:
     // Session ID
     std::string sessionId;
 
+    // Copy messages to the flight recorder
+    bool flightRecord = false;
+
     // Basic constructor
-    Logger() {}
+    Logger();
 
     // Initialize / deinitialize logging
     void initialize ( const std::string& filePath = "", uint32_t options = LOG_DEFAULT_OPTIONS );
@@ -40,6 +198,24 @@ public:
     // Log a message with source file, line, and function
     void log ( const char *srcFile, int srcLine, const char *srcFunc, const char *logMessage );
 
+    // Check if messages are formatted on the background thread
+    bool isAsync() const { return _async.load ( std::memory_order_relaxed ); }
+
+    // Log a message on the background thread, the format must be a string literal
+    template<typename ... V>
+    void logAsync ( const char *srcFile, int srcLine, const char *srcFunc, const char *fmt, const V& ... args )
+    {
+        push<typename CapturedArg<V, AsyncLog::String>::type ...> ( srcFile, srcLine, srcFunc, fmt,
+                CapturedArg<V, AsyncLog::String>::capture ( args ) ... );
+    }
+
+    // Formats that aren't literals are formatted right away
+    template<typename ... V>
+    void logAsync ( const char *srcFile, int srcLine, const char *srcFunc, const std::string& fmt, V ... args )
+    {
+        log ( srcFile, srcLine, srcFunc, format ( fmt, args ... ).c_str() );
+    }
+
     // Get the singleton instance
     static Logger& get();
 
@@ -67,6 +243,92 @@ private:
 #ifdef LOGGER_MUTEXED
     Mutex _mutex;
 #endif
+
+    // Write a message to the file, the time is only used with LOG_GM_TIME or LOG_LOCAL_TIME
+    void write ( const char *srcFile, int srcLine, const char *srcFunc, time_t t, uint64_t now,
+                 const char *logMessage );
+
+    // Flag to indicate if messages are pushed to the background thread
+    std::atomic<bool> _async { false };
+
+    // Unique ID of this logger, to find the buffer of the calling thread
+    const uint32_t _asyncId;
+
+    // Buffers of each thread that logged, these are kept until the logger is destroyed
+    std::vector<std::shared_ptr<AsyncLog::Buffer>> _asyncBuffers;
+
+    // Order of the messages across all the threads
+    std::atomic<uint64_t> _asyncSequence { 0 };
+
+    // Background thread that formats and writes the messages
+    THREAD ( AsyncWorker, Logger );
+
+    AsyncWorker _asyncWorker;
+
+    // Protects the list of buffers and the flags below, and signals flush requests
+    Mutex _asyncMutex;
+    CondVar _asyncFlushed;
+
+    bool _asyncStop = false;
+
+    // Number of flushes requested, and the last one done by the background thread
+    uint32_t _asyncFlushRequest = 0, _asyncFlushDone = 0;
+
+    // Get the buffer of the calling thread, creating it if needed
+    AsyncLog::Buffer *getAsyncBuffer();
+
+    // Copy a message to the buffer of the calling thread
+    template<typename ... C>
+    void push ( const char *srcFile, int srcLine, const char *srcFunc, const char *fmt, C ... args )
+    {
+        typedef AsyncLog::MessageOf<C ...> Message;
+
+        static_assert ( alignof ( Message ) <= alignof ( uint64_t ), "Message alignment is too large" );
+
+        AsyncLog::Buffer *buffer = getAsyncBuffer();
+
+        const size_t size = ( sizeof ( Message ) + AsyncLog::Buffer::Align - 1 ) & ~ ( AsyncLog::Buffer::Align - 1 );
+
+        void *ptr = buffer->reserve ( size );
+
+        if ( ! ptr )
+        {
+            buffer->dropped.fetch_add ( 1, std::memory_order_relaxed );
+            return;
+        }
+
+        Message *message = new ( ptr ) Message ( fmt, std::move ( args ) ... );
+        message->size = size;
+        message->srcFile = srcFile;
+        message->srcLine = srcLine;
+        message->srcFunc = srcFunc;
+        message->sequence = _asyncSequence.fetch_add ( 1, std::memory_order_relaxed );
+        message->run = &Message::formatAndDestroy;
+
+        if ( _options & ( LOG_GM_TIME | LOG_LOCAL_TIME ) )
+        {
+            time ( &message->time );
+            message->now = getAsyncNow();
+        }
+
+        buffer->commit();
+    }
+
+    // Get the current milliseconds for the timestamp
+    static uint64_t getAsyncNow();
+
+    // Write all the pushed messages in order, returns the number of messages written
+    size_t drainAsync();
+
+    // Format and write the messages until stopped, this runs on the background thread
+    void runAsync();
+
+    // Stop the background thread after writing the remaining messages
+    void stopAsync();
+
+    // Disable copy
+    Logger ( const Logger& );
+    const Logger& operator= ( const Logger& );
 };
 
 
@@ -80,13 +342,13 @@ private:
 
 #define LOG_TO(LOGGER, FORMAT, ...)                                                                                    \
     do {                                                                                                               \
-        LOGGER.log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, format ( FORMAT, ## __VA_ARGS__ ).c_str() );        \
+        if ( LOGGER.isAsync() )                                                                                        \
+            LOGGER.logAsync ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, FORMAT, ## __VA_ARGS__ );                  \
+        else                                                                                                           \
+            LOGGER.log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, format ( FORMAT, ## __VA_ARGS__ ).c_str() );    \
     } while ( 0 )
 
-#define LOG(FORMAT, ...)                                                                                               \
-    do {                                                                                                               \
-        Logger::get().log ( __BASE_FILE__, __LINE__, __PRETTY_FUNCTION__, format ( FORMAT, ## __VA_ARGS__ ).c_str() ); \
-    } while ( 0 )
+#define LOG(FORMAT, ...) LOG_TO ( Logger::get(), FORMAT, ## __VA_ARGS__ )
 
 #define LOG_LIST(LIST, TO_STRING)                                                                                      \
     do {                                                                                                               \
@@ -107,12 +369,15 @@ private:
 
 #else
 
+// The asynchronous log is flushed before aborting, otherwise the assertion would never reach the log file
 #define ASSERT(ASSERTION)                                                                                              \
     do {                                                                                                               \
         if ( ASSERTION )                                                                                               \
             break;                                                                                                     \
         LOG ( "Assertion '%s' failed", #ASSERTION );                                                                   \
         PRINT ( "Assertion '%s' failed", #ASSERTION );                                                                 \
+        if ( Logger::get().isAsync() )                                                                                 \
+            Logger::get().flush();                                                                                     \
         abort();                                                                                                       \
     } while ( 0 )
 
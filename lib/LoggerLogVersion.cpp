@@ -12,6 +12,9 @@ void Logger::logVersion() {}
 
 void Logger::logVersion()
 {
+    // Write the pending messages first, since this writes to the file directly
+    flush();
+
     fprintf ( _fd, "LogId '%s'\n", _logId.c_str() );
     fprintf ( _fd, "Version '%s' { '%s', '%s', '%s' }\n", LocalVersion.code.c_str(),
               LocalVersion.major().c_str(), LocalVersion.minor().c_str(), LocalVersion.suffix().c_str() );
@@ -0,0 +1,79 @@
+#include "MappedFile.hpp"
+#include "Exceptions.hpp"
+#include "Logger.hpp"
+
+#include <windows.h>
+
+using namespace std;
+
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open ( const string& file )
+{
+    close();
+
+    _file = CreateFile ( file.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+
+    if ( _file == INVALID_HANDLE_VALUE )
+    {
+        LOG ( "CreateFile failed: %s", WinException::getLastError() );
+        _file = 0;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+
+    if ( ! GetFileSizeEx ( _file, &size ) || size.HighPart )
+    {
+        LOG ( "Invalid file size: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    _size = size.LowPart;
+
+    // Empty files can't be mapped
+    if ( _size == 0 )
+        return true;
+
+    _mapping = CreateFileMapping ( _file, 0, PAGE_READONLY, 0, 0, 0 );
+
+    if ( ! _mapping )
+    {
+        LOG ( "CreateFileMapping failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    _data = ( const char * ) MapViewOfFile ( _mapping, FILE_MAP_READ, 0, 0, 0 );
+
+    if ( ! _data )
+    {
+        LOG ( "MapViewOfFile failed: %s", WinException::getLastError() );
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( _data )
+        UnmapViewOfFile ( _data );
+
+    if ( _mapping )
+        CloseHandle ( _mapping );
+
+    if ( _file )
+        CloseHandle ( _file );
+
+    _file = _mapping = 0;
+    _data = 0;
+    _size = 0;
+}
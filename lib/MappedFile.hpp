@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+
+// Read-only memory mapped file, the contents are only read from disk as they are accessed
+class MappedFile
+{
+public:
+
+    MappedFile() {}
+
+    ~MappedFile();
+
+    // Map the whole file, returns false on error
+    bool open ( const std::string& file );
+
+    void close();
+
+    const char *data() const { return _data; }
+
+    size_t size() const { return _size; }
+
+private:
+
+    // Opaque Windows handles
+    void *_file = 0, *_mapping = 0;
+
+    const char *_data = 0;
+
+    size_t _size = 0;
+
+    // Disable copying
+    MappedFile ( const MappedFile& );
+    const MappedFile& operator= ( const MappedFile& );
+};
@@ -49,6 +49,17 @@ void MemDumpBase::loadDump ( const char *&dump ) const
         ptr.loadDump ( dump );
 }
 
+void MemDumpBase::getPtrOffsets ( size_t& dumpOffset, vector<size_t>& ptrOffsets ) const
+{
+    for ( const MemDumpPtr& ptr : ptrs )
+        ptrOffsets.push_back ( dumpOffset + ptr.srcOffset );
+
+    dumpOffset += size;
+
+    for ( const MemDumpPtr& ptr : ptrs )
+        ptr.getPtrOffsets ( dumpOffset, ptrOffsets );
+}
+
 vector<MemDumpPtr> MemDumpBase::setParents ( const vector<MemDumpPtr>& ptrs, const MemDumpBase *parent )
 {
     vector<MemDumpPtr> ret;
@@ -123,29 +134,69 @@ void MemDumpList::update()
         totalSize += mem.getTotalSize();
 }
 
+vector<size_t> MemDumpList::getPtrOffsets() const
+{
+    vector<size_t> ptrOffsets;
+    size_t dumpOffset = 0;
+
+    for ( const MemDump& mem : addrs )
+        mem.getPtrOffsets ( dumpOffset, ptrOffsets );
+
+    ASSERT ( dumpOffset == totalSize );
+
+    sort ( ptrOffsets.begin(), ptrOffsets.end() );
+    return ptrOffsets;
+}
+
+static void getRanges ( const MemDumpBase& mem, size_t& dumpOffset, uint32_t addr, uint32_t depth,
+                        vector<MemDumpRange>& ranges )
+{
+    ranges.push_back ( { dumpOffset, mem.size, addr, depth } );
+
+    dumpOffset += mem.size;
+
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+        getRanges ( ptr, dumpOffset, ( depth == 0 ? addr + ptr.srcOffset : addr ), depth + 1, ranges );
+}
+
+vector<MemDumpRange> MemDumpList::getRanges() const
+{
+    vector<MemDumpRange> ranges;
+    size_t dumpOffset = 0;
+
+    for ( const MemDump& mem : addrs )
+        ::getRanges ( mem, dumpOffset, ( uint32_t ) ( uintptr_t ) mem.addr, 0, ranges );
+
+    ASSERT ( dumpOffset == totalSize );
+
+    return ranges;
+}
+
+// Sizes and addresses are serialized as 32-bit values, so the same data can be loaded by 64-bit tools
+
 void MemDumpBase::save ( BinaryOutputArchive& ar ) const
 {
-    ar ( size, ptrs.size() );
+    ar ( ( uint32_t ) size, ( uint32_t ) ptrs.size() );
     for ( const MemDumpPtr& ptr : ptrs )
         ptr.save ( ar );
 }
 
 void MemDumpPtr::save ( BinaryOutputArchive& ar ) const
 {
-    ar ( srcOffset, dstOffset );
+    ar ( ( uint32_t ) srcOffset, ( uint32_t ) dstOffset );
     MemDumpBase::save ( ar );
 }
 
 void MemDump::save ( BinaryOutputArchive& ar ) const
 {
-    uint32_t val = ( uint32_t ) addr;
+    uint32_t val = ( uint32_t ) ( uintptr_t ) addr;
     ar ( val );
     MemDumpBase::save ( ar );
 }
 
 void MemDumpList::save ( BinaryOutputArchive& ar ) const
 {
-    ar ( totalSize, addrs.size() );
+    ar ( ( uint32_t ) totalSize, ( uint32_t ) addrs.size() );
     for ( const MemDump& mem : addrs )
         mem.save ( ar );
 }
@@ -157,7 +208,7 @@ static vector<MemDumpPtr> loadPtrs ( size_t count, BinaryInputArchive& ar )
 
     for ( size_t i = 0; i < count; ++i )
     {
-        size_t srcOffset, dstOffset, size, ptrsCount;
+        uint32_t srcOffset, dstOffset, size, ptrsCount;
         ar ( srcOffset, dstOffset, size, ptrsCount );
 
         if ( ptrsCount )
@@ -171,19 +222,20 @@ static vector<MemDumpPtr> loadPtrs ( size_t count, BinaryInputArchive& ar )
 
 void MemDumpList::load ( BinaryInputArchive& ar )
 {
-    size_t count;
-    ar ( totalSize, count );
+    uint32_t size, count;
+    ar ( size, count );
+
+    totalSize = size;
 
     for ( size_t i = 0; i < count; ++i )
     {
-        uint32_t addr;
-        size_t size, ptrsCount;
+        uint32_t addr, size, ptrsCount;
         ar ( addr, size, ptrsCount );
 
         if ( ptrsCount )
-            append ( { ( char * ) addr, size, loadPtrs ( ptrsCount, ar ) } );
+            append ( { ( char * ) ( uintptr_t ) addr, size, loadPtrs ( ptrsCount, ar ) } );
         else
-            append ( { ( char * ) addr, size } );
+            append ( { ( char * ) ( uintptr_t ) addr, size } );
     }
 }
 
@@ -287,3 +339,79 @@ bool MemDumpList::load ( const char *data, size_t size )
 
     return true;
 }
+
+MemDumpPlan::MemDumpPlan ( const MemDumpList& list )
+{
+    for ( const MemDump& mem : list.addrs )
+        append ( mem, NO_PARENT, 0, 0, mem.addr );
+
+    _addrs.resize ( _steps.size() );
+
+    for ( const Step& step : _steps )
+        totalSize += step.size;
+
+    ASSERT ( totalSize == list.totalSize );
+}
+
+void MemDumpPlan::append ( const MemDumpBase& mem, uint32_t parent, uint32_t srcOffset, uint32_t dstOffset, char *addr )
+{
+    const uint32_t index = _steps.size();
+
+    _steps.push_back ( { parent, srcOffset, dstOffset, ( uint32_t ) mem.size, addr } );
+
+    for ( const MemDumpPtr& ptr : mem.ptrs )
+        append ( ptr, index, ptr.srcOffset, ptr.dstOffset, 0 );
+}
+
+inline char *MemDumpPlan::resolve ( size_t i ) const
+{
+    const Step& step = _steps[i];
+
+    if ( step.parent == NO_PARENT )
+        return step.addr;
+
+    const char *parentAddr = _addrs[step.parent];
+
+    if ( parentAddr == 0 )
+        return 0;
+
+    char *dstAddr = ( char * ) ( uintptr_t ) * ( const uint32_t * ) ( parentAddr + step.srcOffset );
+
+    if ( dstAddr == 0 )
+        return 0;
+
+    return dstAddr + step.dstOffset;
+}
+
+void MemDumpPlan::saveDump ( char *dump ) const
+{
+    ASSERT ( dump != 0 );
+
+    for ( size_t i = 0; i < _steps.size(); ++i )
+    {
+        char *addr = _addrs[i] = resolve ( i );
+
+        if ( addr )
+            memcpy ( dump, addr, _steps[i].size );
+        else
+            memset ( dump, 0, _steps[i].size );
+
+        dump += _steps[i].size;
+    }
+}
+
+void MemDumpPlan::loadDump ( const char *dump ) const
+{
+    ASSERT ( dump != 0 );
+
+    // Child addresses are resolved after the parent is loaded, since the pointer values are part of the dump
+    for ( size_t i = 0; i < _steps.size(); ++i )
+    {
+        char *addr = _addrs[i] = resolve ( i );
+
+        if ( addr )
+            memcpy ( addr, dump, _steps[i].size );
+
+        dump += _steps[i].size;
+    }
+}
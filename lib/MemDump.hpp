@@ -37,6 +37,9 @@ public:
     // Get the total size of this memory dump
     size_t getTotalSize() const;
 
+    // Append the offsets of child pointer values in the flat dump, advancing the given dump offset
+    void getPtrOffsets ( size_t& dumpOffset, std::vector<size_t>& ptrOffsets ) const;
+
     // Serialization
     virtual void save ( cereal::BinaryOutputArchive& ar ) const;
 
@@ -83,7 +86,8 @@ public:
 
         ASSERT ( srcOffset + 4 <= parent->size );
 
-        char *dstAddr = * ( char ** ) ( parent->getAddr() + srcOffset );
+        // Pointer values are always 32-bit, since the game is a 32-bit process
+        char *dstAddr = ( char * ) ( uintptr_t ) * ( uint32_t * ) ( parent->getAddr() + srcOffset );
 
         if ( dstAddr == 0 )
             return 0;
@@ -137,11 +141,11 @@ public:
 
     // Construct a memory dump with a memory range
     MemDump ( uint32_t start, uint32_t end )
-        : MemDumpBase ( end - start ), addr ( ( char * ) start ) {}
+        : MemDumpBase ( end - start ), addr ( ( char * ) ( uintptr_t ) start ) {}
 
     // Construct a memory dump with a memory range, with child pointers
     MemDump ( uint32_t start, uint32_t end, const std::vector<MemDumpPtr>& ptrs )
-        : MemDumpBase ( end - start, ptrs ), addr ( ( char * ) start ) {}
+        : MemDumpBase ( end - start, ptrs ), addr ( ( char * ) ( uintptr_t ) start ) {}
 
     // Copy constructor
     MemDump ( const MemDump& a )
@@ -162,6 +166,20 @@ public:
 };
 
 
+// Describes where a range of bytes in the flat dump is copied from
+struct MemDumpRange
+{
+    // Offset and size of the range in the flat dump
+    size_t dumpOffset, size;
+
+    // The starting address for static memory, otherwise the address of the root pointer value
+    uint32_t addr;
+
+    // Number of pointers followed to reach this memory, 0 for static memory
+    uint32_t depth;
+};
+
+
 class MemDumpList
 {
 public:
@@ -214,6 +232,13 @@ public:
     // Update the list of memory dumps: merge continuous address ranges, then compute total size
     void update();
 
+    // Get the offsets of child pointer values in the flat dump, in ascending order.
+    // Pointer values may differ between machines, so these should be skipped when comparing dumps.
+    std::vector<size_t> getPtrOffsets() const;
+
+    // Get the ranges of the flat dump in order, including the memory reached through pointers
+    std::vector<MemDumpRange> getRanges() const;
+
     // Serialization
     void save ( cereal::BinaryOutputArchive& ar ) const;
     void load ( cereal::BinaryInputArchive& ar );
@@ -221,3 +246,54 @@ public:
     bool load ( const std::string& filename );
     bool load ( const char *data, size_t size );
 };
+
+
+// Flattened list of memory dumps, which saves / loads the same flat dump as MemDumpList without recursion
+class MemDumpPlan
+{
+public:
+
+    // Total size of the flat dump
+    size_t totalSize = 0;
+
+    // Construct an empty plan
+    MemDumpPlan() {}
+
+    // Construct a plan from an updated list of memory dumps
+    MemDumpPlan ( const MemDumpList& list );
+
+    // Save / load the memory to / from the given flat dump
+    void saveDump ( char *dump ) const;
+    void loadDump ( const char *dump ) const;
+
+private:
+
+    struct Step
+    {
+        // Index of the parent step, or NO_PARENT for static memory
+        uint32_t parent;
+
+        // Offset of the pointer value in the parent, and the offset to add to the pointer value
+        uint32_t srcOffset, dstOffset;
+
+        // Size of the memory
+        uint32_t size;
+
+        // Starting address for static memory
+        char *addr;
+    };
+
+    static const uint32_t NO_PARENT = 0xFFFFFFFF;
+
+    // Steps in the same order as the flat dump, each parent is before its children
+    std::vector<Step> _steps;
+
+    // Addresses of each step, resolved during save / load
+    mutable std::vector<char *> _addrs;
+
+    // Append the steps for a memory dump and its child pointers
+    void append ( const MemDumpBase& mem, uint32_t parent, uint32_t srcOffset, uint32_t dstOffset, char *addr );
+
+    // Resolve the address of a step, parents must be resolved first
+    char *resolve ( size_t i ) const;
+};
@@ -0,0 +1,76 @@
+#include "MerkleTree.hpp"
+#include "Compression.hpp"
+#include "Logger.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+const size_t MerkleTree::Fanout;
+
+MerkleTree::MerkleTree ( const vector<uint64_t>& leaves )
+{
+    if ( leaves.empty() )
+        return;
+
+    _levels.push_back ( leaves );
+
+    while ( _levels.back().size() > 1 )
+    {
+        const vector<uint64_t>& children = _levels.back();
+        vector<uint64_t> parents ( ( children.size() + Fanout - 1 ) / Fanout );
+
+        // Seed each level differently, so a parent can never be confused with a leaf
+        for ( size_t i = 0; i < parents.size(); ++i )
+        {
+            const size_t count = min ( Fanout, children.size() - i * Fanout );
+            parents[i] = getHash64 ( ( const char * ) &children[i * Fanout], count * sizeof ( uint64_t ),
+                                     _levels.size() );
+        }
+
+        _levels.push_back ( parents );
+    }
+}
+
+uint32_t MerkleTree::getRootNode() const
+{
+    ASSERT ( _levels.empty() == false );
+
+    return getNode ( _levels.size() - 1, 0 );
+}
+
+uint64_t MerkleTree::getRootHash() const
+{
+    ASSERT ( _levels.empty() == false );
+
+    return _levels.back()[0];
+}
+
+bool MerkleTree::hasNode ( uint32_t node ) const
+{
+    return ( getLevel ( node ) < _levels.size() && getIndex ( node ) < _levels[getLevel ( node )].size() );
+}
+
+uint64_t MerkleTree::getHash ( uint32_t node ) const
+{
+    ASSERT ( hasNode ( node ) == true );
+
+    return _levels[getLevel ( node )][getIndex ( node )];
+}
+
+vector<uint32_t> MerkleTree::getChildren ( uint32_t node ) const
+{
+    vector<uint32_t> children;
+
+    if ( ! hasNode ( node ) || getLevel ( node ) == 0 )
+        return children;
+
+    const uint32_t level = getLevel ( node ) - 1;
+    const size_t end = min ( ( getIndex ( node ) + 1 ) * Fanout, _levels[level].size() );
+
+    for ( size_t i = getIndex ( node ) * Fanout; i < end; ++i )
+        children.push_back ( getNode ( level, i ) );
+
+    return children;
+}
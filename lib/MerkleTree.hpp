@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+
+// Tree of 64-bit hashes, where each node is the hash of its children's hashes.
+// Comparing two trees from the root down only visits the subtrees that differ.
+class MerkleTree
+{
+public:
+
+    // Number of children per node
+    static const size_t Fanout = 16;
+
+    // Nodes are identified by their level (0 for leaves) and index within that level
+    static uint32_t getNode ( uint32_t level, uint32_t index ) { return ( level << 24 ) | index; }
+    static uint32_t getLevel ( uint32_t node ) { return ( node >> 24 ); }
+    static uint32_t getIndex ( uint32_t node ) { return ( node & 0xFFFFFF ); }
+
+    // Construct an empty tree
+    MerkleTree() {}
+
+    // Construct a tree from the given leaf hashes
+    MerkleTree ( const std::vector<uint64_t>& leaves );
+
+    // True if the tree has no leaves
+    bool empty() const { return _levels.empty(); }
+
+    // Get the number of leaves
+    size_t getNumLeaves() const { return ( _levels.empty() ? 0 : _levels[0].size() ); }
+
+    // Get the root node and hash
+    uint32_t getRootNode() const;
+    uint64_t getRootHash() const;
+
+    // True if the node exists in this tree
+    bool hasNode ( uint32_t node ) const;
+
+    // Get the hash of a node, the node must exist
+    uint64_t getHash ( uint32_t node ) const;
+
+    // Get the children of a node, empty for leaves
+    std::vector<uint32_t> getChildren ( uint32_t node ) const;
+
+private:
+
+    // Hashes of each level, starting from the leaves, with the root as the only hash of the last level
+    std::vector<std::vector<uint64_t>> _levels;
+};
@@ -4,6 +4,7 @@
 
 #include <cereal/archives/binary.hpp>
 
+#include <array>
 #include <string>
 #include <memory>
 #include <iostream>
@@ -32,3 +32,7 @@ VersionConfig,
 JoysticksChanged,
 TransitionIndex,
 PaletteManager,
+StateHash,
+StateHashNodes,
+RelayStatus,
+BothInputsBlock,
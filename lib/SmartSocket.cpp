@@ -607,3 +607,17 @@ bool SmartSocket::send ( const MsgPtr& message, const IpAddrPort& address )
 {
     BOILERPLATE_SEND ( message, address );
 }
+
+bool SmartSocket::sendEncoded ( const MsgPtr& message, const string& buffer )
+{
+    if ( ! isConnected() )
+        return false;
+
+    if ( _directSocket && _directSocket->isConnected() )
+        return _directSocket->sendEncoded ( message, buffer );
+
+    if ( _tunSocket && _tunSocket->isConnected() )
+        return _tunSocket->sendEncoded ( message, buffer );
+
+    return false;
+}
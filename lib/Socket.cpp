@@ -5,6 +5,7 @@
 #include "SmartSocket.hpp"
 #include "Exceptions.hpp"
 #include "ErrorStrings.hpp"
+#include "FlightRecorder.hpp"
 
 #include <winsock2.h>
 #include <windows.h>
@@ -35,6 +36,25 @@ using namespace std;
 static bool enableForceReusePort = true;
 
 
+// Record a socket event in the flight recorder
+static void recordNetwork ( const Socket *socket, FlightNetwork event, uint32_t value, const IpAddrPort& address )
+{
+    if ( ! FlightRecorder::get().isEnabled() )
+        return;
+
+    FlightNetworkEvent record;
+    memset ( &record, 0, sizeof ( record ) );
+    record.socket = ( uint32_t ) ( uintptr_t ) socket;
+    record.value = value;
+    record.port = address.port;
+    record.event = event;
+    record.protocol = socket->protocol.value;
+    strncpy ( record.address, address.addr.c_str(), sizeof ( record.address ) - 1 );
+
+    FlightRecorder::get().network ( record );
+}
+
+
 Socket::Socket ( Owner *owner, const IpAddrPort& address, Protocol protocol, bool isRaw )
     : owner ( owner ), address ( address ), protocol ( protocol ), _isRaw ( isRaw )
 {
@@ -50,6 +70,8 @@ void Socket::disconnect()
 {
     LOG_SOCKET ( this, "disconnected" );
 
+    recordNetwork ( this, FlightNetwork::Disconnected, 0, address );
+
     if ( _fd )
         closesocket ( _fd );
 
@@ -269,6 +291,7 @@ bool Socket::send ( const char *buffer, size_t len )
         totalBytes += sentBytes;
     }
 
+    recordNetwork ( this, FlightNetwork::Send, len, address );
     return true;
 }
 
@@ -304,6 +327,7 @@ bool Socket::send ( const char *buffer, size_t len, const IpAddrPort& address )
         totalBytes += sentBytes;
     }
 
+    recordNetwork ( this, FlightNetwork::Send, len, address );
     return true;
 }
 
@@ -390,6 +414,9 @@ void Socket::socketRead()
         LOG_SOCKET ( this, "[%d] %s; %s failed",
                      error, WinException::getAsString ( error ), ( isTCP() ? "recv" : "recvfrom" ) );
 
+        if ( error != WSAEWOULDBLOCK )
+            recordNetwork ( this, FlightNetwork::Error, error, address );
+
         // Skip blocking reads
         if ( error == WSAEWOULDBLOCK )
             return;
@@ -418,6 +445,8 @@ void Socket::socketRead()
     }
 #endif
 
+    recordNetwork ( this, FlightNetwork::Read, bufferLen, address );
+
     // Raw read mode
     if ( _isRaw )
     {
@@ -463,6 +492,7 @@ void Socket::socketRead()
             return;
 
         LOG ( "Decoded '%s' using [ %u bytes ]; %u bytes remaining in buffer", msg, consumedBytes, _readPos );
+        recordNetwork ( this, FlightNetwork::Decoded, ( uint32_t ) msg->getMsgType(), address );
         socketRead ( msg, address );
 
         // Abort if the socket is de-allocated
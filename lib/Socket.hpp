@@ -110,6 +110,10 @@ public:
         return send ( MsgPtr ( const_cast<Serializable *> ( &message ), ignoreMsgPtr ), address );
     }
 
+    // Send a protocol message already encoded with Protocol::encode, so the same bytes can be sent over many sockets.
+    // Sockets that can't send the bytes as is, ie UDP sockets using GoBackN, send the message instead.
+    virtual bool sendEncoded ( const MsgPtr& message, const std::string& buffer ) { return send ( message ); }
+
     // Set the packet loss for testing purposes
     void setPacketLoss ( uint8_t percentage );
 
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+#include <cstddef>
+
+
+// Fixed capacity lock-free queue for exactly one producer thread and one consumer thread.
+// Neither side ever blocks or takes a lock, so it is safe to use from the game's frame thread.
+template<typename T, size_t N> class SpscQueue
+{
+public:
+
+    // Push an element, returns false if the queue is full. Only call this from the producer thread.
+    bool push ( T t )
+    {
+        const size_t head = _head.load ( std::memory_order_relaxed );
+
+        if ( head - _tail.load ( std::memory_order_acquire ) == N )
+            return false;
+
+        _elements[head % N] = std::move ( t );
+        _head.store ( head + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Pop an element, returns false if the queue is empty. Only call this from the consumer thread.
+    bool pop ( T& t )
+    {
+        const size_t tail = _tail.load ( std::memory_order_relaxed );
+
+        if ( _head.load ( std::memory_order_acquire ) == tail )
+            return false;
+
+        t = std::move ( _elements[tail % N] );
+        _tail.store ( tail + 1, std::memory_order_release );
+        return true;
+    }
+
+    // Only exact when called from the producer or consumer thread while the other side is idle
+    size_t size() const
+    {
+        return _head.load ( std::memory_order_acquire ) - _tail.load ( std::memory_order_acquire );
+    }
+
+    bool empty() const
+    {
+        return ( size() == 0 );
+    }
+
+private:
+
+    T _elements[N];
+
+    // The producer and consumer positions are kept on separate cache lines, so they don't contend
+    char _pad0[64];
+
+    std::atomic<size_t> _head { 0 };
+
+    char _pad1[64];
+
+    std::atomic<size_t> _tail { 0 };
+};
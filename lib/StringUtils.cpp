@@ -3,39 +3,165 @@
 using namespace std;
 
 
-void splitFormat ( const string& fmt, string& first, string& rest )
+// Characters that can be part of a printf conversion, same as before the format engine
+static bool isSpecChar ( char c )
 {
-    size_t i;
+    return ( isalnum ( c ) || c == '.' || c == '-' || c == '+' || c == '#' );
+}
+
+// Length modifiers, which come before the conversion letter
+static bool isLengthChar ( char c )
+{
+    return ( c == 'h' || c == 'l' || c == 'L' || c == 'q' || c == 'j' || c == 'z' || c == 't' || c == 'I' );
+}
+
+void FormatBuffer::appendLiteral ( const char *begin, const char *end )
+{
+    for ( const char *p; ( p = ( const char * ) memchr ( begin, '%', end - begin ) ); begin = p + 1 )
+    {
+        append ( begin, p + 1 - begin );
+
+        // Skip the second % of %%
+        if ( p + 1 < end && p[1] == '%' )
+            ++p;
+    }
+
+    append ( begin, end - begin );
+}
+
+const char *FormatBuffer::appendUntilSpec ( const char *begin, const char *end, char *spec )
+{
+    const char *p = begin;
 
-    for ( i = 0; i < fmt.size(); ++i )
+    for ( ; ( p = ( const char * ) memchr ( p, '%', end - p ) ); p += 2 )
     {
-        if ( i + 1 < fmt.size() && fmt[i] == '%' && fmt[i + 1] == '%' )
-            ++i;
-        else if ( fmt[i] == '%' && ( i + 1 == fmt.size() || fmt[i + 1] != '%' ) )
+        if ( p + 1 == end || p[1] != '%' )
             break;
     }
 
-    if ( i == fmt.size() - 1 )
+    // No conversions left, or a lone % at the end
+    if ( ! p || p + 1 == end )
     {
-        first = "";
-        rest = fmt;
-        return;
+        appendLiteral ( begin, end );
+        return 0;
     }
 
-    for ( ++i; i < fmt.size(); ++i )
+    appendLiteral ( begin, p );
+
+    // Copy the conversion up to and including the conversion letter
+    size_t len = 0;
+    spec[len++] = *p++;
+
+    while ( p < end && len + 1 < FORMAT_SPEC_SIZE && isSpecChar ( *p ) )
     {
-        if ( ! ( isalnum ( fmt[i] )
-                 || fmt[i] == '.'
-                 || fmt[i] == '-'
-                 || fmt[i] == '+'
-                 || fmt[i] == '#' ) )
+        const char c = ( spec[len++] = *p++ );
+
+        if ( isalpha ( c ) && ! isLengthChar ( c ) )
+            break;
+    }
+
+    spec[len] = 0;
+    return p;
+}
+
+bool FormatBuffer::printInt ( const char *spec, unsigned int val )
+{
+    static const char lowerHex[] = "0123456789abcdef";
+    static const char upperHex[] = "0123456789ABCDEF";
+
+    size_t width = 0;
+    char conversion = spec[1];
+
+    // %0Nx with a single digit width
+    if ( spec[1] == '0' && spec[2] >= '1' && spec[2] <= '9' && spec[3] && ! spec[4] )
+    {
+        width = spec[2] - '0';
+        conversion = spec[3];
+
+        if ( conversion != 'x' && conversion != 'X' )
+            return false;
+    }
+    else if ( ! conversion || spec[2] )
+    {
+        return false;
+    }
+
+    char digits[16];
+    char *const end = digits + sizeof ( digits );
+    char *p = end;
+
+    switch ( conversion )
+    {
+        case 'd':
+        case 'i':
         {
+            const bool negative = ( int ( val ) < 0 );
+            unsigned int abs = ( negative ? 0u - val : val );
+
+            do { *--p = '0' + abs % 10; } while ( abs /= 10 );
+
+            if ( negative )
+                *--p = '-';
             break;
         }
+
+        case 'u':
+            do { *--p = '0' + val % 10; } while ( val /= 10 );
+            break;
+
+        case 'x':
+        case 'X':
+        {
+            const char *hex = ( conversion == 'x' ? lowerHex : upperHex );
+
+            do { *--p = hex[val & 0xF]; } while ( val >>= 4 );
+
+            while ( size_t ( end - p ) < width )
+                *--p = '0';
+            break;
+        }
+
+        default:
+            return false;
+    }
+
+    append ( p, end - p );
+    return true;
+}
+
+void FormatBuffer::printString ( const char *spec, const char *str, size_t len )
+{
+    if ( spec[0] == '%' && spec[1] == 's' && spec[2] == 0 )
+        append ( str, len );
+    else
+        print ( spec, str );
+}
+
+void FormatBuffer::grow ( size_t capacity )
+{
+    if ( _fixed )
+        return;
+
+    capacity = max ( capacity, 2 * _capacity );
+
+    char *data = new char[capacity];
+    memcpy ( data, _data, _size );
+
+    _heap.reset ( data );
+    _data = data;
+    _capacity = capacity;
+}
+
+void formatValue ( FormatBuffer& out, const char *spec, const string& val, int2type<FormatString> )
+{
+    if ( val.find ( "%%" ) == string::npos )
+    {
+        out.printString ( spec, val.c_str(), val.size() );
+        return;
     }
 
-    first = fmt.substr ( 0, i );
-    rest = ( i < fmt.size() ? fmt.substr ( i ) : "" );
+    const string str = format ( val );
+    out.printString ( spec, str.c_str(), str.size() );
 }
 
 string formatAsHex ( const string& bytes )
@@ -8,13 +8,21 @@
 #include <cctype>
 #include <type_traits>
 #include <algorithm>
+#include <memory>
+#include <cstring>
 
 
 #define PRINT(...) do { std::cout << format ( __VA_ARGS__ ) << std::endl; } while ( 0 )
 
 
-// Convert a boolean value to a type
+// Convert a boolean / integer value to a type
 template<bool> struct bool2type {};
+template<int> struct int2type {};
+
+// Compile time list of indices, for expanding a tuple into arguments
+template<size_t ... I> struct Indices {};
+template<size_t N, size_t ... I> struct MakeIndices : MakeIndices < N - 1, N - 1, I ... > {};
+template<size_t ... I> struct MakeIndices<0, I ...> { typedef Indices<I ...> type; };
 
 // Format bytes as a hex string
 std::string formatAsHex ( const std::string& bytes );
@@ -52,43 +60,202 @@ inline std::string format<std::string> ( const std::string& val )
     return val.substr ( 0, i ) + "%" + format ( val.substr ( i + 2 ) );
 }
 
-// For non-integer types
+// Max length of a single printf conversion, eg "%-12.3llu"
+#define FORMAT_SPEC_SIZE ( 32 )
+
+
+struct EnumBase;
+
+// Output buffer of format, which stays on the stack unless the result is long
+class FormatBuffer
+{
+public:
+
+    FormatBuffer() {}
+
+    // Format into the given buffer, which is truncated instead of growing, so formatting never allocates
+    FormatBuffer ( char *data, size_t capacity ) : _data ( data ), _capacity ( capacity ), _fixed ( true ) {}
+
+    void append ( const char *str, size_t len )
+    {
+        reserve ( _size + len );
+
+        len = std::min ( len, _capacity - _size );
+
+        memcpy ( _data + _size, str, len );
+        _size += len;
+    }
+
+    // Append literal text from a format string, which unescapes %%
+    void appendLiteral ( const char *begin, const char *end );
+
+    // Append literal text up to the next conversion, and copy that conversion into spec.
+    // Returns the position after the conversion, or 0 if there are none left.
+    const char *appendUntilSpec ( const char *begin, const char *end, char *spec );
+
+    // Print a single arithmetic or pointer value with a printf conversion
+    template<typename T>
+    void print ( const char *spec, T val )
+    {
+        for ( ;; )
+        {
+            const size_t space = _capacity - _size;
+            const int len = std::snprintf ( _data + _size, space, spec, val );
+
+            if ( len < 0 )
+                return;
+
+            if ( size_t ( len ) < space )
+            {
+                _size += len;
+                return;
+            }
+
+            // Keep what fits before the terminating null, and don't append anything after the truncated value
+            if ( _fixed )
+            {
+                _size += ( space ? space - 1 : 0 );
+                _capacity = _size;
+                return;
+            }
+
+            reserve ( _size + len + 1 );
+        }
+    }
+
+    // Print an int or smaller type without snprintf, for the common %d, %u, %x, and %0Nx conversions.
+    // Returns false for other conversions.
+    bool printInt ( const char *spec, unsigned int val );
+
+    // Print a string with a printf conversion, which is appended directly for a plain %s
+    void printString ( const char *spec, const char *str, size_t len );
+
+    std::string str() const { return std::string ( _data, _size ); }
+
+    size_t size() const { return _size; }
+
+private:
+
+    char _stack[256];
+
+    char *_data = _stack;
+
+    size_t _size = 0, _capacity = sizeof ( _stack );
+
+    bool _fixed = false;
+
+    std::unique_ptr<char[]> _heap;
+
+    void reserve ( size_t capacity )
+    {
+        if ( capacity > _capacity )
+            grow ( capacity );
+    }
+
+    void grow ( size_t capacity );
+
+    FormatBuffer ( const FormatBuffer& );
+    const FormatBuffer& operator= ( const FormatBuffer& );
+};
+
+// How each type of value is formatted
+enum FormatKind { FormatInt, FormatPrintf, FormatString, FormatChars, FormatEnum, FormatStream };
+
+template<typename T>
+struct FormatKindOf
+{
+    static const FormatKind value =
+        ( std::is_integral<T>::value && sizeof ( T ) <= sizeof ( int ) ) ? FormatInt :
+        ( std::is_arithmetic<T>::value || std::is_pointer<T>::value ) ? FormatPrintf :
+        std::is_same<T, std::string>::value ? FormatString :
+        ( std::is_array<T>::value && std::is_same<typename std::remove_cv<typename std::remove_extent<T>::type>::type,
+          char>::value ) ? FormatChars :
+        std::is_base_of<EnumBase, T>::value ? FormatEnum : FormatStream;
+};
+
+// Integers are promoted to int like snprintf arguments
+template<typename T>
+inline void formatValue ( FormatBuffer& out, const char *spec, const T& val, int2type<FormatInt> )
+{
+    if ( ! out.printInt ( spec, ( unsigned int ) val ) )
+        out.print ( spec, val );
+}
+
+// Other arithmetic and pointer types are passed directly to snprintf
 template<typename T>
-inline void printToString ( char *buffer, size_t len, const char *fmt, const T& val, bool2type<false> )
+inline void formatValue ( FormatBuffer& out, const char *spec, const T& val, int2type<FormatPrintf> )
 {
-    std::snprintf ( buffer, len, fmt, format ( val ).c_str() );
+    out.print ( spec, val );
 }
 
-// For integer types
+// Strings are unescaped like format ( const std::string& )
+void formatValue ( FormatBuffer& out, const char *spec, const std::string& val, int2type<FormatString> );
+
 template<typename T>
-inline void printToString ( char *buffer, size_t len, const char *fmt, const T& val, bool2type<true> )
+inline void formatValue ( FormatBuffer& out, const char *spec, const T& val, int2type<FormatChars> )
 {
-    std::snprintf ( buffer, len, fmt, val );
+    out.printString ( spec, val, strlen ( val ) );
 }
 
-// Split a format string into first parameter and rest of string
-void splitFormat ( const std::string& fmt, std::string& first, std::string& rest );
+// Same as the EnumBase stream operator, without the stream
+template<typename T>
+inline void formatValue ( FormatBuffer& out, const char *spec, const T& val, int2type<FormatEnum> )
+{
+    if ( const char *name = val.name() )
+    {
+        out.printString ( spec, name, strlen ( name ) );
+        return;
+    }
+
+    const std::string str = val.str();
+    out.printString ( spec, str.c_str(), str.size() );
+}
+
+template<typename T>
+inline void formatValue ( FormatBuffer& out, const char *spec, const T& val, int2type<FormatStream> )
+{
+    const std::string str = format ( val );
+    out.printString ( spec, str.c_str(), str.size() );
+}
+
+// Remaining text after the last argument
+inline void formatTo ( FormatBuffer& out, const char *begin, const char *end )
+{
+    out.appendLiteral ( begin, end );
+}
 
-// Format a string with arguments
 template<typename T, typename ... V>
-inline std::string format ( const std::string& fmt, const T& val, V ... vals )
+inline void formatTo ( FormatBuffer& out, const char *begin, const char *end, const T& val, const V& ... vals )
 {
-    std::string first, rest;
-    splitFormat ( fmt, first, rest );
+    char spec[FORMAT_SPEC_SIZE];
 
-    if ( first.empty() )
-        return rest;
+    const char *next = out.appendUntilSpec ( begin, end, spec );
 
-    char buffer[4096];
-    printToString ( buffer, sizeof ( buffer ), first.c_str(), val,
-                    bool2type < std::is_arithmetic<T>::value || std::is_pointer<T>::value > () );
+    // Extra arguments are ignored
+    if ( ! next )
+        return;
 
-    if ( rest.empty() )
-        return buffer;
+    formatValue ( out, spec, val, int2type<FormatKindOf<T>::value>() );
 
-    return buffer + format ( rest, vals... );
+    formatTo ( out, next, end, vals ... );
 }
 
+// Format a string with arguments, parsing the format once into a single buffer
+template<typename T, typename ... V>
+inline std::string format ( const char *fmt, const T& val, const V& ... vals )
+{
+    FormatBuffer out;
+    formatTo ( out, fmt, fmt + strlen ( fmt ), val, vals ... );
+    return out.str();
+}
+
+template<typename T, typename ... V>
+inline std::string format ( const std::string& fmt, const T& val, const V& ... vals )
+{
+    FormatBuffer out;
+    formatTo ( out, fmt.c_str(), fmt.c_str() + fmt.size(), val, vals ... );
+    return out.str();
+}
 
 // Parse a hex string
 template <typename T>
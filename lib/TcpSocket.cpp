@@ -138,6 +138,13 @@ bool TcpSocket::send ( const MsgPtr& msg, const IpAddrPort& address )
     return Socket::send ( &buffer[0], buffer.size() );
 }
 
+bool TcpSocket::sendEncoded ( const MsgPtr& msg, const string& buffer )
+{
+    LOG ( "Sending '%s' already encoded to [ %u bytes ]", msg, buffer.size() );
+
+    return Socket::send ( &buffer[0], buffer.size() );
+}
+
 SocketPtr TcpSocket::shared ( Socket::Owner *owner, const SocketShareData& data )
 {
     if ( data.protocol != Protocol::TCP )
@@ -34,6 +34,9 @@ public:
     bool send ( SerializableSequence *message, const IpAddrPort& address = NullAddress ) override;
     bool send ( const MsgPtr& message, const IpAddrPort& address = NullAddress ) override;
 
+    // Send a protocol message already encoded with Protocol::encode
+    bool sendEncoded ( const MsgPtr& message, const std::string& buffer ) override;
+
 protected:
 
     // Socket event callbacks
@@ -4,6 +4,7 @@
 #include <iostream>
 
 #include "Controller.hpp"
+#include "IndexedFrame.hpp"
 
 
 // Number of frames of inputs to send per message
@@ -19,6 +20,28 @@
 #define NUM_ROLLBACK_STATES         ( 256 )
 #endif
 
+// Number of most recent rollback states that a rollback can load, the background worker never touches these
+#define NUM_WINDOW_STATES           ( MAX_ROLLBACK + 1 )
+
+// Number of most recent rollback states kept uncompressed, older states are compressed
+#ifdef DISABLE_STATE_COMPRESSION
+#define NUM_UNCOMPRESSED_STATES     NUM_ROLLBACK_STATES
+#else
+#define NUM_UNCOMPRESSED_STATES     NUM_WINDOW_STATES
+#endif
+
+// Max number of rollback states queued for compression / hashing on the background worker
+#define NUM_STATE_WORKER_JOBS       ( 8 )
+
+// Interval in frames between hashes of confirmed rollback states, which are compared for desync detection
+#define STATE_HASH_INTERVAL         ( 60 )
+
+// Size in bytes of the leaves of the rollback state hash tree, this is the granularity of reported desyncs
+#define STATE_HASH_LEAF_SIZE        ( 512 )
+
+// Number of frames to wait for the remote hash tree nodes when locating a state desync
+#define STATE_DESYNC_TIMEOUT        ( 120 )
+
 
 // Game constants and addresses are prefixed CC
 #define CC_VERSION                  "1.4.0"
@@ -190,6 +213,43 @@
 #define CC_CAMERA_X_ADDR            ( ( int * )      0x564B14 )
 #define CC_CAMERA_Y_ADDR            ( ( int * )      0x564B18 )
 
+// Additional game state addresses that are saved for rollback, see tools/Generator.cpp
+#define CC_P1_EXTRA_STRUCT_ADDR     ( ( char * )     0x557DB8 )
+#define CC_P2_EXTRA_STRUCT_ADDR     ( ( char * )     0x557FC4 )
+#define CC_EXTRA_STRUCT_SIZE        ( 0x20C )
+
+#define CC_P1_SPELL_CIRCLE_ADDR     ( ( float * )    0x5641A4 )
+#define CC_P2_SPELL_CIRCLE_ADDR     ( ( float * )    0x564200 )
+
+#define CC_METER_ANIMATION_ADDR     ( ( uint32_t * ) 0x7717D8 )
+
+#define CC_EFFECTS_ARRAY_ADDR       ( ( char * )     0x67BDE8 )
+#define CC_EFFECTS_ARRAY_COUNT      ( 1000 )
+#define CC_EFFECT_ELEMENT_SIZE      ( 0x33C )
+
+#define CC_SUPER_FLASH_PAUSE_ADDR   ( ( uint32_t * ) 0x5595B4 )
+#define CC_SUPER_FLASH_TIMER_ADDR   ( ( uint32_t * ) 0x562A48 )
+
+#define CC_SUPER_STATE_ARRAY_ADDR   ( ( char * )     0x558608 )
+#define CC_SUPER_STATE_ARRAY_SIZE   ( 5 * 0x30C )
+
+#define CC_P1_STATUS_MSG_ARRAY_ADDR ( ( char * )     0x563580 )
+#define CC_P2_STATUS_MSG_ARRAY_ADDR ( ( char * )     0x5635F4 )
+#define CC_STATUS_MSG_ARRAY_SIZE    ( 0x60 )
+
+#define CC_CAMERA_SCALE_1_ADDR      ( ( float * )    0x54EB70 ) // zoom
+#define CC_CAMERA_SCALE_2_ADDR      ( ( float * )    0x54EB74 ) // zoom
+#define CC_CAMERA_SCALE_3_ADDR      ( ( float * )    0x54EB78 )
+
+#define CC_INPUT_STATE_ADDR         ( ( uint8_t * )  0x562A6F ) // TODO figure out what the values mean
+#define CC_SLOW_TIMER_INIT_ADDR     ( ( uint16_t * ) 0x562A6C ) // Initializes the slowdown timer
+#define CC_SLOW_TIMER_ADDR          ( ( uint16_t * ) 0x55D208 ) // Slowdown timer
+
+#define CC_GRAPHICS_ARRAY_ADDR      ( ( char * )     0x61E170 )
+#define CC_GRAPHICS_ARRAY_SIZE      ( 4000 * 0x60 )
+
+#define CC_GRAPHICS_COUNTER         ( ( uint32_t * ) 0x67BD78 )
+
 // Array of sound effect flags, each byte corresponds to a specific SFX, set to 1 to start
 #define CC_SFX_ARRAY_ADDR           ( ( uint8_t * )  0x76E008 )
 #define CC_SFX_ARRAY_LEN            ( 1500 )
@@ -203,20 +263,6 @@
 #define MM_HOOK_CALL2_ADDR          ( ( char * )     0x40D411 )
 
 
-union IndexedFrame
-{
-    struct { uint32_t frame, index; } parts;
-    uint64_t value;
-};
-
-const IndexedFrame MaxIndexedFrame = {{ UINT_MAX, UINT_MAX }};
-
-inline std::ostream& operator<< ( std::ostream& os, const IndexedFrame& indexedFrame )
-{
-    return ( os << indexedFrame.parts.index << ':' << indexedFrame.parts.frame );
-}
-
-
 inline const char *gameModeStr ( uint32_t gameMode )
 {
     switch ( gameMode )
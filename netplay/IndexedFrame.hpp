@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <climits>
+#include <iostream>
+
+
+// Position in the netplay inputs, chronologically ordered by transition index and then frame
+union IndexedFrame
+{
+    struct { uint32_t frame, index; } parts;
+    uint64_t value;
+};
+
+const IndexedFrame MaxIndexedFrame = {{ UINT_MAX, UINT_MAX }};
+
+inline std::ostream& operator<< ( std::ostream& os, const IndexedFrame& indexedFrame )
+{
+    return ( os << indexedFrame.parts.index << ':' << indexedFrame.parts.frame );
+}
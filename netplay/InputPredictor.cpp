@@ -0,0 +1,151 @@
+#include "InputPredictor.hpp"
+#include "StringUtils.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+
+const uint32_t InputPredictor::MaxHeldFrames;
+
+// Minimum number of times a transition must be seen before it is predicted
+#define MIN_TRANSITION_COUNT ( 3 )
+
+// Counts are halved once a state has seen this many transitions, so the model adapts to recent inputs
+#define MAX_TRANSITION_TOTAL ( 256 )
+
+
+uint32_t MarkovPredictor::getKey ( uint16_t last, uint32_t held )
+{
+    return ( uint32_t ( last ) << 8 ) | min ( held, MaxHeldFrames );
+}
+
+void MarkovPredictor::update ( uint16_t last, uint32_t held, uint16_t input )
+{
+    State& state = _model[getKey ( last, held )];
+
+    Transition *found = 0, *lowest = &state.transitions[0];
+
+    for ( Transition& t : state.transitions )
+    {
+        if ( t.count && t.input == input )
+        {
+            found = &t;
+            break;
+        }
+
+        if ( t.count < lowest->count )
+            lowest = &t;
+    }
+
+    // Replace the least frequent transition if this one is new
+    if ( ! found )
+    {
+        state.total -= lowest->count;
+        found = lowest;
+        *found = { input, 0 };
+    }
+
+    ++found->count;
+    ++state.total;
+
+    if ( state.total < MAX_TRANSITION_TOTAL )
+        return;
+
+    state.total = 0;
+
+    for ( Transition& t : state.transitions )
+    {
+        t.count /= 2;
+        state.total += t.count;
+    }
+}
+
+uint16_t MarkovPredictor::predict ( uint16_t last, uint32_t held ) const
+{
+    const auto it = _model.find ( getKey ( last, held ) );
+
+    if ( it == _model.end() )
+        return last;
+
+    const Transition *best = 0;
+
+    for ( const Transition& t : it->second.transitions )
+    {
+        if ( ! best || t.count > best->count )
+            best = &t;
+    }
+
+    if ( best->count < MIN_TRANSITION_COUNT )
+        return last;
+
+    return best->input;
+}
+
+
+string PredictionStats::str() const
+{
+    return format ( "%s: latency=%u; frames=%u; rollbacks=%u; rerunFrames=%u; maxDepth=%u",
+                    name, latency, frames, rollbacks, rerunFrames, maxDepth );
+}
+
+// Get the number of frames the input before the given frame was held for
+static uint32_t getHeld ( const vector<uint16_t>& inputs, uint32_t frame )
+{
+    uint32_t held = 1;
+
+    while ( held < frame && held < InputPredictor::MaxHeldFrames && inputs[frame - held - 1] == inputs[frame - 1] )
+        ++held;
+
+    return held;
+}
+
+// Predict the input for the given frame, from the inputs used for the previous frames
+static uint16_t predictNext ( const InputPredictor& predictor, const vector<uint16_t>& used, uint32_t frame )
+{
+    if ( frame == 0 )
+        return 0;
+
+    return predictor.predict ( used[frame - 1], getHeld ( used, frame ) );
+}
+
+void evaluatePredictor ( InputPredictor& predictor, const vector<uint16_t>& inputs, uint32_t latency,
+                         PredictionStats& stats )
+{
+    stats.name = predictor.getName();
+    stats.latency = latency;
+    stats.frames += inputs.size();
+
+    // The inputs used by the game for each frame, either actual or predicted
+    vector<uint16_t> used ( inputs.size() );
+
+    // At time T, the actual input for frame T - latency arrives, then the game runs frame T
+    for ( uint32_t time = 0; time < inputs.size() + latency; ++time )
+    {
+        if ( time >= latency )
+        {
+            const uint32_t frame = time - latency;
+
+            if ( frame > 0 )
+                predictor.update ( inputs[frame - 1], getHeld ( inputs, frame ), inputs[frame] );
+
+            if ( frame < time && used[frame] != inputs[frame] )
+            {
+                // Rollback to the mispredicted frame, then re-run up to the current frame with new predictions
+                used[frame] = inputs[frame];
+
+                for ( uint32_t i = frame + 1; i < time && i < inputs.size(); ++i )
+                    used[i] = predictNext ( predictor, used, i );
+
+                ++stats.rollbacks;
+                stats.rerunFrames += time - frame;
+                stats.maxDepth = max ( stats.maxDepth, time - frame );
+            }
+
+            used[frame] = inputs[frame];
+        }
+
+        if ( time < inputs.size() && latency > 0 )
+            used[time] = predictNext ( predictor, used, time );
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+
+// Predicts the next input of a player from the recent inputs, used when the remote input is not known yet.
+// A predictor learns from the actual inputs as they are received. Predictions only affect the local game until
+// the actual inputs arrive, so each side can use a different predictor without desyncing.
+class InputPredictor
+{
+public:
+
+    // Held durations longer than this are treated the same
+    static const uint32_t MaxHeldFrames = 8;
+
+    virtual ~InputPredictor() {}
+
+    // Name of this predictor, for logging
+    virtual const char *getName() const = 0;
+
+    // Forget everything learned so far
+    virtual void clear() = 0;
+
+    // Learn that the given input followed the last input, which was held for the given number of frames
+    virtual void update ( uint16_t last, uint32_t held, uint16_t input ) = 0;
+
+    // Predict the input following the last input, which was held for the given number of frames
+    virtual uint16_t predict ( uint16_t last, uint32_t held ) const = 0;
+};
+
+
+// Always predicts the last input, this was the original behaviour of InputsContainer
+class RepeatLastPredictor : public InputPredictor
+{
+public:
+
+    const char *getName() const override { return "RepeatLast"; }
+
+    void clear() override {}
+
+    void update ( uint16_t last, uint32_t held, uint16_t input ) override {}
+
+    uint16_t predict ( uint16_t last, uint32_t held ) const override { return last; }
+};
+
+
+// Markov model over the input transitions, where the state is the last input and how long it was held.
+// Button presses are short and directions follow patterns, so the next input is predicted to be the most
+// frequent transition from the current state, once it has been seen enough times.
+class MarkovPredictor : public InputPredictor
+{
+public:
+
+    const char *getName() const override { return "Markov"; }
+
+    void clear() override { _model.clear(); }
+
+    void update ( uint16_t last, uint32_t held, uint16_t input ) override;
+
+    uint16_t predict ( uint16_t last, uint32_t held ) const override;
+
+private:
+
+    // Number of most frequent transitions kept per state
+    static const size_t NumTransitions = 4;
+
+    struct Transition
+    {
+        uint16_t input;
+        uint16_t count;
+    };
+
+    struct State
+    {
+        Transition transitions[NumTransitions];
+        uint16_t total = 0;
+
+        State() { for ( Transition& t : transitions ) t = { 0, 0 }; }
+    };
+
+    // Mapping: ( last input, held frames ) -> transitions
+    std::unordered_map<uint32_t, State> _model;
+
+    static uint32_t getKey ( uint16_t last, uint32_t held );
+};
+
+
+// Rollback statistics for a predictor, simulated with a fixed input latency
+struct PredictionStats
+{
+    // Name of the predictor
+    std::string name;
+
+    // Input latency in frames
+    uint32_t latency = 0;
+
+    // Number of frames simulated
+    uint32_t frames = 0;
+
+    // Number of rollbacks (one per mispredicted frame), the total number of re-run frames, and the deepest rollback
+    uint32_t rollbacks = 0, rerunFrames = 0, maxDepth = 0;
+
+    std::string str() const;
+};
+
+
+// Simulate the rollbacks a predictor would cause for the actual inputs of a player, if each input arrives the
+// given number of frames after it was needed. The predictor keeps learning from the inputs, like in netplay.
+void evaluatePredictor ( InputPredictor& predictor, const std::vector<uint16_t>& inputs, uint32_t latency,
+                         PredictionStats& stats );
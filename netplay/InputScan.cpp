@@ -0,0 +1,165 @@
+#include "InputScan.hpp"
+
+#if defined ( __i386__ ) || defined ( __x86_64__ )
+#include <emmintrin.h>
+#define INPUT_SCAN_SSE2
+#endif
+
+
+#ifdef INPUT_SCAN_SSE2
+
+// The build doesn't assume SSE2 since it targets i686, so only these functions are compiled with it
+#define SSE2_FUNCTION __attribute__ ( ( target ( "sse2" ) ) )
+
+static bool checkSse2()
+{
+    // This runs during static initialization, which may be before the CPU features are initialized
+    __builtin_cpu_init();
+    return __builtin_cpu_supports ( "sse2" );
+}
+
+static const bool hasSse2 = checkSse2();
+
+// Each function returns the number of inputs scanned without finding a match, which is a multiple of the vector
+// size. The remaining inputs must be scanned one at a time, starting from that position if no match was found.
+
+SSE2_FUNCTION static size_t anyInputHasMaskSse2 ( const uint16_t *inputs, size_t n, uint16_t mask, bool& found )
+{
+    const __m128i masks = _mm_set1_epi16 ( mask );
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+
+    for ( ; i + INPUT_SCAN_VECTOR_SIZE <= n; i += INPUT_SCAN_VECTOR_SIZE )
+    {
+        const __m128i values = _mm_loadu_si128 ( ( const __m128i * ) ( inputs + i ) );
+
+        // All 16-bit lanes are equal to zero if none of the inputs have the mask
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi16 ( _mm_and_si128 ( values, masks ), zero ) ) != 0xFFFF )
+        {
+            found = true;
+            break;
+        }
+    }
+
+    return i;
+}
+
+SSE2_FUNCTION static size_t allInputsHaveMaskSse2 ( const uint16_t *inputs, size_t n, uint16_t mask, bool& found )
+{
+    const __m128i masks = _mm_set1_epi16 ( mask );
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+
+    for ( ; i + INPUT_SCAN_VECTOR_SIZE <= n; i += INPUT_SCAN_VECTOR_SIZE )
+    {
+        const __m128i values = _mm_loadu_si128 ( ( const __m128i * ) ( inputs + i ) );
+
+        // Any 16-bit lane equal to zero is an input without the mask
+        if ( _mm_movemask_epi8 ( _mm_cmpeq_epi16 ( _mm_and_si128 ( values, masks ), zero ) ) != 0 )
+        {
+            found = true;
+            break;
+        }
+    }
+
+    return i;
+}
+
+SSE2_FUNCTION static size_t anyInputHasDirectionSse2 ( const uint16_t *inputs, size_t n, uint16_t dir1, uint16_t dir2,
+                                                       bool& found )
+{
+    const __m128i masks = _mm_set1_epi16 ( INPUT_SCAN_DIRECTION_MASK );
+    const __m128i dirs1 = _mm_set1_epi16 ( dir1 );
+    const __m128i dirs2 = _mm_set1_epi16 ( dir2 );
+
+    size_t i = 0;
+
+    for ( ; i + INPUT_SCAN_VECTOR_SIZE <= n; i += INPUT_SCAN_VECTOR_SIZE )
+    {
+        const __m128i dirs = _mm_and_si128 ( _mm_loadu_si128 ( ( const __m128i * ) ( inputs + i ) ), masks );
+
+        if ( _mm_movemask_epi8 ( _mm_or_si128 ( _mm_cmpeq_epi16 ( dirs, dirs1 ), _mm_cmpeq_epi16 ( dirs, dirs2 ) ) ) )
+        {
+            found = true;
+            break;
+        }
+    }
+
+    return i;
+}
+
+#endif // INPUT_SCAN_SSE2
+
+
+bool anyInputHasMaskVector ( const uint16_t *inputs, size_t n, uint16_t mask )
+{
+    size_t i = 0;
+
+#ifdef INPUT_SCAN_SSE2
+    bool found = false;
+
+    if ( hasSse2 )
+        i = anyInputHasMaskSse2 ( inputs, n, mask, found );
+
+    if ( found )
+        return true;
+#endif // INPUT_SCAN_SSE2
+
+    for ( ; i < n; ++i )
+    {
+        if ( inputs[i] & mask )
+            return true;
+    }
+
+    return false;
+}
+
+bool allInputsHaveMaskVector ( const uint16_t *inputs, size_t n, uint16_t mask )
+{
+    size_t i = 0;
+
+#ifdef INPUT_SCAN_SSE2
+    bool found = false;
+
+    if ( hasSse2 )
+        i = allInputsHaveMaskSse2 ( inputs, n, mask, found );
+
+    if ( found )
+        return false;
+#endif // INPUT_SCAN_SSE2
+
+    for ( ; i < n; ++i )
+    {
+        if ( ! ( inputs[i] & mask ) )
+            return false;
+    }
+
+    return true;
+}
+
+bool anyInputHasDirectionVector ( const uint16_t *inputs, size_t n, uint16_t dir1, uint16_t dir2 )
+{
+    size_t i = 0;
+
+#ifdef INPUT_SCAN_SSE2
+    bool found = false;
+
+    if ( hasSse2 )
+        i = anyInputHasDirectionSse2 ( inputs, n, dir1, dir2, found );
+
+    if ( found )
+        return true;
+#endif // INPUT_SCAN_SSE2
+
+    for ( ; i < n; ++i )
+    {
+        const uint16_t dir = ( inputs[i] & INPUT_SCAN_DIRECTION_MASK );
+
+        if ( dir == dir1 || dir == dir2 )
+            return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+
+// Scans over contiguous spans of inputs, vectorized with SSE2 if the CPU supports it.
+// Each scan has the same result as checking the inputs one at a time.
+// Spans shorter than a vector are scanned inline, since most history checks are only a few frames.
+
+// Number of inputs per SSE2 register, shorter spans are scanned one at a time
+#define INPUT_SCAN_VECTOR_SIZE ( 8 )
+
+// Mask of the direction bits of an input, see COMBINE_INPUT
+#define INPUT_SCAN_DIRECTION_MASK ( 0x000F )
+
+bool anyInputHasMaskVector ( const uint16_t *inputs, size_t n, uint16_t mask );
+bool allInputsHaveMaskVector ( const uint16_t *inputs, size_t n, uint16_t mask );
+bool anyInputHasDirectionVector ( const uint16_t *inputs, size_t n, uint16_t dir1, uint16_t dir2 );
+
+// True if any of the inputs has any of the bits in the mask set
+inline bool anyInputHasMask ( const uint16_t *inputs, size_t n, uint16_t mask )
+{
+    if ( n >= INPUT_SCAN_VECTOR_SIZE )
+        return anyInputHasMaskVector ( inputs, n, mask );
+
+    for ( size_t i = 0; i < n; ++i )
+    {
+        if ( inputs[i] & mask )
+            return true;
+    }
+
+    return false;
+}
+
+// True if all of the inputs have any of the bits in the mask set, this is also true if there are no inputs
+inline bool allInputsHaveMask ( const uint16_t *inputs, size_t n, uint16_t mask )
+{
+    if ( n >= INPUT_SCAN_VECTOR_SIZE )
+        return allInputsHaveMaskVector ( inputs, n, mask );
+
+    for ( size_t i = 0; i < n; ++i )
+    {
+        if ( ! ( inputs[i] & mask ) )
+            return false;
+    }
+
+    return true;
+}
+
+// True if the direction of any of the inputs is either of the given directions
+inline bool anyInputHasDirection ( const uint16_t *inputs, size_t n, uint16_t dir1, uint16_t dir2 )
+{
+    if ( n >= INPUT_SCAN_VECTOR_SIZE )
+        return anyInputHasDirectionVector ( inputs, n, dir1, dir2 );
+
+    for ( size_t i = 0; i < n; ++i )
+    {
+        const uint16_t dir = ( inputs[i] & INPUT_SCAN_DIRECTION_MASK );
+
+        if ( dir == dir1 || dir == dir2 )
+            return true;
+    }
+
+    return false;
+}
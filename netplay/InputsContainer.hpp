@@ -1,48 +1,100 @@
 #pragma once
 
-#include "Constants.hpp"
+#include "IndexedFrame.hpp"
 #include "Logger.hpp"
 
 #include <vector>
+#include <memory>
 #include <algorithm>
 
 
+// Inputs for each index:frame, stored in fixed size pages taken from a pool owned by the container.
+// Growing an index never moves existing inputs, and erasing old indices returns their pages to the pool,
+// so memory is bounded by the indices still kept, and long sessions don't get slower over time.
 template<typename T>
 class InputsContainer
 {
 public:
 
+    // Number of frames of inputs per page
+    static const size_t PageSize = 256;
+
     // Get a single input for the given index:frame, returns 0 if none.
+    // Returns the predicted input if set, otherwise the last known input, for frames after the known inputs.
     T get ( uint32_t index, uint32_t frame ) const
     {
-        if ( index >= _inputs.size() || _inputs[index].empty() )
+        if ( index >= numIndices() )
             return lastInputBefore ( index );
 
-        if ( frame >= _inputs[index].size() )
-            return _inputs[index].back();
+        const Index& inputs = indexAt ( index );
+
+        if ( frame >= inputs.size )
+        {
+            if ( index == _predictedIndex && inputs.size > 0 && frame >= _predictedStartFrame
+                    && frame - _predictedStartFrame < _predicted.size() )
+            {
+                return _predicted[frame - _predictedStartFrame];
+            }
+
+            // This is the last known input before this index if it has no inputs
+            return inputs.tail;
+        }
 
-        return _inputs[index][frame];
+        return inputs.pages[frame / PageSize][frame % PageSize];
     }
 
     // Get n inputs starting from the given index:frame, ASSERTS if not enough.
     void get ( uint32_t index, uint32_t frame, T *t, size_t n ) const
     {
-        ASSERT ( index < _inputs.size() );
-        ASSERT ( frame + n <= _inputs[index].size() );
+        ASSERT ( index < numIndices() );
+        ASSERT ( frame + n <= indexAt ( index ).size );
 
-        std::copy ( _inputs[index].begin() + frame,
-                    _inputs[index].begin() + frame + n, t );
+        const Index& inputs = indexAt ( index );
+
+        while ( n > 0 )
+        {
+            const size_t offset = frame % PageSize;
+            const size_t count = std::min ( n, PageSize - offset );
+            const T *page = inputs.pages[frame / PageSize];
+
+            std::copy ( page + offset, page + offset + count, t );
+
+            frame += count;
+            t += count;
+            n -= count;
+        }
+    }
+
+    // Read n inputs starting from the given index:frame, each one the same as get ( index, frame ).
+    // Unlike the other get, this doesn't need the inputs to exist, so it can read a span of the input history.
+    // Returns a pointer to the inputs in their page if they are all in one, otherwise they are copied to the buffer.
+    const T *read ( uint32_t index, uint32_t frame, T *buffer, size_t n ) const
+    {
+        const size_t size = ( index < numIndices() ? indexAt ( index ).size : 0 );
+
+        if ( frame + n <= size && frame / PageSize == ( frame + n - 1 ) / PageSize )
+            return indexAt ( index ).pages[frame / PageSize] + ( frame % PageSize );
+
+        const size_t known = ( frame < size ? std::min<size_t> ( n, size - frame ) : 0 );
+
+        if ( known > 0 )
+            get ( index, frame, buffer, known );
+
+        for ( size_t i = known; i < n; ++i )
+            buffer[i] = get ( index, frame + i );
+
+        return buffer;
     }
 
     // Set a single input for the given index:frame, CANNOT change existing inputs.
     void set ( uint32_t index, uint32_t frame, T t )
     {
-        if ( _inputs.size() > index && _inputs[index].size() > frame )
+        if ( numIndices() > index && indexAt ( index ).size > frame )
             return;
 
         resize ( index, frame );
 
-        _inputs[index][frame] = t;
+        write ( index, frame, t );
     }
 
     // Assign a single input for the given index:frame, CAN change existing inputs
@@ -50,7 +102,7 @@ public:
     {
         resize ( index, frame );
 
-        _inputs[index][frame] = t;
+        write ( index, frame, t );
     }
 
     // Fill n inputs with the same given value starting from the given index:frame, CAN change existing inputs.
@@ -58,8 +110,12 @@ public:
     {
         resize ( index, frame, n );
 
-        std::fill ( _inputs[index].begin() + frame,
-                    _inputs[index].begin() + frame + n, t );
+        Index& inputs = indexAt ( index );
+
+        for ( size_t i = frame; i < frame + n; ++i )
+            inputs.pages[i / PageSize][i % PageSize] = t;
+
+        updateTail ( index );
     }
 
     // Set n inputs starting from the given index:frame, CAN change existing inputs.
@@ -83,7 +139,59 @@ public:
 
         resize ( index, frame, n );
 
-        std::copy ( t, t + n, &_inputs[index][frame] );
+        Index& inputs = indexAt ( index );
+
+        while ( n > 0 )
+        {
+            const size_t offset = frame % PageSize;
+            const size_t count = std::min ( n, PageSize - offset );
+
+            std::copy ( t, t + count, inputs.pages[frame / PageSize] + offset );
+
+            frame += count;
+            t += count;
+            n -= count;
+        }
+
+        updateTail ( index );
+    }
+
+    // Set the predicted input for the given index:frame, which must be after the known inputs of that index.
+    // The actual input is compared against the prediction when it is set, to detect changed inputs.
+    void predict ( uint32_t index, uint32_t frame, T t )
+    {
+        if ( index >= numIndices() || indexAt ( index ).size == 0 || frame < indexAt ( index ).size )
+            return;
+
+        const size_t size = indexAt ( index ).size;
+
+        if ( index != _predictedIndex )
+        {
+            _predictedIndex = index;
+            _predicted.clear();
+        }
+
+        // Drop the predictions for frames that are known now
+        if ( _predictedStartFrame < size )
+        {
+            const size_t known = std::min<size_t> ( size - _predictedStartFrame, _predicted.size() );
+            _predicted.erase ( _predicted.begin(), _predicted.begin() + known );
+            _predictedStartFrame = size;
+        }
+
+        if ( _predicted.empty() )
+            _predictedStartFrame = frame;
+
+        if ( frame < _predictedStartFrame )
+        {
+            _predicted.insert ( _predicted.begin(), _predictedStartFrame - frame, get ( index, frame ) );
+            _predictedStartFrame = frame;
+        }
+
+        if ( frame - _predictedStartFrame >= _predicted.size() )
+            _predicted.resize ( frame - _predictedStartFrame + 1, get ( index, frame ) );
+
+        _predicted[frame - _predictedStartFrame] = t;
     }
 
     // Resize the container so that it can contain inputs up to index:frame+n.
@@ -91,65 +199,111 @@ public:
     {
         T last = 0;
 
-        if ( index >= _inputs.size() )
+        if ( index >= numIndices() )
         {
-            last = lastInputBefore ( _inputs.size() );
-            _inputs.resize ( index + 1 );
+            last = lastInputBefore ( numIndices() );
+
+            // New indices inherit the last known input until they have inputs
+            const size_t oldSize = _indices.size();
+
+            _indices.resize ( _eraseCount + index + 1 );
+
+            for ( size_t i = oldSize; i < _indices.size(); ++i )
+                _indices[i].tail = last;
         }
-        else if ( ! _inputs[index].empty() )
+        else if ( indexAt ( index ).size > 0 )
         {
-            last = _inputs[index].back();
+            last = indexAt ( index ).tail;
         }
 
-        if ( frame + n > _inputs[index].size() )
-            _inputs[index].resize ( frame + n, last );
+        Index& inputs = indexAt ( index );
+
+        const size_t size = frame + n;
+
+        if ( size <= inputs.size )
+            return;
+
+        while ( inputs.pages.size() * PageSize < size )
+            inputs.pages.push_back ( allocatePage() );
+
+        for ( size_t i = inputs.size; i < size; ++i )
+            inputs.pages[i / PageSize][i % PageSize] = last;
+
+        inputs.size = size;
+
+        updateTail ( index );
     }
 
     void clear()
     {
-        _inputs.clear();
+        eraseIndexOlderThan ( numIndices() );
+    }
+
+    void clearPredicted()
+    {
+        _predictedIndex = UINT_MAX;
+        _predicted.clear();
     }
 
     bool empty() const
     {
-        return _inputs.empty();
+        return ( numIndices() == 0 );
     }
 
     bool empty ( size_t index ) const
     {
-        if ( index >= _inputs.size() )
+        if ( index >= numIndices() )
             return true;
 
-        return _inputs[index].empty();
+        return ( indexAt ( index ).size == 0 );
     }
 
     uint32_t getEndIndex() const
     {
-        return _inputs.size();
+        return numIndices();
     }
 
     uint32_t getEndFrame() const
     {
-        if ( _inputs.empty() )
+        if ( numIndices() == 0 )
             return 0;
 
-        return _inputs.back().size();
+        return _indices.back().size;
     }
 
     uint32_t getEndFrame ( size_t index ) const
     {
-        if ( index >= _inputs.size() )
+        if ( index >= numIndices() )
             return 0;
 
-        return _inputs[index].size();
+        return indexAt ( index ).size;
     }
 
     void eraseIndexOlderThan ( size_t index )
     {
-        if ( index + 1 >= _inputs.size() )
-            _inputs.clear();
-        else
-            _inputs.erase ( _inputs.begin(), _inputs.begin() + index );
+        clearPredicted();
+
+        if ( index + 1 >= numIndices() )
+            index = numIndices();
+
+        // Return the pages of the erased indices to the pool
+        for ( size_t i = _eraseCount; i < _eraseCount + index; ++i )
+        {
+            _freePages.insert ( _freePages.end(), _indices[i].pages.begin(), _indices[i].pages.end() );
+            _indices[i] = Index();
+        }
+
+        _eraseCount += index;
+
+        if ( _eraseCount * 2 >= _indices.size() )
+        {
+            _indices.erase ( _indices.begin(), _indices.begin() + _eraseCount );
+            _eraseCount = 0;
+        }
+
+        // The first indices without inputs no longer have a last known input before them
+        for ( size_t i = _eraseCount; i < _indices.size() && _indices[i].size == 0; ++i )
+            _indices[i].tail = 0;
     }
 
     IndexedFrame getLastChangedFrame() const
@@ -162,31 +316,109 @@ public:
         _lastChangedFrame = MaxIndexedFrame;
     }
 
+    // Get the number of bytes allocated for pages, including the unused pages in the pool
+    size_t getAllocatedSize() const
+    {
+        return _allocated.size() * PageSize * sizeof ( T );
+    }
+
+    // Get the number of bytes in pages that currently hold inputs
+    size_t getUsedSize() const
+    {
+        return ( _allocated.size() - _freePages.size() ) * PageSize * sizeof ( T );
+    }
+
 private:
 
-    // Mapping: index -> frame -> input
-    std::vector<std::vector<T>> _inputs;
+    struct Index
+    {
+        // Pages holding the inputs of this index
+        std::vector<T *> pages;
+
+        // Number of frames of inputs
+        size_t size = 0;
+
+        // The last input of this index, or the last known input before this index if it has no inputs
+        T tail = 0;
+    };
+
+    // Mapping: index -> frame -> input, the first _eraseCount elements are erased indices.
+    // Erased indices are only removed from the vector once they are the majority, so erasing is amortized O(1).
+    std::vector<Index> _indices;
+    size_t _eraseCount = 0;
+
+    // All the allocated pages, and the ones that are not used by any index
+    std::vector<std::unique_ptr<T[]>> _allocated;
+    std::vector<T *> _freePages;
 
     // Last frame of input that changed
     IndexedFrame _lastChangedFrame = MaxIndexedFrame;
 
-    // Get the last known input BEFORE the given index. Defaults to 0 if unknown.
-    T lastInputBefore ( uint32_t index ) const
+    // Predicted inputs starting from _predictedIndex:_predictedStartFrame, after the known inputs of that index
+    std::vector<T> _predicted;
+    uint32_t _predictedIndex = UINT_MAX, _predictedStartFrame = 0;
+
+    size_t numIndices() const
     {
-        if ( _inputs.empty() || index == 0 )
-            return 0;
+        return _indices.size() - _eraseCount;
+    }
+
+    Index& indexAt ( size_t index )
+    {
+        return _indices[_eraseCount + index];
+    }
+
+    const Index& indexAt ( size_t index ) const
+    {
+        return _indices[_eraseCount + index];
+    }
+
+    // Write a single existing input, then update the tails if it was the last one
+    void write ( uint32_t index, uint32_t frame, T t )
+    {
+        Index& inputs = indexAt ( index );
+
+        inputs.pages[frame / PageSize][frame % PageSize] = t;
+
+        if ( frame + 1 == inputs.size )
+            updateTail ( index );
+    }
 
-        if ( index > _inputs.size() )
-            index = _inputs.size();
+    // Update the cached tail after the last input of the given index changed.
+    // The following indices without inputs inherit the new tail, this stops at the first index with inputs.
+    void updateTail ( uint32_t index )
+    {
+        Index& inputs = indexAt ( index );
+
+        if ( inputs.size > 0 )
+            inputs.tail = inputs.pages[( inputs.size - 1 ) / PageSize][( inputs.size - 1 ) % PageSize];
+
+        for ( size_t i = _eraseCount + index + 1; i < _indices.size() && _indices[i].size == 0; ++i )
+            _indices[i].tail = inputs.tail;
+    }
 
-        do
+    T *allocatePage()
+    {
+        if ( _freePages.empty() )
         {
-            --index;
-            if ( ! _inputs[index].empty() )
-                return _inputs[index].back();
+            _allocated.push_back ( std::unique_ptr<T[]> ( new T[PageSize] ) );
+            return _allocated.back().get();
         }
-        while ( index > 0 );
 
-        return 0;
+        T *page = _freePages.back();
+        _freePages.pop_back();
+        return page;
+    }
+
+    // Get the last known input BEFORE the given index. Defaults to 0 if unknown.
+    T lastInputBefore ( uint32_t index ) const
+    {
+        if ( numIndices() == 0 || index == 0 )
+            return 0;
+
+        if ( index > numIndices() )
+            index = numIndices();
+
+        return indexAt ( index - 1 ).tail;
     }
 };
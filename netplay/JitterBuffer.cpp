@@ -0,0 +1,77 @@
+#include "JitterBuffer.hpp"
+#include "StringUtils.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+void JitterBuffer::clear()
+{
+    *this = JitterBuffer();
+}
+
+void JitterBuffer::arrived ( uint64_t now, uint32_t frames )
+{
+    if ( _lastArrival && now >= _lastArrival )
+    {
+        // Difference between the actual and the expected interval, ie the playback time of the last inputs
+        const double expected = _lastFrames * 1000.0 / JITTER_BUFFER_FPS;
+
+        // Long gaps, eg while loading, are limited to the largest target
+        const double delta = min ( fabs ( double ( now - _lastArrival ) - expected ),
+                                   JITTER_BUFFER_MAX_TARGET * 1000.0 / JITTER_BUFFER_FPS );
+
+        // Smoothed like the RTP interarrival jitter, this is quick to rise but slow to decay
+        if ( delta > _jitter )
+            _jitter += ( delta - _jitter ) / 4;
+        else
+            _jitter += ( delta - _jitter ) / 16;
+    }
+
+    _lastArrival = now;
+    _lastFrames = frames;
+}
+
+double JitterBuffer::update ( uint32_t depth )
+{
+    _depth = depth;
+    _windowDepth = min ( _windowDepth, depth );
+
+    if ( ++_windowFrames < JITTER_BUFFER_WINDOW )
+        return _fps;
+
+    // Inputs arrive in bursts, so the lowest depth over the window is how far ahead the inputs really are
+    _lowDepth = _windowDepth;
+    _windowDepth = UINT_MAX;
+    _windowFrames = 0;
+
+    // Speed up when there are more frames buffered than needed, and slow down when there are less
+    const double error = double ( _lowDepth ) - double ( getTarget() );
+    const double adjust = error / ( JITTER_BUFFER_CORRECTION_SECONDS * JITTER_BUFFER_FPS );
+
+    _fps = JITTER_BUFFER_FPS * ( 1.0 + max ( -JITTER_BUFFER_MAX_ADJUST, min ( JITTER_BUFFER_MAX_ADJUST, adjust ) ) );
+    return _fps;
+}
+
+void JitterBuffer::stalled()
+{
+    ++_stalls;
+
+    _depth = _windowDepth = 0;
+}
+
+uint32_t JitterBuffer::getTarget() const
+{
+    const double jitterFrames = _jitter * JITTER_BUFFER_FPS / 1000.0;
+    const uint32_t extra = uint32_t ( ceil ( JITTER_BUFFER_JITTER_MULTIPLIER * jitterFrames ) );
+
+    return min<uint32_t> ( JITTER_BUFFER_MIN_TARGET + extra, JITTER_BUFFER_MAX_TARGET );
+}
+
+string JitterBuffer::str() const
+{
+    return format ( "Buffer: %u (low %u) / %u frames; Jitter: %.1f ms; %.1f fps; %u stalls",
+                    _depth, ( _lowDepth == UINT_MAX ? 0 : _lowDepth ), getTarget(), _jitter, _fps, _stalls );
+}
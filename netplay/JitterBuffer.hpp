@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <climits>
+#include <string>
+
+
+// Normal number of frames per second
+#define JITTER_BUFFER_FPS ( 60.0 )
+
+// Minimum and maximum number of frames of inputs to keep buffered ahead of the current frame
+#define JITTER_BUFFER_MIN_TARGET ( 6u )
+#define JITTER_BUFFER_MAX_TARGET ( 120u )
+
+// Number of frames of jitter to buffer for each frame of measured jitter
+#define JITTER_BUFFER_JITTER_MULTIPLIER ( 4 )
+
+// Number of frames over which the lowest buffer depth is measured
+#define JITTER_BUFFER_WINDOW ( 60 )
+
+// Number of seconds over which a difference from the target depth is corrected
+#define JITTER_BUFFER_CORRECTION_SECONDS ( 2.0 )
+
+// Maximum fraction of the normal fps that the playback speed is adjusted by
+#define JITTER_BUFFER_MAX_ADJUST ( 0.1 )
+
+
+// Playout buffer for spectators, which receive inputs in bursts from the broadcast schedule.
+// Instead of running as soon as inputs are ready, then stalling until the next burst, this measures the jitter of
+// the input arrivals, and keeps an adaptive number of frames buffered by slightly adjusting the playback speed.
+class JitterBuffer
+{
+public:
+
+    // Forget all the measurements
+    void clear();
+
+    // Inputs for the given number of frames arrived at the given time in milliseconds
+    void arrived ( uint64_t now, uint32_t frames );
+
+    // Update with the number of frames of inputs buffered ahead of the current frame, once per frame.
+    // Returns the desired playback fps.
+    double update ( uint32_t depth );
+
+    // The current frame had to wait for inputs
+    void stalled();
+
+    // Smoothed jitter of the input arrivals in milliseconds
+    double getJitter() const { return _jitter; }
+
+    // Target number of frames buffered, based on the jitter
+    uint32_t getTarget() const;
+
+    // Last buffer depth, and the lowest depth over the last window
+    uint32_t getDepth() const { return _depth; }
+    uint32_t getLowDepth() const { return _lowDepth; }
+
+    double getFps() const { return _fps; }
+
+    uint32_t getStalls() const { return _stalls; }
+
+    std::string str() const;
+
+private:
+
+    // Time and number of frames of the last arrival, 0 if none yet
+    uint64_t _lastArrival = 0;
+
+    uint32_t _lastFrames = 0;
+
+    double _jitter = 0.0;
+
+    uint32_t _depth = 0, _lowDepth = UINT_MAX, _windowDepth = UINT_MAX, _windowFrames = 0;
+
+    double _fps = JITTER_BUFFER_FPS;
+
+    uint32_t _stalls = 0;
+};
@@ -399,6 +399,46 @@ struct SyncHash : public SerializableSequence
 };
 
 
+struct StateHash : public SerializableSequence
+{
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    uint64_t hash = 0;
+
+    StateHash ( IndexedFrame indexedFrame, uint64_t hash ) : indexedFrame ( indexedFrame ), hash ( hash ) {}
+
+    std::string str() const override { return format ( "StateHash[%s,%016llx]", indexedFrame, hash ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( StateHash, indexedFrame.value, hash )
+};
+
+
+struct StateHashNodes : public SerializableSequence
+{
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    // Nodes of the state hash tree and their corresponding hashes, see MerkleTree
+    std::vector<uint32_t> nodes;
+    std::vector<uint64_t> hashes;
+
+    // If mismatched nodes were dropped at any level, because of MAX_STATE_HASH_NODES
+    bool truncated = false;
+
+    // If these are the final mismatched leaves, sent back to the side that drove the drill-down
+    bool done = false;
+
+    StateHashNodes ( IndexedFrame indexedFrame ) : indexedFrame ( indexedFrame ) {}
+
+    std::string str() const override
+    {
+        return format ( "StateHashNodes[%s,%u%s%s]", indexedFrame, nodes.size(),
+                        ( truncated ? ",truncated" : "" ), ( done ? ",done" : "" ) );
+    }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( StateHashNodes, indexedFrame.value, nodes, hashes, truncated, done )
+};
+
+
 struct MenuIndex : public SerializableSequence
 {
     uint32_t index = 0;
@@ -413,6 +453,22 @@ struct MenuIndex : public SerializableSequence
 };
 
 
+// Periodically sent by a spectator's parent with its clock, and echoed back by the spectator along with the number
+// of spectators it relays to, so the parent can measure the latency and balance the spectator tree.
+struct RelayStatus : public SerializableSequence
+{
+    uint64_t time = 0;
+
+    uint32_t relayed = 0;
+
+    RelayStatus ( uint64_t time, uint32_t relayed ) : time ( time ), relayed ( relayed ) {}
+
+    std::string str() const override { return format ( "RelayStatus[%llu,%u]", time, relayed ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( RelayStatus, time, relayed )
+};
+
+
 struct ChangeConfig : public SerializableSequence
 {
     ENUM_BOILERPLATE ( ChangeConfig, Delay, Rollback )
@@ -489,3 +545,25 @@ struct BothInputs : public SerializableSequence, public BaseInputs
 
     PROTOCOL_MESSAGE_BOILERPLATE ( BothInputs, indexedFrame.value, inputs )
 };
+
+
+// Block of inputs for both players sent to spectators that are catching up, these are compressed like other messages
+struct BothInputsBlock : public SerializableSequence
+{
+    // The first index:frame of the block
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    // Represents the input range [frame, frame + inputs[0].size())
+    std::array<std::vector<uint16_t>, 2> inputs;
+
+    BothInputsBlock ( IndexedFrame indexedFrame ) : indexedFrame ( indexedFrame ) {}
+
+    uint32_t getIndex() const { return indexedFrame.parts.index; }
+    uint32_t getStartFrame() const { return indexedFrame.parts.frame; }
+
+    size_t size() const { return inputs[0].size(); }
+
+    std::string str() const override { return format ( "BothInputsBlock[%s,%u]", indexedFrame, size() ); }
+
+    PROTOCOL_MESSAGE_BOILERPLATE ( BothInputsBlock, indexedFrame.value, inputs )
+};
@@ -30,6 +30,9 @@ ENUM ( Options,
        Dummy,
        StrictVersion,
        PidLog,
+       AsyncLog,
+       Predictor,
+       Record,
        SyncTest,
        Replay,
        // Special options
@@ -0,0 +1,567 @@
+#include "ReplayFile.hpp"
+#include "StringUtils.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+using namespace std;
+
+
+namespace ReplayFile
+{
+
+static const char Magic[MagicSize] = { 'C', 'C', 'R', 'E', 'P', 'L', 'A', 'Y' };
+
+// Blocks are aligned to this many bytes
+#define BLOCK_ALIGNMENT ( 8 )
+
+// Max number of blocks in a valid file
+#define MAX_BLOCKS ( 64 )
+
+// Hex dump sizes of the RngState in the old and new sync log formats
+#define OLD_RNG_STATE_DUMP_SIZE ( 707 )
+#define NEW_RNG_STATE_DUMP_SIZE ( 695 )
+
+// The records are read in place, so their layout is part of the format
+static_assert ( sizeof ( Header ) == 16, "Header layout changed" );
+static_assert ( sizeof ( Block ) == 24, "Block layout changed" );
+static_assert ( sizeof ( IndexRecord ) == 48, "IndexRecord layout changed" );
+static_assert ( sizeof ( RollbackRecord ) == 24, "RollbackRecord layout changed" );
+static_assert ( sizeof ( InputsRecord ) == 16, "InputsRecord layout changed" );
+static_assert ( sizeof ( RngStateRecord ) == 16 + RngState3Size, "RngStateRecord layout changed" );
+static_assert ( sizeof ( PlayerRecord ) == 8, "PlayerRecord layout changed" );
+
+
+static size_t getRecordSize ( BlockType type )
+{
+    switch ( type )
+    {
+        case BlockType::Index:
+            return sizeof ( IndexRecord );
+
+        case BlockType::InputsP1:
+        case BlockType::InputsP2:
+            return sizeof ( uint16_t );
+
+        case BlockType::RealInputs:
+        case BlockType::Reinputs:
+            return sizeof ( InputsRecord );
+
+        case BlockType::Rollbacks:
+            return sizeof ( RollbackRecord );
+
+        case BlockType::RngStates:
+            return sizeof ( RngStateRecord );
+
+        case BlockType::Players:
+            return sizeof ( PlayerRecord );
+
+        case BlockType::Strings:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static bool checkRange ( uint32_t start, uint32_t count, uint32_t total )
+{
+    return ( start <= total && count <= total - start );
+}
+
+
+// Per index data while reading a sync log replay, this is flattened into columns at the end
+struct IndexData
+{
+    uint32_t gameMode = 0;
+    string state;
+
+    // Inputs with the Inputs lines only, and with the Reinputs lines too, the last line for each frame wins
+    vector<uint16_t> p1, p2, realP1, realP2;
+
+    vector<RollbackRecord> rollbacks;
+    vector<vector<InputsRecord>> reinputs;
+
+    bool hasRngState = false;
+    RngStateRecord rngState;
+
+    vector<PlayerRecord> players;
+};
+
+// Parse the next unsigned number in the given base, returns false if there isn't one
+static bool parseNumber ( const char *& str, uint32_t& value, int base = 10 )
+{
+    char *end;
+    const unsigned long v = strtoul ( str, &end, base );
+
+    if ( end == str )
+        return false;
+
+    str = end;
+    value = v;
+    return true;
+}
+
+// Parse the next word separated by spaces, returns false if there isn't one
+static bool parseWord ( const char *& str, string& word )
+{
+    while ( *str == ' ' || *str == '\t' )
+        ++str;
+
+    const char *end = str;
+
+    while ( *end && *end != ' ' && *end != '\t' && *end != '\r' )
+        ++end;
+
+    if ( end == str )
+        return false;
+
+    word.assign ( str, end );
+    str = end;
+    return true;
+}
+
+static bool parseRngState ( const string& str, RngStateRecord& record )
+{
+    const bool old = ( str.size() == OLD_RNG_STATE_DUMP_SIZE );
+
+    if ( ! old && str.size() != NEW_RNG_STATE_DUMP_SIZE )
+        return false;
+
+    char data [ sizeof ( uint32_t ) * 4 + RngState3Size ];
+
+    const char *ptr = str.c_str();
+    const size_t size = ( old ? sizeof ( data ) : sizeof ( data ) - sizeof ( uint32_t ) );
+
+    for ( size_t i = 0; i < size; ++i )
+    {
+        uint32_t v;
+
+        if ( ! parseNumber ( ptr, v, 16 ) )
+            return false;
+
+        data[i] = v;
+    }
+
+    memcpy ( &record.rngState0, &data[0], sizeof ( uint32_t ) );
+    memcpy ( &record.rngState1, &data[4], sizeof ( uint32_t ) );
+    memcpy ( &record.rngState2, &data[8], sizeof ( uint32_t ) );
+    memcpy ( record.rngState3, &data[old ? 16 : 12], RngState3Size );
+    return true;
+}
+
+static void setInputs ( vector<uint16_t>& p1, vector<uint16_t>& p2, uint32_t frame, uint32_t v1, uint32_t v2 )
+{
+    if ( frame >= p1.size() )
+    {
+        p1.resize ( frame + 1 );
+        p2.resize ( frame + 1 );
+    }
+
+    p1[frame] = v1;
+    p2[frame] = v2;
+}
+
+bool readSyncLogReplay ( const string& file, Columns& columns, string& error )
+{
+    ifstream fin ( file.c_str() );
+
+    if ( ! fin.good() )
+    {
+        error = "Cannot open " + file;
+        return false;
+    }
+
+    vector<IndexData> indices;
+
+    // Index of the last rollback, the following reinputs belong to it
+    uint32_t lastRollbackIndex = None;
+
+    string line;
+    uint32_t lineNumber = 0;
+
+    while ( getline ( fin, line ) )
+    {
+        ++lineNumber;
+
+        // Each line is: gameMode netplayState index frame tag rest
+        const char *ptr = line.c_str();
+
+        while ( *ptr == ' ' || *ptr == '\t' )
+            ++ptr;
+
+        if ( ! *ptr || *ptr == '\r' )
+            continue;
+
+        uint32_t gameMode, index, frame;
+        string state, tag;
+
+        if ( ! parseNumber ( ptr, gameMode ) || ! parseWord ( ptr, state )
+                || ! parseNumber ( ptr, index ) || ! parseNumber ( ptr, frame ) || ! parseWord ( ptr, tag ) )
+        {
+            error = format ( "Line %u: expected gameMode netplayState index frame tag", lineNumber );
+            return false;
+        }
+
+        const string rest = trimmed ( ptr );
+
+        if ( index >= indices.size() )
+            indices.resize ( index + 1 );
+
+        IndexData& data = indices[index];
+
+        if ( data.state.empty() )
+        {
+            data.gameMode = gameMode;
+            data.state = state;
+        }
+        else if ( data.gameMode != gameMode || data.state != state )
+        {
+            error = format ( "Line %u: inconsistent game mode or state for index %u", lineNumber, index );
+            return false;
+        }
+
+        uint32_t a, b, c;
+        ptr = rest.c_str();
+
+        if ( tag == "Inputs" || tag == "Reinputs" )
+        {
+            if ( ! parseNumber ( ptr, a, 16 ) || ! parseNumber ( ptr, b, 16 ) )
+            {
+                error = format ( "Line %u: invalid inputs", lineNumber );
+                return false;
+            }
+
+            setInputs ( data.realP1, data.realP2, frame, a, b );
+
+            if ( tag == "Inputs" )
+            {
+                setInputs ( data.p1, data.p2, frame, a, b );
+                continue;
+            }
+
+            if ( lastRollbackIndex == None )
+            {
+                error = format ( "Line %u: reinputs without a rollback", lineNumber );
+                return false;
+            }
+
+            InputsRecord record;
+            record.indexedFrame = {{ frame, index }};
+            record.p1 = a;
+            record.p2 = b;
+            record.reserved = 0;
+
+            indices[lastRollbackIndex].reinputs.back().push_back ( record );
+        }
+        else if ( tag == "Rollback" )
+        {
+            if ( ! parseNumber ( ptr, a ) || ! parseNumber ( ptr, b ) )
+            {
+                error = format ( "Line %u: invalid rollback target", lineNumber );
+                return false;
+            }
+
+            RollbackRecord record;
+            record.indexedFrame = {{ frame, index }};
+            record.target = {{ b, a }};
+            record.reinputsStart = record.numReinputs = 0;
+
+            data.rollbacks.push_back ( record );
+            data.reinputs.push_back ( vector<InputsRecord>() );
+            lastRollbackIndex = index;
+        }
+        else if ( tag == "RngState" )
+        {
+            if ( data.hasRngState )
+            {
+                error = format ( "Line %u: duplicate RngState for index %u", lineNumber, index );
+                return false;
+            }
+
+            if ( ! parseRngState ( rest, data.rngState ) )
+            {
+                error = format ( "Line %u: unknown RngState size: %u", lineNumber, rest.size() );
+                return false;
+            }
+
+            data.rngState.index = index;
+            data.hasRngState = true;
+        }
+        else if ( tag == "P1" || tag == "P2" )
+        {
+            if ( ! parseNumber ( ptr, a ) || ! parseNumber ( ptr, b ) || ! parseNumber ( ptr, c ) )
+            {
+                error = format ( "Line %u: invalid player", lineNumber );
+                return false;
+            }
+
+            PlayerRecord record;
+            record.index = index;
+            record.player = ( tag == "P1" ? 1 : 2 );
+            record.chara = a;
+            record.moon = b;
+            record.color = c;
+
+            data.players.push_back ( record );
+        }
+        else
+        {
+            error = format ( "Line %u: unhandled tag: '%s'", lineNumber, tag );
+            return false;
+        }
+    }
+
+    columns = Columns();
+
+    // The empty string is at offset 0
+    columns.strings.push_back ( '\0' );
+
+    for ( const IndexData& data : indices )
+    {
+        IndexRecord record;
+        memset ( &record, 0, sizeof ( record ) );
+
+        record.gameMode = data.gameMode;
+        record.state = None;
+
+        if ( ! data.state.empty() )
+        {
+            const string str = data.state + '\0';
+            const size_t pos = columns.strings.find ( str );
+
+            if ( pos != string::npos && ( pos == 0 || columns.strings[pos - 1] == '\0' ) )
+            {
+                record.state = pos;
+            }
+            else
+            {
+                record.state = columns.strings.size();
+                columns.strings += str;
+            }
+        }
+
+        record.inputsStart = columns.inputsP1.size();
+        record.numInputs = data.p1.size();
+        columns.inputsP1.insert ( columns.inputsP1.end(), data.p1.begin(), data.p1.end() );
+        columns.inputsP2.insert ( columns.inputsP2.end(), data.p2.begin(), data.p2.end() );
+
+        // Only keep the real inputs that are different from the inputs
+        record.realInputsStart = columns.realInputs.size();
+
+        for ( uint32_t frame = 0; frame < data.realP1.size(); ++frame )
+        {
+            const bool same = ( frame < data.p1.size()
+                                && data.p1[frame] == data.realP1[frame] && data.p2[frame] == data.realP2[frame] );
+
+            if ( same )
+                continue;
+
+            InputsRecord real;
+            real.indexedFrame = {{ frame, ( uint32_t ) columns.indices.size() }};
+            real.p1 = data.realP1[frame];
+            real.p2 = data.realP2[frame];
+            real.reserved = 0;
+
+            columns.realInputs.push_back ( real );
+        }
+
+        record.numRealInputs = columns.realInputs.size() - record.realInputsStart;
+
+        record.rollbacksStart = columns.rollbacks.size();
+        record.numRollbacks = data.rollbacks.size();
+
+        for ( size_t i = 0; i < data.rollbacks.size(); ++i )
+        {
+            RollbackRecord rollback = data.rollbacks[i];
+            rollback.reinputsStart = columns.reinputs.size();
+            rollback.numReinputs = data.reinputs[i].size();
+
+            columns.rollbacks.push_back ( rollback );
+            columns.reinputs.insert ( columns.reinputs.end(), data.reinputs[i].begin(), data.reinputs[i].end() );
+        }
+
+        record.rngState = None;
+
+        if ( data.hasRngState )
+        {
+            record.rngState = columns.rngStates.size();
+            columns.rngStates.push_back ( data.rngState );
+        }
+
+        record.playersStart = columns.players.size();
+        record.numPlayers = data.players.size();
+        columns.players.insert ( columns.players.end(), data.players.begin(), data.players.end() );
+
+        columns.indices.push_back ( record );
+    }
+
+    return true;
+}
+
+bool write ( const string& file, const Columns& columns )
+{
+    struct Data
+    {
+        BlockType type;
+        const char *bytes;
+        size_t count;
+    };
+
+    const Data data[] =
+    {
+        { BlockType::Index, ( const char * ) columns.indices.data(), columns.indices.size() },
+        { BlockType::InputsP1, ( const char * ) columns.inputsP1.data(), columns.inputsP1.size() },
+        { BlockType::InputsP2, ( const char * ) columns.inputsP2.data(), columns.inputsP2.size() },
+        { BlockType::RealInputs, ( const char * ) columns.realInputs.data(), columns.realInputs.size() },
+        { BlockType::Rollbacks, ( const char * ) columns.rollbacks.data(), columns.rollbacks.size() },
+        { BlockType::Reinputs, ( const char * ) columns.reinputs.data(), columns.reinputs.size() },
+        { BlockType::RngStates, ( const char * ) columns.rngStates.data(), columns.rngStates.size() },
+        { BlockType::Players, ( const char * ) columns.players.data(), columns.players.size() },
+        { BlockType::Strings, columns.strings.c_str(), columns.strings.size() },
+    };
+
+    Header header;
+    memcpy ( header.magic, Magic, MagicSize );
+    header.version = Version;
+    header.numBlocks = sizeof ( data ) / sizeof ( data[0] );
+
+    vector<Block> blocks;
+    uint64_t offset = sizeof ( header ) + header.numBlocks * sizeof ( Block );
+
+    for ( const Data& d : data )
+    {
+        offset = ( offset + BLOCK_ALIGNMENT - 1 ) & ~ ( uint64_t ) ( BLOCK_ALIGNMENT - 1 );
+
+        Block block;
+        block.type = ( uint32_t ) d.type;
+        block.count = d.count;
+        block.offset = offset;
+        block.size = d.count * getRecordSize ( d.type );
+
+        blocks.push_back ( block );
+        offset += block.size;
+    }
+
+    ofstream fout ( file.c_str(), ios::binary );
+
+    if ( ! fout.good() )
+        return false;
+
+    fout.write ( ( const char * ) &header, sizeof ( header ) );
+    fout.write ( ( const char * ) &blocks[0], blocks.size() * sizeof ( Block ) );
+
+    uint64_t position = sizeof ( header ) + blocks.size() * sizeof ( Block );
+
+    static const char padding[BLOCK_ALIGNMENT] = { 0 };
+
+    for ( size_t i = 0; i < blocks.size(); ++i )
+    {
+        fout.write ( padding, blocks[i].offset - position );
+
+        if ( blocks[i].size )
+            fout.write ( data[i].bytes, blocks[i].size );
+
+        position = blocks[i].offset + blocks[i].size;
+    }
+
+    return fout.good();
+}
+
+bool isBinary ( const char *data, size_t size )
+{
+    return ( size >= MagicSize && memcmp ( data, Magic, MagicSize ) == 0 );
+}
+
+
+bool Reader::open ( const char *data, size_t size )
+{
+    *this = Reader();
+
+    if ( size < sizeof ( Header ) || ! isBinary ( data, size ) )
+        return false;
+
+    const Header& header = * ( const Header * ) data;
+
+    if ( header.version != Version || header.numBlocks > MAX_BLOCKS )
+        return false;
+
+    if ( sizeof ( Header ) + header.numBlocks * sizeof ( Block ) > size )
+        return false;
+
+    const Block *blocks = ( const Block * ) ( data + sizeof ( Header ) );
+
+    for ( uint32_t i = 0; i < header.numBlocks; ++i )
+    {
+        const Block& block = blocks[i];
+
+        // Ignore unknown blocks
+        if ( block.type >= ( uint32_t ) BlockType::Count )
+            continue;
+
+        if ( block.offset % BLOCK_ALIGNMENT || block.offset > size || block.size > size - block.offset )
+            return false;
+
+        if ( block.size != block.count * ( uint64_t ) getRecordSize ( ( BlockType ) block.type ) )
+            return false;
+
+        _columns[block.type] = data + block.offset;
+        _count[block.type] = block.count;
+    }
+
+    // The strings must be null terminated, starting with the empty string
+    const uint32_t numStrings = getCount ( BlockType::Strings );
+    const char *strings = getColumn<char> ( BlockType::Strings );
+
+    if ( numStrings == 0 || strings[0] || strings[numStrings - 1] )
+        return false;
+
+    // Check all the ranges once, so accessing the columns doesn't need to
+    const uint32_t numInputs = min ( getCount ( BlockType::InputsP1 ), getCount ( BlockType::InputsP2 ) );
+
+    for ( uint32_t i = 0; i < getNumIndices(); ++i )
+    {
+        const IndexRecord& index = getIndex ( i );
+
+        if ( index.state != None && index.state >= numStrings )
+            return false;
+
+        if ( ! checkRange ( index.inputsStart, index.numInputs, numInputs )
+                || ! checkRange ( index.realInputsStart, index.numRealInputs, getCount ( BlockType::RealInputs ) )
+                || ! checkRange ( index.rollbacksStart, index.numRollbacks, getCount ( BlockType::Rollbacks ) )
+                || ! checkRange ( index.playersStart, index.numPlayers, getCount ( BlockType::Players ) ) )
+        {
+            return false;
+        }
+
+        if ( index.rngState != None && index.rngState >= getCount ( BlockType::RngStates ) )
+            return false;
+    }
+
+    const RollbackRecord *rollbacks = getColumn<RollbackRecord> ( BlockType::Rollbacks );
+
+    for ( uint32_t i = 0; i < getCount ( BlockType::Rollbacks ); ++i )
+    {
+        if ( ! checkRange ( rollbacks[i].reinputsStart, rollbacks[i].numReinputs, getCount ( BlockType::Reinputs ) ) )
+            return false;
+    }
+
+    return true;
+}
+
+const IndexRecord& Reader::getIndex ( uint32_t index ) const
+{
+    return getColumn<IndexRecord> ( BlockType::Index ) [index];
+}
+
+const char *Reader::getString ( uint32_t offset ) const
+{
+    if ( offset == None )
+        return "";
+
+    return getColumn<char> ( BlockType::Strings ) + offset;
+}
+
+} // namespace ReplayFile
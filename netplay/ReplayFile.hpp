@@ -0,0 +1,172 @@
+#pragma once
+
+#include "IndexedFrame.hpp"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+
+// Binary columnar replay format, see ReplayManager for how each column is used.
+//
+// The file starts with a Header, followed by a table of Blocks, followed by the blocks themselves. Each block is
+// one column of fixed size records, aligned to 8 bytes, so a mapped file can be accessed in place without parsing.
+// Records of each index are contiguous in their columns, and located through the Index column, so loading only
+// needs to read the Index column, and everything else is decoded on demand, one index at a time.
+namespace ReplayFile
+{
+
+// Current version of the format, files with a different version are rejected
+const uint32_t Version = 1;
+
+// Size of the magic string at the start of the file
+const size_t MagicSize = 8;
+
+// Size of the last RngState array, same as CC_RNG_STATE3_SIZE which isn't included since it depends on the
+// Windows headers. ReplayManager checks that they are equal.
+const size_t RngState3Size = 220;
+
+// Marks a missing record
+const uint32_t None = 0xFFFFFFFF;
+
+enum class BlockType : uint32_t
+{
+    Index = 0,
+    InputsP1,
+    InputsP2,
+    RealInputs,
+    Rollbacks,
+    Reinputs,
+    RngStates,
+    Players,
+    Strings,
+
+    // Number of block types
+    Count
+};
+
+struct Header
+{
+    char magic[MagicSize];
+    uint32_t version;
+    uint32_t numBlocks;
+};
+
+struct Block
+{
+    uint32_t type;
+    uint32_t count;
+    uint64_t offset;
+    uint64_t size;
+};
+
+// One record per transition index, up to the last index in the replay
+struct IndexRecord
+{
+    // Game mode, and offset of the NetplayState name in the Strings column, 0 / None if the index has no records
+    uint32_t gameMode;
+    uint32_t state;
+
+    // Range of inputs in the InputsP1 / InputsP2 columns, one per frame starting from frame 0
+    uint32_t inputsStart, numInputs;
+
+    // Range of inputs in the RealInputs column, which override the inputs with the reinputs
+    uint32_t realInputsStart, numRealInputs;
+
+    // Range of rollbacks in the Rollbacks column
+    uint32_t rollbacksStart, numRollbacks;
+
+    // Position in the RngStates column, None if there isn't one
+    uint32_t rngState;
+
+    // Range of players in the Players column
+    uint32_t playersStart, numPlayers;
+
+    uint32_t reserved;
+};
+
+// Rollback from indexedFrame to target, followed by the reinputs that were logged after it
+struct RollbackRecord
+{
+    IndexedFrame indexedFrame;
+    IndexedFrame target;
+    uint32_t reinputsStart, numReinputs;
+};
+
+// Inputs for both players at a specific index:frame, for RealInputs and Reinputs, and the recorded inputs
+struct InputsRecord
+{
+    IndexedFrame indexedFrame;
+    uint16_t p1, p2;
+    uint32_t reserved;
+};
+
+struct RngStateRecord
+{
+    uint32_t index;
+    uint32_t rngState0, rngState1, rngState2;
+    char rngState3[RngState3Size];
+};
+
+// Character selected by a player at the start of an index
+struct PlayerRecord
+{
+    uint32_t index;
+    uint8_t player, chara, moon, color;
+};
+
+
+// All the columns of a replay, used to convert and write replays
+struct Columns
+{
+    std::vector<IndexRecord> indices;
+    std::vector<uint16_t> inputsP1, inputsP2;
+    std::vector<InputsRecord> realInputs;
+    std::vector<RollbackRecord> rollbacks;
+    std::vector<InputsRecord> reinputs;
+    std::vector<RngStateRecord> rngStates;
+    std::vector<PlayerRecord> players;
+    std::string strings;
+};
+
+// Read a replay in the text format generated by scripts/sync2replay from a sync log, returns false on error
+bool readSyncLogReplay ( const std::string& file, Columns& columns, std::string& error );
+
+// Write a replay in the binary format, returns false on error
+bool write ( const std::string& file, const Columns& columns );
+
+// Check if the data starts like a binary replay
+bool isBinary ( const char *data, size_t size );
+
+
+// Read-only view of a binary replay in memory, typically a mapped file
+class Reader
+{
+public:
+
+    // Validate the header and block table, returns false if the replay is invalid
+    bool open ( const char *data, size_t size );
+
+    uint32_t getNumIndices() const { return _count[( size_t ) BlockType::Index]; }
+
+    const IndexRecord& getIndex ( uint32_t index ) const;
+
+    // Get the state name at the given offset in the Strings column, empty if the offset is None
+    const char *getString ( uint32_t offset ) const;
+
+    template<typename T>
+    const T *getColumn ( BlockType type ) const
+    {
+        return ( const T * ) _columns[( size_t ) type];
+    }
+
+    uint32_t getCount ( BlockType type ) const { return _count[( size_t ) type]; }
+
+private:
+
+    const char *_columns[( size_t ) BlockType::Count] = { 0 };
+
+    uint32_t _count[( size_t ) BlockType::Count] = { 0 };
+};
+
+} // namespace ReplayFile
@@ -5,12 +5,23 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 using namespace std;
 
 
+static_assert ( ReplayFile::RngState3Size == CC_RNG_STATE3_SIZE, "RngState3 size must match the replay format" );
+
+
 bool ReplayManager::load ( const string& replayFile, bool real )
 {
+    _mapped.reset ( new MappedFile() );
+
+    if ( _mapped->open ( replayFile ) && ReplayFile::isBinary ( _mapped->data(), _mapped->size() ) )
+        return loadBinary ( real );
+
+    _mapped.reset();
+
     ifstream fin ( replayFile.c_str() );
     bool good = fin.good();
 
@@ -43,8 +54,11 @@ bool ReplayManager::load ( const string& replayFile, bool real )
             if ( index >= _states.size() )
                 _states.resize ( index + 1 );
 
-            if ( _states[index].empty() )
-                _states[index] = "NetplayState::" + netplayState;
+            NetplayState::Enum state = NetplayState::Unknown;
+            NetplayState::parse ( netplayState, state );
+
+            if ( _states[index] == NetplayState::Unknown )
+                _states[index] = state;
 
             if ( gameMode == CC_GAME_MODE_LOADING )
             {
@@ -57,7 +71,7 @@ bool ReplayManager::load ( const string& replayFile, bool real )
                     _initialStates.push_back ( MsgPtr ( new InitialGameState ( { 0, index } ) ) );
             }
 
-            ASSERT ( _states[index] == "NetplayState::" + netplayState );
+            ASSERT ( _states[index] == state );
 
             if ( tag == "Inputs" || ( real && tag == "Reinputs" ) )
             {
@@ -209,6 +223,156 @@ bool ReplayManager::load ( const string& replayFile, bool real )
     return good;
 }
 
+bool ReplayManager::loadBinary ( bool real )
+{
+    if ( ! _reader.open ( _mapped->data(), _mapped->size() ) )
+    {
+        LOG ( "Invalid binary replay" );
+        _mapped.reset();
+        return false;
+    }
+
+    _real = real;
+
+    const uint32_t numIndices = _reader.getNumIndices();
+    const ReplayFile::PlayerRecord *players = _reader.getColumn<ReplayFile::PlayerRecord> (
+                                                  ReplayFile::BlockType::Players );
+
+    uint32_t numInputs = 0, numRollbacks = 0, numRngStates = 0;
+
+    _modes.resize ( numIndices );
+    _states.resize ( numIndices );
+
+    // Only the modes, states, and initial states are decoded now, they are small and needed for seeking
+    for ( uint32_t index = 0; index < numIndices; ++index )
+    {
+        const ReplayFile::IndexRecord& record = _reader.getIndex ( index );
+
+        _modes[index] = record.gameMode;
+
+        if ( record.state != ReplayFile::None )
+        {
+            NetplayState::Enum state = NetplayState::Unknown;
+            NetplayState::parse ( _reader.getString ( record.state ), state );
+            _states[index] = state;
+        }
+
+        if ( record.numInputs || ( real && record.numRealInputs ) )
+            numInputs = index + 1;
+
+        if ( ! real && record.numRollbacks )
+            numRollbacks = index + 1;
+
+        if ( record.rngState != ReplayFile::None )
+            numRngStates = index + 1;
+
+        if ( record.gameMode == CC_GAME_MODE_LOADING )
+            _initialStates.push_back ( MsgPtr ( new InitialGameState ( { 0, index } ) ) );
+
+        if ( record.gameMode != CC_GAME_MODE_IN_GAME )
+            continue;
+
+        for ( uint32_t i = record.playersStart; i < record.playersStart + record.numPlayers; ++i )
+        {
+            ASSERT ( _initialStates.empty() == false );
+            ASSERT ( players[i].player == 1 || players[i].player == 2 );
+
+            InitialGameState& initial = _initialStates.back()->getAs<InitialGameState>();
+
+            initial.chara[players[i].player - 1] = players[i].chara;
+            initial.moon[players[i].player - 1] = players[i].moon;
+            initial.color[players[i].player - 1] = players[i].color;
+        }
+    }
+
+    _inputs.resize ( numInputs );
+    _rollbacks.resize ( numRollbacks );
+    _reinputs.resize ( numRollbacks );
+    _rngStates.resize ( numRngStates );
+    _decoded.assign ( numIndices, false );
+
+    LOG ( "Mapped up to [%u:%u]", getLastIndex(), getLastFrame() );
+
+    return true;
+}
+
+void ReplayManager::decode ( uint32_t index ) const
+{
+    if ( ! _mapped || index >= _decoded.size() || _decoded[index] )
+        return;
+
+    _decoded[index] = true;
+
+    const ReplayFile::IndexRecord& record = _reader.getIndex ( index );
+
+    if ( index < _inputs.size() )
+    {
+        const uint16_t *p1 = _reader.getColumn<uint16_t> ( ReplayFile::BlockType::InputsP1 ) + record.inputsStart;
+        const uint16_t *p2 = _reader.getColumn<uint16_t> ( ReplayFile::BlockType::InputsP2 ) + record.inputsStart;
+
+        vector<Inputs>& inputs = _inputs[index];
+        inputs.resize ( record.numInputs );
+
+        for ( uint32_t frame = 0; frame < record.numInputs; ++frame )
+            inputs[frame] = { {{ frame, index }}, p1[frame], p2[frame] };
+
+        // Real inputs override the inputs with the reinputs
+        const ReplayFile::InputsRecord *real = _reader.getColumn<ReplayFile::InputsRecord> (
+                ReplayFile::BlockType::RealInputs ) + record.realInputsStart;
+
+        for ( uint32_t i = 0; _real && i < record.numRealInputs; ++i )
+        {
+            const uint32_t frame = real[i].indexedFrame.parts.frame;
+
+            if ( frame >= inputs.size() )
+                inputs.resize ( frame + 1 );
+
+            inputs[frame] = { real[i].indexedFrame, real[i].p1, real[i].p2 };
+        }
+    }
+
+    if ( index < _rollbacks.size() )
+    {
+        const ReplayFile::RollbackRecord *rollbacks = _reader.getColumn<ReplayFile::RollbackRecord> (
+                    ReplayFile::BlockType::Rollbacks ) + record.rollbacksStart;
+        const ReplayFile::InputsRecord *reinputs = _reader.getColumn<ReplayFile::InputsRecord> (
+                    ReplayFile::BlockType::Reinputs );
+
+        for ( uint32_t i = 0; i < record.numRollbacks; ++i )
+        {
+            const uint32_t frame = rollbacks[i].indexedFrame.parts.frame;
+
+            if ( frame >= _rollbacks[index].size() )
+            {
+                _rollbacks[index].resize ( frame + 1, MaxIndexedFrame );
+                _reinputs[index].resize ( frame + 1 );
+            }
+
+            _rollbacks[index][frame] = rollbacks[i].target;
+
+            const ReplayFile::InputsRecord *begin = reinputs + rollbacks[i].reinputsStart;
+
+            for ( const ReplayFile::InputsRecord *it = begin; it != begin + rollbacks[i].numReinputs; ++it )
+                _reinputs[index][frame].push_back ( { it->indexedFrame, it->p1, it->p2 } );
+        }
+    }
+
+    if ( index < _rngStates.size() && record.rngState != ReplayFile::None )
+    {
+        const ReplayFile::RngStateRecord& rng = _reader.getColumn<ReplayFile::RngStateRecord> (
+                ReplayFile::BlockType::RngStates ) [record.rngState];
+
+        RngState *rngState = new RngState ( 0 );
+
+        rngState->rngState0 = rng.rngState0;
+        rngState->rngState1 = rng.rngState1;
+        rngState->rngState2 = rng.rngState2;
+        copy ( rng.rngState3, rng.rngState3 + CC_RNG_STATE3_SIZE, rngState->rngState3.begin() );
+
+        _rngStates[index].reset ( rngState );
+    }
+}
+
 uint32_t ReplayManager::getGameMode ( IndexedFrame indexedFrame )
 {
     if ( indexedFrame.parts.index >= _modes.size() )
@@ -217,13 +381,10 @@ uint32_t ReplayManager::getGameMode ( IndexedFrame indexedFrame )
     return _modes[indexedFrame.parts.index];
 }
 
-const string& ReplayManager::getStateStr ( IndexedFrame indexedFrame )
+NetplayState ReplayManager::getState ( IndexedFrame indexedFrame ) const
 {
     if ( indexedFrame.parts.index >= _states.size() )
-    {
-        static const string empty;
-        return empty;
-    }
+        return NetplayState::Unknown;
 
     return _states[indexedFrame.parts.index];
 }
@@ -254,6 +415,8 @@ const ReplayManager::Inputs& ReplayManager::getInputs ( IndexedFrame indexedFram
         return empty;
     }
 
+    decode ( indexedFrame.parts.index );
+
     if ( indexedFrame.parts.index >= _inputs.size()
             || indexedFrame.parts.frame >= _inputs[indexedFrame.parts.index].size() )
     {
@@ -265,6 +428,8 @@ const ReplayManager::Inputs& ReplayManager::getInputs ( IndexedFrame indexedFram
 
 IndexedFrame ReplayManager::getRollbackTarget ( IndexedFrame indexedFrame )
 {
+    decode ( indexedFrame.parts.index );
+
     if ( indexedFrame.parts.index >= _rollbacks.size()
             || indexedFrame.parts.frame >= _rollbacks[indexedFrame.parts.index].size() )
     {
@@ -276,6 +441,8 @@ IndexedFrame ReplayManager::getRollbackTarget ( IndexedFrame indexedFrame )
 
 const vector<ReplayManager::Inputs>& ReplayManager::getReinputs ( IndexedFrame indexedFrame )
 {
+    decode ( indexedFrame.parts.index );
+
     if ( indexedFrame.parts.index >= _reinputs.size()
             || indexedFrame.parts.frame >= _reinputs[indexedFrame.parts.index].size() )
     {
@@ -286,8 +453,42 @@ const vector<ReplayManager::Inputs>& ReplayManager::getReinputs ( IndexedFrame i
     return _reinputs[indexedFrame.parts.index][indexedFrame.parts.frame];
 }
 
+vector<uint16_t> ReplayManager::getPlayerInputs ( uint32_t index, uint8_t player ) const
+{
+    ASSERT ( player == 1 || player == 2 );
+
+    vector<uint16_t> inputs;
+
+    decode ( index );
+
+    if ( index >= _inputs.size() )
+        return inputs;
+
+    inputs.reserve ( _inputs[index].size() );
+
+    for ( const Inputs& i : _inputs[index] )
+        inputs.push_back ( player == 1 ? i.p1 : i.p2 );
+
+    if ( index >= _reinputs.size() )
+        return inputs;
+
+    // Later reinputs override earlier inputs for the same frame
+    for ( const vector<Inputs>& reinputs : _reinputs[index] )
+    {
+        for ( const Inputs& i : reinputs )
+        {
+            if ( i.indexedFrame.parts.index == index && i.indexedFrame.parts.frame < inputs.size() )
+                inputs[i.indexedFrame.parts.frame] = ( player == 1 ? i.p1 : i.p2 );
+        }
+    }
+
+    return inputs;
+}
+
 MsgPtr ReplayManager::getRngState ( IndexedFrame indexedFrame )
 {
+    decode ( indexedFrame.parts.index );
+
     if ( indexedFrame.parts.index >= _rngStates.size() )
         return 0;
 
@@ -307,6 +508,8 @@ uint32_t ReplayManager::getLastFrame() const
     if ( _inputs.empty() )
         return 0;
 
+    decode ( _inputs.size() - 1 );
+
     if ( _inputs.back().empty() )
         return 0;
 
@@ -315,13 +518,28 @@ uint32_t ReplayManager::getLastFrame() const
 
 MsgPtr ReplayManager::getInitialStateBefore ( uint32_t index ) const
 {
-    for ( int i = _initialStates.size() - 1; i >= 0; --i )
-    {
-        ASSERT ( _initialStates[i].get() != 0 );
+    if ( index == 0 )
+        return 0;
 
-        if ( _initialStates[i]->getAs<InitialGameState>().indexedFrame.parts.index < index )
-            return _initialStates[i];
-    }
+    return getCheckpointBefore ( {{ 0, index - 1 }} );
+}
+
+// Compare an index with the index of an initial state
+static bool isBeforeInitialState ( uint32_t index, const MsgPtr& msg )
+{
+    ASSERT ( msg.get() != 0 );
+
+    return index < msg->getAs<InitialGameState>().indexedFrame.parts.index;
+}
+
+MsgPtr ReplayManager::getCheckpointBefore ( IndexedFrame indexedFrame ) const
+{
+    // Find the first initial state after the index, the one before it is the checkpoint
+    const auto it = upper_bound ( _initialStates.begin(), _initialStates.end(), indexedFrame.parts.index,
+                                  isBeforeInitialState );
+
+    if ( it == _initialStates.begin() )
+        return 0;
 
-    return 0;
+    return * ( it - 1 );
 }
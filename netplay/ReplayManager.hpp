@@ -2,9 +2,13 @@
 
 #include "Constants.hpp"
 #include "Protocol.hpp"
+#include "ReplayFile.hpp"
+#include "MappedFile.hpp"
+#include "NetplayStates.hpp"
 
 #include <string>
 #include <vector>
+#include <memory>
 
 
 class ReplayManager
@@ -17,11 +21,14 @@ public:
         uint16_t p1, p2;
     };
 
+    // Load either a text replay generated by scripts/sync2replay, or a binary replay converted from one.
+    // Binary replays are mapped, and each index is only decoded when it is first accessed.
     bool load ( const std::string& replayFile, bool real );
 
     uint32_t getGameMode ( IndexedFrame indexedFrame );
 
-    const std::string& getStateStr ( IndexedFrame indexedFrame );
+    // Returns NetplayState::Unknown if the index has no state
+    NetplayState getState ( IndexedFrame indexedFrame ) const;
 
     const Inputs& getInputs ( IndexedFrame indexedFrame );
 
@@ -29,27 +36,53 @@ public:
 
     const std::vector<Inputs>& getReinputs ( IndexedFrame indexedFrame );
 
+    // Get the actual inputs of a player for a whole transition index, ie with the reinputs applied
+    std::vector<uint16_t> getPlayerInputs ( uint32_t index, uint8_t player ) const;
+
     MsgPtr getRngState ( IndexedFrame indexedFrame );
 
     uint32_t getLastIndex() const;
 
     uint32_t getLastFrame() const;
 
+    // Get the initial state of the last game that started before the given index
     MsgPtr getInitialStateBefore ( uint32_t index ) const;
 
+    // Get the checkpoint to start playback from to reach the given index:frame as soon as possible, which is the
+    // initial state of the game containing it. Inputs and RngStates are located per index, so with this seeking
+    // only needs to fast-forward within one game. Returns null if there is no game before the index:frame.
+    MsgPtr getCheckpointBefore ( IndexedFrame indexedFrame ) const;
+
 private:
 
     std::vector<uint32_t> _modes;
 
-    std::vector<std::string> _states;
+    std::vector<NetplayState> _states;
 
-    std::vector<std::vector<Inputs>> _inputs;
+    // These are decoded lazily for binary replays, so they are mutable
+    mutable std::vector<std::vector<Inputs>> _inputs;
 
-    std::vector<MsgPtr> _rngStates;
+    mutable std::vector<MsgPtr> _rngStates;
 
-    std::vector<std::vector<IndexedFrame>> _rollbacks;
+    mutable std::vector<std::vector<IndexedFrame>> _rollbacks;
 
-    std::vector<std::vector<std::vector<Inputs>>> _reinputs;
+    mutable std::vector<std::vector<std::vector<Inputs>>> _reinputs;
 
+    // Initial state of each game, in order of index, so they can be searched in O(log n)
     std::vector<MsgPtr> _initialStates;
+
+    // Mapped binary replay, null for text replays
+    std::shared_ptr<MappedFile> _mapped;
+
+    ReplayFile::Reader _reader;
+
+    bool _real = false;
+
+    // Indices of the binary replay that have already been decoded
+    mutable std::vector<bool> _decoded;
+
+    bool loadBinary ( bool real );
+
+    // Decode the records of an index of the binary replay, if it hasn't been decoded yet
+    void decode ( uint32_t index ) const;
 };
@@ -0,0 +1,287 @@
+#include "ReplayRecorder.hpp"
+#include "Compression.hpp"
+#include "Logger.hpp"
+
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+
+namespace ReplayFile
+{
+
+static const char RecordMagic[MagicSize] = { 'C', 'C', 'R', 'E', 'C', 'O', 'R', 'D' };
+
+// Max block size accepted when reading, so a corrupt file can't allocate too much
+#define MAX_RECORD_BLOCK_SIZE ( 16 * 1024 * 1024 )
+
+// The records are copied byte for byte, so their layout is part of the format
+static_assert ( sizeof ( RecordFileHeader ) == 16, "RecordFileHeader layout changed" );
+static_assert ( sizeof ( RecordBlockHeader ) == 8, "RecordBlockHeader layout changed" );
+static_assert ( sizeof ( RollbackFrameRecord ) == 16, "RollbackFrameRecord layout changed" );
+static_assert ( sizeof ( SyncHashRecord ) == 40 + 2 * 44, "SyncHashRecord layout changed" );
+
+
+size_t getRecordSize ( RecordType type )
+{
+    switch ( type )
+    {
+        case RecordType::Inputs:
+        case RecordType::Reinputs:
+            return sizeof ( InputsRecord );
+
+        case RecordType::Rollback:
+            return sizeof ( RollbackFrameRecord );
+
+        case RecordType::RngState:
+            return sizeof ( RngStateRecord );
+
+        case RecordType::SyncHash:
+            return sizeof ( SyncHashRecord );
+
+        default:
+            return 0;
+    }
+}
+
+bool isRecording ( const char *data, size_t size )
+{
+    return ( size >= MagicSize && ! memcmp ( data, RecordMagic, MagicSize ) );
+}
+
+
+void Recorder::Worker::run()
+{
+    context.runWorker();
+}
+
+Recorder::Recorder() : _worker ( *this ) {}
+
+Recorder::~Recorder()
+{
+    stop();
+}
+
+bool Recorder::start ( const string& file )
+{
+    stop();
+
+    _fd = fopen ( file.c_str(), "wb" );
+
+    if ( ! _fd )
+    {
+        LOG ( "Failed to open '%s'", file );
+        return false;
+    }
+
+    RecordFileHeader header;
+    memcpy ( header.magic, RecordMagic, MagicSize );
+    header.version = RecordVersion;
+    header.blockSize = BlockSize;
+
+    fwrite ( &header, sizeof ( header ), 1, _fd );
+
+    _pool.reset ( new char[NumBlocks * BlockSize] );
+
+    _current = { _pool.get(), 0 };
+
+    for ( size_t i = 1; i < NumBlocks; ++i )
+        _free.push ( { _pool.get() + i * BlockSize, 0 } );
+
+    _numStalls = 0;
+
+    _worker.start();
+
+    LOG ( "Recording to '%s'", file );
+    return true;
+}
+
+void Recorder::stop()
+{
+    if ( ! _fd )
+        return;
+
+    if ( _current.size )
+        post ( _current );
+
+    _current = { 0, 0 };
+
+    // A block without data tells the worker to stop after writing the remaining blocks
+    post ( { 0, 0 } );
+
+    _worker.join();
+
+    // All the blocks are back in the free queue now
+    Block block;
+    while ( _free.pop ( block ) )
+        ;
+
+    _pool.reset();
+
+    fclose ( _fd );
+    _fd = 0;
+
+    LOG ( "Stopped recording: numStalls=%u", _numStalls );
+}
+
+void Recorder::nextBlock()
+{
+    if ( _current.size )
+        post ( _current );
+
+    if ( _free.pop ( _current ) )
+        return;
+
+    // The worker is behind, so wait until it frees a block, this bounds the memory used
+    ++_numStalls;
+
+    LOCK ( _mutex );
+
+    while ( ! _free.pop ( _current ) )
+        _freed.wait ( _mutex );
+}
+
+void Recorder::post ( const Block& block )
+{
+    // There are only NumBlocks blocks, plus the stop block, so this never fails
+    const bool pushed = _full.push ( block );
+
+    ASSERT ( pushed == true );
+
+    LOCK ( _mutex );
+    _posted.signal();
+}
+
+void Recorder::runWorker()
+{
+    vector<char> buffer ( compressBound ( BlockSize ) );
+
+    Block block;
+
+    for ( ;; )
+    {
+        if ( ! _full.pop ( block ) )
+        {
+            LOCK ( _mutex );
+
+            if ( _full.empty() )
+                _posted.wait ( _mutex );
+
+            continue;
+        }
+
+        if ( ! block.data )
+            return;
+
+        RecordBlockHeader header;
+        header.size = block.size;
+        header.compressedSize = compress ( block.data, block.size, &buffer[0], buffer.size(), CompressionLevel );
+
+        // Store the block as is if it doesn't compress
+        if ( header.compressedSize >= header.size )
+            header.compressedSize = 0;
+
+        fwrite ( &header, sizeof ( header ), 1, _fd );
+
+        if ( header.compressedSize )
+            fwrite ( &buffer[0], header.compressedSize, 1, _fd );
+        else
+            fwrite ( block.data, block.size, 1, _fd );
+
+        block.size = 0;
+
+        const bool pushed = _free.push ( block );
+
+        ASSERT ( pushed == true );
+
+        LOCK ( _mutex );
+        _freed.signal();
+    }
+}
+
+
+bool RecordReader::open ( const string& file, string& error )
+{
+    ifstream fin ( file.c_str(), ios::binary );
+
+    if ( ! fin.good() )
+    {
+        error = "Failed to open file";
+        return false;
+    }
+
+    RecordFileHeader header;
+
+    if ( ! fin.read ( ( char * ) &header, sizeof ( header ) )
+            || memcmp ( header.magic, RecordMagic, MagicSize ) || header.version != RecordVersion )
+    {
+        error = "Invalid header";
+        return false;
+    }
+
+    _records.clear();
+    _position = 0;
+
+    vector<char> buffer;
+
+    RecordBlockHeader block;
+
+    while ( fin.read ( ( char * ) &block, sizeof ( block ) ) )
+    {
+        if ( block.size > MAX_RECORD_BLOCK_SIZE || block.compressedSize > MAX_RECORD_BLOCK_SIZE )
+        {
+            error = "Invalid block size";
+            return false;
+        }
+
+        const size_t start = _records.size();
+
+        _records.resize ( start + block.size );
+
+        if ( ! block.compressedSize )
+        {
+            if ( block.size && ! fin.read ( &_records[start], block.size ) )
+            {
+                error = "Truncated block";
+                return false;
+            }
+
+            continue;
+        }
+
+        buffer.resize ( block.compressedSize );
+
+        if ( ! fin.read ( &buffer[0], block.compressedSize )
+                || uncompress ( &buffer[0], block.compressedSize, &_records[start], block.size ) != block.size )
+        {
+            error = "Invalid compressed block";
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RecordReader::next ( RecordType& type, const char *& payload )
+{
+    if ( _position >= _records.size() )
+        return false;
+
+    type = ( RecordType ) _records[_position];
+
+    const size_t size = getRecordSize ( type );
+
+    // A record that doesn't fit means the file is truncated or corrupt
+    if ( ! size || _position + 1 + size > _records.size() )
+    {
+        _position = _records.size();
+        return false;
+    }
+
+    payload = &_records[_position + 1];
+    _position += 1 + size;
+    return true;
+}
+
+} // namespace ReplayFile
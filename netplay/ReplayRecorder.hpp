@@ -0,0 +1,228 @@
+#pragma once
+
+#include "ReplayFile.hpp"
+#include "SpscQueue.hpp"
+#include "Thread.hpp"
+
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+
+// Streaming replay recorder, which writes records in a compact binary framing instead of formatted text.
+//
+// Each record is a one byte RecordType followed by a fixed size payload for that type. Records are appended to
+// fixed size blocks on the calling thread, which is only a memcpy. Full blocks are compressed and written to the
+// file by a worker thread, then returned to a fixed pool of blocks, so memory is bounded no matter how long the
+// session is. The file is a RecordFileHeader followed by blocks of [RecordBlockHeader][data].
+namespace ReplayFile
+{
+
+// Current version of the recording format
+const uint32_t RecordVersion = 1;
+
+enum class RecordType : uint8_t
+{
+    Inputs = 0,
+    Reinputs,
+    Rollback,
+    RngState,
+    SyncHash,
+
+    // Number of record types
+    Count
+};
+
+struct RecordFileHeader
+{
+    char magic[MagicSize];
+    uint32_t version;
+    uint32_t blockSize;
+};
+
+struct RecordBlockHeader
+{
+    // Size of the block before compression, and the compressed size, which is 0 if the block is stored as is
+    uint32_t size, compressedSize;
+};
+
+// Rollback from indexedFrame to target, the Reinputs records that follow are the re-run frames
+struct RollbackFrameRecord
+{
+    IndexedFrame indexedFrame;
+    IndexedFrame target;
+};
+
+// Same layout as the SyncHash message, which isn't included since it depends on the Windows headers
+struct SyncHashRecord
+{
+    IndexedFrame indexedFrame;
+
+    char hash[16];
+
+    uint32_t roundTimer, realTimer;
+
+    int32_t cameraX, cameraY;
+
+    struct CharaHash
+    {
+        uint32_t seq, seqState, health, redHealth, meter, heat;
+        float guardBar, guardQuality;
+        int32_t x, y;
+        uint16_t chara, moon;
+    };
+
+    CharaHash chara[2];
+};
+
+// Get the payload size of a record type, 0 if the type is invalid
+size_t getRecordSize ( RecordType type );
+
+// Check if the data starts like a recording
+bool isRecording ( const char *data, size_t size );
+
+
+class Recorder
+{
+public:
+
+    // Size of each block before compression, and the number of blocks in the pool
+    static const size_t BlockSize = 64 * 1024;
+    static const size_t NumBlocks = 8;
+
+    // Fastest zlib level, streaming only needs to keep up with the session, the inputs compress well anyway
+    static const int CompressionLevel = 1;
+
+    Recorder();
+    ~Recorder();
+
+    // Start recording to the given file, returns false if it can't be opened
+    bool start ( const std::string& file );
+
+    // Write the remaining records and close the file
+    void stop();
+
+    bool isRecording() const { return ( _fd != 0 ); }
+
+    void inputs ( IndexedFrame indexedFrame, uint16_t p1, uint16_t p2 )
+    {
+        const InputsRecord record = { indexedFrame, p1, p2, 0 };
+        append ( RecordType::Inputs, &record, sizeof ( record ) );
+    }
+
+    void reinputs ( IndexedFrame indexedFrame, uint16_t p1, uint16_t p2 )
+    {
+        const InputsRecord record = { indexedFrame, p1, p2, 0 };
+        append ( RecordType::Reinputs, &record, sizeof ( record ) );
+    }
+
+    void rollback ( IndexedFrame indexedFrame, IndexedFrame target )
+    {
+        const RollbackFrameRecord record = { indexedFrame, target };
+        append ( RecordType::Rollback, &record, sizeof ( record ) );
+    }
+
+    void rngState ( const RngStateRecord& record )
+    {
+        append ( RecordType::RngState, &record, sizeof ( record ) );
+    }
+
+    void syncHash ( const SyncHashRecord& record )
+    {
+        append ( RecordType::SyncHash, &record, sizeof ( record ) );
+    }
+
+    // Number of times the recorder had to wait for the worker because all the blocks were full
+    size_t getNumStalls() const { return _numStalls; }
+
+private:
+
+    struct Block
+    {
+        char *data;
+        size_t size;
+    };
+
+    // Worker thread that compresses and writes the full blocks, a block without data tells it to stop
+    THREAD ( Worker, Recorder );
+
+    Worker _worker;
+
+    std::unique_ptr<char[]> _pool;
+
+    // Full blocks waiting to be written, with extra space for the stop block
+    SpscQueue<Block, NumBlocks + 1> _full;
+
+    // Blocks that have been written and can be reused
+    SpscQueue<Block, NumBlocks> _free;
+
+    // Signalled when a block is posted to the worker, and when a block is freed by the worker
+    Mutex _mutex;
+    CondVar _posted, _freed;
+
+    // Block currently being filled, only used by the recording thread
+    Block _current = { 0, 0 };
+
+    FILE *_fd = 0;
+
+    size_t _numStalls = 0;
+
+    // Append a record to the current block, posting it to the worker if it is full
+    void append ( RecordType type, const void *payload, size_t size )
+    {
+        if ( ! _fd )
+            return;
+
+        if ( _current.size + 1 + size > BlockSize )
+            nextBlock();
+
+        _current.data[_current.size] = ( char ) type;
+        memcpy ( _current.data + _current.size + 1, payload, size );
+        _current.size += 1 + size;
+    }
+
+    // Post the current block to the worker if it isn't empty, then take a free block, waiting if there are none
+    void nextBlock();
+
+    // Post a block to the worker
+    void post ( const Block& block );
+
+    // Compress and write the blocks until stopped, this runs on the worker thread
+    void runWorker();
+
+    // Disable copy
+    Recorder ( const Recorder& );
+    const Recorder& operator= ( const Recorder& );
+};
+
+
+// Reads a recording made by Recorder, all the blocks are decompressed when opening, so this is meant for tools
+class RecordReader
+{
+public:
+
+    // Read and decompress the whole file, returns false on error
+    bool open ( const std::string& file, std::string& error );
+
+    // Get the next record, returns false at the end. The payload points into the reader, and may be unaligned.
+    bool next ( RecordType& type, const char *& payload );
+
+    // Copy a payload into the record struct of its type
+    template<typename T>
+    static T get ( const char *payload )
+    {
+        T t;
+        memcpy ( &t, payload, sizeof ( t ) );
+        return t;
+    }
+
+private:
+
+    std::string _records;
+
+    size_t _position = 0;
+};
+
+} // namespace ReplayFile
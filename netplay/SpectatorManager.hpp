@@ -11,9 +11,29 @@
 // Default pending socket timeout
 #define DEFAULT_PENDING_TIMEOUT ( 20000 )
 
+// Number of frames between each RelayStatus sent to spectators
+#define RELAY_STATUS_INTERVAL ( 120 )
+
+// Milliseconds of latency that each spectator relayed by a spectator is worth, when choosing where to redirect.
+// This balances the spectator tree, while still preferring spectators with a lower latency.
+#define RELAY_SPECTATOR_COST ( 20 )
+
+// Latency assumed for spectators that haven't replied to a RelayStatus yet
+#define RELAY_UNKNOWN_LATENCY ( 200 )
+
+// Number of frames behind the current frame, before a spectator is sent large blocks of inputs to catch up
+#define CATCH_UP_THRESHOLD ( 5 * 60 )
+
+// Maximum number of frames of inputs in each block sent to spectators that are catching up
+#define CATCH_UP_BLOCK_FRAMES ( 5 * 60 )
+
+// Number of frames between each block sent to spectators that are catching up
+#define CATCH_UP_INTERVAL ( 6 )
+
 
 // Forward declarations
 struct RngState;
+struct RelayStatus;
 struct NetplayManager;
 struct ProcessManager;
 
@@ -28,10 +48,28 @@ struct Spectator
 
     IpAddrPort serverAddr;
 
+    // Number of spectators relayed by this spectator, including indirectly
+    uint32_t relayed = 0;
+
+    // Smoothed latency in milliseconds measured with RelayStatus, UINT_MAX if not measured yet
+    uint32_t latency = UINT_MAX;
+
     std::list<Socket *>::iterator it;
 };
 
 
+// A message encoded once, and sent as is to every spectator that needs it
+struct EncodedMsg
+{
+    MsgPtr msg;
+
+    std::string buffer;
+
+    // Spectator position after sending the message, only for BothInputs
+    IndexedFrame next = {{ 0, 0 }};
+};
+
+
 class SpectatorManager
 {
 public:
@@ -61,7 +99,15 @@ public:
 
     void popSpectator ( Socket *socket );
 
-    const IpAddrPort& getRandomSpectatorAddress() const;
+    // Number of spectators relayed by this client, ie all the spectators in the tree below this client
+    uint32_t numRelayed() const;
+
+    // Get the spectator server address to redirect a new spectator to, or NullAddress if there are none.
+    // This is the spectator with the lowest latency and the fewest relayed spectators, which is then counted as
+    // relaying one more spectator until its next RelayStatus.
+    const IpAddrPort& getRelayAddress();
+
+    void gotRelayStatus ( Socket *socket, const RelayStatus& relayStatus );
 
 
     void newRngState ( const RngState& rngState );
@@ -70,6 +116,21 @@ public:
 
 private:
 
+    // Get the messages to send this frame, each is only encoded once per frame
+    const EncodedMsg& getEncodedBothInputs ( IndexedFrame pos );
+
+    const EncodedMsg& getEncodedRngState ( uint32_t index );
+
+    const EncodedMsg& getEncodedMenuIndex ( uint32_t index );
+
+    const EncodedMsg& getEncodedBothInputsBlock ( IndexedFrame pos );
+
+    // True if the spectator is far enough behind that it should be sent blocks of inputs
+    bool isCatchingUp ( const Spectator& spectator ) const;
+
+    // Send the next inputs to a spectator, as a block if catching up, and the RngState / retry menu index once
+    void sendInputs ( Socket *socket, Spectator& spectator, bool catchUp );
+
     std::unordered_map<Socket *, SocketPtr> _pendingSockets;
 
     std::unordered_map<Socket *, TimerPtr> _pendingSocketTimers;
@@ -82,10 +143,14 @@ private:
 
     std::list<Socket *>::iterator _spectatorListPos;
 
-    std::unordered_map<Socket *, Spectator>::const_iterator _spectatorMapPos;
-
     uint32_t _currentMinIndex = UINT_MAX;
 
+    // Messages encoded this frame, BothInputs(Block) are keyed by the spectator position before sending,
+    // RngStates and retry menu indices are keyed by transition index.
+    std::unordered_map<uint64_t, EncodedMsg> _encodedBothInputs, _encodedBlocks;
+
+    std::unordered_map<uint32_t, EncodedMsg> _encodedRngStates, _encodedMenuIndices;
+
     NetplayManager *_netManPtr = 0;
 
     const ProcessManager *_procManPtr = 0;
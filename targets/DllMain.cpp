@@ -16,6 +16,9 @@
 #include "DllFrameRate.hpp"
 #include "ReplayManager.hpp"
 #include "DllRollbackManager.hpp"
+#include "ReplayRecorder.hpp"
+#include "FlightRecorder.hpp"
+#include "JitterBuffer.hpp"
 
 #include <windows.h>
 
@@ -47,11 +50,14 @@ using namespace std;
 // The maximum number of milliseconds to wait for inputs before timeout
 #define MAX_WAIT_INPUTS_INTERVAL    ( 10000 )
 
-// The maximum number of spectators allowed for ClientMode::Spectate
+// The maximum number of spectators allowed for ClientMode::Spectate, ie the fan-out of the spectator tree
 #define MAX_SPECTATORS              ( 15 )
 
-// The maximum number of spectators allowed for ClientMode::Host/Client
-#define MAX_ROOT_SPECTATORS         ( 1 )
+// The maximum number of spectators allowed for ClientMode::Host/Client, further spectators are relayed by these
+#define MAX_ROOT_SPECTATORS         ( 2 )
+
+// The number of frames between each rendered frame while a spectator is catching up
+#define SPECTATE_CATCH_UP_RENDER    ( 30 )
 
 // Indicates if this client should redirect spectators
 #define SHOULD_REDIRECT_SPECTATORS  ( clientMode.isSpectate()                                                       \
@@ -59,10 +65,16 @@ using namespace std;
                                       : numSpectators() >= MAX_ROOT_SPECTATORS )
 
 
+// Log to the sync log, and to the flight recorder even when logging is disabled
 #define LOG_SYNC(FORMAT, ...)                                                                                       \
-    LOG_TO ( syncLog, "%s [%u] %s [%s] " FORMAT,                                                                    \
-             gameModeStr ( *CC_GAME_MODE_ADDR ), *CC_GAME_MODE_ADDR,                                                \
-             netMan.getState(), netMan.getIndexedFrame(), ## __VA_ARGS__ )
+    do {                                                                                                            \
+        LOG_TO ( syncLog, "%s [%u] %s [%s] " FORMAT,                                                                \
+                 gameModeStr ( *CC_GAME_MODE_ADDR ), *CC_GAME_MODE_ADDR,                                            \
+                 netMan.getState(), netMan.getIndexedFrame(), ## __VA_ARGS__ );                                     \
+        FlightRecorder::get().log ( FlightChannel::Sync, "%s [%u] %s [%s] " FORMAT,                                 \
+                                    gameModeStr ( *CC_GAME_MODE_ADDR ), *CC_GAME_MODE_ADDR,                         \
+                                    netMan.getState(), netMan.getIndexedFrame(), ## __VA_ARGS__ );                  \
+    } while ( 0 )
 
 #define LOG_SYNC_CHARACTER(N)                                                                                       \
     LOG_SYNC ( "P%u: C=%u; M=%u; c=%u; seq=%u; st=%u; hp=%u; rh=%u; gb=%.1f; gq=%.1f; mt=%u; ht=%u; x=%d; y=%d",    \
@@ -105,6 +117,9 @@ struct DllMain
     // DllRollbackManager instance
     DllRollbackManager rollMan;
 
+    // Streaming recorder for the inputs, rollbacks, RngStates, and SyncHashes of this session
+    ReplayFile::Recorder replayRec;
+
     // If remote has loaded up to character select
     bool remoteCharaSelectLoaded = false;
 
@@ -157,6 +172,15 @@ struct DllMain
     // If we should fast-forward when spectating
     bool spectateFastFwd = true;
 
+    // Spectator playout buffer, which adjusts the playback speed to keep a smooth lead over the remote inputs
+    JitterBuffer jitterBuffer;
+
+    // Transition index measured by the playout buffer, it starts over for each index
+    uint32_t jitterBufferIndex = 0;
+
+    // If we should show the spectator playout buffer stats
+    bool showJitterStats = false;
+
     // The minimum number of frames that must run normally, before we're allowed to do another rollback
     uint8_t minRollbackSpacing = 2;
 
@@ -164,6 +188,12 @@ struct DllMain
     // Local and remote SyncHashes
     list<MsgPtr> localSync, remoteSync;
 
+    // Local and remote hashes of confirmed rollback states
+    list<MsgPtr> localStateHashes, remoteStateHashes;
+
+    // Frames left to locate a state desync before stopping, 0 if there is no state desync
+    uint32_t stateDesyncTimer = 0;
+
     // Debug testing flags
     bool randomInputs = false;
     bool randomDelay = false;
@@ -175,10 +205,67 @@ struct DllMain
     bool replayInputs = false;
     uint32_t replaySpeed = 2;
     IndexedFrame replayStop = MaxIndexedFrame;
+    IndexedFrame replaySeek = {{ 0, 0 }};
     IndexedFrame replayCheck = MaxIndexedFrame;
     string replayCheckRngHexStr;
 #endif // NOT RELEASE
 
+    // Record a frame event with the current inputs in the flight recorder
+    void recordFrame ( FlightFrame event, IndexedFrame target = {{ 0, 0 }} )
+    {
+        const FlightFrameEvent record =
+        {
+            netMan.getIndex(), netMan.getFrame(), target.parts.index, target.parts.frame,
+            netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ), event
+        };
+
+        FlightRecorder::get().frame ( record );
+    }
+
+    // Record a rollback that was just loaded, from fastFwdStopFrame to the current frame, and its first reinputs
+    void recordRollback()
+    {
+        replayRec.rollback ( fastFwdStopFrame, netMan.getIndexedFrame() );
+        replayRec.reinputs ( netMan.getIndexedFrame(), netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+
+        recordFrame ( FlightFrame::Rollback, fastFwdStopFrame );
+    }
+
+    void recordRngState ( const RngState& rngState )
+    {
+        static_assert ( sizeof ( rngState.rngState3 ) == ReplayFile::RngState3Size, "RngState3 size changed" );
+
+        ReplayFile::RngStateRecord record;
+        record.index = rngState.index;
+        record.rngState0 = rngState.rngState0;
+        record.rngState1 = rngState.rngState1;
+        record.rngState2 = rngState.rngState2;
+        memcpy ( record.rngState3, &rngState.rngState3[0], sizeof ( record.rngState3 ) );
+
+        replayRec.rngState ( record );
+
+        recordFrame ( FlightFrame::RngState );
+    }
+
+    void recordSyncHash ( const SyncHash& syncHash )
+    {
+        static_assert ( sizeof ( syncHash.chara ) == sizeof ( ReplayFile::SyncHashRecord::chara ),
+                        "SyncHash::CharaHash layout changed" );
+
+        ReplayFile::SyncHashRecord record;
+        record.indexedFrame = syncHash.indexedFrame;
+        memcpy ( record.hash, syncHash.hash, sizeof ( record.hash ) );
+        record.roundTimer = syncHash.roundTimer;
+        record.realTimer = syncHash.realTimer;
+        record.cameraX = syncHash.cameraX;
+        record.cameraY = syncHash.cameraY;
+        memcpy ( record.chara, &syncHash.chara[0], sizeof ( record.chara ) );
+
+        replayRec.syncHash ( record );
+
+        recordFrame ( FlightFrame::SyncHash, syncHash.indexedFrame );
+    }
+
     void frameStepNormal()
     {
         switch ( netMan.getState().value )
@@ -206,15 +293,56 @@ struct DllMain
             case NetplayState::Skippable:
             case NetplayState::RetryMenu:
             {
-                // Fast-forward if spectator
-                if ( spectateFastFwd && clientMode.isSpectate() && netMan.getState() != NetplayState::Loading )
+                // Playout buffer and fast-forward if spectator
+                if ( clientMode.isSpectate() && netMan.getState() != NetplayState::Loading )
                 {
                     static bool doneSkipping = true;
 
                     const IndexedFrame remoteIndexedFrame = netMan.getRemoteIndexedFrame();
+                    const IndexedFrame localIndexedFrame = netMan.getIndexedFrame();
 
+                    const uint32_t remoteIndex = remoteIndexedFrame.parts.index;
+                    const uint32_t remoteFrame = remoteIndexedFrame.parts.frame;
+                    const uint32_t localIndex = localIndexedFrame.parts.index;
+                    const uint32_t localFrame = localIndexedFrame.parts.frame;
+
+                    if ( localIndex != jitterBufferIndex )
+                    {
+                        jitterBuffer.clear();
+                        jitterBufferIndex = localIndex;
+                    }
+
+                    // Adjust the playback speed to keep the target number of frames buffered, instead of stalling.
+                    // The depth is only known within the same index, otherwise play at the normal speed.
+                    if ( remoteIndex == localIndex && remoteFrame >= localFrame )
+                        DllFrameRate::desiredFps = jitterBuffer.update ( remoteFrame - localFrame );
+                    else
+                        DllFrameRate::desiredFps = 60.0;
+
+                    DllOverlayUi::statsText = ( showJitterStats ? jitterBuffer.str() : "" );
+
+                    // Far behind, eg when joining late, so only render occasionally, which removes the fps limit.
+                    // This is the same threshold as the remote uses to send blocks of inputs to catch up.
+                    const bool isCatchingUp = ( remoteIndex > localIndex + 1 )
+                        || ( remoteIndex == localIndex + 1 && remoteFrame >= CATCH_UP_THRESHOLD )
+                        || ( remoteIndex == localIndex && remoteFrame > localFrame + CATCH_UP_THRESHOLD );
+
+                    // Far enough ahead of the playout buffer target that adjusting the speed isn't enough
+                    const uint32_t fastFwdFrames = jitterBuffer.getTarget() + 2 * NUM_INPUTS;
+
+                    if ( !spectateFastFwd )
+                    {
+                        doneSkipping = true;
+                    }
+                    else if ( isCatchingUp )
+                    {
+                        if ( localFrame % SPECTATE_CATCH_UP_RENDER )
+                            *CC_SKIP_FRAMES_ADDR = 1;
+
+                        doneSkipping = true;
+                    }
                     // Fast-forward implemented by skipping the rendering every other frame
-                    if ( doneSkipping && remoteIndexedFrame.value > netMan.getIndexedFrame().value + 2 * NUM_INPUTS )
+                    else if ( doneSkipping && remoteIndexedFrame.value > localIndexedFrame.value + fastFwdFrames )
                     {
                         *CC_SKIP_FRAMES_ADDR = 1;
                         doneSkipping = false;
@@ -300,6 +428,9 @@ struct DllMain
                 {
                     if ( KeyboardState::isPressed ( VK_SPACE ) )
                         spectateFastFwd = !spectateFastFwd;
+
+                    if ( KeyboardState::isPressed ( VK_F1 ) )
+                        showJitterStats = !showJitterStats;
                 }
                 else
                 {
@@ -317,8 +448,8 @@ struct DllMain
                     if ( repMan.getGameMode ( netMan.getIndexedFrame() ) )
                         ASSERT ( repMan.getGameMode ( netMan.getIndexedFrame() ) == *CC_GAME_MODE_ADDR );
 
-                    if ( ! repMan.getStateStr ( netMan.getIndexedFrame() ).empty() )
-                        ASSERT ( repMan.getStateStr ( netMan.getIndexedFrame() ) == netMan.getState().str() );
+                    if ( repMan.getState ( netMan.getIndexedFrame() ) != NetplayState::Unknown )
+                        ASSERT ( repMan.getState ( netMan.getIndexedFrame() ) == netMan.getState() );
 
                     // Inputs
                     const auto& inputs = repMan.getInputs ( netMan.getIndexedFrame() );
@@ -354,12 +485,16 @@ struct DllMain
                             LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                                      before, target, netMan.getIndexedFrame() );
 
+                            recordRollback();
+
                             LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
                             return;
                         }
 
                         LOG_TO ( syncLog, "%s Rollback to target=[%s] failed!", before, target );
 
+                        recordFrame ( FlightFrame::RollbackFailed, target );
+
                         ASSERT_IMPOSSIBLE;
                     }
 
@@ -486,6 +621,9 @@ struct DllMain
         if ( rollbackTimer == minRollbackSpacing )
             netMan.clearLastChangedFrame();
 
+        // If this frame had to wait for inputs
+        bool stalled = false;
+
         for ( ;; )
         {
             // Poll until we are ready to run
@@ -508,6 +646,13 @@ struct DllMain
                 // Continue if ready
                 if ( ready )
                     break;
+
+                // Count each frame that had to wait for inputs once
+                if ( ! stalled )
+                {
+                    jitterBuffer.stalled();
+                    stalled = true;
+                }
             }
             else
             {
@@ -558,6 +703,8 @@ struct DllMain
                 LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                          before, netMan.getLastChangedFrame(), netMan.getIndexedFrame() );
 
+                recordRollback();
+
                 LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
 
                 netMan.clearLastChangedFrame();
@@ -566,6 +713,8 @@ struct DllMain
             }
 
             LOG_TO ( syncLog, "%s Rollback to target=[%s] failed!", before, netMan.getLastChangedFrame() );
+
+            recordFrame ( FlightFrame::RollbackFailed, netMan.getLastChangedFrame() );
         }
 
         // Update the RngState if necessary
@@ -589,7 +738,10 @@ struct DllMain
             MsgPtr msgRngState = netMan.getRngState();
 
             if ( msgRngState )
+            {
                 procMan.setRngState ( msgRngState->getAs<RngState>() );
+                recordRngState ( msgRngState->getAs<RngState>() );
+            }
         }
 
         // Update delay and/or rollback if necessary
@@ -649,6 +801,8 @@ struct DllMain
                         LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                                  before, netMan.getLastChangedFrame(), netMan.getIndexedFrame() );
 
+                        recordRollback();
+
                         LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
                         return;
                     }
@@ -696,6 +850,8 @@ struct DllMain
                     LOG_TO ( syncLog, "%s Rollback: target=[%s]; actual=[%s]",
                              before, target, netMan.getIndexedFrame() );
 
+                    recordRollback();
+
                     LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
 
                     --rollbackTimer;
@@ -703,6 +859,8 @@ struct DllMain
                 }
 
                 LOG_TO ( syncLog, "%s Rollback to target=[%s] failed!", before, target );
+
+                recordFrame ( FlightFrame::RollbackFailed, target );
             }
         }
 
@@ -719,6 +877,7 @@ struct DllMain
                 MsgPtr msgSyncHash ( new SyncHash ( netMan.getIndexedFrame() ) );
                 dataSocket->send ( msgSyncHash );
                 localSync.push_back ( msgSyncHash );
+                recordSyncHash ( msgSyncHash->getAs<SyncHash>() );
             }
         }
 
@@ -752,6 +911,10 @@ struct DllMain
             LOG_TO ( syncLog, "< %s", L.dump() );
             LOG_TO ( syncLog, "> %s", R.dump() );
 
+            recordFrame ( FlightFrame::Desync, L.indexedFrame );
+            FlightRecorder::get().text ( FlightChannel::Sync, ( "< " + L.dump() ).c_str() );
+            FlightRecorder::get().text ( FlightChannel::Sync, ( "> " + R.dump() ).c_str() );
+
 #undef L
 #undef R
 
@@ -763,6 +926,85 @@ struct DllMain
             return;
         }
 
+        // Stop once a state desync has been located, or we ran out of time waiting for the remote hashes
+        if ( stateDesyncTimer && --stateDesyncTimer == 0 )
+        {
+            syncLog.deinitialize();
+            delayedStop ( "Desync!" );
+
+            randomInputs = false;
+            localInputs [ clientMode.isLocal() ? 1 : 0 ] = 0;
+            return;
+        }
+
+        // Send hashes of confirmed rollback states
+        for ( MsgPtr msgStateHash = rollMan.getStateHash(); msgStateHash; msgStateHash = rollMan.getStateHash() )
+        {
+            if ( dataSocket && dataSocket->isConnected() )
+            {
+                dataSocket->send ( msgStateHash );
+                localStateHashes.push_back ( msgStateHash );
+            }
+        }
+
+        // Compare current lists of state hashes, these cover the whole game state of a confirmed frame
+        while ( !localStateHashes.empty() && !remoteStateHashes.empty() )
+        {
+
+#define L localStateHashes.front()->getAs<StateHash>()
+#define R remoteStateHashes.front()->getAs<StateHash>()
+
+            while ( !remoteStateHashes.empty() && L.indexedFrame.value > R.indexedFrame.value )
+                remoteStateHashes.pop_front();
+
+            if ( remoteStateHashes.empty() )
+                break;
+
+            while ( !localStateHashes.empty() && R.indexedFrame.value > L.indexedFrame.value )
+                localStateHashes.pop_front();
+
+            if ( localStateHashes.empty() )
+                break;
+
+            if ( L.hash == R.hash )
+            {
+                localStateHashes.pop_front();
+                remoteStateHashes.pop_front();
+                continue;
+            }
+
+            if ( stateDesyncTimer )
+                break;
+
+            LOG_TO ( syncLog, "Desync: state hash mismatch" );
+            LOG_TO ( syncLog, "< %s", L.str() );
+            LOG_TO ( syncLog, "> %s", R.str() );
+
+            recordFrame ( FlightFrame::Desync, L.indexedFrame );
+            FlightRecorder::get().text ( FlightChannel::Sync, ( "< " + L.str() ).c_str() );
+            FlightRecorder::get().text ( FlightChannel::Sync, ( "> " + R.str() ).c_str() );
+
+            // Exchange the hash tree nodes with the remote to locate the desynced memory ranges.
+            // Only the host starts, so there is a single drill-down, and the client waits for it.
+            if ( clientMode.isHost() )
+            {
+                if ( MsgPtr msgStateHashNodes = rollMan.getStateHashNodes ( L.indexedFrame ) )
+                {
+                    if ( dataSocket && dataSocket->isConnected() )
+                        dataSocket->send ( msgStateHashNodes );
+                }
+            }
+
+#undef L
+#undef R
+
+            localStateHashes.clear();
+            remoteStateHashes.clear();
+
+            stateDesyncTimer = STATE_DESYNC_TIMEOUT;
+            break;
+        }
+
         if ( replayInputs && netMan.getIndex() >= repMan.getLastIndex() && netMan.getFrame() >= repMan.getLastFrame() )
         {
             replayInputs = false;
@@ -820,6 +1062,10 @@ struct DllMain
         memset ( AsmHacks::sfxFilterArray, 0, CC_SFX_ARRAY_LEN );
         memset ( AsmHacks::sfxMuteArray, 0, CC_SFX_ARRAY_LEN );
 
+        replayRec.inputs ( netMan.getIndexedFrame(), netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+
+        recordFrame ( FlightFrame::Inputs );
+
 #ifndef DISABLE_LOGGING
         MsgPtr msgRngState = procMan.getRngState ( 0 );
         ASSERT ( msgRngState.get() != 0 );
@@ -876,6 +1122,10 @@ struct DllMain
             *CC_SKIP_FRAMES_ADDR = 1;
         }
 
+        replayRec.reinputs ( netMan.getIndexedFrame(), netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
+
+        recordFrame ( FlightFrame::Reinputs );
+
         LOG_SYNC ( "Reinputs: 0x%04x 0x%04x", netMan.getRawInput ( 1 ), netMan.getRawInput ( 2 ) );
         LOG_SYNC ( "roundOverTimer=%d; introState=%u; roundTimer=%u; realTimer=%u; hitsparks=%u; camera={ %d, %d }",
                    roundOverTimer, *CC_INTRO_STATE_ADDR, *CC_ROUND_TIMER_ADDR, *CC_REAL_TIMER_ADDR,
@@ -920,10 +1170,24 @@ struct DllMain
         procMan.writeGameInput ( remotePlayer, netMan.getInput ( remotePlayer ) );
 
 #ifndef RELEASE
-        if ( replayInputs && ( replaySpeed == 1 || KeyboardState::isDown ( VK_SPACE ) ) )
+        // Fast-forward as fast as possible until reaching the seek target
+        if ( replayInputs && netMan.getIndexedFrame().value < replaySeek.value )
+        {
             DllFrameRate::desiredFps = numeric_limits<double>::max();
-        else if ( replayInputs && replaySpeed == 2 )
             *CC_SKIP_FRAMES_ADDR = 1;
+        }
+        else if ( replayInputs && ( replaySpeed == 1 || KeyboardState::isDown ( VK_SPACE ) ) )
+        {
+            DllFrameRate::desiredFps = numeric_limits<double>::max();
+        }
+        else if ( replayInputs )
+        {
+            // Back to normal speed once done seeking or fast-forwarding
+            DllFrameRate::desiredFps = 60.0;
+
+            if ( replaySpeed == 2 )
+                *CC_SKIP_FRAMES_ADDR = 1;
+        }
 #endif
     }
 
@@ -1088,6 +1352,13 @@ struct DllMain
 
     void delayedStop ( const string& error )
     {
+        // Keep the events that led to the first stop, which is usually the interesting one
+        if ( ! stopping )
+        {
+            FlightRecorder::get().dump ( ( ProcessManager::appDir + FLIGHT_DUMP_FILE ).c_str(),
+                                         error.empty() ? "Stopped" : error.c_str() );
+        }
+
         if ( ! error.empty() )
             procMan.ipcSend ( new ErrorMessage ( error ) );
 
@@ -1097,6 +1368,52 @@ struct DllMain
         stopping = true;
     }
 
+#ifndef RELEASE
+    // Log the desynced memory ranges, and stop on the next frame
+    void stateDesyncLocated ( const vector<uint32_t>& leaves, bool truncated )
+    {
+        for ( uint32_t node : leaves )
+            LOG_TO ( syncLog, "Desync range: %s", rollMan.describeStateHashLeaf ( node ) );
+
+        if ( leaves.empty() )
+            LOG_TO ( syncLog, "Desync range: not found" );
+
+        if ( truncated )
+            LOG_TO ( syncLog, "Desync ranges truncated, only part of the desynced state is listed" );
+
+        stateDesyncTimer = 1;
+    }
+
+    void logPredictionStats()
+    {
+        static const uint32_t latencies[] = { 2, 4, 8 };
+
+        for ( uint32_t latency : latencies )
+        {
+            RepeatLastPredictor repeatLast;
+            MarkovPredictor markov;
+            PredictionStats repeatLastStats, markovStats;
+
+            for ( uint32_t i = 0; i <= repMan.getLastIndex(); ++i )
+            {
+                if ( repMan.getGameMode ( {{ 0, i }} ) != CC_GAME_MODE_IN_GAME )
+                    continue;
+
+                for ( uint8_t player = 1; player <= 2; ++player )
+                {
+                    const vector<uint16_t> inputs = repMan.getPlayerInputs ( i, player );
+
+                    evaluatePredictor ( repeatLast, inputs, latency, repeatLastStats );
+                    evaluatePredictor ( markov, inputs, latency, markovStats );
+                }
+            }
+
+            LOG ( "%s", repeatLastStats.str() );
+            LOG ( "%s", markovStats.str() );
+        }
+    }
+#endif // NOT RELEASE
+
     void checkRoundOver()
     {
         bool p1_over, p2_over;
@@ -1188,7 +1505,7 @@ struct DllMain
             IpAddrPort redirectAddr;
 
             if ( SHOULD_REDIRECT_SPECTATORS )
-                redirectAddr = getRandomRedirectAddress();
+                redirectAddr = getRedirectAddress();
 
             if ( redirectAddr.port == 0 )
             {
@@ -1322,10 +1639,61 @@ struct DllMain
                 netMan.setRngState ( msg->getAs<RngState>() );
                 return;
 
+            case MsgType::RelayStatus:
+                // From our parent via MainApp, so reply with the number of spectators we relay
+                if ( ! socket )
+                    procMan.ipcSend ( new RelayStatus ( msg->getAs<RelayStatus>().time, numRelayed() ) );
+                else
+                    gotRelayStatus ( socket, msg->getAs<RelayStatus>() );
+                return;
+
 #ifndef RELEASE
             case MsgType::SyncHash:
                 remoteSync.push_back ( msg );
                 return;
+
+            case MsgType::StateHash:
+                remoteStateHashes.push_back ( msg );
+                return;
+
+            case MsgType::StateHashNodes:
+            {
+                const StateHashNodes& stateHashNodes = msg->getAs<StateHashNodes>();
+
+                // The remote located the desync, so both sides stop with the same report
+                if ( stateHashNodes.done )
+                {
+                    stateDesyncLocated ( stateHashNodes.nodes, stateHashNodes.truncated );
+                    return;
+                }
+
+                const vector<uint32_t> mismatched = rollMan.compareStateHashNodes ( stateHashNodes );
+
+                if ( mismatched.empty() || MerkleTree::getLevel ( mismatched[0] ) == 0 )
+                {
+                    stateDesyncLocated ( mismatched, stateHashNodes.truncated );
+
+                    MsgPtr msgDone ( new StateHashNodes ( stateHashNodes.indexedFrame ) );
+                    msgDone->getAs<StateHashNodes>().nodes = mismatched;
+                    msgDone->getAs<StateHashNodes>().truncated = stateHashNodes.truncated;
+                    msgDone->getAs<StateHashNodes>().done = true;
+
+                    if ( dataSocket && dataSocket->isConnected() )
+                        dataSocket->send ( msgDone );
+                    return;
+                }
+
+                if ( MsgPtr msgStateHashNodes = rollMan.getStateHashNodes ( stateHashNodes.indexedFrame, mismatched ) )
+                {
+                    // Keep the truncation of the earlier levels
+                    if ( stateHashNodes.truncated )
+                        msgStateHashNodes->getAs<StateHashNodes>().truncated = true;
+
+                    if ( dataSocket && dataSocket->isConnected() )
+                        dataSocket->send ( msgStateHashNodes );
+                }
+                return;
+            }
 #endif // NOT RELEASE
 
             default:
@@ -1388,6 +1756,13 @@ struct DllMain
                 switch ( msg->getMsgType() )
                 {
                     case MsgType::InitialGameState:
+                        // Also sent when resuming from a new relay, after the game has already started
+                        if ( netMan.getState() != NetplayState::PreInitial )
+                        {
+                            LOG ( "Resumed spectating at [%s]", netMan.getIndexedFrame() );
+                            return;
+                        }
+
                         netMan.initial = msg->getAs<InitialGameState>();
 
                         if ( netMan.initial.chara[0] == UNKNOWN_POSITION )
@@ -1412,9 +1787,14 @@ struct DllMain
                         return;
 
                     case MsgType::BothInputs:
+                        jitterBuffer.arrived ( TimerManager::get().getNow(), NUM_INPUTS );
                         netMan.setBothInputs ( msg->getAs<BothInputs>() );
                         return;
 
+                    case MsgType::BothInputsBlock:
+                        netMan.setBothInputs ( msg->getAs<BothInputsBlock>() );
+                        return;
+
                     case MsgType::MenuIndex:
                         netMan.setRetryMenuIndex ( msg->getAs<MenuIndex>().index, msg->getAs<MenuIndex>().menuIndex );
                         return;
@@ -1463,20 +1843,31 @@ struct DllMain
                 if ( options[Options::HeldStartDuration] )
                     netMan.heldStartDuration = lexical_cast<uint32_t> ( options.arg ( Options::HeldStartDuration ) );
 
+                if ( options.arg ( Options::Predictor ) == "repeat" )
+                    netMan.setInputPredictor ( make_shared<RepeatLastPredictor>() );
+                else
+                    netMan.setInputPredictor ( make_shared<MarkovPredictor>() );
+
                 // This will log in the previous appDir folder it not the same
                 LOG ( "appDir='%s'", ProcessManager::appDir );
 
                 Logger::get().sessionId = options.arg ( Options::SessionId );
-                Logger::get().initialize ( ProcessManager::appDir + LOG_FILE );
+                Logger::get().initialize ( ProcessManager::appDir + LOG_FILE,
+                                           LOG_DEFAULT_OPTIONS | ( options[Options::AsyncLog] ? LOG_ASYNC : 0 ) );
                 Logger::get().logVersion();
 
                 LOG ( "gameDir='%s'", ProcessManager::gameDir );
                 LOG ( "appDir='%s'", ProcessManager::appDir );
 
                 syncLog.sessionId = options.arg ( Options::SessionId );
-                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, 0 );
+                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE,
+                                     ( options[Options::AsyncLog] ? LOG_ASYNC : 0 ) );
                 syncLog.logVersion();
 
+                // Record this session if enabled, unless it is a replay
+                if ( options[Options::Record] && ! options[Options::Replay] )
+                    replayRec.start ( ProcessManager::appDir + REPLAY_RECORD_FILE );
+
                 // Manually hit Alt+Enter to enable fullscreen
                 if ( options[Options::Fullscreen] && DllHacks::windowHandle == GetForegroundWindow() )
                 {
@@ -1566,6 +1957,30 @@ struct DllMain
                         netMan.initial.stage = 1;
                     }
 
+                    // Parse seek index and frame, this starts from the checkpoint before it, then fast-forwards to it
+                    it = find ( args.begin(), args.end(), "seek" );
+                    if ( it != args.end() )
+                        ++it;
+                    if ( it != args.end() && ( args.end() - it ) >= 2 )
+                    {
+                        replaySeek.parts.index = lexical_cast<uint32_t> ( *it++ );
+                        replaySeek.parts.frame = lexical_cast<uint32_t> ( *it++ );
+
+                        MsgPtr msgInitialState = repMan.getCheckpointBefore ( replaySeek );
+
+                        ASSERT ( msgInitialState.get() != 0 );
+
+                        netMan.initial = msgInitialState->getAs<InitialGameState>();
+                        netMan.initial.netplayState = 0xFF;
+                        netMan.initial.stage = 1;
+
+                        LOG ( "Seeking to [%s] from [%s]", replaySeek, netMan.initial.indexedFrame );
+                    }
+
+                    // Log the rollbacks each input predictor would have caused for this replay
+                    if ( find ( args.begin(), args.end(), "predict" ) != args.end() )
+                        logPredictionStats();
+
                     replayInputs = true;
                 }
                 else
@@ -1883,6 +2298,8 @@ struct DllMain
 
         syncLog.deinitialize();
 
+        replayRec.stop();
+
         procMan.disconnectPipe();
 
         ControllerManager::get().owner = 0;
@@ -1907,18 +2324,45 @@ private:
         LOG ( "Failed to save: %s", file );
     }
 
-    const IpAddrPort& getRandomRedirectAddress() const
+    const IpAddrPort& getRedirectAddress()
     {
+        // The client also relays spectators, but we don't know how many, so randomly split between both trees
         size_t r = rand() % ( 1 + numSpectators() );
 
         if ( r == 0 && !clientServerAddr.empty() )
             return clientServerAddr;
-        else
-            return getRandomSpectatorAddress();
+
+        const IpAddrPort& relayAddr = getRelayAddress();
+
+        if ( relayAddr.empty() && !clientServerAddr.empty() )
+            return clientServerAddr;
+
+        return relayAddr;
     }
 };
 
 
+// Exception filter that was installed before ours
+static LPTOP_LEVEL_EXCEPTION_FILTER previousExceptionFilter = 0;
+
+// Dump the flight recorder on a crash, then let the previous filter handle the exception.
+// The heap may be corrupted at this point, so this formats into buffers on the stack.
+static LONG WINAPI unhandledException ( EXCEPTION_POINTERS *info )
+{
+    const string& dir = ( ProcessManager::appDir.empty() ? ProcessManager::gameDir : ProcessManager::appDir );
+
+    char file[MAX_PATH], reason[FLIGHT_REASON_SIZE];
+    snprintf ( file, sizeof ( file ), "%s" FLIGHT_DUMP_FILE, dir.c_str() );
+    snprintf ( reason, sizeof ( reason ), "Exception 0x%08x", ( uint32_t ) info->ExceptionRecord->ExceptionCode );
+
+    FlightRecorder::get().dump ( file, reason, false );
+
+    if ( previousExceptionFilter )
+        return previousExceptionFilter ( info );
+
+    return EXCEPTION_CONTINUE_SEARCH;
+}
+
 static void initializeDllMain()
 {
     mainApp.reset ( new DllMain() );
@@ -1962,6 +2406,11 @@ extern "C" BOOL APIENTRY DllMain ( HMODULE, DWORD reason, LPVOID )
             LOG ( "DLL_PROCESS_ATTACH" );
             LOG ( "gameDir='%s'", ProcessManager::gameDir );
 
+            // Keep recent events in memory, which are dumped on a desync, stop, or crash
+            FlightRecorder::get().initialize();
+            Logger::get().flightRecord = true;
+            previousExceptionFilter = SetUnhandledExceptionFilter ( unhandledException );
+
             // We want the DLL to be able to rebind any previously bound ports
             Socket::forceReusePort ( true );
 
@@ -3,6 +3,7 @@
 #include "ProcessManager.hpp"
 #include "Exceptions.hpp"
 #include "CharacterSelect.hpp"
+#include "InputScan.hpp"
 
 #include <algorithm>
 #include <cmath>
@@ -20,6 +21,9 @@ using namespace std;
 // Extra number to add to preserveStartIndex, this is a safety buffer for chained spectators.
 #define PRESERVE_START_INDEX_BUFFER ( 5 )
 
+// Max number of frames of input history scanned at once, the history is read into a buffer this size on the stack.
+#define HISTORY_CHUNK_SIZE ( 64 )
+
 
 #define RETURN_MASH_INPUT(DIRECTION, BUTTONS)                       \
     do {                                                            \
@@ -110,6 +114,9 @@ uint16_t NetplayManager::getSkippableInput ( uint8_t player )
 
 uint16_t NetplayManager::getInGameInput ( uint8_t player )
 {
+    if ( player == _remotePlayer && isInRollback() && _predictor )
+        predictRemoteInput();
+
     uint16_t input = getRawInput ( player );
 
     // Disable pausing in netplay versus mode. Also only allow start button in versus after holding it for a duration.
@@ -403,29 +410,35 @@ uint16_t NetplayManager::getMenuNavInput()
     return 0;
 }
 
+const uint16_t *NetplayManager::readInputHistory ( uint8_t player, uint32_t start, uint32_t n, uint16_t *buffer ) const
+{
+    ASSERT ( player == 1 || player == 2 );
+    ASSERT ( getIndex() >= _startIndex );
+    ASSERT ( n > 0 && n <= HISTORY_CHUNK_SIZE );
+    ASSERT ( start + n <= getFrame() + 1 );
+
+    return _inputs[player - 1].read ( getIndex() - _startIndex, getFrame() - start - ( n - 1 ), buffer, n );
+}
+
 bool NetplayManager::hasUpDownInHistory ( uint8_t player, uint32_t start, uint32_t end ) const
 {
-    for ( size_t i = start; i < end; ++i )
-    {
-        if ( i > getFrame() )
-            break;
+    ASSERT ( player == 0 || player == 1 || player == 2 );
 
-        if ( player == 0 )
-        {
-            const uint16_t p1dir = 0xF & getRawInput ( 1, getFrame() - i );
+    uint16_t buffer[HISTORY_CHUNK_SIZE];
 
-            const uint16_t p2dir = 0xF & getRawInput ( 2, getFrame() - i );
+    // The history before the first frame is empty
+    end = min ( end, getFrame() + 1 );
 
-            if ( ( p1dir == 2 ) || ( p1dir == 8 ) || ( p2dir == 2 ) || ( p2dir == 8 ) )
-                return true;
-        }
-        else
-        {
-            ASSERT ( player == 1 || player == 2 );
+    for ( ; start < end; start += HISTORY_CHUNK_SIZE )
+    {
+        const uint32_t n = min<uint32_t> ( end - start, HISTORY_CHUNK_SIZE );
 
-            const uint16_t dir = 0xF & getRawInput ( player, getFrame() - i );
+        for ( uint8_t p = 1; p <= 2; ++p )
+        {
+            if ( player != 0 && player != p )
+                continue;
 
-            if ( ( dir == 2 ) || ( dir == 8 ) )
+            if ( anyInputHasDirection ( readInputHistory ( p, start, n, buffer ), n, 2, 8 ) )
                 return true;
         }
     }
@@ -437,14 +450,15 @@ bool NetplayManager::hasButtonInHistory ( uint8_t player, uint16_t button, uint3
 {
     ASSERT ( player == 1 || player == 2 );
 
-    for ( size_t i = start; i < end; ++i )
-    {
-        if ( i > getFrame() )
-            break;
+    uint16_t buffer[HISTORY_CHUNK_SIZE];
 
-        const uint16_t buttons = getRawInput ( player, getFrame() - i ) >> 4;
+    end = min ( end, getFrame() + 1 );
 
-        if ( buttons & button )
+    for ( ; start < end; start += HISTORY_CHUNK_SIZE )
+    {
+        const uint32_t n = min<uint32_t> ( end - start, HISTORY_CHUNK_SIZE );
+
+        if ( anyInputHasMask ( readInputHistory ( player, start, n, buffer ), n, COMBINE_INPUT ( 0, button ) ) )
             return true;
     }
 
@@ -455,14 +469,24 @@ bool NetplayManager::heldButtonInHistory ( uint8_t player, uint16_t button, uint
 {
     ASSERT ( player == 1 || player == 2 );
 
-    for ( size_t i = start; i < end; ++i )
-    {
-        if ( i > getFrame() )
-            return false;
+    if ( start >= end )
+        return true;
+
+    // Not held if the history goes back before the first frame
+    if ( end > getFrame() + 1 )
+        return false;
+
+    // The button usually isn't held at all, so check the latest input before scanning the whole history
+    if ( ! ( getRawInput ( player, getFrame() - start ) & COMBINE_INPUT ( 0, button ) ) )
+        return false;
 
-        const uint16_t buttons = getRawInput ( player, getFrame() - i ) >> 4;
+    uint16_t buffer[HISTORY_CHUNK_SIZE];
 
-        if ( ! ( buttons & button ) )
+    for ( ; start < end; start += HISTORY_CHUNK_SIZE )
+    {
+        const uint32_t n = min<uint32_t> ( end - start, HISTORY_CHUNK_SIZE );
+
+        if ( ! allInputsHaveMask ( readInputHistory ( player, start, n, buffer ), n, COMBINE_INPUT ( 0, button ) ) )
             return false;
     }
 
@@ -690,6 +714,62 @@ void NetplayManager::setInputs ( uint8_t player, const PlayerInputs& playerInput
 
     _inputs[player - 1].set ( playerInputs.getIndex() - _startIndex, playerInputs.getStartFrame(),
                               &playerInputs.inputs[0], playerInputs.size(), checkStartingFromIndex );
+
+    if ( player == _remotePlayer && isInRollback() && _predictor )
+        learnRemoteInputs ( playerInputs.getIndex() - _startIndex );
+}
+
+void NetplayManager::setInputPredictor ( const shared_ptr<InputPredictor>& predictor )
+{
+    _predictor = predictor;
+    _learnedIndex = UINT_MAX;
+    _learnedFrame = 0;
+
+    _inputs[_remotePlayer - 1].clearPredicted();
+}
+
+uint32_t NetplayManager::getRemoteHeldFrames ( uint32_t index, uint32_t frame ) const
+{
+    const InputsContainer<uint16_t>& inputs = _inputs[_remotePlayer - 1];
+    const uint16_t last = inputs.get ( index, frame - 1 );
+
+    uint32_t held = 1;
+
+    while ( held < frame && held < InputPredictor::MaxHeldFrames && inputs.get ( index, frame - held - 1 ) == last )
+        ++held;
+
+    return held;
+}
+
+void NetplayManager::learnRemoteInputs ( uint32_t index )
+{
+    const InputsContainer<uint16_t>& inputs = _inputs[_remotePlayer - 1];
+
+    // The learned position is absolute, since the offset indicies shift when old inputs are erased
+    if ( _learnedIndex != _startIndex + index )
+    {
+        _learnedIndex = _startIndex + index;
+        _learnedFrame = 1;
+    }
+
+    for ( ; _learnedFrame < inputs.getEndFrame ( index ); ++_learnedFrame )
+    {
+        _predictor->update ( inputs.get ( index, _learnedFrame - 1 ), getRemoteHeldFrames ( index, _learnedFrame ),
+                             inputs.get ( index, _learnedFrame ) );
+    }
+}
+
+void NetplayManager::predictRemoteInput()
+{
+    const uint32_t index = getIndex() - _startIndex;
+
+    if ( getFrame() == 0 || getFrame() < _inputs[_remotePlayer - 1].getEndFrame ( index ) )
+        return;
+
+    const uint16_t input = _predictor->predict ( _inputs[_remotePlayer - 1].get ( index, getFrame() - 1 ),
+                                                 getRemoteHeldFrames ( index, getFrame() ) );
+
+    _inputs[_remotePlayer - 1].predict ( index, getFrame(), input );
 }
 
 MsgPtr NetplayManager::getBothInputs ( IndexedFrame& pos ) const
@@ -701,21 +781,10 @@ MsgPtr NetplayManager::getBothInputs ( IndexedFrame& pos ) const
 
     ASSERT ( orig.parts.index >= _startIndex );
 
-    // This is most recent frame, in the spectator's transition index, that the spectator is allowed to "see"
-    uint32_t commonEndFrame = min ( _inputs[0].getEndFrame ( orig.parts.index - _startIndex ),
-                                    _inputs[1].getEndFrame ( orig.parts.index - _startIndex ) );
+    const uint32_t commonEndFrame = getSpectatorEndFrame ( orig.parts.index );
 
     if ( orig.parts.index == getIndex() )                   // During the same transition index
     {
-        if ( isInRollback() )
-        {
-            // Add a buffer to the end frame during rollback
-            if ( commonEndFrame > 2 * NUM_INPUTS )
-                commonEndFrame -= 2 * NUM_INPUTS;
-            else
-                commonEndFrame = 0;
-        }
-
         if ( orig.parts.frame + 1 <= commonEndFrame )
         {
             // Increment by NUM_INPUTS when behind
@@ -762,6 +831,69 @@ MsgPtr NetplayManager::getBothInputs ( IndexedFrame& pos ) const
     return MsgPtr ( bothInputs );
 }
 
+MsgPtr NetplayManager::getBothInputsBlock ( IndexedFrame& pos, uint32_t maxFrames ) const
+{
+    if ( pos.parts.index > getIndex() )
+        return 0;
+
+    ASSERT ( pos.parts.index >= _startIndex );
+
+    const uint32_t commonEndFrame = getSpectatorEndFrame ( pos.parts.index );
+
+    // The spectator already has the inputs before the start of its next BothInputs
+    const uint32_t startFrame = pos.parts.frame + 1 - NUM_INPUTS;
+    const uint32_t endFrame = min ( commonEndFrame, startFrame + maxFrames );
+
+    if ( endFrame <= startFrame )
+    {
+        // Since we're at the end of an older transition index, increment to the next one
+        if ( pos.parts.index < getIndex() )
+        {
+            pos.parts.frame = NUM_INPUTS - 1;
+            ++pos.parts.index;
+        }
+
+        return 0;
+    }
+
+    const IndexedFrame start = {{ startFrame, pos.parts.index }};
+
+    BothInputsBlock *bothInputsBlock = new BothInputsBlock ( start );
+
+    for ( uint8_t i = 0; i < 2; ++i )
+    {
+        bothInputsBlock->inputs[i].resize ( endFrame - startFrame );
+
+        _inputs[i].get ( pos.parts.index - _startIndex, startFrame,
+                         &bothInputsBlock->inputs[i][0], bothInputsBlock->size() );
+    }
+
+    // The next BothInputs starts after the end of this block
+    pos.parts.frame = endFrame + NUM_INPUTS - 1;
+
+    // Continue with the next transition index once an older one is done
+    if ( pos.parts.index < getIndex() && endFrame == commonEndFrame )
+    {
+        pos.parts.frame = NUM_INPUTS - 1;
+        ++pos.parts.index;
+    }
+
+    return MsgPtr ( bothInputsBlock );
+}
+
+uint32_t NetplayManager::getSpectatorEndFrame ( uint32_t index ) const
+{
+    // This is most recent frame, in the spectator's transition index, that the spectator is allowed to "see"
+    uint32_t commonEndFrame = min ( _inputs[0].getEndFrame ( index - _startIndex ),
+                                    _inputs[1].getEndFrame ( index - _startIndex ) );
+
+    // Add a buffer to the end frame during rollback
+    if ( index == getIndex() && isInRollback() )
+        commonEndFrame = ( commonEndFrame > 2 * NUM_INPUTS ? commonEndFrame - 2 * NUM_INPUTS : 0 );
+
+    return commonEndFrame;
+}
+
 void NetplayManager::setBothInputs ( const BothInputs& bothInputs )
 {
     // Only keep remote inputs at most 1 transition index old, but at least as new as the startIndex
@@ -777,6 +909,22 @@ void NetplayManager::setBothInputs ( const BothInputs& bothInputs )
                      &bothInputs.inputs[1][0], bothInputs.size() );
 }
 
+void NetplayManager::setBothInputs ( const BothInputsBlock& bothInputsBlock )
+{
+    // Same as BothInputs, also ignoring empty or malformed blocks
+    if ( bothInputsBlock.getIndex() + 1 < getIndex() || bothInputsBlock.getIndex() < _startIndex
+            || bothInputsBlock.size() == 0 || bothInputsBlock.inputs[0].size() != bothInputsBlock.inputs[1].size() )
+    {
+        return;
+    }
+
+    _inputs[0].set ( bothInputsBlock.getIndex() - _startIndex, bothInputsBlock.getStartFrame(),
+                     &bothInputsBlock.inputs[0][0], bothInputsBlock.size() );
+
+    _inputs[1].set ( bothInputsBlock.getIndex() - _startIndex, bothInputsBlock.getStartFrame(),
+                     &bothInputsBlock.inputs[1][0], bothInputsBlock.size() );
+}
+
 bool NetplayManager::isRemoteInputReady() const
 {
     if ( _state.value < NetplayState::CharaSelect || _state.value == NetplayState::Skippable
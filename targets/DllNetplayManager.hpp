@@ -3,8 +3,10 @@
 #include "Messages.hpp"
 #include "InputsContainer.hpp"
 #include "NetplayStates.hpp"
+#include "InputPredictor.hpp"
 
 #include <vector>
+#include <memory>
 #include <climits>
 
 
@@ -79,8 +81,13 @@ public:
     // Otherwise this increments the given pos by at most NUM_INPUTS if returning non-null.
     MsgPtr getBothInputs ( IndexedFrame& pos ) const;
 
+    // Get a block of at most maxFrames inputs for both players, for spectators that are catching up.
+    // May return null like getBothInputs, otherwise this increments the given pos past the end of the block.
+    MsgPtr getBothInputsBlock ( IndexedFrame& pos, uint32_t maxFrames ) const;
+
     // Set inputs for both players
     void setBothInputs ( const BothInputs& bothInputs );
+    void setBothInputs ( const BothInputsBlock& bothInputsBlock );
 
     // True if remote input is ready for the current frame, otherwise the caller should wait for more input
     bool isRemoteInputReady() const;
@@ -116,6 +123,9 @@ public:
     // Set remote transition index
     void setRemoteIndex ( uint32_t remoteIndex );
 
+    // Set the predictor used for the remote input when it is not known yet during rollback, null repeats the last input
+    void setInputPredictor ( const std::shared_ptr<InputPredictor>& predictor );
+
     // Check if the next state transition is valid
     bool isValidNext ( NetplayState state );
 
@@ -177,6 +187,24 @@ private:
     // The remote player, ie the one where setInputs gets called for each input message
     uint8_t _remotePlayer = 2;
 
+    // Predictor for the remote input during rollback
+    std::shared_ptr<InputPredictor> _predictor = std::make_shared<MarkovPredictor>();
+
+    // The next remote index:frame the predictor will learn from
+    uint32_t _learnedIndex = UINT_MAX, _learnedFrame = 0;
+
+    // Learn from the remote inputs of the given offset index that are known now
+    void learnRemoteInputs ( uint32_t index );
+
+    // Predict the remote input for the current frame if it is not known yet
+    void predictRemoteInput();
+
+    // Get the number of frames the remote input before the given offset index:frame was held for
+    uint32_t getRemoteHeldFrames ( uint32_t index, uint32_t frame ) const;
+
+    // Get the end frame of the inputs that spectators are allowed to "see" in the given transition index
+    uint32_t getSpectatorEndFrame ( uint32_t index ) const;
+
     // Get the input for the specific NetplayState
     uint16_t getPreInitialInput ( uint8_t player );
     uint16_t getInitialInput ( uint8_t player );
@@ -195,6 +223,10 @@ private:
     bool hasButtonInHistory ( uint8_t player, uint16_t button, uint32_t start, uint32_t end ) const;
     bool heldButtonInHistory ( uint8_t player, uint16_t button, uint32_t start, uint32_t end ) const;
 
+    // Read n (at most HISTORY_CHUNK_SIZE) raw inputs of the history from start, ordered oldest first.
+    // Returns a pointer to the inputs, which may be copied to the buffer. Must not go back before the first frame.
+    const uint16_t *readInputHistory ( uint8_t player, uint32_t start, uint32_t n, uint16_t *buffer ) const;
+
     // Get the buffered preserveStartIndex
     uint32_t getBufferedPreserveStartIndex() const;
 };
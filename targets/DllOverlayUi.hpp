@@ -37,6 +37,10 @@ void updateMessage();
 bool isShowingMessage();
 
 
+// Stats text shown in the corner, even when the overlay is disabled
+extern std::string statsText;
+
+
 #ifndef RELEASE
 
 extern std::string debugText;
@@ -23,6 +23,8 @@ using namespace DllOverlayUi;
 
 #define OVERLAY_DEBUG_COLOR             D3DCOLOR_XRGB ( 255, 0, 0 )
 
+#define OVERLAY_STATS_COLOR             D3DCOLOR_XRGB ( 255, 255, 0 )
+
 #define OVERLAY_TEXT_BORDER             ( 10 )
 
 #define OVERLAY_SELECTOR_L_COLOR        D3DCOLOR_XRGB ( 210, 0, 0 )
@@ -266,6 +268,8 @@ bool isShowingMessage()
     return ( messageTimeout > 0 );
 }
 
+string statsText;
+
 #ifndef RELEASE
 
 string debugText;
@@ -357,6 +361,16 @@ void renderOverlayText ( IDirect3DDevice9 *device, const D3DVIEWPORT9& viewport
 
 #endif // RELEASE
 
+    if ( ! statsText.empty() )
+    {
+        RECT rect;
+        rect.top = rect.left = OVERLAY_TEXT_BORDER;
+        rect.right = viewport.Width - OVERLAY_TEXT_BORDER;
+        rect.bottom = viewport.Height - OVERLAY_TEXT_BORDER;
+
+        DrawText ( font, statsText, rect, DT_LEFT | DT_BOTTOM | DT_SINGLELINE, OVERLAY_STATS_COLOR );
+    }
+
     if ( state == State::Disabled )
         return;
 
@@ -1,7 +1,12 @@
 #include "DllRollbackManager.hpp"
 #include "MemDump.hpp"
+#include "Compression.hpp"
 #include "DllAsmHacks.hpp"
 #include "ErrorStringsExt.hpp"
+#include "SpscQueue.hpp"
+#include "Thread.hpp"
+
+#include <windows.h>
 
 #include <utility>
 #include <algorithm>
@@ -16,9 +21,192 @@ extern const unsigned char binary_res_rollback_bin_end;
 // Deserialized rollback memory data
 static MemDumpList allAddrs;
 
+// Offsets of the pointer values in each game state, these are skipped when hashing
+static vector<size_t> allPtrOffsets;
+
+// Ranges of memory in each game state, used to describe desyncs
+static vector<MemDumpRange> allRanges;
+
+// Number of hash trees to keep for locating desyncs
+#define NUM_STATE_TREES ( 4 )
+
+// Max number of hashes to send in a single StateHashNodes message
+#define MAX_STATE_HASH_NODES ( 1024 )
+
+// Named memory regions, see tools/Generator.cpp
+struct NamedRegion
+{
+    uint32_t start, end, elementSize;
+    const char *name;
+};
+
+#define REGION(ADDR, NAME)          { ( uint32_t ) ADDR, ( uint32_t ) ADDR + sizeof ( *ADDR ), 0, NAME }
+#define ARRAY(ADDR, SIZE, NAME)     { ( uint32_t ) ADDR, ( uint32_t ) ADDR + SIZE, 0, NAME }
+#define ELEMENTS(ADDR, N, SIZE, NAME)  { ( uint32_t ) ADDR, ( uint32_t ) ADDR + N * SIZE, SIZE, NAME }
+
+static const NamedRegion namedRegions[] =
+{
+    ELEMENTS ( CC_P1_ENABLED_FLAG_ADDR, 4, CC_PLR_STRUCT_SIZE, "players" ),
+    ELEMENTS ( CC_EFFECTS_ARRAY_ADDR, CC_EFFECTS_ARRAY_COUNT, CC_EFFECT_ELEMENT_SIZE, "effects" ),
+    ELEMENTS ( CC_GRAPHICS_ARRAY_ADDR, CC_GRAPHICS_ARRAY_SIZE / 0x60, 0x60, "graphics" ),
+    ELEMENTS ( CC_SUPER_STATE_ARRAY_ADDR, CC_SUPER_STATE_ARRAY_SIZE / 0x30C, 0x30C, "superStates" ),
+    ARRAY ( CC_P1_EXTRA_STRUCT_ADDR, CC_EXTRA_STRUCT_SIZE, "p1Extra" ),
+    ARRAY ( CC_P2_EXTRA_STRUCT_ADDR, CC_EXTRA_STRUCT_SIZE, "p2Extra" ),
+    ARRAY ( CC_P1_STATUS_MSG_ARRAY_ADDR, CC_STATUS_MSG_ARRAY_SIZE, "p1StatusMsgs" ),
+    ARRAY ( CC_P2_STATUS_MSG_ARRAY_ADDR, CC_STATUS_MSG_ARRAY_SIZE, "p2StatusMsgs" ),
+    ARRAY ( CC_RNG_STATE3_ADDR, CC_RNG_STATE3_SIZE, "rngState3" ),
+    REGION ( CC_RNG_STATE0_ADDR, "rngState0" ),
+    REGION ( CC_RNG_STATE1_ADDR, "rngState1" ),
+    REGION ( CC_RNG_STATE2_ADDR, "rngState2" ),
+    REGION ( CC_ROUND_TIMER_ADDR, "roundTimer" ),
+    REGION ( CC_REAL_TIMER_ADDR, "realTimer" ),
+    REGION ( CC_WORLD_TIMER_ADDR, "worldTimer" ),
+    REGION ( CC_SLOW_TIMER_INIT_ADDR, "slowTimerInit" ),
+    REGION ( CC_SLOW_TIMER_ADDR, "slowTimer" ),
+    REGION ( CC_INTRO_STATE_ADDR, "introState" ),
+    REGION ( CC_INPUT_STATE_ADDR, "inputState" ),
+    REGION ( CC_SKIPPABLE_FLAG_ADDR, "skippableFlag" ),
+    REGION ( CC_GRAPHICS_COUNTER, "graphicsCounter" ),
+    REGION ( CC_SUPER_FLASH_PAUSE_ADDR, "superFlashPause" ),
+    REGION ( CC_SUPER_FLASH_TIMER_ADDR, "superFlashTimer" ),
+    REGION ( CC_P1_WINS_ADDR, "p1Wins" ),
+    REGION ( CC_P2_WINS_ADDR, "p2Wins" ),
+    REGION ( CC_P1_GAME_POINT_FLAG_ADDR, "p1GamePointFlag" ),
+    REGION ( CC_P2_GAME_POINT_FLAG_ADDR, "p2GamePointFlag" ),
+    REGION ( CC_METER_ANIMATION_ADDR, "meterAnimation" ),
+    REGION ( CC_P1_SPELL_CIRCLE_ADDR, "p1SpellCircle" ),
+    REGION ( CC_P2_SPELL_CIRCLE_ADDR, "p2SpellCircle" ),
+    REGION ( CC_CAMERA_SCALE_1_ADDR, "cameraScale1" ),
+    REGION ( CC_CAMERA_SCALE_2_ADDR, "cameraScale2" ),
+    REGION ( CC_CAMERA_SCALE_3_ADDR, "cameraScale3" ),
+};
+
+#undef REGION
+#undef ARRAY
+#undef ELEMENTS
+
+static string getRegionName ( uint32_t addr )
+{
+    for ( const NamedRegion& region : namedRegions )
+    {
+        if ( addr < region.start || addr >= region.end )
+            continue;
+
+        const uint32_t offset = addr - region.start;
+
+        if ( region.elementSize )
+            return format ( "%s[%u]+0x%X", region.name, offset / region.elementSize, offset % region.elementSize );
+
+        if ( offset )
+            return format ( "%s+0x%X", region.name, offset );
+
+        return region.name;
+    }
+
+    return "unknown";
+}
+
+// Number of uncompressed states in the memory pool, including one for the newest state before compression,
+// and the states waiting for the worker to compress them.
+#define NUM_POOL_STATES                                                                                     \
+    ( NUM_UNCOMPRESSED_STATES + 1 + NUM_STATE_WORKER_JOBS < NUM_ROLLBACK_STATES                             \
+      ? NUM_UNCOMPRESSED_STATES + 1 + NUM_STATE_WORKER_JOBS : NUM_ROLLBACK_STATES )
+
 template<typename T>
 static inline void deleteArray ( T *ptr ) { delete[] ptr; }
 
+// Get the affinity mask for the worker, which is the last core the process can run on, excluding the first core
+// since the frame thread is pinned to it (see TimerManager). Returns 0 if there is no spare core.
+static DWORD_PTR getWorkerAffinityMask()
+{
+    DWORD_PTR processMask, systemMask;
+
+    if ( ! GetProcessAffinityMask ( GetCurrentProcess(), &processMask, &systemMask ) )
+        return 0;
+
+    processMask &= ~ ( DWORD_PTR ) 1;
+
+    // Clear the lowest bits until only the highest one is left
+    while ( processMask & ( processMask - 1 ) )
+        processMask &= ( processMask - 1 );
+
+    return processMask;
+}
+
+
+// Worker thread that compresses and hashes game states once they have left the rollback window.
+// Jobs and results are passed through lock-free queues, so the frame thread never blocks on the worker,
+// except when it has to touch a state that still has unfinished jobs.
+class DllRollbackManager::Worker : public Thread
+{
+public:
+
+    // Results of the finished jobs, popped by the frame thread
+    SpscQueue<JobResult, NUM_STATE_WORKER_JOBS> results;
+
+    Worker ( DWORD_PTR affinityMask )
+        : _affinityMask ( affinityMask ), _event ( CreateEvent ( 0, FALSE, FALSE, 0 ) ) {}
+
+    ~Worker()
+    {
+        // ~Thread calls Thread::join, so we must tell the worker to stop first
+        post ( { JobType::Stop, 0 } );
+        join();
+
+        CloseHandle ( _event );
+    }
+
+    // The frame thread never has more than NUM_STATE_WORKER_JOBS unfinished jobs, so this never fails
+    void post ( const Job& job )
+    {
+        const bool pushed = _jobs.push ( job );
+
+        ASSERT ( pushed == true );
+
+        SetEvent ( _event );
+    }
+
+    void run() override
+    {
+        SetThreadAffinityMask ( GetCurrentThread(), _affinityMask );
+
+        Job job;
+
+        for ( ;; )
+        {
+            if ( ! _jobs.pop ( job ) )
+            {
+                WaitForSingleObject ( _event, INFINITE );
+                continue;
+            }
+
+            if ( job.type == JobType::Stop )
+                return;
+
+            JobResult result = { job.type, job.state };
+
+            runJob ( result, _buffer );
+
+            const bool pushed = results.push ( move ( result ) );
+
+            ASSERT ( pushed == true );
+        }
+    }
+
+private:
+
+    // Extra space for the stop job
+    SpscQueue<Job, NUM_STATE_WORKER_JOBS + 1> _jobs;
+
+    const DWORD_PTR _affinityMask;
+
+    // Auto-reset event signalled whenever a job is posted
+    HANDLE _event;
+
+    // Temporary buffer used when compressing / hashing game states
+    vector<char> _buffer;
+};
+
 
 void DllRollbackManager::GameState::save()
 {
@@ -52,53 +240,459 @@ void DllRollbackManager::allocateStates()
     {
         const size_t size = ( ( char * ) &binary_res_rollback_bin_end ) - ( char * ) &binary_res_rollback_bin_start;
         allAddrs.load ( ( char * ) &binary_res_rollback_bin_start, size );
+        allPtrOffsets = allAddrs.getPtrOffsets();
+        allRanges = allAddrs.getRanges();
     }
 
     if ( allAddrs.empty() )
         THROW_EXCEPTION ( "Failed to load rollback data!", ERROR_BAD_ROLLBACK_DATA );
 
     if ( ! _memoryPool )
-        _memoryPool.reset ( new char[NUM_ROLLBACK_STATES * allAddrs.totalSize], deleteArray<char> );
+        _memoryPool.reset ( new char[NUM_POOL_STATES * allAddrs.totalSize], deleteArray<char> );
 
-    for ( size_t i = 0; i < NUM_ROLLBACK_STATES; ++i )
+    waitForJobs();
+
+    for ( size_t i = 0; i < NUM_POOL_STATES; ++i )
         _freeStack.push ( i * allAddrs.totalSize );
 
+    if ( ! _worker )
+    {
+        const DWORD_PTR affinityMask = getWorkerAffinityMask();
+
+        if ( affinityMask )
+        {
+            LOG ( "Starting rollback worker: affinityMask=0x%X", affinityMask );
+
+            _worker.reset ( new Worker ( affinityMask ) );
+            _worker->start();
+        }
+    }
+
     _statesList.clear();
 
+    _pendingHashes.clear();
+    _stateHashes.clear();
+    _stateTrees.clear();
+
     for ( auto& sfxArray : _sfxHistory )
         memset ( &sfxArray[0], 0, CC_SFX_ARRAY_LEN );
 }
 
 void DllRollbackManager::deallocateStates()
 {
+    waitForJobs();
+
+    _worker.reset();
+
     _memoryPool.reset();
 
     while ( ! _freeStack.empty() )
         _freeStack.pop();
 
     _statesList.clear();
+
+    _compressBuffer.clear();
+
+    _pendingHashes.clear();
+    _stateHashes.clear();
+    _stateTrees.clear();
 }
 
-void DllRollbackManager::saveState ( const NetplayManager& netMan )
+void DllRollbackManager::freeState ( const GameState& state )
 {
-    if ( _freeStack.empty() )
+    if ( state.rawBytes )
+        _freeStack.push ( state.rawBytes - _memoryPool.get() );
+}
+
+void DllRollbackManager::compressOldStates()
+{
+    if ( _statesList.size() <= NUM_UNCOMPRESSED_STATES )
+        return;
+
+    // Uncompressed states are always the most recent ones, so usually only one state leaves the window per save.
+    // All the older states have already been released, unless a rollback loaded one of them.
+    auto it = _statesList.rbegin();
+    advance ( it, NUM_UNCOMPRESSED_STATES );
+
+    for ( ; it != _statesList.rend() && ! it->released; ++it )
     {
-        ASSERT ( _statesList.empty() == false );
+        ASSERT ( it->rawBytes != 0 );
+
+        it->released = true;
+        postJob ( JobType::Compress, *it );
+    }
+}
+
+void DllRollbackManager::postJob ( JobType type, GameState& state )
+{
+    ++state.jobs;
+
+    if ( ! _worker )
+    {
+        JobResult result = { type, &state };
+        runJob ( result, _compressBuffer );
+        finishJob ( result );
+        return;
+    }
+
+    while ( _numJobs >= NUM_STATE_WORKER_JOBS )
+    {
+        if ( ! finishJobs() )
+            Sleep ( 0 );
+    }
+
+    _worker->post ( { type, &state } );
+    ++_numJobs;
+}
+
+bool DllRollbackManager::finishJobs()
+{
+    if ( ! _worker )
+        return false;
+
+    JobResult result;
+    bool finished = false;
+
+    while ( _worker->results.pop ( result ) )
+    {
+        --_numJobs;
+        finishJob ( result );
+        finished = true;
+    }
+
+    return finished;
+}
+
+void DllRollbackManager::finishJob ( JobResult& result )
+{
+    GameState& state = *result.state;
+
+    ASSERT ( state.jobs > 0 );
+
+    --state.jobs;
+
+    if ( result.type == JobType::Hash )
+    {
+        _stateTrees.push_back ( make_pair ( state.indexedFrame, move ( result.tree ) ) );
+
+        if ( _stateTrees.size() > NUM_STATE_TREES )
+            _stateTrees.pop_front();
+
+        const uint64_t hash = _stateTrees.back().second.getRootHash();
+
+        _stateHashes.push_back ( MsgPtr ( new StateHash ( state.indexedFrame, hash ) ) );
+    }
+
+    // The raw bytes can only be returned to the pool once no other job needs them
+    if ( state.jobs == 0 && state.rawBytes && ! state.compressedBytes.empty() )
+    {
+        freeState ( state );
+        state.rawBytes = 0;
+    }
+}
 
-        if ( _statesList.front().indexedFrame.parts.frame <= netMan.getRemoteFrame() )
+void DllRollbackManager::waitForJobs ( const GameState *state )
+{
+    while ( state ? state->jobs : _numJobs )
+    {
+        if ( ! finishJobs() )
+            Sleep ( 0 );
+    }
+}
+
+void DllRollbackManager::runJob ( JobResult& result, vector<char>& buffer )
+{
+    GameState& state = *result.state;
+
+    if ( buffer.size() < compressZeroRunsBound ( allAddrs.totalSize ) )
+        buffer.resize ( compressZeroRunsBound ( allAddrs.totalSize ) );
+
+    switch ( result.type )
+    {
+        case JobType::Compress:
         {
-            auto it = _statesList.begin();
-            ++it;
-            _freeStack.push ( it->rawBytes - _memoryPool.get() );
-            _statesList.erase ( it );
+            ASSERT ( state.rawBytes != 0 );
+
+            const size_t size = compressZeroRuns ( state.rawBytes, allAddrs.totalSize, &buffer[0], buffer.size() );
+
+            ASSERT ( size > 0 );
+
+            state.compressedBytes.assign ( &buffer[0], &buffer[0] + size );
+            break;
+        }
+
+        case JobType::Hash:
+            result.tree = hashState ( state, buffer );
+            break;
+
+        default:
+            ASSERT_IMPOSSIBLE;
+            break;
+    }
+}
+
+void DllRollbackManager::uncompressState ( GameState& state )
+{
+    ASSERT ( state.rawBytes == 0 );
+    ASSERT ( _freeStack.empty() == false );
+
+    state.rawBytes = _memoryPool.get() + _freeStack.top();
+    _freeStack.pop();
+
+    const size_t size = uncompressZeroRuns ( &state.compressedBytes[0], state.compressedBytes.size(),
+                                             state.rawBytes, allAddrs.totalSize );
+
+    ASSERT ( size == allAddrs.totalSize );
+
+    vector<char>().swap ( state.compressedBytes );
+
+    // The state is back inside the uncompressed window
+    state.released = false;
+}
+
+void DllRollbackManager::hashConfirmedStates ( const NetplayManager& netMan )
+{
+    // The game state at frame F only depends on inputs before F, and is invalidated by a rollback to before F
+    IndexedFrame confirmed = netMan.getRemoteIndexedFrame();
+    ++confirmed.parts.frame;
+
+    const IndexedFrame lastChangedFrame = netMan.getLastChangedFrame();
+
+    if ( lastChangedFrame.value < confirmed.value )
+        confirmed = lastChangedFrame;
+
+    while ( ! _pendingHashes.empty() && _pendingHashes.front().value <= confirmed.value )
+    {
+        const IndexedFrame indexedFrame = _pendingHashes.front();
+
+        // The game state may have been erased by a rollback, since states are not saved during re-run
+        size_t position = 0;
+        auto it = _statesList.rbegin();
+
+        for ( ; it != _statesList.rend() && it->indexedFrame.value > indexedFrame.value; ++it )
+            ++position;
+
+        // States inside the rollback window are hashed once they leave it, so the worker never touches them
+        if ( it != _statesList.rend() && it->indexedFrame.value == indexedFrame.value )
+        {
+            if ( position < NUM_WINDOW_STATES )
+                return;
+
+            postJob ( JobType::Hash, *it );
+        }
+
+        _pendingHashes.pop_front();
+    }
+}
+
+MerkleTree DllRollbackManager::hashState ( const GameState& state, vector<char>& buffer )
+{
+    const char *dump = state.rawBytes;
+
+    if ( ! dump )
+    {
+        const size_t size = uncompressZeroRuns ( &state.compressedBytes[0], state.compressedBytes.size(),
+                                                 &buffer[0], allAddrs.totalSize );
+
+        ASSERT ( size == allAddrs.totalSize );
+
+        dump = &buffer[0];
+    }
+
+    vector<uint64_t> leaves ( ( allAddrs.totalSize + STATE_HASH_LEAF_SIZE - 1 ) / STATE_HASH_LEAF_SIZE );
+
+    auto ptr = allPtrOffsets.cbegin();
+
+    for ( size_t i = 0; i < leaves.size(); ++i )
+    {
+        const size_t start = i * STATE_HASH_LEAF_SIZE;
+        const size_t end = min<size_t> ( start + STATE_HASH_LEAF_SIZE, allAddrs.totalSize );
+
+        // Skip the pointer values, since heap addresses can differ between machines
+        while ( ptr != allPtrOffsets.cend() && *ptr + sizeof ( uint32_t ) <= start )
+            ++ptr;
+
+        Hash64 hash;
+        size_t offset = start;
+
+        for ( auto it = ptr; it != allPtrOffsets.cend() && *it < end; ++it )
+        {
+            if ( *it > offset )
+                hash.update ( dump + offset, *it - offset );
+
+            offset = max ( offset, min<size_t> ( *it + sizeof ( uint32_t ), end ) );
+        }
+
+        hash.update ( dump + offset, end - offset );
+        leaves[i] = hash.digest();
+    }
+
+    return MerkleTree ( leaves );
+}
+
+const MerkleTree *DllRollbackManager::getStateTree ( IndexedFrame indexedFrame ) const
+{
+    for ( const auto& stateTree : _stateTrees )
+    {
+        if ( stateTree.first.value == indexedFrame.value )
+            return &stateTree.second;
+    }
+
+    return 0;
+}
+
+MsgPtr DllRollbackManager::getStateHashNodes ( IndexedFrame indexedFrame ) const
+{
+    const MerkleTree *tree = getStateTree ( indexedFrame );
+
+    if ( ! tree )
+        return 0;
+
+    return getStateHashNodes ( indexedFrame, { tree->getRootNode() } );
+}
+
+MsgPtr DllRollbackManager::getStateHashNodes ( IndexedFrame indexedFrame, const vector<uint32_t>& parents ) const
+{
+    const MerkleTree *tree = getStateTree ( indexedFrame );
+
+    if ( ! tree )
+    {
+        LOG ( "No hash tree for indexedFrame=%s", indexedFrame );
+        return 0;
+    }
+
+    StateHashNodes *stateHashNodes = new StateHashNodes ( indexedFrame );
+
+    uint32_t dropped = 0;
+
+    for ( uint32_t parent : parents )
+    {
+        for ( uint32_t node : tree->getChildren ( parent ) )
+        {
+            if ( stateHashNodes->nodes.size() >= MAX_STATE_HASH_NODES )
+            {
+                ++dropped;
+                continue;
+            }
+
+            stateHashNodes->nodes.push_back ( node );
+            stateHashNodes->hashes.push_back ( tree->getHash ( node ) );
+        }
+    }
+
+    // The desync ranges will only cover part of the desynced state
+    if ( dropped )
+    {
+        LOG ( "Dropped %u of %u state hash nodes for indexedFrame=%s",
+              dropped, dropped + stateHashNodes->nodes.size(), indexedFrame );
+        stateHashNodes->truncated = true;
+    }
+
+    return MsgPtr ( stateHashNodes );
+}
+
+vector<uint32_t> DllRollbackManager::compareStateHashNodes ( const StateHashNodes& stateHashNodes ) const
+{
+    vector<uint32_t> mismatched;
+
+    const MerkleTree *tree = getStateTree ( stateHashNodes.indexedFrame );
+
+    if ( ! tree || stateHashNodes.nodes.size() != stateHashNodes.hashes.size() )
+    {
+        LOG ( "No hash tree for indexedFrame=%s", stateHashNodes.indexedFrame );
+        return mismatched;
+    }
+
+    for ( size_t i = 0; i < stateHashNodes.nodes.size(); ++i )
+    {
+        const uint32_t node = stateHashNodes.nodes[i];
+
+        if ( tree->hasNode ( node ) && tree->getHash ( node ) != stateHashNodes.hashes[i] )
+            mismatched.push_back ( node );
+    }
+
+    return mismatched;
+}
+
+string DllRollbackManager::describeStateHashLeaf ( uint32_t node ) const
+{
+    const size_t start = MerkleTree::getIndex ( node ) * STATE_HASH_LEAF_SIZE;
+    const size_t end = min<size_t> ( start + STATE_HASH_LEAF_SIZE, allAddrs.totalSize );
+
+    // Find the first range that overlaps the leaf
+    auto it = upper_bound ( allRanges.cbegin(), allRanges.cend(), start,
+                            [] ( size_t offset, const MemDumpRange& range ) { return offset < range.dumpOffset; } );
+
+    if ( it != allRanges.cbegin() )
+        --it;
+
+    string str;
+
+    for ( ; it != allRanges.cend() && it->dumpOffset < end; ++it )
+    {
+        const size_t rangeStart = max ( start, it->dumpOffset );
+        const size_t rangeEnd = min ( end, it->dumpOffset + it->size );
+
+        if ( rangeStart >= rangeEnd )
+            continue;
+
+        if ( ! str.empty() )
+            str += "; ";
+
+        if ( it->depth == 0 )
+        {
+            const uint32_t addr = it->addr + ( rangeStart - it->dumpOffset );
+
+            str += format ( "{ 0x%06X, 0x%06X } %s", addr, addr + ( rangeEnd - rangeStart ), getRegionName ( addr ) );
         }
         else
         {
-            _freeStack.push ( _statesList.front().rawBytes - _memoryPool.get() );
-            _statesList.pop_front();
+            str += format ( "{ +0x%X, +0x%X } via %u pointer(s) from 0x%06X %s",
+                            rangeStart - it->dumpOffset, rangeEnd - it->dumpOffset, it->depth, it->addr,
+                            getRegionName ( it->addr ) );
         }
     }
 
+    return str;
+}
+
+MsgPtr DllRollbackManager::getStateHash()
+{
+    if ( _stateHashes.empty() )
+        return 0;
+
+    MsgPtr msg = _stateHashes.front();
+    _stateHashes.pop_front();
+    return msg;
+}
+
+void DllRollbackManager::saveState ( const NetplayManager& netMan )
+{
+    finishJobs();
+
+    if ( _statesList.size() >= NUM_ROLLBACK_STATES )
+    {
+        ASSERT ( _statesList.empty() == false );
+
+        auto it = _statesList.begin();
+
+        if ( it->indexedFrame.parts.frame <= netMan.getRemoteFrame() )
+            ++it;
+
+        waitForJobs ( & ( *it ) );
+        freeState ( *it );
+        _statesList.erase ( it );
+    }
+
+    // The pool only runs out if the worker is behind on compressing states
+    while ( _freeStack.empty() && _numJobs )
+    {
+        if ( ! finishJobs() )
+            Sleep ( 0 );
+    }
+
+    ASSERT ( _freeStack.empty() == false );
+
     std::fenv_t fp_env;
 
     fegetenv(&fp_env);
@@ -114,7 +708,16 @@ void DllRollbackManager::saveState ( const NetplayManager& netMan )
 
     _freeStack.pop();
     state.save();
-    _statesList.push_back ( state );
+    _statesList.push_back ( move ( state ) );
+
+#ifndef RELEASE
+    if ( netMan.getFrame() % STATE_HASH_INTERVAL == 0 )
+        _pendingHashes.push_back ( netMan.getIndexedFrame() );
+
+    hashConfirmedStates ( netMan );
+#endif // NOT RELEASE
+
+    compressOldStates();
 
     uint8_t *currentSfxArray = &_sfxHistory [ netMan.getFrame() % NUM_ROLLBACK_STATES ][0];
     memcpy ( currentSfxArray, AsmHacks::sfxFilterArray, CC_SFX_ARRAY_LEN );
@@ -147,15 +750,24 @@ bool DllRollbackManager::loadState ( IndexedFrame indexedFrame, NetplayManager&
             netMan._state = it->netplayState;
             netMan._startWorldTime = it->startWorldTime;
             netMan._indexedFrame = it->indexedFrame;
-            it->load();
 
             // Erase all other states after the current one.
             // Note: it.base() returns 1 after the position of it, but moving forward.
             for ( auto jt = it.base(); jt != _statesList.end(); ++jt )
             {
-                _freeStack.push ( jt->rawBytes - _memoryPool.get() );
+                waitForJobs ( & ( *jt ) );
+                freeState ( *jt );
             }
 
+            // The worker may still be compressing or hashing the loaded state if it was outside the window
+            waitForJobs ( & ( *it ) );
+
+            // The loaded state becomes the most recent one, so it is kept uncompressed
+            if ( ! it->rawBytes )
+                uncompressState ( *it );
+
+            it->load();
+
             _statesList.erase ( it.base(), _statesList.end() );
 
             // Initialize the SFX filter by flagging all played SFX flags in the range (R,S),
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "DllNetplayManager.hpp"
+#include "MerkleTree.hpp"
 #include "Constants.hpp"
 
 #include <memory>
 #include <stack>
 #include <list>
+#include <deque>
 #include <array>
+#include <vector>
 #include <cfenv>
 
 
@@ -28,6 +31,21 @@ public:
     // Finalize rollback sound effects
     void finishedRerunSounds();
 
+    // Get the next hash of a confirmed game state, returns null if there are none.
+    // A game state is confirmed once all the inputs before it are known and no earlier rollback is pending.
+    MsgPtr getStateHash();
+
+    // Get the local hashes of the children of the given nodes in the hash tree of a hashed game state.
+    // Without any nodes, this returns the children of the root. Returns null if the tree is no longer available.
+    MsgPtr getStateHashNodes ( IndexedFrame indexedFrame ) const;
+    MsgPtr getStateHashNodes ( IndexedFrame indexedFrame, const std::vector<uint32_t>& parents ) const;
+
+    // Compare remote hashes with the local hash tree, returns the nodes that don't match
+    std::vector<uint32_t> compareStateHashNodes ( const StateHashNodes& stateHashNodes ) const;
+
+    // Describe the memory ranges covered by a leaf of the hash tree
+    std::string describeStateHashLeaf ( uint32_t node ) const;
+
 private:
 
     struct GameState
@@ -39,23 +57,100 @@ private:
         IndexedFrame indexedFrame;
         std::fenv_t fp_env;
 
-        // The pointer to the raw bytes in the state pool
+        // The pointer to the raw bytes in the state pool, null if the state has been compressed
         char *rawBytes;
 
+        // Zero-run compressed bytes, only used once the state leaves the uncompressed window
+        std::vector<char> compressedBytes;
+
+        // Number of unfinished worker jobs, the frame thread must not touch the bytes of this state until 0
+        uint32_t jobs;
+
+        // True once the state has been handed over to the worker for compression
+        bool released;
+
         // Save / load the game state
         void save();
         void load();
     };
 
-    // Memory pool to allocate game states
+    // Memory pool to allocate uncompressed game states
     std::shared_ptr<char> _memoryPool;
 
     // Unused indices in the memory pool, each game state has the same size
     std::stack<size_t> _freeStack;
 
+    // Temporary buffer used when compressing game states without the worker
+    std::vector<char> _compressBuffer;
+
+    // Type of work done on a game state outside the rollback window
+    enum class JobType : uint8_t { Stop, Compress, Hash };
+
+    struct Job
+    {
+        JobType type;
+        GameState *state;
+    };
+
+    struct JobResult
+    {
+        JobType type;
+        GameState *state;
+        MerkleTree tree;
+    };
+
+    // Worker thread that compresses and hashes game states, null if there is no spare CPU core
+    class Worker;
+    std::shared_ptr<Worker> _worker;
+
+    // Number of jobs posted to the worker whose results have not been finished yet
+    size_t _numJobs = 0;
+
     // List of saved game states in chronological order
     std::list<GameState> _statesList;
 
     // History of sound effect playbacks
     std::array<std::array<uint8_t, CC_SFX_ARRAY_LEN>, NUM_ROLLBACK_STATES> _sfxHistory;
+
+    // Frames of saved game states to hash once they are confirmed
+    std::deque<IndexedFrame> _pendingHashes;
+
+    // Hashes of confirmed game states
+    std::deque<MsgPtr> _stateHashes;
+
+    // Hash trees of the most recently hashed game states, kept for locating desyncs
+    std::deque<std::pair<IndexedFrame, MerkleTree>> _stateTrees;
+
+    // Return the memory used by a game state to the pool
+    void freeState ( const GameState& state );
+
+    // Hand the states that just left the uncompressed window over to the worker for compression
+    void compressOldStates();
+
+    // Post a job for a game state outside the rollback window, this runs immediately if there is no worker
+    void postJob ( JobType type, GameState& state );
+
+    // Finish the results of jobs done by the worker, returns false if there were none
+    bool finishJobs();
+
+    // Apply the result of a job on the frame thread
+    void finishJob ( JobResult& result );
+
+    // Wait until the worker has finished all the jobs of the given state, or all jobs if null
+    void waitForJobs ( const GameState *state = 0 );
+
+    // Run a job, this only touches the given state and buffer, so it is safe to call from the worker
+    static void runJob ( JobResult& result, std::vector<char>& buffer );
+
+    // Uncompress a game state back into the memory pool
+    void uncompressState ( GameState& state );
+
+    // Hash any pending game states that are now confirmed
+    void hashConfirmedStates ( const NetplayManager& netMan );
+
+    // Hash the bytes of a game state, each leaf of the tree covers STATE_HASH_LEAF_SIZE bytes
+    static MerkleTree hashState ( const GameState& state, std::vector<char>& buffer );
+
+    // Get the hash tree of a hashed game state, returns null if it is no longer available
+    const MerkleTree *getStateTree ( IndexedFrame indexedFrame ) const;
 };
@@ -1,6 +1,7 @@
 #include "SpectatorManager.hpp"
 #include "DllNetplayManager.hpp"
 #include "ProcessManager.hpp"
+#include "TimerManager.hpp"
 #include "Logger.hpp"
 #include "Algorithms.hpp"
 #include "Constants.hpp"
@@ -10,7 +11,6 @@ using namespace std;
 
 SpectatorManager::SpectatorManager ( NetplayManager *netManPtr, const ProcessManager *procManPtr )
     : _spectatorListPos ( _spectatorList.end() )
-    , _spectatorMapPos ( _spectatorMap.end() )
     , _netManPtr ( netManPtr )
     , _procManPtr ( procManPtr )
 {
@@ -59,9 +59,6 @@ void SpectatorManager::pushSpectator ( Socket *socketPtr, const IpAddrPort& serv
 
     _spectatorMap[socketPtr] = spectator;
 
-    if ( _spectatorMap.size() == 1 || _spectatorMapPos == _spectatorMap.cend() )
-        _spectatorMapPos = _spectatorMap.cbegin();
-
     _netManPtr->preserveStartIndex = min ( _netManPtr->preserveStartIndex, spectator.pos.parts.index );
 
     LOG ( "socket=%08x; spectator.pos=[%s]; preserveStartIndex=%u",
@@ -98,17 +95,134 @@ void SpectatorManager::popSpectator ( Socket *socketPtr )
     if ( _spectatorListPos == it->second.it )
         ++_spectatorListPos;
 
-    if ( _spectatorMapPos == it )
-        ++_spectatorMapPos;
-
     _spectatorList.erase ( it->second.it );
     _spectatorMap.erase ( socketPtr );
 }
 
 void SpectatorManager::newRngState ( const RngState& rngState )
 {
+    const MsgPtr msg ( const_cast<RngState *> ( &rngState ), ignoreMsgPtr );
+    const string buffer = Protocol::encode ( msg );
+
     for ( Socket *socket : _spectatorList )
-        socket->send ( rngState );
+        socket->sendEncoded ( msg, buffer );
+}
+
+const EncodedMsg& SpectatorManager::getEncodedBothInputs ( IndexedFrame pos )
+{
+    const auto it = _encodedBothInputs.find ( pos.value );
+
+    if ( it != _encodedBothInputs.end() )
+        return it->second;
+
+    EncodedMsg& encoded = _encodedBothInputs[pos.value];
+    encoded.msg = _netManPtr->getBothInputs ( pos );
+    encoded.buffer = Protocol::encode ( encoded.msg );
+    encoded.next = pos;
+    return encoded;
+}
+
+const EncodedMsg& SpectatorManager::getEncodedRngState ( uint32_t index )
+{
+    const auto it = _encodedRngStates.find ( index );
+
+    if ( it != _encodedRngStates.end() )
+        return it->second;
+
+    EncodedMsg& encoded = _encodedRngStates[index];
+    encoded.msg = _netManPtr->getRngState ( index );
+    encoded.buffer = Protocol::encode ( encoded.msg );
+    return encoded;
+}
+
+const EncodedMsg& SpectatorManager::getEncodedMenuIndex ( uint32_t index )
+{
+    const auto it = _encodedMenuIndices.find ( index );
+
+    if ( it != _encodedMenuIndices.end() )
+        return it->second;
+
+    EncodedMsg& encoded = _encodedMenuIndices[index];
+    encoded.msg = _netManPtr->getRetryMenuIndex ( index );
+    encoded.buffer = Protocol::encode ( encoded.msg );
+    return encoded;
+}
+
+const EncodedMsg& SpectatorManager::getEncodedBothInputsBlock ( IndexedFrame pos )
+{
+    const auto it = _encodedBlocks.find ( pos.value );
+
+    if ( it != _encodedBlocks.end() )
+        return it->second;
+
+    EncodedMsg& encoded = _encodedBlocks[pos.value];
+    encoded.msg = _netManPtr->getBothInputsBlock ( pos, CATCH_UP_BLOCK_FRAMES );
+    encoded.buffer = Protocol::encode ( encoded.msg );
+    encoded.next = pos;
+    return encoded;
+}
+
+bool SpectatorManager::isCatchingUp ( const Spectator& spectator ) const
+{
+    const uint32_t index = _netManPtr->getIndex();
+    const uint32_t frame = _netManPtr->getFrame();
+
+    // More than one transition index behind
+    if ( spectator.pos.parts.index + 1 < index )
+        return true;
+
+    // In the previous transition index, so at least the current frame behind
+    if ( spectator.pos.parts.index + 1 == index )
+        return ( frame >= CATCH_UP_THRESHOLD );
+
+    return ( spectator.pos.parts.index == index && frame >= spectator.pos.parts.frame + CATCH_UP_THRESHOLD );
+}
+
+void SpectatorManager::sendInputs ( Socket *socket, Spectator& spectator, bool catchUp )
+{
+    const uint32_t oldIndex = spectator.pos.parts.index;
+
+    LOG ( "socket=%08x; spectator.pos=[%s]; preserveStartIndex=%u; catchUp=%u",
+          socket, spectator.pos, _netManPtr->preserveStartIndex, catchUp );
+
+    const EncodedMsg& bothInputs = ( catchUp ? getEncodedBothInputsBlock ( spectator.pos )
+                                     : getEncodedBothInputs ( spectator.pos ) );
+    spectator.pos = bothInputs.next;
+
+    // Send inputs if available
+    if ( bothInputs.msg )
+        socket->sendEncoded ( bothInputs.msg, bothInputs.buffer );
+
+    // Clear sent flags whenever the index changes
+    if ( spectator.pos.parts.index > oldIndex )
+    {
+        spectator.sentRngState = false;
+        spectator.sentRetryMenuIndex = false;
+    }
+
+    // Send RngState ONCE if available
+    if ( !spectator.sentRngState )
+    {
+        const EncodedMsg& rngState = getEncodedRngState ( oldIndex );
+
+        if ( rngState.msg )
+        {
+            socket->sendEncoded ( rngState.msg, rngState.buffer );
+            spectator.sentRngState = true;
+        }
+    }
+
+    // Send retry menu index ONCE if available
+    if ( !spectator.sentRetryMenuIndex )
+    {
+        const EncodedMsg& menuIndex = getEncodedMenuIndex ( oldIndex );
+
+        if ( menuIndex.msg )
+        {
+            socket->sendEncoded ( menuIndex.msg, menuIndex.buffer );
+            spectator.sentRetryMenuIndex = true;
+        }
+    }
 }
 
 void SpectatorManager::frameStepSpectators()
@@ -116,27 +230,44 @@ void SpectatorManager::frameStepSpectators()
     if ( _spectatorMap.empty() )
     {
         _spectatorListPos = _spectatorList.end();
-        _spectatorMapPos = _spectatorMap.cend();
 
         // Reset the preserve index
         _netManPtr->preserveStartIndex = _currentMinIndex = UINT_MAX;
         return;
     }
 
-    if ( _spectatorMapPos == _spectatorMap.cend() )
-        _spectatorMapPos = _spectatorMap.cbegin();
+    // Periodically measure the latency and the number of spectators relayed by each spectator
+    if ( ( *CC_WORLD_TIMER_ADDR ) % RELAY_STATUS_INTERVAL == 0 )
+    {
+        const MsgPtr msg ( new RelayStatus ( TimerManager::get().getNow(), numRelayed() ) );
+        const string buffer = Protocol::encode ( msg );
+
+        for ( Socket *socket : _spectatorList )
+            socket->sendEncoded ( msg, buffer );
+    }
 
-    if ( _spectatorMap.size() > 1 )
-        ++_spectatorMapPos;
+    // Spectators at the same position this frame get the same bytes, so messages are only encoded once
+    _encodedBothInputs.clear();
+    _encodedBlocks.clear();
+    _encodedRngStates.clear();
+    _encodedMenuIndices.clear();
 
-    if ( _spectatorMapPos == _spectatorMap.cend() )
-        _spectatorMapPos = _spectatorMap.cbegin();
+    // Spectators that are far behind, eg late joiners, are sent the backlog in large blocks at a much higher rate
+    // than the normal broadcast, until they are close enough to the current frame.
+    if ( ( *CC_WORLD_TIMER_ADDR ) % CATCH_UP_INTERVAL == 0 )
+    {
+        for ( auto& kv : _spectatorMap )
+        {
+            if ( isCatchingUp ( kv.second ) )
+                sendInputs ( kv.first, kv.second, true );
+        }
+    }
 
     // Number of times to broadcast per frame
     const uint32_t multiplier = 1 + ( _spectatorList.size() * 2 ) / ( NUM_INPUTS + 1 );
 
-    // Number of frames between each broadcast
-    const uint32_t interval = ( multiplier * NUM_INPUTS / 2 ) / _spectatorList.size();
+    // Number of frames between each broadcast, at least every frame since the multiplier is rounded down
+    const uint32_t interval = max<uint32_t> ( 1, ( multiplier * NUM_INPUTS / 2 ) / _spectatorList.size() );
 
     if ( ( *CC_WORLD_TIMER_ADDR ) % interval )
         return;
@@ -160,75 +291,77 @@ void SpectatorManager::frameStepSpectators()
 
         ASSERT ( it != _spectatorMap.end() );
 
-        Socket *socket = it->first;
         Spectator& spectator = it->second;
-        const uint32_t oldIndex = spectator.pos.parts.index;
 
-        LOG ( "socket=%08x; spectator.pos=[%s]; preserveStartIndex=%u",
-              socket, spectator.pos, _netManPtr->preserveStartIndex );
+        sendInputs ( it->first, spectator, isCatchingUp ( spectator ) );
+
+        ++_spectatorListPos;
 
-        MsgPtr msgBothInputs = _netManPtr->getBothInputs ( spectator.pos );
+        // Update the current min index
+        _currentMinIndex = min ( _currentMinIndex, spectator.pos.parts.index );
+    }
+}
 
-        // Send inputs if available
-        if ( msgBothInputs )
-            socket->send ( msgBothInputs );
+uint32_t SpectatorManager::numRelayed() const
+{
+    uint32_t count = 0;
 
-        // Clear sent flags whenever the index changes
-        if ( spectator.pos.parts.index > oldIndex )
-        {
-            spectator.sentRngState = false;
-            spectator.sentRetryMenuIndex = false;
-        }
+    for ( const auto& kv : _spectatorMap )
+        count += 1 + kv.second.relayed;
 
-        MsgPtr msgRngState = _netManPtr->getRngState ( oldIndex );
+    return count;
+}
 
-        // Send RngState ONCE if available
-        if ( msgRngState && !spectator.sentRngState )
-        {
-            socket->send ( msgRngState );
-            spectator.sentRngState = true;
-        }
+const IpAddrPort& SpectatorManager::getRelayAddress()
+{
+    Spectator *best = 0;
+    uint64_t bestCost = UINT64_MAX;
+
+    for ( auto& kv : _spectatorMap )
+    {
+        // Spectators without a server port can't relay
+        if ( kv.second.serverAddr.port == 0 )
+            continue;
 
-        MsgPtr msgMenuIndex = _netManPtr->getRetryMenuIndex ( oldIndex );
+        const uint32_t latency = ( kv.second.latency == UINT_MAX ? RELAY_UNKNOWN_LATENCY : kv.second.latency );
+        const uint64_t cost = latency + uint64_t ( RELAY_SPECTATOR_COST ) * kv.second.relayed;
 
-        // Send retry menu index ONCE if available
-        if ( msgMenuIndex && !spectator.sentRetryMenuIndex )
+        if ( cost < bestCost )
         {
-            socket->send ( msgMenuIndex );
-            spectator.sentRetryMenuIndex = true;
+            best = &kv.second;
+            bestCost = cost;
         }
-
-        ++_spectatorListPos;
-
-        // Update the current min index
-        _currentMinIndex = min ( _currentMinIndex, spectator.pos.parts.index );
     }
-}
 
-const IpAddrPort& SpectatorManager::getRandomSpectatorAddress() const
-{
-    if ( _spectatorMap.empty() || _spectatorMapPos == _spectatorMap.cend() )
+    if ( ! best )
     {
         LOG ( "'%s'", NullAddress );
         return NullAddress;
     }
 
-    auto it = _spectatorMapPos;
+    ++best->relayed;
 
-#ifndef RELEASE
-    if ( it->second.serverAddr.port == 0 )
-    {
-        do
-        {
-            ++it;
+    LOG ( "'%s'; latency=%u; relayed=%u", best->serverAddr, best->latency, best->relayed );
+    return best->serverAddr;
+}
 
-            if ( it == _spectatorMap.end() )
-                it = _spectatorMap.begin();
-        }
-        while ( it->second.serverAddr.port == 0 && it != _spectatorMapPos );
-    }
-#endif
+void SpectatorManager::gotRelayStatus ( Socket *socket, const RelayStatus& relayStatus )
+{
+    const auto it = _spectatorMap.find ( socket );
+
+    if ( it == _spectatorMap.end() )
+        return;
+
+    Spectator& spectator = it->second;
+    const uint64_t now = TimerManager::get().getNow();
+    const uint32_t latency = ( now > relayStatus.time ? uint32_t ( now - relayStatus.time ) : 0 );
+
+    if ( spectator.latency == UINT_MAX )
+        spectator.latency = latency;
+    else
+        spectator.latency = ( 3 * spectator.latency + latency ) / 4;
+
+    spectator.relayed = relayStatus.relayed;
 
-    LOG ( "'%s'", it->second.serverAddr );
-    return it->second.serverAddr;
+    LOG ( "socket=%08x; latency=%u; relayed=%u", socket, spectator.latency, spectator.relayed );
 }
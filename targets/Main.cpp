@@ -262,8 +262,17 @@ int main ( int argc, char *argv[] )
         { Options::Tunnel,    0,  "", "tunnel", Arg::None,        "  --tunnel             Force UDP tunnel" },
         { Options::Dummy,     0,  "",  "dummy", Arg::None,        "  --dummy              Dummy with fake inputs" },
         { Options::PidLog,    0,  "", "pidlog", Arg::None,        "  --pidlog             Tag log files with the PID" },
+        { Options::AsyncLog,  0,  "", "asynclog", Arg::None,      "  --asynclog           Log on a background thread" },
+        { Options::Record,    0,  "", "record", Arg::None,        "  --record             Record each session to replay.rec" },
         { Options::FakeUi,    0,  "",   "fake", Arg::None,        "  --fake               Fake UI mode\n" },
 
+        {
+            Options::Predictor, 0, "", "predictor", Arg::Required,
+            "  --predictor P        Predict missing remote inputs with P.\n"
+            "                         markov (default) learns the opponent's transitions,\n"
+            "                         repeat repeats the last remote input.\n"
+        },
+
         {
             Options::StrictVersion, 0, "S", "strict", Arg::None,
             "  --strict, -S         Strict version match, can be stacked up to 3 times.\n"
@@ -287,6 +296,9 @@ int main ( int argc, char *argv[] )
         { Options::Tunnel, 0, "", "tunnel", Arg::None, 0 },
         { Options::Dummy, 0, "", "dummy", Arg::None, 0 },
         { Options::PidLog, 0, "", "pidlog", Arg::None, 0 },
+        { Options::AsyncLog, 0, "", "asynclog", Arg::None, 0 },
+        { Options::Predictor, 0, "", "predictor", Arg::Required, 0 },
+        { Options::Record, 0, "", "record", Arg::None, 0 },
         { Options::StrictVersion, 0, "S", "", Arg::None, 0 },
 #endif
 
@@ -382,12 +394,14 @@ int main ( int argc, char *argv[] )
     }
 
     // Initialize logging
+    const uint32_t logOptions = LOG_DEFAULT_OPTIONS | ( opt[Options::AsyncLog] ? LOG_ASYNC : 0 );
+
     if ( opt[Options::Stdout] )
-        Logger::get().initialize();
+        Logger::get().initialize ( "", logOptions );
     else if ( opt[Options::PidLog] )
-        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE, LOG_DEFAULT_OPTIONS | PID_IN_FILENAME );
+        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE, logOptions | PID_IN_FILENAME );
     else
-        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE );
+        Logger::get().initialize ( ProcessManager::appDir + LOG_FILE, logOptions );
     Logger::get().logVersion();
 
     LOG ( "Running from: %s", ProcessManager::appDir );
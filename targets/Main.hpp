@@ -16,6 +16,12 @@
 // Log file that contains all the data needed to keep games in sync
 #define SYNC_LOG_FILE FOLDER "sync.log"
 
+// Binary recording of the inputs, rollbacks, RngStates, and SyncHashes of the last session
+#define REPLAY_RECORD_FILE FOLDER "replay.rec"
+
+// Recent events kept in memory, dumped on a desync, stop, or crash
+#define FLIGHT_DUMP_FILE FOLDER "flight.dump"
+
 // Controller mappings file extension
 #define MAPPINGS_EXT ".mappings"
 
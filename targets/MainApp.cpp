@@ -111,6 +111,12 @@ struct MainApp
 
     bool isDummyReady = false;
 
+    // The spectator server address of the game, resent to the new parent when reconnecting
+    IpAddrPort spectateServerAddr;
+
+    // Indicates if this spectator lost its relay, and is reconnecting to the original address to resume spectating
+    bool isReconnecting = false;
+
     TimerPtr startTimer;
 
     IndexedFrame dummyFrame = {{ 0, 0 }};
@@ -652,6 +658,49 @@ struct MainApp
         startGameIfReady();
     }
 
+    void gotReconnectMsg ( const MsgPtr& msg )
+    {
+        ASSERT ( isReconnecting == true );
+
+        switch ( msg->getMsgType() )
+        {
+            case MsgType::VersionConfig:
+                // The version was already checked when we first connected
+                return;
+
+            case MsgType::SpectateConfig:
+                if ( msg->getAs<SpectateConfig>().sessionId != spectateConfig.sessionId )
+                {
+                    LOG ( "sessionId='%s' is not the spectated session", msg->getAs<SpectateConfig>().sessionId );
+                    break;
+                }
+
+                LOG ( "Resuming from '%s'", address );
+
+                isReconnecting = false;
+
+                // The game is already running, so confirm immediately and send our spectator server address,
+                // then the new relay sends the inputs, which the game already has up to its current position.
+                ctrlSocket->send ( new ConfirmConfig() );
+                ctrlSocket->send ( spectateServerAddr );
+                return;
+
+            case MsgType::ErrorMessage:
+                LOG ( "ErrorMessage: %s", msg->getAs<ErrorMessage>().error );
+                break;
+
+            default:
+                LOG ( "Unexpected '%s' while reconnecting", msg );
+                return;
+        }
+
+        isReconnecting = false;
+        ctrlSocket.reset();
+
+        forwardMsgQueue();
+        procMan.ipcSend ( new ErrorMessage ( "Disconnected!" ) );
+    }
+
     void gotDummyMsg ( const MsgPtr& msg )
     {
         ASSERT ( options[Options::Dummy] );
@@ -800,10 +849,12 @@ struct MainApp
 
             syncLog.sessionId = ( clientMode.isSpectate() ? spectateConfig.sessionId : netplayConfig.sessionId );
 
+            const uint32_t logOptions = ( options[Options::AsyncLog] ? LOG_ASYNC : 0 );
+
             if ( options[Options::PidLog] )
-                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, PID_IN_FILENAME );
+                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, logOptions | PID_IN_FILENAME );
             else
-                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, 0 );
+                syncLog.initialize ( ProcessManager::appDir + SYNC_LOG_FILE, logOptions );
             syncLog.logVersion();
             return;
         }
@@ -925,10 +976,23 @@ struct MainApp
 
             LOG ( "%s disconnected!", ( socket == ctrlSocket.get() ? "ctrlSocket" : "dataSocket" ) );
 
-            // TODO auto reconnect to original host address
+            // TODO auto reconnect to original host address when netplaying, only spectators reconnect for now
 
             if ( socket == ctrlSocket.get() && clientMode.isSpectate() )
             {
+                // If the relay spectator we were redirected to left, go back to the original address to be redirected
+                // to a new relay, then resume spectating from it without restarting the game.
+                if ( isQueueing && !isReconnecting && !spectateServerAddr.empty() && address != originalAddress )
+                {
+                    LOG ( "Reconnecting to '%s'", originalAddress );
+
+                    isReconnecting = true;
+                    address = originalAddress;
+                    ctrlSocket = SmartSocket::connectTCP ( this, address, options[Options::Tunnel] );
+                    return;
+                }
+
+                isReconnecting = false;
                 forwardMsgQueue();
                 procMan.ipcSend ( new ErrorMessage ( "Disconnected!" ) );
                 return;
@@ -980,6 +1044,11 @@ struct MainApp
             gotVersionConfig ( socket, msg->getAs<VersionConfig>() );
             return;
         }
+        else if ( isReconnecting && socket == ctrlSocket.get() )
+        {
+            gotReconnectMsg ( msg );
+            return;
+        }
         else if ( isDummyReady )
         {
             gotDummyMsg ( msg );
@@ -1099,6 +1168,10 @@ struct MainApp
                 return;
 
             case MsgType::IpAddrPort:
+                if ( clientMode.isSpectate() )
+                    spectateServerAddr = msg->getAs<IpAddrPort>();
+
+            case MsgType::RelayStatus:
                 if ( ctrlSocket && ctrlSocket->isConnected() )
                     ctrlSocket->send ( msg );
                 return;
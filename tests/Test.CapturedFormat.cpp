@@ -0,0 +1,121 @@
+#ifndef RELEASE
+
+#include "CapturedFormat.hpp"
+#include "IndexedFrame.hpp"
+#include "Enum.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+
+ENUM ( CaptureEnum, First, Second );
+
+
+// Fixed size string that doesn't copy small types, like the flight recorder
+struct FixedString
+{
+    static const bool CopySmallTypes = false;
+
+    char str[16];
+
+    FixedString ( const char *src, size_t len )
+    {
+        len = min<size_t> ( len, sizeof ( str ) - 1 );
+        memcpy ( str, src, len );
+        str[len] = 0;
+    }
+};
+
+static ostream& operator<< ( ostream& os, const FixedString& str ) { return ( os << str.str ); }
+
+// Unbounded string that copies small types, like the asynchronous logger
+struct CopyingString
+{
+    static const bool CopySmallTypes = true;
+
+    string str;
+
+    CopyingString ( const char *str, size_t len ) : str ( str, len ) {}
+};
+
+static ostream& operator<< ( ostream& os, const CopyingString& str ) { return ( os << str.str ); }
+
+
+template<typename S, typename ... V>
+static string captureAndFormat ( const char *fmt, const V& ... args )
+{
+    typedef CapturedFormat<typename CapturedArg<V, S>::type ...> Captured;
+
+    const Captured captured ( fmt, CapturedArg<V, S>::capture ( args ) ... );
+    return captured.str();
+}
+
+
+TEST ( CapturedFormat, Types )
+{
+    static_assert ( CapturedArg<int, FixedString>::isCopied, "Numbers must be copied" );
+    static_assert ( CapturedArg<CaptureEnum, FixedString>::isCopied, "ENUMs must be copied" );
+    static_assert ( ! CapturedArg<char *, CopyingString>::isCopied, "Char pointers must not be copied" );
+    static_assert ( ! CapturedArg<string, CopyingString>::isCopied, "Strings must not be copied" );
+
+    static_assert ( CapturedArg<IndexedFrame, CopyingString>::isCopied, "Small types must be copied if enabled" );
+    static_assert ( ! CapturedArg<IndexedFrame, FixedString>::isCopied, "Small types must be formatted if disabled" );
+}
+
+TEST ( CapturedFormat, SameAsFormat )
+{
+    const IndexedFrame indexedFrame = {{ 12, 34 }};
+    const string str = "a%%b";
+    const char *null = 0;
+
+    const CaptureEnum value ( CaptureEnum::Second );
+    const string expected = format ( "[%s] %s %s %s %u %08x %.2f %s", indexedFrame, str, value, "(null)", 5, 0xAB, 1.5,
+                                     "chars" );
+
+    char chars[] = "chars";
+
+    EXPECT_EQ ( expected, ( captureAndFormat<CopyingString> ( "[%s] %s %s %s %u %08x %.2f %s", indexedFrame, str,
+                            value, null, 5, 0xAB, 1.5, chars ) ) );
+    EXPECT_EQ ( expected, ( captureAndFormat<FixedString> ( "[%s] %s %s %s %u %08x %.2f %s", indexedFrame, str,
+                            value, null, 5, 0xAB, 1.5, chars ) ) );
+
+    // Without arguments, %% is not unescaped, like format
+    EXPECT_EQ ( format ( "100%%" ), captureAndFormat<CopyingString> ( "100%%" ) );
+}
+
+TEST ( CapturedFormat, CapturedChars )
+{
+    char chars[] = "chars";
+
+    const CapturedFormat<FixedString> captured ( "%s", CapturedArg<char *, FixedString>::capture ( chars ) );
+
+    // The char pointer is copied, so it can change before formatting
+    chars[0] = 'X';
+
+    EXPECT_EQ ( "chars", captured.str() );
+
+    // Strings longer than the fixed size are truncated
+    EXPECT_EQ ( "0123456789abcde", captureAndFormat<FixedString> ( "%s", "0123456789abcdefghij" ) );
+}
+
+TEST ( CapturedFormat, FixedBuffer )
+{
+    char buffer[8];
+
+    const char *fmt = "%s %u!";
+    FormatBuffer out ( buffer, sizeof ( buffer ) );
+    formatTo ( out, fmt, fmt + strlen ( fmt ), "abc", 12345 );
+
+    // Truncated to the buffer, without allocating
+    EXPECT_EQ ( "abc 1234", out.str() );
+
+    fmt = "%.3f!";
+    FormatBuffer out2 ( buffer, sizeof ( buffer ) );
+    formatTo ( out2, fmt, fmt + strlen ( fmt ), 1234.5 );
+
+    // Values printed with snprintf keep what fits before the terminating null, and nothing is appended after them
+    EXPECT_EQ ( "1234.50", out2.str() );
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,69 @@
+#ifndef RELEASE
+
+#include "Enum.hpp"
+#include "NetplayStates.hpp"
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+
+using namespace std;
+
+
+ENUM ( TestEnum, First, Second, Third );
+
+
+TEST ( Enum, Names )
+{
+    EXPECT_EQ ( 4u, TestEnum::numNames() );
+
+    EXPECT_STREQ ( "TestEnum::Unknown", TestEnum().name() );
+    EXPECT_STREQ ( "TestEnum::Third", TestEnum ( TestEnum::Third ).name() );
+    EXPECT_STREQ ( "NetplayState::RetryMenu", NetplayState ( NetplayState::RetryMenu ).name() );
+
+    // The names are the same static strings every time
+    EXPECT_EQ ( TestEnum ( TestEnum::First ).name(), TestEnum::name ( TestEnum::First ) );
+
+    const TestEnum invalid ( ( TestEnum::Enum ) 10 );
+
+    EXPECT_EQ ( 0, invalid.name() );
+    EXPECT_EQ ( "TestEnum::Second", TestEnum ( TestEnum::Second ).str() );
+    EXPECT_EQ ( "Unknown (10)", invalid.str() );
+
+    ostringstream ss;
+    ss << TestEnum ( TestEnum::Second ) << ' ' << invalid;
+    EXPECT_EQ ( "TestEnum::Second Unknown (10)", ss.str() );
+}
+
+TEST ( Enum, Parse )
+{
+    TestEnum::Enum value = TestEnum::Unknown;
+
+    EXPECT_TRUE ( TestEnum::parse ( "Second", value ) );
+    EXPECT_EQ ( TestEnum::Second, value );
+
+    EXPECT_TRUE ( TestEnum::parse ( "TestEnum::Third", value ) );
+    EXPECT_EQ ( TestEnum::Third, value );
+
+    EXPECT_TRUE ( TestEnum::parse ( "Unknown", value ) );
+    EXPECT_EQ ( TestEnum::Unknown, value );
+
+    // Only the given length is compared
+    const char *line = "First [1:2] tag";
+    EXPECT_TRUE ( TestEnum::parse ( line, 5, value ) );
+    EXPECT_EQ ( TestEnum::First, value );
+
+    // Invalid names leave the value unchanged
+    EXPECT_FALSE ( TestEnum::parse ( line, 4, value ) );
+    EXPECT_FALSE ( TestEnum::parse ( "", value ) );
+    EXPECT_FALSE ( TestEnum::parse ( "TestEnum::", value ) );
+    EXPECT_FALSE ( TestEnum::parse ( "Secondd", value ) );
+    EXPECT_FALSE ( TestEnum::parse ( "Other::First", value ) );
+    EXPECT_EQ ( TestEnum::First, value );
+
+    NetplayState::Enum state = NetplayState::Unknown;
+    EXPECT_TRUE ( NetplayState::parse ( "CharaSelect", state ) );
+    EXPECT_EQ ( NetplayState::CharaSelect, state );
+}
+
+#endif // NOT RELEASE
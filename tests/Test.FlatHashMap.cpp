@@ -0,0 +1,104 @@
+#ifndef RELEASE
+
+#include "tools/FlatHashMap.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <unordered_map>
+
+using namespace std;
+
+
+#define NUM_ROUNDS      ( 50 )
+#define NUM_OPERATIONS  ( 20000 )
+
+
+// Apply the same random operations to both maps, and check that every result matches
+TEST ( FlatHashMap, MatchesUnorderedMap )
+{
+    mt19937 rng ( 1 );
+
+    for ( int round = 0; round < NUM_ROUNDS; ++round )
+    {
+        SCOPED_TRACE ( round );
+
+        FlatHashMap<uint32_t, uint32_t> flat;
+        unordered_map<uint32_t, uint32_t> expected;
+
+        // Few distinct keys in the early rounds, so the table stays small and the probes wrap around its end often
+        const uint32_t maxKeys = 8 << ( round % 8 );
+
+        for ( int i = 0; i < NUM_OPERATIONS; ++i )
+        {
+            SCOPED_TRACE ( i );
+
+            const uint32_t key = rng() % maxKeys;
+            const uint32_t value = rng();
+
+            switch ( rng() % 8 )
+            {
+                case 0:
+                case 1:
+                case 2:
+                    flat[key] = value;
+                    expected[key] = value;
+                    break;
+
+                case 3:
+                case 4:
+                case 5:
+                    ASSERT_EQ ( expected.erase ( key ) == 1, flat.erase ( key ) );
+                    break;
+
+                case 6:
+                {
+                    const auto it = expected.find ( key );
+                    const uint32_t *found = flat.find ( key );
+
+                    ASSERT_EQ ( it != expected.end(), found != 0 );
+
+                    if ( found )
+                    {
+                        ASSERT_EQ ( it->second, *found );
+                    }
+                    break;
+                }
+
+                default:
+                    // Inserting a default value if not found
+                    ASSERT_EQ ( expected[key], flat[key] );
+                    break;
+            }
+
+            ASSERT_EQ ( expected.size(), flat.size() );
+        }
+
+        // Every key is still reachable after all the backward shifts
+        for ( const auto& kv : expected )
+        {
+            const uint32_t *found = flat.find ( kv.first );
+
+            ASSERT_TRUE ( found != 0 );
+            ASSERT_EQ ( kv.second, *found );
+        }
+
+        size_t count = 0;
+
+        flat.forEach ( [&] ( uint32_t key, uint32_t value )
+        {
+            ++count;
+            EXPECT_EQ ( expected[key], value );
+        } );
+
+        EXPECT_EQ ( expected.size(), count );
+        EXPECT_EQ ( expected.size(), flat.size() );
+
+        flat.clear();
+
+        EXPECT_TRUE ( flat.empty() );
+        EXPECT_FALSE ( flat.contains ( 0 ) );
+    }
+}
+
+#endif // NOT RELEASE
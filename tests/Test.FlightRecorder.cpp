@@ -0,0 +1,111 @@
+#ifndef RELEASE
+
+#include "FlightRecorder.hpp"
+#include "IndexedFrame.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+using namespace std;
+
+
+#define DUMP_FILE "test_flight.dump"
+
+
+TEST ( FlightRecorder, DumpFormat )
+{
+    FlightRecorder recorder;
+
+    // Nothing is recorded before initializing
+    recorder.log ( FlightChannel::Sync, "ignored" );
+
+    recorder.initialize();
+
+    const IndexedFrame indexedFrame = {{ 12, 34 }};
+    const string str = "a%%b";
+    char chars[] = "chars";
+
+    recorder.log ( FlightChannel::Sync, "[%s] %s %s %u %08x", indexedFrame, str, chars, 5, 0xAB );
+
+    // Records are only formatted when dumping, after this
+    chars[0] = 'X';
+
+    const FlightFrameEvent frame = { 34, 12, 34, 20, 0x1234, 0x5678, FlightFrame::Rollback };
+    recorder.frame ( frame );
+
+    FlightNetworkEvent network;
+    memset ( &network, 0, sizeof ( network ) );
+    network.value = 42;
+    network.event = FlightNetwork::Read;
+    recorder.network ( network );
+
+    recorder.text ( FlightChannel::Log, "text" );
+
+    ASSERT_TRUE ( recorder.dump ( DUMP_FILE, "Test" ) );
+
+    recorder.deinitialize();
+
+    FlightDumpReader reader;
+    string error;
+
+    ASSERT_TRUE ( reader.open ( DUMP_FILE, error ) ) << error;
+
+    EXPECT_EQ ( "Test", reader.reason );
+    ASSERT_EQ ( 4u, reader.records.size() );
+
+    // Records are in the order they were recorded, regardless of the channel
+    EXPECT_EQ ( FlightType::Text, reader.records[0].header.type );
+    EXPECT_EQ ( FlightChannel::Sync, reader.records[0].header.channel );
+    EXPECT_EQ ( format ( "[%s] %s %s %u %08x", indexedFrame, str, "chars", 5, 0xAB ), reader.records[0].payload );
+
+    EXPECT_EQ ( FlightType::Frame, reader.records[1].header.type );
+    EXPECT_EQ ( 0, memcmp ( &frame, &reader.records[1].payload[0], sizeof ( frame ) ) );
+
+    EXPECT_EQ ( FlightType::Network, reader.records[2].header.type );
+    EXPECT_EQ ( 42u, reader.records[2].get<FlightNetworkEvent>().value );
+
+    EXPECT_EQ ( "text", reader.records[3].payload );
+
+    remove ( DUMP_FILE );
+}
+
+TEST ( FlightRecorder, Overwrite )
+{
+    FlightRecorder recorder;
+
+    recorder.initialize();
+
+    // Enough records to wrap around the channel several times
+    const uint32_t count = 4 * FLIGHT_CHANNEL_SIZE / ( sizeof ( FlightRecordHeader ) + 16 );
+
+    for ( uint32_t i = 0; i < count; ++i )
+        recorder.log ( FlightChannel::Sync, "%u %s", i, ( i % 3 ? "" : "padding" ) );
+
+    ASSERT_TRUE ( recorder.dump ( DUMP_FILE, "Test" ) );
+
+    recorder.deinitialize();
+
+    FlightDumpReader reader;
+    string error;
+
+    ASSERT_TRUE ( reader.open ( DUMP_FILE, error ) ) << error;
+    ASSERT_FALSE ( reader.records.empty() );
+    EXPECT_LT ( reader.records.size(), count );
+
+    // Only the newest records are kept, with none missing in between
+    uint32_t next = count - reader.records.size();
+
+    for ( const FlightDumpReader::Record& record : reader.records )
+    {
+        uint32_t i = 0;
+        ASSERT_EQ ( 1, sscanf ( record.payload.c_str(), "%u", &i ) ) << record.payload;
+        EXPECT_EQ ( next++, i );
+    }
+
+    EXPECT_EQ ( count, next );
+
+    remove ( DUMP_FILE );
+}
+
+#endif // NOT RELEASE
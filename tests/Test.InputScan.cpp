@@ -0,0 +1,133 @@
+#ifndef RELEASE
+
+#include "InputScan.hpp"
+#include "InputsContainer.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+
+using namespace std;
+
+
+#define NUM_ITERATIONS  ( 10000 )
+#define MAX_INPUTS      ( 100 )
+
+
+static bool anyInputHasMaskScalar ( const uint16_t *inputs, size_t n, uint16_t mask )
+{
+    for ( size_t i = 0; i < n; ++i )
+    {
+        if ( inputs[i] & mask )
+            return true;
+    }
+
+    return false;
+}
+
+static bool allInputsHaveMaskScalar ( const uint16_t *inputs, size_t n, uint16_t mask )
+{
+    for ( size_t i = 0; i < n; ++i )
+    {
+        if ( ! ( inputs[i] & mask ) )
+            return false;
+    }
+
+    return true;
+}
+
+static bool anyInputHasDirectionScalar ( const uint16_t *inputs, size_t n, uint16_t dir1, uint16_t dir2 )
+{
+    for ( size_t i = 0; i < n; ++i )
+    {
+        if ( ( inputs[i] & 0xF ) == dir1 || ( inputs[i] & 0xF ) == dir2 )
+            return true;
+    }
+
+    return false;
+}
+
+
+TEST ( InputScan, RandomSpans )
+{
+    mt19937 rng ( 1 );
+
+    vector<uint16_t> inputs ( MAX_INPUTS + 1 );
+
+    for ( int i = 0; i < NUM_ITERATIONS; ++i )
+    {
+        // Mostly sparse inputs, so matches can be anywhere in the span including the scalar tail
+        const uint32_t density = 1 + rng() % 64;
+
+        for ( uint16_t& input : inputs )
+            input = ( rng() % density == 0 ? uint16_t ( rng() ) : uint16_t ( rng() % 2 ? 0xFFF0 : 0 ) );
+
+        // Start at an odd offset sometimes, so loads are unaligned
+        const size_t offset = rng() % 2;
+        const size_t n = rng() % MAX_INPUTS;
+        const uint16_t *span = &inputs[offset];
+
+        const uint16_t mask = ( 1u << ( rng() % 16 ) );
+
+        EXPECT_EQ ( anyInputHasMaskScalar ( span, n, mask ), anyInputHasMask ( span, n, mask ) );
+        EXPECT_EQ ( allInputsHaveMaskScalar ( span, n, mask ), allInputsHaveMask ( span, n, mask ) );
+        EXPECT_EQ ( anyInputHasDirectionScalar ( span, n, 2, 8 ), anyInputHasDirection ( span, n, 2, 8 ) );
+    }
+}
+
+TEST ( InputScan, Edges )
+{
+    vector<uint16_t> inputs ( 17, 0x0010 );
+
+    EXPECT_FALSE ( anyInputHasMask ( &inputs[0], 0, 0xFFFF ) );
+    EXPECT_TRUE ( allInputsHaveMask ( &inputs[0], 0, 0xFFFF ) );
+    EXPECT_FALSE ( anyInputHasDirection ( &inputs[0], 0, 0, 0 ) );
+
+    EXPECT_TRUE ( allInputsHaveMask ( &inputs[0], inputs.size(), 0x0010 ) );
+
+    // A single input without the mask in the SIMD part or the scalar tail
+    for ( size_t i = 0; i < inputs.size(); ++i )
+    {
+        inputs[i] = 0x0002;
+
+        EXPECT_FALSE ( allInputsHaveMask ( &inputs[0], inputs.size(), 0x0010 ) );
+        EXPECT_TRUE ( anyInputHasDirection ( &inputs[0], inputs.size(), 2, 8 ) );
+        EXPECT_FALSE ( anyInputHasDirection ( &inputs[0], inputs.size(), 4, 6 ) );
+
+        inputs[i] = 0x0010;
+    }
+}
+
+TEST ( InputScan, ReadHistory )
+{
+    mt19937 rng ( 2 );
+
+    InputsContainer<uint16_t> container;
+
+    for ( uint32_t index = 0; index < 4; ++index )
+    {
+        const uint32_t numFrames = rng() % 600;
+
+        for ( uint32_t frame = 0; frame < numFrames; ++frame )
+            container.set ( index, frame, uint16_t ( rng() ) );
+    }
+
+    container.predict ( 3, container.getEndFrame ( 3 ) + 2, 0x1234 );
+
+    vector<uint16_t> buffer ( 2 * MAX_INPUTS );
+
+    for ( int i = 0; i < NUM_ITERATIONS; ++i )
+    {
+        const uint32_t index = rng() % 6;
+        const uint32_t frame = rng() % 700;
+        const size_t n = rng() % buffer.size();
+
+        const uint16_t *read = container.read ( index, frame, &buffer[0], n );
+
+        for ( size_t j = 0; j < n; ++j )
+            ASSERT_EQ ( container.get ( index, frame + j ), read[j] );
+    }
+}
+
+#endif // NOT RELEASE
@@ -0,0 +1,355 @@
+#ifndef RELEASE
+
+#include "InputsContainer.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+#include <map>
+
+using namespace std;
+
+
+#define NUM_ITERATIONS  ( 100000 )
+#define MAX_INDICES     ( 8 )
+#define MAX_FRAMES      ( 700 )
+#define MAX_INPUTS      ( 300 )
+
+
+// The previous implementation with one flat vector per index, plus the prediction overlay
+template<typename T>
+class FlatInputsContainer
+{
+public:
+
+    T get ( uint32_t index, uint32_t frame ) const
+    {
+        if ( index >= _inputs.size() || _inputs[index].empty() )
+            return lastInputBefore ( index );
+
+        if ( frame >= _inputs[index].size() )
+        {
+            const auto it = _predicted.find ( frame );
+
+            if ( index == _predictedIndex && it != _predicted.end() )
+                return it->second;
+
+            return _inputs[index].back();
+        }
+
+        return _inputs[index][frame];
+    }
+
+    void get ( uint32_t index, uint32_t frame, T *t, size_t n ) const
+    {
+        copy ( _inputs[index].begin() + frame, _inputs[index].begin() + frame + n, t );
+    }
+
+    void set ( uint32_t index, uint32_t frame, T t )
+    {
+        if ( _inputs.size() > index && _inputs[index].size() > frame )
+            return;
+
+        resize ( index, frame );
+
+        _inputs[index][frame] = t;
+    }
+
+    void assign ( uint32_t index, uint32_t frame, T t )
+    {
+        resize ( index, frame );
+
+        _inputs[index][frame] = t;
+    }
+
+    void set ( uint32_t index, uint32_t frame, T t, size_t n )
+    {
+        resize ( index, frame, n );
+
+        fill ( _inputs[index].begin() + frame, _inputs[index].begin() + frame + n, t );
+    }
+
+    void set ( uint32_t index, uint32_t frame, const T *t, size_t n, uint32_t checkStartingFromIndex = UINT_MAX )
+    {
+        if ( index >= checkStartingFromIndex )
+        {
+            for ( size_t i = 0; i < n; ++i )
+            {
+                if ( get ( index, frame + i ) == t[i] )
+                    continue;
+
+                const IndexedFrame f = {{ uint32_t ( frame + i ), index }};
+                _lastChangedFrame.value = min ( _lastChangedFrame.value, f.value );
+                break;
+            }
+        }
+
+        resize ( index, frame, n );
+
+        copy ( t, t + n, &_inputs[index][frame] );
+    }
+
+    // Predictions are contiguous, the gaps take the last known input, and the known frames are dropped
+    void predict ( uint32_t index, uint32_t frame, T t )
+    {
+        if ( index >= _inputs.size() || _inputs[index].empty() || frame < _inputs[index].size() )
+            return;
+
+        if ( index != _predictedIndex )
+        {
+            _predictedIndex = index;
+            _predicted.clear();
+        }
+
+        _predicted.erase ( _predicted.begin(), _predicted.lower_bound ( _inputs[index].size() ) );
+
+        if ( ! _predicted.empty() )
+        {
+            const uint32_t first = min ( _predicted.begin()->first, frame );
+            const uint32_t last = max ( _predicted.rbegin()->first, frame );
+
+            for ( uint32_t i = first; i <= last; ++i )
+                _predicted.insert ( { i, _inputs[index].back() } );
+        }
+
+        _predicted[frame] = t;
+    }
+
+    void resize ( uint32_t index, uint32_t frame, size_t n = 1 )
+    {
+        T last = 0;
+
+        if ( index >= _inputs.size() )
+        {
+            last = lastInputBefore ( _inputs.size() );
+            _inputs.resize ( index + 1 );
+        }
+        else if ( ! _inputs[index].empty() )
+        {
+            last = _inputs[index].back();
+        }
+
+        if ( frame + n > _inputs[index].size() )
+            _inputs[index].resize ( frame + n, last );
+    }
+
+    void clear()
+    {
+        clearPredicted();
+        _inputs.clear();
+    }
+
+    void clearPredicted()
+    {
+        _predictedIndex = UINT_MAX;
+        _predicted.clear();
+    }
+
+    bool empty() const
+    {
+        return _inputs.empty();
+    }
+
+    bool empty ( size_t index ) const
+    {
+        return ( index >= _inputs.size() || _inputs[index].empty() );
+    }
+
+    uint32_t getEndIndex() const
+    {
+        return _inputs.size();
+    }
+
+    uint32_t getEndFrame() const
+    {
+        return ( _inputs.empty() ? 0 : _inputs.back().size() );
+    }
+
+    uint32_t getEndFrame ( size_t index ) const
+    {
+        return ( index >= _inputs.size() ? 0 : _inputs[index].size() );
+    }
+
+    void eraseIndexOlderThan ( size_t index )
+    {
+        clearPredicted();
+
+        if ( index + 1 >= _inputs.size() )
+            _inputs.clear();
+        else
+            _inputs.erase ( _inputs.begin(), _inputs.begin() + index );
+    }
+
+    IndexedFrame getLastChangedFrame() const
+    {
+        return _lastChangedFrame;
+    }
+
+    void clearLastChangedFrame()
+    {
+        _lastChangedFrame = MaxIndexedFrame;
+    }
+
+private:
+
+    vector<vector<T>> _inputs;
+
+    IndexedFrame _lastChangedFrame = MaxIndexedFrame;
+
+    map<uint32_t, T> _predicted;
+    uint32_t _predictedIndex = UINT_MAX;
+
+    T lastInputBefore ( uint32_t index ) const
+    {
+        if ( index > _inputs.size() )
+            index = _inputs.size();
+
+        while ( index > 0 )
+        {
+            --index;
+            if ( ! _inputs[index].empty() )
+                return _inputs[index].back();
+        }
+
+        return 0;
+    }
+};
+
+
+// Apply the same random operations to both containers, and check that every result matches
+TEST ( InputsContainer, MatchesFlatContainer )
+{
+    mt19937 rng ( 1 );
+
+    InputsContainer<uint16_t> paged;
+    FlatInputsContainer<uint16_t> flat;
+
+    vector<uint16_t> inputs ( MAX_INPUTS ), expected ( MAX_INPUTS ), actual ( MAX_INPUTS );
+
+    // Few distinct inputs, so the changed frame detection sees both equal and different inputs
+    auto randomInput = [&]() { return uint16_t ( rng() % 4 ); };
+
+    for ( int i = 0; i < NUM_ITERATIONS; ++i )
+    {
+        SCOPED_TRACE ( i );
+
+        const uint32_t index = rng() % MAX_INDICES;
+        const uint32_t frame = rng() % MAX_FRAMES;
+        const size_t n = 1 + rng() % MAX_INPUTS;
+        const uint16_t input = randomInput();
+
+        switch ( rng() % 16 )
+        {
+            case 0:
+            case 1:
+                paged.set ( index, frame, input );
+                flat.set ( index, frame, input );
+                break;
+
+            case 2:
+                paged.assign ( index, frame, input );
+                flat.assign ( index, frame, input );
+                break;
+
+            case 3:
+                paged.set ( index, frame, input, n );
+                flat.set ( index, frame, input, n );
+                break;
+
+            case 4:
+            case 5:
+            {
+                for ( size_t j = 0; j < n; ++j )
+                    inputs[j] = randomInput();
+
+                const uint32_t checkStartingFromIndex = ( rng() % 2 ? 0 : UINT_MAX );
+
+                paged.set ( index, frame, &inputs[0], n, checkStartingFromIndex );
+                flat.set ( index, frame, &inputs[0], n, checkStartingFromIndex );
+                break;
+            }
+
+            case 6:
+                paged.resize ( index, frame, n );
+                flat.resize ( index, frame, n );
+                break;
+
+            case 7:
+            case 8:
+            {
+                // Predict just after the known inputs most of the time, like the rollback does
+                const uint32_t predicted = paged.getEndFrame ( index ) + rng() % 8;
+
+                paged.predict ( index, predicted, input );
+                flat.predict ( index, predicted, input );
+                break;
+            }
+
+            case 9:
+                paged.clearPredicted();
+                flat.clearPredicted();
+                break;
+
+            case 10:
+            {
+                const size_t erased = rng() % ( MAX_INDICES / 2 );
+
+                paged.eraseIndexOlderThan ( erased );
+                flat.eraseIndexOlderThan ( erased );
+                break;
+            }
+
+            case 11:
+                if ( rng() % 16 == 0 )
+                {
+                    paged.clear();
+                    flat.clear();
+                }
+                break;
+
+            case 12:
+                EXPECT_EQ ( flat.getLastChangedFrame().value, paged.getLastChangedFrame().value );
+                paged.clearLastChangedFrame();
+                flat.clearLastChangedFrame();
+                break;
+
+            default:
+            {
+                // Read a range of known inputs
+                const size_t size = flat.getEndFrame ( index );
+
+                if ( size == 0 )
+                    break;
+
+                const uint32_t start = rng() % size;
+                const size_t count = min<size_t> ( n, size - start );
+
+                flat.get ( index, start, &expected[0], count );
+                paged.get ( index, start, &actual[0], count );
+
+                for ( size_t j = 0; j < count; ++j )
+                    ASSERT_EQ ( expected[j], actual[j] );
+                break;
+            }
+        }
+
+        ASSERT_EQ ( flat.empty(), paged.empty() );
+        ASSERT_EQ ( flat.getEndIndex(), paged.getEndIndex() );
+        ASSERT_EQ ( flat.getEndFrame(), paged.getEndFrame() );
+        ASSERT_EQ ( flat.getLastChangedFrame().value, paged.getLastChangedFrame().value );
+
+        // Check some single inputs, including past the known inputs and indices
+        for ( int j = 0; j < 8; ++j )
+        {
+            const uint32_t checkIndex = rng() % ( MAX_INDICES + 2 );
+            const uint32_t checkFrame = rng() % ( MAX_FRAMES + MAX_INPUTS );
+
+            ASSERT_EQ ( flat.empty ( checkIndex ), paged.empty ( checkIndex ) );
+            ASSERT_EQ ( flat.getEndFrame ( checkIndex ), paged.getEndFrame ( checkIndex ) );
+            ASSERT_EQ ( flat.get ( checkIndex, checkFrame ), paged.get ( checkIndex, checkFrame ) );
+        }
+    }
+}
+
+#endif // NOT RELEASE
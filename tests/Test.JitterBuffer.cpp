@@ -0,0 +1,82 @@
+#ifndef RELEASE
+
+#include "JitterBuffer.hpp"
+
+#include <gtest/gtest.h>
+
+using namespace std;
+
+
+TEST ( JitterBuffer, Jitter )
+{
+    JitterBuffer buffer;
+
+    EXPECT_EQ ( JITTER_BUFFER_MIN_TARGET, buffer.getTarget() );
+
+    // Inputs arriving exactly as fast as they are played have no jitter, even in bursts
+    for ( uint64_t i = 1; i <= 20; ++i )
+        buffer.arrived ( i * 500, 30 );
+
+    EXPECT_EQ ( 0.0, buffer.getJitter() );
+    EXPECT_EQ ( JITTER_BUFFER_MIN_TARGET, buffer.getTarget() );
+
+    // Alternating early and late arrivals increase the target
+    for ( uint64_t i = 1; i <= 20; ++i )
+        buffer.arrived ( 10000 + i * 500 + ( i % 2 ? 100 : 0 ), 30 );
+
+    EXPECT_GT ( buffer.getJitter(), 50.0 );
+    EXPECT_GT ( buffer.getTarget(), JITTER_BUFFER_MIN_TARGET + 12 );
+
+    // A long gap is limited to the largest target
+    buffer.arrived ( 1000000, 30 );
+    EXPECT_EQ ( JITTER_BUFFER_MAX_TARGET, buffer.getTarget() );
+
+    // Then the jitter decays once the inputs are steady again
+    const double jitter = buffer.getJitter();
+
+    for ( uint64_t i = 1; i <= 20; ++i )
+        buffer.arrived ( 1000000 + i * 500, 30 );
+
+    EXPECT_LT ( buffer.getJitter(), jitter / 2 );
+
+    buffer.clear();
+    EXPECT_EQ ( 0.0, buffer.getJitter() );
+}
+
+TEST ( JitterBuffer, Speed )
+{
+    JitterBuffer buffer;
+
+    // The speed only changes once per window
+    for ( uint32_t i = 0; i + 1 < JITTER_BUFFER_WINDOW; ++i )
+        EXPECT_EQ ( JITTER_BUFFER_FPS, buffer.update ( 100 ) );
+
+    // Far ahead of the target, so speed up by at most the maximum adjustment
+    EXPECT_EQ ( JITTER_BUFFER_FPS * ( 1 + JITTER_BUFFER_MAX_ADJUST ), buffer.update ( 100 ) );
+    EXPECT_EQ ( 100u, buffer.getLowDepth() );
+
+    // The lowest depth over the window is used, and a stall counts as an empty buffer, so slow down
+    for ( uint32_t i = 0; i + 1 < JITTER_BUFFER_WINDOW; ++i )
+        buffer.update ( 100 );
+
+    buffer.stalled();
+
+    EXPECT_LT ( buffer.update ( 30 ), JITTER_BUFFER_FPS );
+    EXPECT_EQ ( 0u, buffer.getLowDepth() );
+    EXPECT_EQ ( 1u, buffer.getStalls() );
+
+    // Slightly ahead of the target, so speed up slightly
+    for ( uint32_t i = 0; i < JITTER_BUFFER_WINDOW; ++i )
+        buffer.update ( buffer.getTarget() + 6 );
+
+    EXPECT_GT ( buffer.getFps(), JITTER_BUFFER_FPS );
+    EXPECT_LT ( buffer.getFps(), JITTER_BUFFER_FPS * ( 1 + JITTER_BUFFER_MAX_ADJUST ) );
+
+    // At the target, so play at the normal speed
+    for ( uint32_t i = 0; i < JITTER_BUFFER_WINDOW; ++i )
+        buffer.update ( buffer.getTarget() );
+
+    EXPECT_EQ ( JITTER_BUFFER_FPS, buffer.getFps() );
+}
+
+#endif // NOT RELEASE
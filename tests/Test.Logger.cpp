@@ -0,0 +1,133 @@
+#ifndef RELEASE
+
+#include "Logger.hpp"
+#include "Thread.hpp"
+#include "IndexedFrame.hpp"
+
+#include <gtest/gtest.h>
+
+#include <fstream>
+#include <vector>
+#include <memory>
+#include <cstdio>
+
+using namespace std;
+
+
+#define LOG_FILE        "test_async.log"
+#define NUM_THREADS     ( 4 )
+#define NUM_MESSAGES    ( 10000 )
+
+
+static vector<string> readLines ( const string& file )
+{
+    vector<string> lines;
+    ifstream fin ( file.c_str() );
+    string line;
+
+    while ( getline ( fin, line ) )
+        lines.push_back ( line );
+
+    return lines;
+}
+
+TEST ( Logger, AsyncFormat )
+{
+    Logger logger;
+
+    const IndexedFrame indexedFrame = {{ 12, 34 }};
+    const string str = "a%%b";
+    char chars[] = "chars";
+
+    logger.initialize ( LOG_FILE, 0 );
+    LOG_TO ( logger, "[%s] %s %s %s %u %08x %.2f", indexedFrame, str, chars, ( const char * ) chars, 5, 0xAB, 1.5 );
+    LOG_TO ( logger, "no args" );
+    logger.deinitialize();
+
+    const vector<string> expected = readLines ( LOG_FILE );
+
+    logger.initialize ( LOG_FILE, LOG_ASYNC );
+
+    EXPECT_TRUE ( logger.isAsync() );
+
+    LOG_TO ( logger, "[%s] %s %s %s %u %08x %.2f", indexedFrame, str, chars, ( const char * ) chars, 5, 0xAB, 1.5 );
+
+    // Messages are only formatted on the background thread, after this
+    chars[0] = 'X';
+
+    LOG_TO ( logger, "no args" );
+    logger.deinitialize();
+
+    EXPECT_FALSE ( logger.isAsync() );
+
+    const vector<string> lines = readLines ( LOG_FILE );
+
+    ASSERT_EQ ( 2u, expected.size() );
+    EXPECT_EQ ( expected, lines );
+
+    remove ( LOG_FILE );
+}
+
+TEST ( Logger, AsyncThreads )
+{
+    Logger logger;
+
+    logger.initialize ( LOG_FILE, LOG_ASYNC );
+
+    class LogThread : public Thread
+    {
+    public:
+
+        LogThread ( Logger& logger, int id ) : _logger ( logger ), _id ( id ) {}
+
+        void run() override
+        {
+            for ( int i = 0; i < NUM_MESSAGES; ++i )
+            {
+                LOG_TO ( _logger, "%d %d", _id, i );
+
+                // Give the background thread time to catch up, since full buffers drop messages
+                if ( i % 1000 == 999 )
+                    _logger.flush();
+            }
+        }
+
+    private:
+
+        Logger& _logger;
+
+        int _id;
+    };
+
+    vector<shared_ptr<LogThread>> threads;
+
+    for ( int i = 0; i < NUM_THREADS; ++i )
+    {
+        threads.push_back ( make_shared<LogThread> ( logger, i ) );
+        threads.back()->start();
+    }
+
+    for ( const auto& thread : threads )
+        thread->join();
+
+    logger.deinitialize();
+
+    const vector<string> lines = readLines ( LOG_FILE );
+
+    ASSERT_EQ ( ( size_t ) NUM_THREADS * NUM_MESSAGES, lines.size() );
+
+    // Messages from each thread are in order
+    vector<int> next ( NUM_THREADS, 0 );
+
+    for ( const string& line : lines )
+    {
+        int id = -1, i = -1;
+        ASSERT_EQ ( 2, sscanf ( line.c_str(), "%d %d", &id, &i ) ) << line;
+        ASSERT_TRUE ( id >= 0 && id < NUM_THREADS );
+        EXPECT_EQ ( next[id]++, i );
+    }
+
+    remove ( LOG_FILE );
+}
+
+#endif // NOT RELEASE
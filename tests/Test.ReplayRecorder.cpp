@@ -0,0 +1,172 @@
+#ifndef RELEASE
+
+#include "ReplayRecorder.hpp"
+
+#include <gtest/gtest.h>
+
+#include <random>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+using namespace ReplayFile;
+
+
+#define RECORD_FILE     "test_recording.rec"
+#define NUM_FRAMES      ( 100000 )
+
+
+TEST ( ReplayRecorder, RoundTrip )
+{
+    mt19937 rng ( 1 );
+
+    vector<InputsRecord> inputs;
+    vector<RollbackFrameRecord> rollbacks;
+    vector<RngStateRecord> rngStates;
+    vector<SyncHashRecord> syncHashes;
+
+    {
+        Recorder recorder;
+
+        ASSERT_TRUE ( recorder.start ( RECORD_FILE ) );
+
+        IndexedFrame indexedFrame = {{ 0, 0 }};
+
+        for ( uint32_t i = 0; i < NUM_FRAMES; ++i, ++indexedFrame.parts.frame )
+        {
+            if ( i % 5000 == 0 )
+            {
+                indexedFrame.parts.frame = 0;
+                ++indexedFrame.parts.index;
+
+                RngStateRecord rngState;
+                rngState.index = indexedFrame.parts.index;
+                rngState.rngState0 = rng();
+                rngState.rngState1 = rng();
+                rngState.rngState2 = rng();
+
+                for ( char& c : rngState.rngState3 )
+                    c = ( char ) rng();
+
+                recorder.rngState ( rngState );
+                rngStates.push_back ( rngState );
+            }
+
+            const InputsRecord record = { indexedFrame, ( uint16_t ) ( rng() & 0xFF ), 0, 0 };
+
+            recorder.inputs ( record.indexedFrame, record.p1, record.p2 );
+            inputs.push_back ( record );
+
+            if ( i % 150 == 149 )
+            {
+                SyncHashRecord syncHash;
+                memset ( &syncHash, 0, sizeof ( syncHash ) );
+                syncHash.indexedFrame = indexedFrame;
+                syncHash.roundTimer = i;
+
+                recorder.syncHash ( syncHash );
+                syncHashes.push_back ( syncHash );
+            }
+
+            if ( i % 1000 == 999 )
+            {
+                IndexedFrame target = indexedFrame;
+                target.parts.frame -= 3;
+
+                recorder.rollback ( indexedFrame, target );
+                rollbacks.push_back ( { indexedFrame, target } );
+
+                recorder.reinputs ( target, 1, 2 );
+            }
+        }
+
+        recorder.stop();
+
+        EXPECT_FALSE ( recorder.isRecording() );
+    }
+
+    RecordReader reader;
+    string error;
+
+    ASSERT_TRUE ( reader.open ( RECORD_FILE, error ) ) << error;
+
+    RecordType type;
+    const char *payload;
+
+    size_t numInputs = 0, numReinputs = 0, numRollbacks = 0, numRngStates = 0, numSyncHashes = 0;
+
+    while ( reader.next ( type, payload ) )
+    {
+        switch ( type )
+        {
+            case RecordType::Inputs:
+            {
+                ASSERT_LT ( numInputs, inputs.size() );
+                const InputsRecord record = RecordReader::get<InputsRecord> ( payload );
+                EXPECT_EQ ( inputs[numInputs].indexedFrame.value, record.indexedFrame.value );
+                EXPECT_EQ ( inputs[numInputs].p1, record.p1 );
+                ++numInputs;
+                break;
+            }
+
+            case RecordType::Reinputs:
+                EXPECT_EQ ( 2, RecordReader::get<InputsRecord> ( payload ).p2 );
+                ++numReinputs;
+                break;
+
+            case RecordType::Rollback:
+                ASSERT_LT ( numRollbacks, rollbacks.size() );
+                EXPECT_EQ ( rollbacks[numRollbacks].target.value,
+                            RecordReader::get<RollbackFrameRecord> ( payload ).target.value );
+                ++numRollbacks;
+                break;
+
+            case RecordType::RngState:
+                ASSERT_LT ( numRngStates, rngStates.size() );
+                EXPECT_EQ ( 0, memcmp ( &rngStates[numRngStates], payload, sizeof ( RngStateRecord ) ) );
+                ++numRngStates;
+                break;
+
+            case RecordType::SyncHash:
+                ASSERT_LT ( numSyncHashes, syncHashes.size() );
+                EXPECT_EQ ( syncHashes[numSyncHashes].roundTimer,
+                            RecordReader::get<SyncHashRecord> ( payload ).roundTimer );
+                ++numSyncHashes;
+                break;
+
+            default:
+                FAIL() << "Invalid record type";
+        }
+    }
+
+    EXPECT_EQ ( inputs.size(), numInputs );
+    EXPECT_EQ ( rollbacks.size(), numReinputs );
+    EXPECT_EQ ( rollbacks.size(), numRollbacks );
+    EXPECT_EQ ( rngStates.size(), numRngStates );
+    EXPECT_EQ ( syncHashes.size(), numSyncHashes );
+
+    remove ( RECORD_FILE );
+}
+
+TEST ( ReplayRecorder, Empty )
+{
+    {
+        Recorder recorder;
+
+        ASSERT_TRUE ( recorder.start ( RECORD_FILE ) );
+    }
+
+    RecordReader reader;
+    string error;
+
+    ASSERT_TRUE ( reader.open ( RECORD_FILE, error ) ) << error;
+
+    RecordType type;
+    const char *payload;
+
+    EXPECT_FALSE ( reader.next ( type, payload ) );
+
+    remove ( RECORD_FILE );
+}
+
+#endif // NOT RELEASE
@@ -273,6 +273,67 @@ struct BaseTestSocket : public Socket::Owner, public Timer::Owner
         TimerManager::get().deinitialize();                                                                         \
     }
 
+#define TEST_SEND_ENCODED(T, LOSS, FAIL, KEEP_ALIVE, TIMEOUT)                                                       \
+    TEST ( T, SendEncoded ) {                                                                                       \
+        static int done = 0;                                                                                        \
+        done = 0;                                                                                                   \
+        struct TestSocket : public BaseTestSocket<T, KEEP_ALIVE, TIMEOUT> {                                         \
+            MsgPtr msg;                                                                                             \
+            void socketAccepted ( Socket *serverSocket ) override {                                                 \
+                accepted = serverSocket->accept ( this );                                                           \
+                MsgPtr message ( new TestMessage ( "Hello client!" ) );                                             \
+                accepted->sendEncoded ( message, Protocol::encode ( message ) );                                    \
+            }                                                                                                       \
+            void socketConnected ( Socket *socket ) override {                                                      \
+                MsgPtr message ( new TestMessage ( "Hello server!" ) );                                             \
+                socket->sendEncoded ( message, Protocol::encode ( message ) );                                      \
+            }                                                                                                       \
+            void socketRead ( Socket *socket, const MsgPtr& msg, const IpAddrPort& address ) override {             \
+                this->msg = msg;                                                                                    \
+                ++done;                                                                                             \
+                if ( done >= 2 ) {                                                                                  \
+                    LOG ( "Stopping because all msgs have been received" );                                         \
+                    EventManager::get().stop();                                                                     \
+                }                                                                                                   \
+            }                                                                                                       \
+            void timerExpired ( Timer *timer ) override {                                                           \
+                LOG ( "Stopping because of timeout" );                                                              \
+                EventManager::get().stop();                                                                         \
+            }                                                                                                       \
+            TestSocket ( uint16_t port ) : BaseTestSocket ( port )                                                  \
+            { socket->setPacketLoss ( LOSS ); socket->setCheckSumFail ( FAIL ); }                                   \
+            TestSocket ( const string& address, uint16_t port ) : BaseTestSocket ( address, port )                  \
+            { socket->setPacketLoss ( LOSS ); socket->setCheckSumFail ( FAIL ); }                                   \
+        };                                                                                                          \
+        TimerManager::get().initialize();                                                                           \
+        SocketManager::get().initialize();                                                                          \
+        TestSocket server ( 0 );                                                                                    \
+        TestSocket client ( "127.0.0.1", server.socket->address.port );                                             \
+        EventManager::get().start();                                                                                \
+        EXPECT_TRUE ( server.socket.get() );                                                                        \
+        if ( server.socket.get() )                                                                                  \
+            EXPECT_TRUE ( server.socket->isServer() );                                                              \
+        EXPECT_TRUE ( server.accepted.get() );                                                                      \
+        if ( server.accepted.get() )                                                                                \
+            EXPECT_TRUE ( server.accepted->isConnected() );                                                         \
+        EXPECT_TRUE ( server.msg.get() );                                                                           \
+        if ( server.msg.get() ) {                                                                                   \
+            EXPECT_EQ ( MsgType::TestMessage, server.msg->getMsgType() );                                           \
+            EXPECT_EQ ( "Hello server!", server.msg->getAs<TestMessage>().str );                                    \
+        }                                                                                                           \
+        EXPECT_TRUE ( client.socket.get() );                                                                        \
+        if ( client.socket.get() )                                                                                  \
+            EXPECT_TRUE ( client.socket->isConnected() );                                                           \
+        EXPECT_TRUE ( client.msg.get() );                                                                           \
+        if ( client.msg.get() ) {                                                                                   \
+            EXPECT_EQ ( MsgType::TestMessage, client.msg->getMsgType() );                                           \
+            EXPECT_EQ ( "Hello client!", client.msg->getAs<TestMessage>().str );                                    \
+        }                                                                                                           \
+        EXPECT_EQ ( 2, done );                                                                                      \
+        SocketManager::get().deinitialize();                                                                        \
+        TimerManager::get().deinitialize();                                                                         \
+    }
+
 #define TEST_SEND_WITHOUT_SERVER(T, LOSS, FAIL, KEEP_ALIVE, TIMEOUT)                                                \
     TEST ( T, SendWithoutServer ) {                                                                                 \
         static int done = 0;                                                                                        \
@@ -0,0 +1,65 @@
+#ifndef RELEASE
+
+#include "StringUtils.hpp"
+#include "Enum.hpp"
+#include "IndexedFrame.hpp"
+
+#include <gtest/gtest.h>
+
+#include <climits>
+
+using namespace std;
+
+
+ENUM ( TestState, First, Second );
+
+
+TEST ( StringUtils, FormatIntegers )
+{
+    EXPECT_EQ ( "0 -1 4294967295 2147483647 -2147483648", format ( "%d %d %u %d %d", 0, -1, -1, INT_MAX, INT_MIN ) );
+    EXPECT_EQ ( "0x0000abcd 0X00ABCD 0 ff", format ( "0x%08x 0X%06X %x %x", 0xABCDu, 0xABCD, 0, ( uint8_t ) 0xFF ) );
+    EXPECT_EQ ( "-1 1 65 255", format ( "%d %u %d %u", ( char ) -1, true, 'A', ( uint8_t ) 255 ) );
+    EXPECT_EQ ( "   42 42   +42 002a", format ( "%5u %-5d%+d %04x", 42u, 42, 42, 42 ) );
+    EXPECT_EQ ( "12345678901 -5 1.50 2.5", format ( "%llu %lld %.2f %.1f", 12345678901ull, -5ll, 1.5, 2.5f ) );
+}
+
+TEST ( StringUtils, FormatStrings )
+{
+    const string str = "a%%b";
+    const char chars[] = "chars";
+    const char *ptr = "ptr";
+
+    EXPECT_EQ ( "a%b chars ptr", format ( "%s %s %s", str, chars, ptr ) );
+    EXPECT_EQ ( "[a%b  ] [ chars]", format ( "[%-5s] [%6s]", str, chars ) );
+
+    // Letters after a conversion are literal
+    EXPECT_EQ ( "charsLatest 5KB", format ( "%sLatest %uKB", chars, 5 ) );
+
+    // %% is unescaped in the format, but not when there are no arguments
+    EXPECT_EQ ( "100% 1", format ( "100%% %d", 1 ) );
+    EXPECT_EQ ( "100%%", format ( "100%%" ) );
+}
+
+TEST ( StringUtils, FormatObjects )
+{
+    const IndexedFrame indexedFrame = {{ 12, 34 }};
+    const TestState state = TestState::Second;
+
+    EXPECT_EQ ( "[34:12] TestState::Second", format ( "[%s] %s", indexedFrame, state ) );
+    EXPECT_EQ ( "TestState::Second", format ( "%s", ( const EnumBase& ) state ) );
+}
+
+TEST ( StringUtils, FormatArguments )
+{
+    // Missing arguments leave the conversion, and extra arguments are ignored
+    EXPECT_EQ ( "1 %u 50%", format ( "%d %u 50%%", 1 ) );
+    EXPECT_EQ ( "1 2", format ( "%d %d", 1, 2, 3 ) );
+    EXPECT_EQ ( "none", format ( "none", 1 ) );
+
+    // Long results don't fit on the stack
+    const string longStr ( 1000, 'x' );
+    EXPECT_EQ ( longStr + longStr + "1", format ( "%s%s%d", longStr, longStr, 1 ) );
+    EXPECT_EQ ( string ( 500, ' ' ) + "1", format ( "%501d", 1 ) );
+}
+
+#endif // NOT RELEASE
@@ -14,6 +14,8 @@ TEST_DISCONNECT_ACCEPTED    ( TcpSocket, 0, 0, 0, 1000 )
 
 TEST_SEND                   ( TcpSocket, 0, 0, 0, 1000 )
 
+TEST_SEND_ENCODED           ( TcpSocket, 0, 0, 0, 1000 )
+
 TEST_SEND_WITHOUT_SERVER    ( TcpSocket, 0, 0, 0, 1000 )
 
 TEST_SEND_PARTIAL           ( TcpSocket )
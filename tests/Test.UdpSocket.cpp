@@ -24,6 +24,8 @@ TEST_DISCONNECT_ACCEPTED    ( UdpSocket, 0, 0, 1000, LONG_TIMEOUT )
 
 TEST_SEND                   ( UdpSocket, PACKET_LOSS, CHECK_SUM_FAIL, LONG_TIMEOUT, LONG_TIMEOUT )
 
+TEST_SEND_ENCODED           ( UdpSocket, PACKET_LOSS, CHECK_SUM_FAIL, LONG_TIMEOUT, LONG_TIMEOUT )
+
 // This test doesn't make sense since there is only one UDP socket
 // TEST_SEND_WITHOUT_SERVER    ( UdpSocket, PACKET_LOSS, CHECK_SUM_FAIL, LONG_TIMEOUT, LONG_TIMEOUT )
 
@@ -0,0 +1,687 @@
+#include "MemDump.hpp"
+#include "Compression.hpp"
+
+#include <sys/mman.h>
+
+#include <map>
+#include <memory>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+
+using namespace std;
+
+
+// Linux native benchmark of the rollback save / load strategies, without the game.
+//
+// The rollback memory list is loaded from rollback.bin (as generated by tools/Generator.cpp), then a synthetic
+// image of the game's address space is mapped at the given base, with a synthetic heap for the pointed memory.
+// Each frame randomly modifies the image, then saves a state. Periodically, a rollback loads an earlier state,
+// and re-runs the frames up to the current one. Every loaded state is checked against the hash of the saved one.
+
+
+// Size of the synthetic heap for the memory reached through pointers
+#define HEAP_SIZE ( 64 * 1024 * 1024 )
+
+// Defaults for NUM_ROLLBACK_STATES and NUM_UNCOMPRESSED_STATES in a debug build,
+// Constants.hpp isn't included since it depends on the Windows headers.
+#define DEFAULT_ROLLBACK_STATES ( 256 )
+#define DEFAULT_UNCOMPRESSED_STATES ( 16 )
+
+// Size of the blocks compared by the delta strategy
+#define DELTA_BLOCK_SIZE ( 64 )
+
+#define ALIGN_PAGE(SIZE) ( ( ( SIZE ) + 0xFFF ) & ~ ( size_t ) 0xFFF )
+
+
+struct Options
+{
+    string file;
+
+    // Base address of the synthetic image, 0 to use the game's addresses
+    uintptr_t base = 0;
+
+    // Number of frames to run
+    uint32_t frames = 6000;
+
+    // Number of frames to rollback
+    uint32_t rollback = 8;
+
+    // Interval in frames between rollbacks
+    uint32_t interval = 4;
+
+    // Number of bytes modified per frame
+    uint32_t dirty = 4096;
+
+    // Fraction of non-zero bytes in the initial image
+    double density = 0.05;
+
+    // Number of rollback states, and the number of those kept uncompressed
+    uint32_t states = DEFAULT_ROLLBACK_STATES;
+    uint32_t uncompressed = DEFAULT_UNCOMPRESSED_STATES;
+};
+
+
+class SyntheticImage
+{
+public:
+
+    // Memory list relocated to the synthetic image
+    MemDumpList allAddrs;
+
+    ~SyntheticImage()
+    {
+        if ( _map )
+            munmap ( _map, _mapSize );
+    }
+
+    // Map the image at the given base, then fill it with random data
+    bool initialize ( const MemDumpList& gameAddrs, uintptr_t base, double density )
+    {
+        uintptr_t start = UINTPTR_MAX, end = 0;
+
+        for ( const MemDump& mem : gameAddrs.addrs )
+        {
+            start = min ( start, ( uintptr_t ) mem.addr );
+            end = max ( end, ( uintptr_t ) mem.addr + mem.size );
+        }
+
+        start &= ~ ( uintptr_t ) 0xFFF;
+
+        if ( base == 0 )
+            base = start;
+
+        _imageSize = ALIGN_PAGE ( end - start );
+        _mapSize = _imageSize + HEAP_SIZE;
+
+        // Pointer values are 32-bit, so the whole image must be mapped below 4GB
+        if ( base + _mapSize > 0xFFFFFFFFULL )
+        {
+            PRINT ( "Base address is too high: 0x%X", ( uint32_t ) base );
+            return false;
+        }
+
+        void *map = mmap ( ( void * ) base, _mapSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0 );
+
+        if ( map == MAP_FAILED )
+        {
+            PRINT ( "Failed to map 0x%X bytes at 0x%X", ( uint32_t ) _mapSize, ( uint32_t ) base );
+            return false;
+        }
+
+        _map = ( char * ) map;
+        _heap = _map + _imageSize;
+
+        for ( const MemDump& mem : gameAddrs.addrs )
+            allAddrs.append ( MemDump ( _map + ( ( uintptr_t ) mem.addr - start ), mem.size, mem.ptrs ) );
+
+        allAddrs.totalSize = gameAddrs.totalSize;
+
+        _nonZero = bernoulli_distribution ( density );
+
+        mt19937 rng ( 0 );
+
+        for ( const MemDump& mem : allAddrs.addrs )
+        {
+            fill ( mem.addr, mem.size, density, rng );
+
+            if ( ! allocatePtrs ( mem, mem.addr, density, rng ) )
+            {
+                PRINT ( "Synthetic heap is too small" );
+                return false;
+            }
+        }
+
+        for ( const pair<char *, size_t>& range : _ranges )
+            _totalRangeSize += range.second;
+
+        sort ( _ptrValues.begin(), _ptrValues.end() );
+        return true;
+    }
+
+    // Randomly modify the image, the pointer values are never modified.
+    // Runs are cleared or filled so that the fraction of non-zero bytes stays around the initial density.
+    void step ( mt19937& rng, uint32_t dirty )
+    {
+        while ( dirty )
+        {
+            // Modify a short run of bytes in a random range, weighted by size
+            size_t offset = rng() % _totalRangeSize;
+
+            auto it = _ranges.cbegin();
+
+            for ( ; offset >= it->second; ++it )
+                offset -= it->second;
+
+            const size_t len = min<size_t> ( min<size_t> ( 1 + rng() % 32, it->second - offset ), dirty );
+
+            const bool clear = ! _nonZero ( rng );
+
+            for ( size_t i = 0; i < len; ++i )
+            {
+                char *addr = it->first + offset + i;
+
+                if ( ! isPtrValue ( addr ) )
+                    *addr = ( clear ? 0 : ( char ) ( 1 + rng() % 255 ) );
+            }
+
+            dirty -= len;
+        }
+    }
+
+    size_t getImageSize() const { return _imageSize; }
+
+    size_t getHeapUsed() const { return _heapUsed; }
+
+private:
+
+    char *_map = 0, *_heap = 0;
+
+    size_t _mapSize = 0, _imageSize = 0, _heapUsed = 0, _totalRangeSize = 0;
+
+    // Memory ranges that are saved for rollback
+    vector<pair<char *, size_t>> _ranges;
+
+    // Addresses of pointer values, in ascending order
+    vector<char *> _ptrValues;
+
+    bernoulli_distribution _nonZero;
+
+    void fill ( char *addr, size_t size, double density, mt19937& rng )
+    {
+        // Game memory is mostly zero, with the non-zero bytes in short runs of 1 to 32 bytes
+        bernoulli_distribution nonZero ( density / 16.5 );
+
+        for ( size_t i = 0; i < size; ++i )
+        {
+            if ( ! nonZero ( rng ) )
+                continue;
+
+            for ( size_t end = min<size_t> ( size, i + 1 + rng() % 32 ); i < end; ++i )
+                addr[i] = ( char ) ( 1 + rng() % 255 );
+        }
+
+        _ranges.push_back ( make_pair ( addr, size ) );
+    }
+
+    // Allocate the heap memory for the child pointers, setting the pointer values
+    bool allocatePtrs ( const MemDumpBase& mem, char *addr, double density, mt19937& rng )
+    {
+        // Pointers with the same value may point to different parts of the same memory
+        map<size_t, size_t> extents;
+
+        for ( const MemDumpPtr& ptr : mem.ptrs )
+        {
+            size_t& extent = extents[ptr.srcOffset];
+            extent = max ( extent, ptr.dstOffset + ptr.size );
+        }
+
+        for ( const auto& kv : extents )
+        {
+            const size_t size = ( kv.second + 15 ) & ~ ( size_t ) 15;
+
+            if ( _heapUsed + size > HEAP_SIZE )
+                return false;
+
+            char *block = _heap + _heapUsed;
+            _heapUsed += size;
+
+            * ( uint32_t * ) ( addr + kv.first ) = ( uint32_t ) ( uintptr_t ) block;
+            _ptrValues.push_back ( addr + kv.first );
+        }
+
+        for ( const MemDumpPtr& ptr : mem.ptrs )
+        {
+            char *dstAddr = ptr.getAddr();
+
+            fill ( dstAddr, ptr.size, density, rng );
+
+            if ( ! allocatePtrs ( ptr, dstAddr, density, rng ) )
+                return false;
+        }
+
+        return true;
+    }
+
+    bool isPtrValue ( const char *addr ) const
+    {
+        auto it = upper_bound ( _ptrValues.cbegin(), _ptrValues.cend(), addr );
+
+        if ( it == _ptrValues.cbegin() )
+            return false;
+
+        --it;
+        return ( addr < *it + sizeof ( uint32_t ) );
+    }
+};
+
+
+class Strategy
+{
+public:
+
+    Strategy ( uint32_t numStates ) : _numStates ( numStates ) {}
+
+    virtual ~Strategy() {}
+
+    virtual const char *getName() const = 0;
+
+    // Save the current memory for the given frame
+    virtual void saveState ( uint32_t frame ) = 0;
+
+    // Load the memory of the given frame, discarding any later states
+    virtual void loadState ( uint32_t frame ) = 0;
+
+    // Bytes of memory used by the saved states
+    virtual size_t getMemoryUsed() const = 0;
+
+protected:
+
+    // Number of states that can be loaded
+    const uint32_t _numStates;
+};
+
+
+// Copies the whole memory list into a ring of states, like DllRollbackManager without compression
+class FullStrategy : public Strategy
+{
+public:
+
+    FullStrategy ( const MemDumpList& allAddrs, uint32_t numStates )
+        : Strategy ( numStates ), _allAddrs ( allAddrs ), _states ( numStates * allAddrs.totalSize ) {}
+
+    const char *getName() const override { return "full"; }
+
+    void saveState ( uint32_t frame ) override
+    {
+        char *dump = getState ( frame );
+
+        for ( const MemDump& mem : _allAddrs.addrs )
+            mem.saveDump ( dump );
+    }
+
+    void loadState ( uint32_t frame ) override
+    {
+        const char *dump = getState ( frame );
+
+        for ( const MemDump& mem : _allAddrs.addrs )
+            mem.loadDump ( dump );
+    }
+
+    size_t getMemoryUsed() const override { return _states.size(); }
+
+protected:
+
+    const MemDumpList& _allAddrs;
+
+    vector<char> _states;
+
+    char *getState ( uint32_t frame )
+    {
+        return &_states [ ( frame % _numStates ) * _allAddrs.totalSize ];
+    }
+};
+
+
+// Same as the full strategy, but using the flattened MemDumpPlan
+class PlanStrategy : public FullStrategy
+{
+public:
+
+    PlanStrategy ( const MemDumpList& allAddrs, uint32_t numStates )
+        : FullStrategy ( allAddrs, numStates ), _plan ( allAddrs ) {}
+
+    const char *getName() const override { return "plan"; }
+
+    void saveState ( uint32_t frame ) override { _plan.saveDump ( getState ( frame ) ); }
+
+    void loadState ( uint32_t frame ) override { _plan.loadDump ( getState ( frame ) ); }
+
+private:
+
+    MemDumpPlan _plan;
+};
+
+
+// Keeps the most recent states uncompressed, and zero-run compresses the older ones, like DllRollbackManager
+class CompressedStrategy : public Strategy
+{
+public:
+
+    CompressedStrategy ( const MemDumpList& allAddrs, uint32_t numStates, uint32_t numUncompressed )
+        : Strategy ( numStates )
+        , _numUncompressed ( numUncompressed )
+        , _plan ( allAddrs )
+        , _raw ( numUncompressed * allAddrs.totalSize )
+        , _compressed ( numStates )
+        , _compressBuffer ( compressZeroRunsBound ( allAddrs.totalSize ) )
+        , _uncompressBuffer ( allAddrs.totalSize ) {}
+
+    const char *getName() const override { return "compressed"; }
+
+    void saveState ( uint32_t frame ) override
+    {
+        // Compress the state that is leaving the uncompressed window, before its slot is reused
+        for ( ; _firstRawFrame + _numUncompressed <= frame; ++_firstRawFrame )
+        {
+            const size_t size = compressZeroRuns ( getRawState ( _firstRawFrame ), _plan.totalSize,
+                                                   &_compressBuffer[0], _compressBuffer.size() );
+
+            ASSERT ( size > 0 );
+
+            _compressed [ _firstRawFrame % _numStates ].assign ( &_compressBuffer[0], &_compressBuffer[0] + size );
+        }
+
+        _plan.saveDump ( getRawState ( frame ) );
+    }
+
+    void loadState ( uint32_t frame ) override
+    {
+        if ( frame >= _firstRawFrame )
+        {
+            _plan.loadDump ( getRawState ( frame ) );
+            return;
+        }
+
+        const vector<char>& compressed = _compressed [ frame % _numStates ];
+
+        const size_t size = uncompressZeroRuns ( &compressed[0], compressed.size(),
+                                                 &_uncompressBuffer[0], _plan.totalSize );
+
+        ASSERT ( size == _plan.totalSize );
+
+        _plan.loadDump ( &_uncompressBuffer[0] );
+
+        // The loaded state becomes the most recent one, so it is kept uncompressed
+        memcpy ( getRawState ( frame ), &_uncompressBuffer[0], _plan.totalSize );
+        _firstRawFrame = frame;
+    }
+
+    size_t getMemoryUsed() const override
+    {
+        size_t size = _raw.size();
+
+        for ( const vector<char>& compressed : _compressed )
+            size += compressed.size();
+
+        return size;
+    }
+
+private:
+
+    const uint32_t _numUncompressed;
+
+    MemDumpPlan _plan;
+
+    // States before this frame are compressed
+    uint32_t _firstRawFrame = 0;
+
+    vector<char> _raw;
+
+    vector<vector<char>> _compressed;
+
+    vector<char> _compressBuffer, _uncompressBuffer;
+
+    char *getRawState ( uint32_t frame )
+    {
+        return &_raw [ ( frame % _numUncompressed ) * _plan.totalSize ];
+    }
+};
+
+
+// Keeps a single copy of the latest state, plus an undo log of the blocks that changed each frame
+class DeltaStrategy : public Strategy
+{
+public:
+
+    DeltaStrategy ( const MemDumpList& allAddrs, uint32_t numStates )
+        : Strategy ( numStates )
+        , _plan ( allAddrs )
+        , _latest ( allAddrs.totalSize )
+        , _current ( allAddrs.totalSize )
+        , _undo ( numStates ) {}
+
+    const char *getName() const override { return "delta"; }
+
+    void saveState ( uint32_t frame ) override
+    {
+        _plan.saveDump ( &_current[0] );
+
+        vector<Block>& undo = _undo [ frame % _numStates ];
+        undo.clear();
+
+        for ( size_t offset = 0; offset < _current.size(); offset += DELTA_BLOCK_SIZE )
+        {
+            const size_t size = min<size_t> ( DELTA_BLOCK_SIZE, _current.size() - offset );
+
+            if ( memcmp ( &_latest[offset], &_current[offset], size ) == 0 )
+                continue;
+
+            // Record the previous contents of the block, then update it
+            undo.push_back ( Block() );
+            undo.back().offset = offset;
+            memcpy ( undo.back().bytes, &_latest[offset], size );
+            memcpy ( &_latest[offset], &_current[offset], size );
+        }
+
+        _latestFrame = frame;
+    }
+
+    void loadState ( uint32_t frame ) override
+    {
+        // Undo the changes of each later frame, in reverse order
+        for ( ; _latestFrame > frame; --_latestFrame )
+        {
+            for ( const Block& block : _undo [ _latestFrame % _numStates ] )
+            {
+                const size_t size = min<size_t> ( DELTA_BLOCK_SIZE, _latest.size() - block.offset );
+                memcpy ( &_latest[block.offset], block.bytes, size );
+            }
+        }
+
+        _plan.loadDump ( &_latest[0] );
+    }
+
+    size_t getMemoryUsed() const override
+    {
+        size_t size = _latest.size() + _current.size();
+
+        for ( const vector<Block>& undo : _undo )
+            size += undo.size() * sizeof ( Block );
+
+        return size;
+    }
+
+private:
+
+    struct Block
+    {
+        size_t offset;
+        char bytes[DELTA_BLOCK_SIZE];
+    };
+
+    MemDumpPlan _plan;
+
+    vector<char> _latest, _current;
+
+    vector<vector<Block>> _undo;
+
+    uint32_t _latestFrame = 0;
+};
+
+
+struct Stats
+{
+    double saveTime = 0, loadTime = 0, rerunTime = 0;
+
+    uint32_t saves = 0, loads = 0, reruns = 0, errors = 0;
+};
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsed ( const Clock::time_point& start )
+{
+    return chrono::duration<double, micro> ( Clock::now() - start ).count();
+}
+
+static uint64_t hashMemory ( const MemDumpPlan& plan, vector<char>& buffer )
+{
+    plan.saveDump ( &buffer[0] );
+    return getHash64 ( &buffer[0], buffer.size() );
+}
+
+static Stats run ( Strategy& strategy, SyntheticImage& image, const Options& options )
+{
+    Stats stats;
+
+    const MemDumpPlan plan ( image.allAddrs );
+
+    vector<char> buffer ( plan.totalSize );
+
+    vector<uint64_t> hashes ( options.states );
+
+    mt19937 rng ( 1 );
+
+    auto save = [&] ( uint32_t frame ) -> double
+    {
+        const Clock::time_point start = Clock::now();
+        strategy.saveState ( frame );
+        const double time = elapsed ( start );
+
+        hashes [ frame % options.states ] = hashMemory ( plan, buffer );
+
+        stats.saveTime += time;
+        ++stats.saves;
+        return time;
+    };
+
+    save ( 0 );
+
+    for ( uint32_t frame = 1; frame < options.frames; ++frame )
+    {
+        image.step ( rng, options.dirty );
+        save ( frame );
+
+        if ( frame < options.rollback || frame % options.interval )
+            continue;
+
+        // Rollback, then re-run the frames up to the current frame
+        const uint32_t target = frame - options.rollback;
+
+        const Clock::time_point start = Clock::now();
+        strategy.loadState ( target );
+        stats.loadTime += elapsed ( start );
+        ++stats.loads;
+
+        if ( hashMemory ( plan, buffer ) != hashes [ target % options.states ] )
+            ++stats.errors;
+
+        double rerunTime = 0;
+
+        for ( uint32_t i = target + 1; i <= frame; ++i )
+        {
+            image.step ( rng, options.dirty );
+            rerunTime += save ( i );
+        }
+
+        stats.rerunTime += rerunTime;
+        ++stats.reruns;
+    }
+
+    return stats;
+}
+
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-b" )
+            options.base = stoul ( argv[++i], 0, 0 );
+        else if ( i + 1 < argc && arg == "-f" )
+            options.frames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-r" )
+            options.rollback = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-i" )
+            options.interval = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-d" )
+            options.dirty = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-z" )
+            options.density = stod ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-s" )
+            options.states = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-u" )
+            options.uncompressed = stoul ( argv[++i] );
+        else
+            options.file = arg;
+    }
+
+    if ( options.file.empty() )
+    {
+        PRINT ( "Usage: %s rollback.bin [-b base] [-f frames] [-r rollback] [-i interval] [-d dirty] [-z density]"
+                " [-s states] [-u uncompressed]", argv[0] );
+        return -1;
+    }
+
+    options.states = max<uint32_t> ( options.states, 2 );
+    options.uncompressed = min<uint32_t> ( max<uint32_t> ( options.uncompressed, 1 ), options.states );
+    options.rollback = min<uint32_t> ( max<uint32_t> ( options.rollback, 1 ), options.states - 1 );
+    options.interval = max<uint32_t> ( options.interval, 1 );
+
+    MemDumpList gameAddrs;
+
+    if ( ! gameAddrs.load ( options.file ) || gameAddrs.empty() )
+    {
+        PRINT ( "Failed to load rollback data: %s", options.file );
+        return -1;
+    }
+
+    SyntheticImage image;
+
+    if ( ! image.initialize ( gameAddrs, options.base, options.density ) )
+        return -1;
+
+    PRINT ( "totalSize=%u; ranges=%u; imageSize=%u; heapUsed=%u",
+            image.allAddrs.totalSize, image.allAddrs.getRanges().size(), image.getImageSize(), image.getHeapUsed() );
+
+    PRINT ( "frames=%u; rollback=%u; interval=%u; dirty=%u; density=%.3f; states=%u; uncompressed=%u",
+            options.frames, options.rollback, options.interval, options.dirty, options.density,
+            options.states, options.uncompressed );
+
+    vector<shared_ptr<Strategy>> strategies =
+    {
+        shared_ptr<Strategy> ( new FullStrategy ( image.allAddrs, options.states ) ),
+        shared_ptr<Strategy> ( new PlanStrategy ( image.allAddrs, options.states ) ),
+        shared_ptr<Strategy> ( new CompressedStrategy ( image.allAddrs, options.states, options.uncompressed ) ),
+        shared_ptr<Strategy> ( new DeltaStrategy ( image.allAddrs, options.states ) ),
+    };
+
+    // Keep the initial image, so each strategy starts from the same memory
+    const MemDumpPlan plan ( image.allAddrs );
+    vector<char> initial ( plan.totalSize );
+    plan.saveDump ( &initial[0] );
+
+    PRINT ( "%-12s %10s %10s %12s %12s %8s", "strategy", "save(us)", "load(us)", "rerun(us)", "memory(KB)", "errors" );
+
+    for ( const shared_ptr<Strategy>& strategy : strategies )
+    {
+        plan.loadDump ( &initial[0] );
+
+        const Stats stats = run ( *strategy, image, options );
+
+        PRINT ( "%-12s %10.2f %10.2f %12.2f %12u %8u", strategy->getName(),
+                stats.saveTime / max ( stats.saves, 1u ),
+                stats.loadTime / max ( stats.loads, 1u ),
+                stats.rerunTime / max ( stats.reruns, 1u ),
+                strategy->getMemoryUsed() / 1024, stats.errors );
+    }
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+
+// Open addressing hash map with integer keys, stored in a single flat array with linear probing.
+// Erasing shifts the following entries back, so there are no tombstones and lookups stay short.
+// Pointers to values are invalidated by any insert or erase.
+template<typename K, typename V>
+class FlatHashMap
+{
+public:
+
+    FlatHashMap() : _slots ( MinCapacity ) {}
+
+    size_t size() const { return _size; }
+
+    bool empty() const { return ( _size == 0 ); }
+
+    // Get the value for the key, or null if not found
+    V *find ( K key )
+    {
+        const size_t i = findSlot ( key );
+        return ( _slots[i].used ? &_slots[i].value : 0 );
+    }
+
+    const V *find ( K key ) const
+    {
+        return const_cast<FlatHashMap *> ( this )->find ( key );
+    }
+
+    bool contains ( K key ) const { return ( find ( key ) != 0 ); }
+
+    // Get the value for the key, inserting a default value if not found
+    V& operator[] ( K key )
+    {
+        size_t i = findSlot ( key );
+
+        if ( _slots[i].used )
+            return _slots[i].value;
+
+        // Keep the load factor at most 1/2
+        if ( 2 * ( _size + 1 ) > _slots.size() )
+        {
+            grow();
+            i = findSlot ( key );
+        }
+
+        _slots[i].key = key;
+        _slots[i].value = V();
+        _slots[i].used = true;
+        ++_size;
+        return _slots[i].value;
+    }
+
+    // Erase the key, returns false if not found
+    bool erase ( K key )
+    {
+        size_t i = findSlot ( key );
+
+        if ( ! _slots[i].used )
+            return false;
+
+        const size_t mask = _slots.size() - 1;
+
+        // Shift back the following entries that would no longer be reachable
+        for ( size_t j = ( i + 1 ) & mask; _slots[j].used; j = ( j + 1 ) & mask )
+        {
+            const size_t home = hash ( _slots[j].key ) & mask;
+
+            // Move the entry at j into the hole at i, unless its home slot is cyclically in (i, j]
+            if ( ( ( j - home ) & mask ) >= ( ( j - i ) & mask ) )
+            {
+                _slots[i] = std::move ( _slots[j] );
+                i = j;
+            }
+        }
+
+        _slots[i].used = false;
+        _slots[i].value = V();
+        --_size;
+        return true;
+    }
+
+    void clear()
+    {
+        _slots.assign ( MinCapacity, Slot() );
+        _size = 0;
+    }
+
+    // Call the function with each key and value, the map must not be modified during this
+    template<typename F>
+    void forEach ( F f )
+    {
+        for ( Slot& slot : _slots )
+        {
+            if ( slot.used )
+                f ( slot.key, slot.value );
+        }
+    }
+
+private:
+
+    static const size_t MinCapacity = 16;
+
+    struct Slot
+    {
+        K key = K();
+
+        V value = V();
+
+        bool used = false;
+    };
+
+    std::vector<Slot> _slots;
+
+    size_t _size = 0;
+
+    // Mix the bits of the key, since keys like IP addresses and sequential ids aren't uniformly distributed
+    static size_t hash ( K key )
+    {
+        uint64_t x = uint64_t ( key );
+        x ^= x >> 33;
+        x *= 0xFF51AFD7ED558CCDull;
+        x ^= x >> 33;
+        x *= 0xC4CEB9FE1A85EC53ull;
+        x ^= x >> 33;
+        return size_t ( x );
+    }
+
+    // Find the slot with the key, or the empty slot where it would be inserted
+    size_t findSlot ( K key ) const
+    {
+        const size_t mask = _slots.size() - 1;
+
+        size_t i = hash ( key ) & mask;
+
+        while ( _slots[i].used && _slots[i].key != key )
+            i = ( i + 1 ) & mask;
+
+        return i;
+    }
+
+    void grow()
+    {
+        std::vector<Slot> old ( 2 * _slots.size() );
+        old.swap ( _slots );
+
+        const size_t mask = _slots.size() - 1;
+
+        for ( Slot& slot : old )
+        {
+            if ( ! slot.used )
+                continue;
+
+            size_t i = hash ( slot.key ) & mask;
+
+            while ( _slots[i].used )
+                i = ( i + 1 ) & mask;
+
+            _slots[i] = std::move ( slot );
+        }
+    }
+};
@@ -0,0 +1,138 @@
+#include "FlightRecorder.hpp"
+#include "Logger.hpp"
+
+#include <string>
+#include <cstring>
+
+using namespace std;
+
+
+// Renders a flight recorder dump written by the DLL on a desync, stop, or crash.
+//
+// Records from all the channels are printed in the order they were recorded, with the time relative to the dump.
+
+
+static const char *ChannelNames[] = { "Log", "Sync", "Network", "Frame" };
+
+static const char *NetworkNames[] = { "Send", "Read", "Decoded", "Error", "Disconnected" };
+
+static const char *FrameNames[] =
+{
+    "Inputs", "Reinputs", "Rollback", "RollbackFailed", "RngState", "SyncHash", "Desync"
+};
+
+static const char *ProtocolNames[] = { "TCP", "UDP", "Smart" };
+
+
+template<typename T, size_t N>
+static const char *getName ( const char *( &names ) [N], T value )
+{
+    return ( ( size_t ) value < N ? names[( size_t ) value] : "Unknown" );
+}
+
+static string formatNetwork ( const FlightNetworkEvent& event )
+{
+    string str = format ( "%-12s %-5s socket=%08x %s:%u", getName ( NetworkNames, event.event ),
+                          getName ( ProtocolNames, event.protocol ), event.socket, event.address, event.port );
+
+    switch ( event.event )
+    {
+        case FlightNetwork::Send:
+        case FlightNetwork::Read:
+            str += format ( " bytes=%u", event.value );
+            break;
+
+        case FlightNetwork::Decoded:
+            str += format ( " msgType=%u", event.value );
+            break;
+
+        case FlightNetwork::Error:
+            str += format ( " error=%u", event.value );
+            break;
+
+        default:
+            break;
+    }
+
+    return str;
+}
+
+static string formatFrame ( const FlightFrameEvent& event )
+{
+    string str = format ( "%-14s [%u:%u]", getName ( FrameNames, event.event ), event.index, event.frame );
+
+    switch ( event.event )
+    {
+        case FlightFrame::Inputs:
+        case FlightFrame::Reinputs:
+            str += format ( " 0x%04x 0x%04x", event.p1, event.p2 );
+            break;
+
+        case FlightFrame::Rollback:
+        case FlightFrame::RollbackFailed:
+            str += format ( " target=[%u:%u]", event.targetIndex, event.targetFrame );
+            break;
+
+        case FlightFrame::SyncHash:
+        case FlightFrame::Desync:
+            str += format ( " compared=[%u:%u]", event.targetIndex, event.targetFrame );
+            break;
+
+        default:
+            break;
+    }
+
+    return str;
+}
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc != 2 )
+    {
+        PRINT ( "Usage: %s flight.dump", argv[0] );
+        return -1;
+    }
+
+    FlightDumpReader reader;
+    string error;
+
+    if ( ! reader.open ( argv[1], error ) )
+    {
+        PRINT ( "%s: %s", argv[1], error );
+        return -1;
+    }
+
+    PRINT ( "Reason: %s", reader.reason );
+    PRINT ( "Records: %u", ( uint32_t ) reader.records.size() );
+
+    for ( const FlightDumpReader::Record& record : reader.records )
+    {
+        string str;
+
+        switch ( record.header.type )
+        {
+            case FlightType::Text:
+                str = record.payload;
+                break;
+
+            case FlightType::Network:
+                str = formatNetwork ( record.get<FlightNetworkEvent>() );
+                break;
+
+            case FlightType::Frame:
+                str = formatFrame ( record.get<FlightFrameEvent>() );
+                break;
+
+            default:
+                str = format ( "Unknown record type %u", ( uint32_t ) record.header.type );
+                break;
+        }
+
+        // Time relative to the dump, which can be before the earliest record
+        const double seconds = ( double ( record.header.time ) - double ( reader.time ) ) / 1000;
+
+        PRINT ( "%10.3f %-7s %s", seconds, getName ( ChannelNames, record.header.channel ), str );
+    }
+
+    return 0;
+}
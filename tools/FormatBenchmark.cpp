@@ -0,0 +1,182 @@
+#include "StringUtils.hpp"
+#include "Enum.hpp"
+#include "IndexedFrame.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+
+using namespace std;
+
+
+// Linux native benchmark of format with typical log lines, against the previous implementation.
+//
+// The previous implementation split the format string at each conversion and concatenated the results recursively.
+// Both implementations are run on the same lines, and their results must match.
+
+
+// Default number of times each line is formatted
+#define DEFAULT_ITERATIONS ( 200000 )
+
+
+namespace Legacy
+{
+
+void splitFormat ( const string& fmt, string& first, string& rest )
+{
+    size_t i;
+
+    for ( i = 0; i < fmt.size(); ++i )
+    {
+        if ( i + 1 < fmt.size() && fmt[i] == '%' && fmt[i + 1] == '%' )
+            ++i;
+        else if ( fmt[i] == '%' && ( i + 1 == fmt.size() || fmt[i + 1] != '%' ) )
+            break;
+    }
+
+    if ( i == fmt.size() - 1 )
+    {
+        first = "";
+        rest = fmt;
+        return;
+    }
+
+    for ( ++i; i < fmt.size(); ++i )
+    {
+        if ( ! ( isalnum ( fmt[i] ) || fmt[i] == '.' || fmt[i] == '-' || fmt[i] == '+' || fmt[i] == '#' ) )
+            break;
+    }
+
+    first = fmt.substr ( 0, i );
+    rest = ( i < fmt.size() ? fmt.substr ( i ) : "" );
+}
+
+template<typename T>
+inline void printToString ( char *buffer, size_t len, const char *fmt, const T& val, bool2type<false> )
+{
+    snprintf ( buffer, len, fmt, ::format ( val ).c_str() );
+}
+
+template<typename T>
+inline void printToString ( char *buffer, size_t len, const char *fmt, const T& val, bool2type<true> )
+{
+    snprintf ( buffer, len, fmt, val );
+}
+
+inline string format ( const string& fmt ) { return ::format ( fmt ); }
+
+template<typename T, typename ... V>
+inline string format ( const string& fmt, const T& val, V ... vals )
+{
+    string first, rest;
+    splitFormat ( fmt, first, rest );
+
+    if ( first.empty() )
+        return rest;
+
+    char buffer[4096];
+    printToString ( buffer, sizeof ( buffer ), first.c_str(), val,
+                    bool2type < is_arithmetic<T>::value || is_pointer<T>::value > () );
+
+    if ( rest.empty() )
+        return buffer;
+
+    return buffer + Legacy::format ( rest, vals... );
+}
+
+} // namespace Legacy
+
+
+ENUM ( BenchState, Initial, CharaSelect, InGame );
+
+
+struct Line
+{
+    const char *name;
+
+    function<string()> current, legacy;
+};
+
+#define LINE(NAME, ...)                                                                                             \
+    { NAME, [&]() { return format ( __VA_ARGS__ ); }, [&]() { return Legacy::format ( __VA_ARGS__ ); } }
+
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsed ( const Clock::time_point& start )
+{
+    return chrono::duration<double, nano> ( Clock::now() - start ).count();
+}
+
+
+int main ( int argc, char *argv[] )
+{
+    uint32_t iterations = DEFAULT_ITERATIONS;
+
+    if ( argc == 3 && string ( argv[1] ) == "-n" )
+    {
+        iterations = stoul ( argv[2] );
+    }
+    else if ( argc != 1 )
+    {
+        PRINT ( "Usage: %s [-n iterations]", argv[0] );
+        return -1;
+    }
+
+    const IndexedFrame indexedFrame = {{ 1234, 56 }};
+    const BenchState state = BenchState::InGame;
+    const string address = "192.168.0.1:3939";
+    const string escaped = "100%% done";
+    const char *gameMode = "InGame";
+
+    uint32_t volatile value = 0x1234;
+
+    const vector<Line> lines =
+    {
+        LINE ( "sync", "%s [%u] %s [%s] Inputs: 0x%04x 0x%04x", gameMode, 1u, state, indexedFrame, value, value ),
+        LINE ( "chara",
+               "P%u: C=%u; M=%u; c=%u; seq=%u; st=%u; hp=%u; rh=%u; gb=%.1f; gq=%.1f; mt=%u; ht=%u; x=%d; y=%d",
+               1u, 2u, 3u, 4u, value, 6u, 11400u, 11400u, 1.5f, 2.5f, 10000u, 0u, -100, 0 ),
+        LINE ( "socket", "socket=%08x; address='%s'; protocol=%s; connected", value, address, "TCP" ),
+        LINE ( "decoded", "Decoded '%s' using [ %u bytes ]; %u bytes remaining in buffer", escaped, 28u, 0u ),
+        LINE ( "widths", "%-12s %10.3f %12llu %8s", "name", 3.25, 12345678901ull, "right" ),
+    };
+
+    PRINT ( "iterations=%u", iterations );
+
+    bool matched = true;
+
+    for ( const Line& line : lines )
+    {
+        const string current = line.current(), legacy = line.legacy();
+
+        if ( current != legacy )
+        {
+            PRINT ( "%s: mismatch '%s' != '%s'", line.name, current, legacy );
+            matched = false;
+            continue;
+        }
+
+        size_t total = 0;
+
+        Clock::time_point start = Clock::now();
+
+        for ( uint32_t i = 0; i < iterations; ++i )
+            total += line.current().size();
+
+        const double currentNs = elapsed ( start ) / iterations;
+
+        start = Clock::now();
+
+        for ( uint32_t i = 0; i < iterations; ++i )
+            total += line.legacy().size();
+
+        const double legacyNs = elapsed ( start ) / iterations;
+
+        PRINT ( "%-8s %8.1f ns  legacy %8.1f ns  %5.2fx  (%u chars)",
+                line.name, currentNs, legacyNs, legacyNs / currentNs, ( uint32_t ) ( total / iterations / 2 ) );
+    }
+
+    return ( matched ? 0 : -1 );
+}
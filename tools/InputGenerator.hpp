@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+
+
+// Random inputs that are held for a random number of frames, like real inputs. Used by the Linux native benchmarks.
+class InputGenerator
+{
+public:
+
+    uint16_t next ( std::mt19937& rng )
+    {
+        if ( _held == 0 )
+        {
+            _input = ( rng() & 0x0F ) | ( ( rng() & 0x3 ) << 4 ) | ( ( rng() % 10 ) << 8 );
+            _held = 1 + rng() % 20;
+        }
+
+        --_held;
+        return _input;
+    }
+
+private:
+
+    uint16_t _input = 0;
+
+    uint32_t _held = 0;
+};
@@ -0,0 +1,318 @@
+#include "InputScan.hpp"
+#include "InputsContainer.hpp"
+#include "Logger.hpp"
+
+#include <random>
+#include <chrono>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+
+// Linux native benchmark of the input history scans NetplayManager does every frame while navigating the menus.
+//
+// Each frame runs the same checks as the chara select and retry menu inputs: up / down in the last 3 frames for
+// either player, a confirm / cancel button in frames 1 to 3, and start held for the whole held start duration.
+// The checks are timed reading each input with InputsContainer::get, like NetplayManager used to, and reading
+// spans of the history with InputsContainer::read then scanning them, like it does now. Both must agree.
+
+
+// Button bits, see Constants.hpp, which isn't included since it depends on the Windows headers
+#define BUTTON_START                ( 0x0001 )
+#define BUTTON_A                    ( 0x0010 )
+#define BUTTON_B                    ( 0x0020 )
+#define BUTTON_CONFIRM_CANCEL       ( 0x0C00 )
+
+// Same as NetplayManager
+#define HISTORY_CHUNK_SIZE          ( 64 )
+
+// Default held start duration of 1.5 seconds at 60 fps
+#define DEFAULT_HELD_START_FRAMES   ( 90 )
+
+
+struct Options
+{
+    // Number of frames to simulate, in menu indices of this many frames
+    uint32_t frames = 1000000;
+    uint32_t menuFrames = 3600;
+
+    // Number of frames start must be held for
+    uint32_t heldStart = DEFAULT_HELD_START_FRAMES;
+
+    // Number of times each path is run, the fastest run is reported
+    uint32_t runs = 5;
+};
+
+
+struct Results
+{
+    uint32_t upDown = 0, button = 0, heldStart = 0;
+
+    bool operator== ( const Results& other ) const
+    {
+        return upDown == other.upDown && button == other.button && heldStart == other.heldStart;
+    }
+};
+
+
+// Inputs while navigating the menus: mostly idle, with short direction and button presses, and start held sometimes
+class MenuInputGenerator
+{
+public:
+
+    uint16_t next ( mt19937& rng )
+    {
+        if ( _held == 0 )
+        {
+            const uint32_t r = rng() % 100;
+
+            if ( r < 60 )
+                _input = 0;
+            else if ( r < 80 )
+                _input = ( rng() % 2 ? 2 : 8 );
+            else if ( r < 98 )
+                _input = ( ( rng() % 2 ? BUTTON_A : BUTTON_B ) << 4 );
+            else
+                _input = ( BUTTON_START << 4 );
+
+            _held = ( _input == ( BUTTON_START << 4 ) ? 60 + rng() % 60 : 1 + rng() % 10 );
+        }
+
+        --_held;
+        return _input;
+    }
+
+private:
+
+    uint16_t _input = 0;
+
+    uint32_t _held = 0;
+};
+
+
+// The history checks, reading each input with get
+class GetHistory
+{
+public:
+
+    GetHistory ( const InputsContainer<uint16_t> *inputs, uint32_t index, uint32_t frame )
+        : _inputs ( inputs ), _index ( index ), _frame ( frame ) {}
+
+    bool hasUpDown ( uint32_t start, uint32_t end ) const
+    {
+        for ( size_t i = start; i < end && i <= _frame; ++i )
+        {
+            for ( uint8_t p = 0; p < 2; ++p )
+            {
+                const uint16_t dir = 0xF & _inputs[p].get ( _index, _frame - i );
+
+                if ( dir == 2 || dir == 8 )
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool hasButton ( uint16_t button, uint32_t start, uint32_t end ) const
+    {
+        for ( size_t i = start; i < end && i <= _frame; ++i )
+        {
+            if ( ( _inputs[0].get ( _index, _frame - i ) >> 4 ) & button )
+                return true;
+        }
+
+        return false;
+    }
+
+    bool heldButton ( uint16_t button, uint32_t start, uint32_t end ) const
+    {
+        for ( size_t i = start; i < end; ++i )
+        {
+            if ( i > _frame || ! ( ( _inputs[0].get ( _index, _frame - i ) >> 4 ) & button ) )
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    const InputsContainer<uint16_t> *_inputs;
+
+    uint32_t _index, _frame;
+};
+
+
+// The history checks, reading spans of the history then scanning them
+class ScanHistory
+{
+public:
+
+    ScanHistory ( const InputsContainer<uint16_t> *inputs, uint32_t index, uint32_t frame )
+        : _inputs ( inputs ), _index ( index ), _frame ( frame ) {}
+
+    bool hasUpDown ( uint32_t start, uint32_t end ) const
+    {
+        uint16_t inputs[HISTORY_CHUNK_SIZE];
+
+        for ( end = min ( end, _frame + 1 ); start < end; start += HISTORY_CHUNK_SIZE )
+        {
+            for ( uint8_t p = 0; p < 2; ++p )
+            {
+                const uint32_t n = min<uint32_t> ( end - start, HISTORY_CHUNK_SIZE );
+
+                if ( anyInputHasDirection ( read ( p, start, n, inputs ), n, 2, 8 ) )
+                    return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool hasButton ( uint16_t button, uint32_t start, uint32_t end ) const
+    {
+        uint16_t inputs[HISTORY_CHUNK_SIZE];
+
+        for ( end = min ( end, _frame + 1 ); start < end; start += HISTORY_CHUNK_SIZE )
+        {
+            const uint32_t n = min<uint32_t> ( end - start, HISTORY_CHUNK_SIZE );
+
+            if ( anyInputHasMask ( read ( 0, start, n, inputs ), n, uint16_t ( button << 4 ) ) )
+                return true;
+        }
+
+        return false;
+    }
+
+    bool heldButton ( uint16_t button, uint32_t start, uint32_t end ) const
+    {
+        if ( start < end && end > _frame + 1 )
+            return false;
+
+        if ( start < end && ! ( _inputs[0].get ( _index, _frame - start ) & ( button << 4 ) ) )
+            return false;
+
+        uint16_t inputs[HISTORY_CHUNK_SIZE];
+
+        for ( ; start < end; start += HISTORY_CHUNK_SIZE )
+        {
+            const uint32_t n = min<uint32_t> ( end - start, HISTORY_CHUNK_SIZE );
+
+            if ( ! allInputsHaveMask ( read ( 0, start, n, inputs ), n, uint16_t ( button << 4 ) ) )
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    const InputsContainer<uint16_t> *_inputs;
+
+    uint32_t _index, _frame;
+
+    // Read n inputs of the history from start, ordered oldest first
+    const uint16_t *read ( uint8_t player, uint32_t start, uint32_t n, uint16_t *buffer ) const
+    {
+        return _inputs[player].read ( _index, _frame - start - ( n - 1 ), buffer, n );
+    }
+};
+
+
+typedef chrono::high_resolution_clock Clock;
+
+template<typename History>
+static double run ( const InputsContainer<uint16_t> *inputs, const Options& options, Results& results )
+{
+    double best = 0;
+
+    for ( uint32_t run = 0; run < options.runs; ++run )
+    {
+        const Clock::time_point start = Clock::now();
+
+        results = Results();
+
+        for ( uint32_t i = 0; i < options.frames; ++i )
+        {
+            const History history ( inputs, i / options.menuFrames, i % options.menuFrames );
+
+            // Chara select and retry menu navigation
+            results.upDown += history.hasUpDown ( 0, 3 );
+            results.button += history.hasButton ( BUTTON_A | BUTTON_B | BUTTON_CONFIRM_CANCEL, 1, 3 );
+
+            // Returning to the main menu
+            results.heldStart += history.heldButton ( BUTTON_START, 0, options.heldStart );
+        }
+
+        const double time = chrono::duration<double, nano> ( Clock::now() - start ).count() / options.frames;
+
+        if ( run == 0 || time < best )
+            best = time;
+    }
+
+    return best;
+}
+
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-n" )
+            options.frames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-m" )
+            options.menuFrames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-h" )
+            options.heldStart = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-r" )
+            options.runs = stoul ( argv[++i] );
+        else
+        {
+            PRINT ( "Usage: %s [-n frames] [-m menuFrames] [-h heldStartFrames] [-r runs]", argv[0] );
+            return -1;
+        }
+    }
+
+    options.frames = max<uint32_t> ( options.frames, 1 );
+    options.menuFrames = max<uint32_t> ( options.menuFrames, 1 );
+    options.runs = max<uint32_t> ( options.runs, 1 );
+
+    PRINT ( "frames=%u; menuFrames=%u; heldStart=%u; runs=%u",
+            options.frames, options.menuFrames, options.heldStart, options.runs );
+
+    InputsContainer<uint16_t> inputs[2];
+
+    MenuInputGenerator generators[2];
+
+    mt19937 rng ( 1 );
+
+    for ( uint32_t i = 0; i < options.frames; ++i )
+    {
+        for ( uint8_t p = 0; p < 2; ++p )
+            inputs[p].set ( i / options.menuFrames, i % options.menuFrames, generators[p].next ( rng ) );
+    }
+
+    Results getResults, scanResults;
+
+    const double getTime = run<GetHistory> ( inputs, options, getResults );
+    const double scanTime = run<ScanHistory> ( inputs, options, scanResults );
+
+    PRINT ( "%8s %12s %10s %10s %10s", "path", "ns/frame", "upDown", "button", "heldStart" );
+    PRINT ( "%8s %12.1f %10u %10u %10u", "get", getTime, getResults.upDown, getResults.button, getResults.heldStart );
+    PRINT ( "%8s %12.1f %10u %10u %10u", "scan", scanTime,
+            scanResults.upDown, scanResults.button, scanResults.heldStart );
+
+    if ( ! ( getResults == scanResults ) )
+    {
+        PRINT ( "Results differ!" );
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include "InputsContainer.hpp"
+#include "InputGenerator.hpp"
+#include "Logger.hpp"
+
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+
+// Linux native benchmark of InputsContainer over a long netplay session, without the game.
+//
+// Each transition index alternates between a menu and a game. Every frame, the local input is set with a delay,
+// a batch of remote inputs is set like PlayerInputs messages, and both inputs are read back. Periodically the
+// inputs for both players are read in batches for spectators, like BothInputs messages. Old indices are erased
+// once they are older than the spectator lag, like NetplayManager does with preserveStartIndex.
+
+
+// Defaults for NUM_INPUTS and the input delay, Constants.hpp isn't included since it depends on the Windows headers
+#define DEFAULT_BATCH_INPUTS ( 30 )
+#define DEFAULT_DELAY ( 4 )
+
+// Number of progress reports over the whole session
+#define NUM_REPORTS ( 10 )
+
+
+struct Options
+{
+    // Number of games, each game has a menu index and a game index
+    uint32_t games = 1000;
+
+    // Number of frames of each game and menu index
+    uint32_t gameFrames = 5400;
+    uint32_t menuFrames = 600;
+
+    // Number of indices kept before the current one, 0 to keep all indices like a spectator from the start
+    uint32_t lag = 4;
+
+    // Number of inputs per message, and the local input delay
+    uint32_t batch = DEFAULT_BATCH_INPUTS;
+    uint32_t delay = DEFAULT_DELAY;
+};
+
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsed ( const Clock::time_point& start )
+{
+    return chrono::duration<double, nano> ( Clock::now() - start ).count();
+}
+
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-g" )
+            options.games = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-f" )
+            options.gameFrames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-m" )
+            options.menuFrames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-l" )
+            options.lag = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-b" )
+            options.batch = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-d" )
+            options.delay = stoul ( argv[++i] );
+        else
+        {
+            PRINT ( "Usage: %s [-g games] [-f gameFrames] [-m menuFrames] [-l lag] [-b batch] [-d delay]", argv[0] );
+            return -1;
+        }
+    }
+
+    options.games = max<uint32_t> ( options.games, 1 );
+    options.gameFrames = max<uint32_t> ( options.gameFrames, 1 );
+    options.menuFrames = max<uint32_t> ( options.menuFrames, 1 );
+    options.batch = max<uint32_t> ( options.batch, 1 );
+
+    PRINT ( "games=%u; gameFrames=%u; menuFrames=%u; lag=%u; batch=%u; delay=%u",
+            options.games, options.gameFrames, options.menuFrames, options.lag, options.batch, options.delay );
+
+    InputsContainer<uint16_t> local, remote;
+
+    InputGenerator localGenerator, remoteGenerator;
+
+    mt19937 rng ( 1 );
+
+    vector<uint16_t> remoteInputs, buffer ( options.batch );
+
+    const uint32_t numIndices = 2 * options.games;
+
+    uint32_t startIndex = 0;
+
+    uint64_t frames = 0, reportFrames = 0;
+
+    double time = 0, reportTime = 0, maxEraseTime = 0;
+
+    size_t peakSize = 0;
+
+    PRINT ( "%8s %12s %12s %14s %14s", "index", "frames", "ns/frame", "allocated(KB)", "used(KB)" );
+
+    for ( uint32_t index = 0; index < numIndices; ++index )
+    {
+        // Erase the indices older than the spectator lag
+        if ( options.lag && index - startIndex > options.lag )
+        {
+            const Clock::time_point start = Clock::now();
+
+            local.eraseIndexOlderThan ( index - options.lag - startIndex );
+            remote.eraseIndexOlderThan ( index - options.lag - startIndex );
+
+            const double eraseTime = elapsed ( start );
+
+            time += eraseTime;
+            reportTime += eraseTime;
+            maxEraseTime = max ( maxEraseTime, eraseTime );
+
+            startIndex = index - options.lag;
+        }
+
+        const uint32_t offset = index - startIndex;
+        const uint32_t numFrames = ( index % 2 ? options.gameFrames : options.menuFrames );
+
+        remoteInputs.resize ( numFrames );
+
+        for ( uint32_t frame = 0; frame < numFrames; ++frame )
+        {
+            const uint16_t localInput = localGenerator.next ( rng );
+            remoteInputs[frame] = remoteGenerator.next ( rng );
+
+            const uint32_t batchStart = ( frame + 1 > options.batch ? frame + 1 - options.batch : 0 );
+            const uint32_t batchSize = frame + 1 - batchStart;
+
+            const Clock::time_point start = Clock::now();
+
+            local.set ( offset, frame + options.delay, localInput );
+            remote.set ( offset, batchStart, &remoteInputs[batchStart], batchSize, offset );
+
+            uint16_t inputs = local.get ( offset, frame ) ^ remote.get ( offset, frame );
+
+            // Send both inputs to spectators
+            if ( frame + 1 >= options.batch && ( frame + 1 ) % options.batch == 0 )
+            {
+                local.get ( offset, batchStart, &buffer[0], batchSize );
+                inputs ^= buffer[0];
+                remote.get ( offset, batchStart, &buffer[0], batchSize );
+                inputs ^= buffer[0];
+            }
+
+            remote.clearLastChangedFrame();
+
+            const double frameTime = elapsed ( start );
+
+            time += frameTime;
+            reportTime += frameTime;
+
+            // Make sure the reads aren't optimized away
+            if ( inputs == 0xFFFF )
+                rng.discard ( 1 );
+        }
+
+        frames += numFrames;
+        reportFrames += numFrames;
+
+        peakSize = max ( peakSize, local.getAllocatedSize() + remote.getAllocatedSize() );
+
+        if ( ( index + 1 ) % max<uint32_t> ( numIndices / NUM_REPORTS, 1 ) == 0 || index + 1 == numIndices )
+        {
+            PRINT ( "%8u %12llu %12.1f %14u %14u", index + 1, ( unsigned long long ) frames,
+                    reportTime / max<uint64_t> ( reportFrames, 1 ),
+                    ( local.getAllocatedSize() + remote.getAllocatedSize() ) / 1024,
+                    ( local.getUsedSize() + remote.getUsedSize() ) / 1024 );
+
+            reportTime = 0;
+            reportFrames = 0;
+        }
+    }
+
+    PRINT ( "total: frames=%llu; ns/frame=%.1f; maxErase(ns)=%.0f; peakAllocated(KB)=%u",
+            ( unsigned long long ) frames, time / max<uint64_t> ( frames, 1 ), maxEraseTime, peakSize / 1024 );
+
+    return 0;
+}
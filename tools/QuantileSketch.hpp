@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+
+// Maximum relative error of the quantiles
+#define QUANTILE_SKETCH_ERROR ( 0.01 )
+
+// Number of buckets, enough for values up to about 7 * 10^8
+#define QUANTILE_SKETCH_BUCKETS ( 1024 )
+
+
+// Streaming quantile sketch of non-negative integers, eg latencies in microseconds. Values are counted in logarithmic
+// buckets, so the memory is fixed, and any quantile is within QUANTILE_SKETCH_ERROR of an actual value, before
+// rounding to an integer.
+// Only one thread may add values, but any thread can read the counts at any time, without locking.
+class QuantileSketch
+{
+public:
+
+    QuantileSketch()
+    {
+        for ( std::atomic<uint64_t>& count : _counts )
+            count.store ( 0, std::memory_order_relaxed );
+    }
+
+    void add ( uint64_t value )
+    {
+        // There is only one writer, so this doesn't need an atomic read-modify-write
+        std::atomic<uint64_t>& count = _counts[getBucket ( value )];
+        count.store ( count.load ( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    }
+
+    uint64_t getCount ( size_t bucket ) const
+    {
+        return _counts[bucket].load ( std::memory_order_relaxed );
+    }
+
+    // Bucket 0 is only for 0, bucket i holds the values in ( gamma^(i-2), gamma^(i-1) ]
+    static size_t getBucket ( uint64_t value )
+    {
+        if ( value == 0 )
+            return 0;
+
+        const double index = std::ceil ( std::log ( double ( value ) ) / std::log ( getGamma() ) );
+        return std::min<size_t> ( 1 + size_t ( std::max ( 0.0, index ) ), QUANTILE_SKETCH_BUCKETS - 1 );
+    }
+
+    // Value with the least relative error to all the values of a bucket
+    static uint64_t getValue ( size_t bucket )
+    {
+        if ( bucket == 0 )
+            return 0;
+
+        return uint64_t ( std::llround ( 2 * std::pow ( getGamma(), double ( bucket - 1 ) ) / ( getGamma() + 1 ) ) );
+    }
+
+    static double getGamma()
+    {
+        return ( 1 + QUANTILE_SKETCH_ERROR ) / ( 1 - QUANTILE_SKETCH_ERROR );
+    }
+
+private:
+
+    std::atomic<uint64_t> _counts[QUANTILE_SKETCH_BUCKETS];
+};
+
+
+// Copy of the counts of one or more sketches, which can be subtracted to get the quantiles over a time window
+class QuantileSnapshot
+{
+public:
+
+    QuantileSnapshot() : _counts ( QUANTILE_SKETCH_BUCKETS ) {}
+
+    void add ( const QuantileSketch& sketch )
+    {
+        for ( size_t i = 0; i < _counts.size(); ++i )
+            _counts[i] += sketch.getCount ( i );
+    }
+
+    void add ( const QuantileSnapshot& snapshot )
+    {
+        for ( size_t i = 0; i < _counts.size(); ++i )
+            _counts[i] += snapshot._counts[i];
+    }
+
+    // Remove an earlier snapshot of the same sketches
+    void subtract ( const QuantileSnapshot& snapshot )
+    {
+        for ( size_t i = 0; i < _counts.size(); ++i )
+            _counts[i] -= std::min ( _counts[i], snapshot._counts[i] );
+    }
+
+    uint64_t getCount() const
+    {
+        uint64_t count = 0;
+
+        for ( uint64_t c : _counts )
+            count += c;
+
+        return count;
+    }
+
+    // Value at the quantile p in [0, 1], or 0 if empty
+    uint64_t getQuantile ( double p ) const
+    {
+        const uint64_t count = getCount();
+
+        if ( count == 0 )
+            return 0;
+
+        const uint64_t rank = std::min ( count - 1, uint64_t ( p * count ) );
+
+        uint64_t seen = 0;
+
+        for ( size_t i = 0; i < _counts.size(); ++i )
+        {
+            seen += _counts[i];
+
+            if ( seen > rank )
+                return QuantileSketch::getValue ( i );
+        }
+
+        return 0;
+    }
+
+private:
+
+    std::vector<uint64_t> _counts;
+};
@@ -0,0 +1,100 @@
+#include "RelayServer.hpp"
+#include "Logger.hpp"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <csignal>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+
+// Linux native tunnel match making server, a drop in replacement for scripts/server.py.
+
+
+static volatile sig_atomic_t stopping = 0;
+
+static void signalHandler ( int signum )
+{
+    stopping = 1;
+}
+
+int main ( int argc, char *argv[] )
+{
+    uint16_t port = RELAY_DEFAULT_PORT;
+    uint32_t numShards = max<long> ( 1, sysconf ( _SC_NPROCESSORS_ONLN ) );
+    string statsPath;
+    bool verbose = false;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-p" )
+            port = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-t" )
+            numShards = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-s" )
+            statsPath = argv[++i];
+        else if ( arg == "-v" )
+            verbose = true;
+        else
+        {
+            PRINT ( "Usage: %s [-p port] [-t threads] [-s stats socket] [-v]", argv[0] );
+            return -1;
+        }
+    }
+
+    // Each host and client keeps a TCP connection open
+    rlimit limit;
+
+    if ( getrlimit ( RLIMIT_NOFILE, &limit ) == 0 )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit ( RLIMIT_NOFILE, &limit );
+    }
+
+    signal ( SIGINT, signalHandler );
+    signal ( SIGTERM, signalHandler );
+    signal ( SIGPIPE, SIG_IGN );
+
+    RelayServer server;
+    server.verbose = verbose;
+
+    string error;
+
+    if ( ! server.listen ( port, numShards, error ) )
+    {
+        PRINT ( "%s", error );
+        return -1;
+    }
+
+    PRINT ( "Listening on port %u with %u threads", port, server.numShards() );
+
+    if ( ! statsPath.empty() )
+    {
+        if ( ! server.listenStats ( statsPath, error ) )
+        {
+            PRINT ( "%s", error );
+            return -1;
+        }
+
+        PRINT ( "Serving stats on %s", statsPath );
+    }
+
+    server.start();
+
+    while ( ! stopping && ! server.failed() )
+        usleep ( RELAY_POLL_TIMEOUT * 1000 );
+
+    server.stop();
+
+    if ( server.failed() )
+        return -1;
+
+    PRINT ( "Stopped; connections=%u; hosts=%u; matches=%u",
+            server.numConnections(), server.numHosts(), server.numMatches() );
+    return 0;
+}
@@ -0,0 +1,605 @@
+#include "Thread.hpp"
+#include "Logger.hpp"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+using namespace std;
+
+
+// Linux native load generator for the tunnel match making server, ie tools/relay_server or scripts/server.py.
+//
+// Each pair is a host and a client, each with a TCP connection and a UDP socket, like SmartSocket. The host registers
+// a unique hosting port once, then the pair repeats rounds as fast as possible: the client sends the address of the
+// host, both sides are sent MatchInfo, both send UdpData (resent until answered), and both are sent TunInfo with the
+// UDP address of the other side. The server only forwards addresses, so the forwarded packets are the UdpData
+// datagrams answered with a TunInfo.
+//
+// The match latency is from the client sending the address to the client receiving MatchInfo, and the forward
+// latency is from the first UdpData of a side to the other side receiving TunInfo.
+
+
+// Number of milliseconds to wait for the host registrations, before the clients start connecting
+#define REGISTER_DELAY ( 200 )
+
+// Number of milliseconds before a round is restarted
+#define ROUND_TIMEOUT ( 5000 )
+
+// Number of milliseconds between checks for UdpData to resend
+#define RESEND_CHECK_INTERVAL ( 5 )
+
+// Maximum number of epoll events handled per wait
+#define MAX_EVENTS ( 256 )
+
+// Size of the buffer used to read the TCP sockets
+#define READ_BUFFER_SIZE ( 4096 )
+
+
+static const char MatchInfoHeader[] = "MatchInfo";
+
+static const char TunInfoHeader[] = "TunInfo";
+
+
+struct Options
+{
+    string server = "127.0.0.1";
+
+    uint16_t port = 3939;
+
+    uint32_t pairs = 1000;
+
+    uint32_t threads = 1;
+
+    double seconds = 10;
+
+    // Number of milliseconds between resends of UdpData, like the UDP keep alive of SmartSocket
+    uint32_t resend = 50;
+};
+
+
+struct Result
+{
+    uint64_t rounds = 0, udpData = 0, tunInfos = 0, timeouts = 0, disconnects = 0, errors = 0;
+
+    // Microseconds
+    vector<uint32_t> matchLatencies, forwardLatencies;
+
+    void add ( Result& other )
+    {
+        rounds += other.rounds;
+        udpData += other.udpData;
+        tunInfos += other.tunInfos;
+        timeouts += other.timeouts;
+        disconnects += other.disconnects;
+        errors += other.errors;
+
+        matchLatencies.insert ( matchLatencies.end(), other.matchLatencies.begin(), other.matchLatencies.end() );
+        forwardLatencies.insert ( forwardLatencies.end(), other.forwardLatencies.begin(), other.forwardLatencies.end() );
+    }
+};
+
+
+static uint64_t getMicroseconds()
+{
+    return chrono::duration_cast<chrono::microseconds> ( chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+static string getLocalAddress ( int fd )
+{
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof ( addr );
+    getsockname ( fd, ( sockaddr * ) &addr, &addrLen );
+
+    char buffer[INET_ADDRSTRLEN];
+    inet_ntop ( AF_INET, &addr.sin_addr, buffer, sizeof ( buffer ) );
+
+    return format ( "%s:%u", buffer, ntohs ( addr.sin_port ) );
+}
+
+
+// Pairs of host and client run by one thread, on one epoll
+class LoadThread : public Thread
+{
+public:
+
+    Result result;
+
+    LoadThread ( const Options& options, const sockaddr_in& server, uint32_t firstPair, uint32_t numPairs )
+        : _options ( options ), _server ( server ), _pairs ( numPairs )
+    {
+        for ( uint32_t i = 0; i < numPairs; ++i )
+            _pairs[i].hostPort = 1 + firstPair + i;
+    }
+
+    ~LoadThread()
+    {
+        join();
+
+        for ( Pair& pair : _pairs )
+        {
+            for ( int fd : { pair.tcp[0], pair.tcp[1], pair.udp[0], pair.udp[1] } )
+            {
+                if ( fd >= 0 )
+                    ::close ( fd );
+            }
+        }
+
+        if ( _epollFd >= 0 )
+            ::close ( _epollFd );
+    }
+
+    // Connect and register the hosts
+    bool connectHosts ( string& error )
+    {
+        _epollFd = epoll_create1 ( 0 );
+
+        for ( uint32_t i = 0; i < _pairs.size(); ++i )
+        {
+            Pair& pair = _pairs[i];
+
+            if ( ! open ( i, Host, error ) )
+                return false;
+
+            char hostingPort[3] = { 'T' };
+            memcpy ( &hostingPort[1], &pair.hostPort, sizeof ( pair.hostPort ) );
+
+            if ( ::send ( pair.tcp[Host], hostingPort, sizeof ( hostingPort ), MSG_NOSIGNAL ) != 3 )
+            {
+                error = format ( "Failed to register host: %s", strerror ( errno ) );
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Connect the clients, and run the rounds until the end time
+    void runUntil ( uint64_t end )
+    {
+        _end = end;
+        Thread::start();
+    }
+
+    void run() override
+    {
+        string error;
+
+        for ( uint32_t i = 0; i < _pairs.size(); ++i )
+        {
+            if ( ! open ( i, Client, error ) )
+            {
+                PRINT ( "%s", error );
+                ++result.errors;
+                continue;
+            }
+
+            startRound ( i );
+        }
+
+        epoll_event events[MAX_EVENTS];
+
+        uint64_t lastCheck = 0;
+
+        for ( ;; )
+        {
+            const uint64_t now = getMicroseconds();
+
+            if ( now >= _end )
+                break;
+
+            if ( now - lastCheck >= RESEND_CHECK_INTERVAL * 1000 )
+            {
+                for ( uint32_t i = 0; i < _pairs.size(); ++i )
+                    check ( i, now );
+
+                lastCheck = now;
+            }
+
+            const int count = epoll_wait ( _epollFd, events, MAX_EVENTS, RESEND_CHECK_INTERVAL );
+
+            for ( int i = 0; i < count; ++i )
+            {
+                const uint32_t index = events[i].data.u64 >> 2;
+                const Side side = Side ( ( events[i].data.u64 >> 1 ) & 1 );
+
+                if ( events[i].data.u64 & 1 )
+                    drainUdp ( index, side );
+                else
+                    readTcp ( index, side );
+            }
+        }
+    }
+
+private:
+
+    // Indexed like the server, ie by the isClient flag of the UdpData sent to the other side
+    enum Side { Client = 0, Host = 1 };
+
+    struct Pair
+    {
+        uint16_t hostPort = 0;
+
+        int tcp[2] = { -1, -1 }, udp[2] = { -1, -1 };
+
+        // UDP address of each side, as seen by the server
+        string udpAddress[2];
+
+        // Incomplete TCP messages of each side
+        string buffer[2];
+
+        bool dead = false;
+
+        // Current round
+        uint64_t roundStart = 0;
+        uint32_t matchId[2] = { 0, 0 };
+        uint64_t firstSend[2] = { 0, 0 }, lastSend[2] = { 0, 0 };
+        bool tunInfo[2] = { false, false };
+    };
+
+    const Options& _options;
+
+    const sockaddr_in _server;
+
+    vector<Pair> _pairs;
+
+    int _epollFd = -1;
+
+    uint64_t _end = 0;
+
+    bool open ( uint32_t index, Side side, string& error )
+    {
+        Pair& pair = _pairs[index];
+
+        const int tcp = socket ( AF_INET, SOCK_STREAM, 0 );
+        const int udp = socket ( AF_INET, SOCK_DGRAM, 0 );
+
+        pair.tcp[side] = tcp;
+        pair.udp[side] = udp;
+
+        const int one = 1;
+
+        if ( tcp < 0 || udp < 0
+                || setsockopt ( tcp, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) ) != 0
+                || connect ( tcp, ( const sockaddr * ) &_server, sizeof ( _server ) ) != 0
+                || connect ( udp, ( const sockaddr * ) &_server, sizeof ( _server ) ) != 0
+                || fcntl ( tcp, F_SETFL, O_NONBLOCK ) != 0
+                || fcntl ( udp, F_SETFL, O_NONBLOCK ) != 0 )
+        {
+            error = format ( "Failed to connect: %s", strerror ( errno ) );
+            return false;
+        }
+
+        pair.udpAddress[side] = getLocalAddress ( udp );
+        pair.buffer[side].clear();
+
+        epoll_event event;
+        memset ( &event, 0, sizeof ( event ) );
+        event.events = EPOLLIN;
+
+        event.data.u64 = ( uint64_t ( index ) << 2 ) | ( side << 1 );
+        epoll_ctl ( _epollFd, EPOLL_CTL_ADD, tcp, &event );
+
+        event.data.u64 |= 1;
+        epoll_ctl ( _epollFd, EPOLL_CTL_ADD, udp, &event );
+        return true;
+    }
+
+    void close ( uint32_t index, Side side )
+    {
+        Pair& pair = _pairs[index];
+
+        for ( int *fd : { &pair.tcp[side], &pair.udp[side] } )
+        {
+            if ( *fd < 0 )
+                continue;
+
+            epoll_ctl ( _epollFd, EPOLL_CTL_DEL, *fd, 0 );
+            ::close ( *fd );
+            *fd = -1;
+        }
+    }
+
+    void startRound ( uint32_t index )
+    {
+        Pair& pair = _pairs[index];
+
+        if ( pair.dead )
+            return;
+
+        pair.roundStart = getMicroseconds();
+        pair.matchId[0] = pair.matchId[1] = 0;
+        pair.firstSend[0] = pair.firstSend[1] = 0;
+        pair.tunInfo[0] = pair.tunInfo[1] = false;
+
+        // The address of the host as seen by the server, which is the same as the address of its UDP socket
+        const string address = "T" + pair.udpAddress[Host].substr ( 0, pair.udpAddress[Host].rfind ( ':' ) )
+                               + format ( ":%u", pair.hostPort );
+
+        if ( ::send ( pair.tcp[Client], address.c_str(), address.size(), MSG_NOSIGNAL ) != ( ssize_t ) address.size() )
+            ++result.errors;
+    }
+
+    void sendUdpData ( Pair& pair, Side side, uint64_t now )
+    {
+        char udpData[1 + sizeof ( uint32_t )];
+        udpData[0] = ( side == Client ? 1 : 0 );
+        memcpy ( &udpData[1], &pair.matchId[side], sizeof ( uint32_t ) );
+
+        if ( ::send ( pair.udp[side], udpData, sizeof ( udpData ), 0 ) == sizeof ( udpData ) )
+            ++result.udpData;
+
+        if ( ! pair.firstSend[side] )
+            pair.firstSend[side] = now;
+
+        pair.lastSend[side] = now;
+    }
+
+    // Resend UdpData that hasn't been answered, and restart rounds that timed out
+    void check ( uint32_t index, uint64_t now )
+    {
+        Pair& pair = _pairs[index];
+
+        if ( pair.dead )
+            return;
+
+        if ( now - pair.roundStart >= ROUND_TIMEOUT * 1000ull )
+        {
+            ++result.timeouts;
+            startRound ( index );
+            return;
+        }
+
+        for ( Side side : { Client, Host } )
+        {
+            // TunInfo with the address of this side goes to the other side
+            if ( pair.firstSend[side] && ! pair.tunInfo[1 - side]
+                    && now - pair.lastSend[side] >= _options.resend * 1000ull )
+            {
+                sendUdpData ( pair, side, now );
+            }
+        }
+    }
+
+    void drainUdp ( uint32_t index, Side side )
+    {
+        // The server never sends anything over UDP
+        char buffer[64];
+
+        while ( recv ( _pairs[index].udp[side], buffer, sizeof ( buffer ), 0 ) > 0 )
+            ;
+    }
+
+    void readTcp ( uint32_t index, Side side )
+    {
+        Pair& pair = _pairs[index];
+
+        char buffer[READ_BUFFER_SIZE];
+
+        const ssize_t len = recv ( pair.tcp[side], buffer, sizeof ( buffer ), 0 );
+
+        if ( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+            return;
+
+        if ( len <= 0 )
+        {
+            ++result.disconnects;
+            close ( index, side );
+
+            string error;
+
+            // The server disconnects clients whose host isn't registered yet, so reconnect and try again
+            if ( side == Host || ! open ( index, side, error ) )
+            {
+                pair.dead = true;
+                return;
+            }
+
+            startRound ( index );
+            return;
+        }
+
+        // Messages can be coalesced or split by TCP
+        string& stream = pair.buffer[side];
+        stream.append ( buffer, len );
+
+        const uint64_t now = getMicroseconds();
+
+        for ( ;; )
+        {
+            const size_t matchInfoLen = sizeof ( MatchInfoHeader ) - 1 + sizeof ( uint32_t );
+            const size_t tunInfoLen = sizeof ( TunInfoHeader ) - 1 + sizeof ( uint32_t );
+
+            if ( stream.compare ( 0, sizeof ( MatchInfoHeader ) - 1, MatchInfoHeader ) == 0 )
+            {
+                if ( stream.size() < matchInfoLen )
+                    return;
+
+                memcpy ( &pair.matchId[side], &stream[sizeof ( MatchInfoHeader ) - 1], sizeof ( uint32_t ) );
+                stream.erase ( 0, matchInfoLen );
+
+                if ( side == Client )
+                    result.matchLatencies.push_back ( now - pair.roundStart );
+
+                sendUdpData ( pair, side, now );
+            }
+            else if ( stream.compare ( 0, sizeof ( TunInfoHeader ) - 1, TunInfoHeader ) == 0 )
+            {
+                const size_t end = stream.find ( '\0', tunInfoLen );
+
+                if ( end == string::npos )
+                    return;
+
+                uint32_t matchId;
+                memcpy ( &matchId, &stream[sizeof ( TunInfoHeader ) - 1], sizeof ( matchId ) );
+
+                const string address = stream.substr ( tunInfoLen, end - tunInfoLen );
+                stream.erase ( 0, end + 1 );
+
+                // Ignore TunInfo for rounds that timed out
+                const Side other = Side ( 1 - side );
+
+                if ( matchId != pair.matchId[side] || pair.tunInfo[side] || ! pair.firstSend[other] )
+                    continue;
+
+                if ( address != pair.udpAddress[other] )
+                    ++result.errors;
+
+                ++result.tunInfos;
+                result.forwardLatencies.push_back ( now - pair.firstSend[other] );
+                pair.tunInfo[side] = true;
+
+                if ( pair.tunInfo[Client] && pair.tunInfo[Host] )
+                {
+                    ++result.rounds;
+                    startRound ( index );
+                }
+            }
+            else if ( stream.size() < max ( sizeof ( MatchInfoHeader ), sizeof ( TunInfoHeader ) ) - 1
+                      && ( string ( MatchInfoHeader ).compare ( 0, stream.size(), stream ) == 0
+                           || string ( TunInfoHeader ).compare ( 0, stream.size(), stream ) == 0 ) )
+            {
+                // Incomplete header
+                return;
+            }
+            else
+            {
+                if ( ! stream.empty() )
+                    ++result.errors;
+
+                stream.clear();
+                return;
+            }
+        }
+    }
+};
+
+
+template<typename T>
+static T percentile ( vector<T>& values, double p )
+{
+    if ( values.empty() )
+        return T();
+
+    const size_t i = min ( values.size() - 1, size_t ( p * values.size() ) );
+
+    nth_element ( values.begin(), values.begin() + i, values.end() );
+    return values[i];
+}
+
+static void printLatencies ( const char *name, vector<uint32_t>& values )
+{
+    PRINT ( "%s latency (us): p50=%u; p90=%u; p99=%u; p99.9=%u; max=%u", name,
+            percentile ( values, 0.5 ), percentile ( values, 0.9 ), percentile ( values, 0.99 ),
+            percentile ( values, 0.999 ), percentile ( values, 1.0 ) );
+}
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-s" )
+            options.server = argv[++i];
+        else if ( i + 1 < argc && arg == "-p" )
+            options.port = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-n" )
+            options.pairs = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-t" )
+            options.threads = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-d" )
+            options.seconds = stod ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-r" )
+            options.resend = stoul ( argv[++i] );
+        else
+        {
+            PRINT ( "Usage: %s [-s server] [-p port] [-n pairs] [-t threads] [-d seconds] [-r resend ms]", argv[0] );
+            return -1;
+        }
+    }
+
+    // Each host and client registration is unique by hosting port
+    options.pairs = max<uint32_t> ( 1, min<uint32_t> ( options.pairs, 0xFFFF ) );
+    options.threads = max<uint32_t> ( 1, min ( options.threads, options.pairs ) );
+
+    sockaddr_in server;
+    memset ( &server, 0, sizeof ( server ) );
+    server.sin_family = AF_INET;
+    server.sin_port = htons ( options.port );
+
+    if ( inet_pton ( AF_INET, options.server.c_str(), &server.sin_addr ) != 1 )
+    {
+        PRINT ( "Invalid server address: %s", options.server );
+        return -1;
+    }
+
+    // Each pair has 2 TCP and 2 UDP sockets
+    rlimit limit;
+
+    if ( getrlimit ( RLIMIT_NOFILE, &limit ) == 0 )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit ( RLIMIT_NOFILE, &limit );
+    }
+
+    vector<unique_ptr<LoadThread>> threads;
+
+    string error;
+
+    for ( uint32_t i = 0, first = 0; i < options.threads; ++i )
+    {
+        const uint32_t count = options.pairs / options.threads + ( i < options.pairs % options.threads ? 1 : 0 );
+
+        threads.emplace_back ( new LoadThread ( options, server, first, count ) );
+        first += count;
+
+        if ( ! threads.back()->connectHosts ( error ) )
+        {
+            PRINT ( "%s", error );
+            return -1;
+        }
+    }
+
+    usleep ( REGISTER_DELAY * 1000 );
+
+    const uint64_t start = getMicroseconds();
+
+    for ( const unique_ptr<LoadThread>& thread : threads )
+        thread->runUntil ( start + uint64_t ( options.seconds * 1000000 ) );
+
+    Result result;
+
+    for ( const unique_ptr<LoadThread>& thread : threads )
+    {
+        thread->join();
+        result.add ( thread->result );
+    }
+
+    const double seconds = ( getMicroseconds() - start ) / 1000000.0;
+
+    PRINT ( "Pairs: %u; Threads: %u; Seconds: %.1f", options.pairs, options.threads, seconds );
+    PRINT ( "Rounds: %llu (%.0f/s); UdpData sent: %llu (%.0f/s); Forwarded: %llu (%.0f/s)",
+            result.rounds, result.rounds / seconds, result.udpData, result.udpData / seconds,
+            result.tunInfos, result.tunInfos / seconds );
+    PRINT ( "Timeouts: %llu; Disconnects: %llu; Errors: %llu", result.timeouts, result.disconnects, result.errors );
+
+    printLatencies ( "Match", result.matchLatencies );
+    printLatencies ( "Forward", result.forwardLatencies );
+    return 0;
+}
@@ -0,0 +1,893 @@
+#include "RelayServer.hpp"
+#include "StringUtils.hpp"
+#include "Logger.hpp"
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+
+#define LOG_RELAY(FORMAT, ...)                                                                                      \
+    do {                                                                                                            \
+        if ( _server.verbose )                                                                                      \
+            PRINT ( "[%u] " FORMAT, _shard, ## __VA_ARGS__ );                                                       \
+    } while ( 0 )
+
+
+static const char MatchInfoHeader[] = "MatchInfo";
+
+static const char TunInfoHeader[] = "TunInfo";
+
+// Min and max length of a TypedConnectionAddress, ie "T1.1.1.1:0" and "T255.255.255.255:65535"
+static const size_t MinAddressLength = 10;
+static const size_t MaxAddressLength = 22;
+
+
+static bool setNonBlocking ( int fd )
+{
+    const int flags = fcntl ( fd, F_GETFL );
+    return ( flags >= 0 && fcntl ( fd, F_SETFL, flags | O_NONBLOCK ) == 0 );
+}
+
+static string formatIp ( uint32_t ip )
+{
+    char buffer[INET_ADDRSTRLEN];
+    inet_ntop ( AF_INET, &ip, buffer, sizeof ( buffer ) );
+    return buffer;
+}
+
+static string formatAddress ( uint32_t ip, uint16_t port )
+{
+    return format ( "%s:%u", formatIp ( ip ), port );
+}
+
+// Microseconds since the given relay time, 0 if the clock went back
+static uint64_t getElapsed ( uint64_t time )
+{
+    const uint64_t now = getRelayTime();
+    return ( now > time ? now - time : 0 );
+}
+
+
+RelayShard::RelayShard ( RelayServer& server, uint32_t shard, uint32_t numShards )
+    : _server ( server ), _shard ( shard ), _lastMatchId ( shard ), _outboxes ( numShards )
+{
+    for ( uint32_t i = 0; i < numShards; ++i )
+        _inboxes.emplace_back ( new Queue() );
+}
+
+RelayShard::~RelayShard()
+{
+    join();
+    close();
+}
+
+void RelayShard::close()
+{
+    for ( size_t fd = 0; fd < _connections.size(); ++fd )
+    {
+        if ( _connections[fd].open )
+            ::close ( fd );
+    }
+
+    _connections.clear();
+    _connFds.clear();
+    _hosts.clear();
+    _matches.clear();
+
+    _numConnections = _numHosts = _numMatches = 0;
+
+    for ( int fd : { _tcpFd, _udpFd, _eventFd, _epollFd } )
+    {
+        if ( fd >= 0 )
+            ::close ( fd );
+    }
+
+    _tcpFd = _udpFd = _eventFd = _epollFd = -1;
+}
+
+bool RelayShard::listen ( uint16_t port, string& error )
+{
+    close();
+
+    sockaddr_in addr;
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl ( INADDR_ANY );
+    addr.sin_port = htons ( port );
+
+    const int one = 1;
+
+    _epollFd = epoll_create1 ( 0 );
+    _tcpFd = socket ( AF_INET, SOCK_STREAM, 0 );
+    _udpFd = socket ( AF_INET, SOCK_DGRAM, 0 );
+    _eventFd = eventfd ( 0, EFD_NONBLOCK );
+
+    // Each shard binds its own sockets to the same port, and the kernel balances between them
+    if ( _epollFd < 0 || _tcpFd < 0 || _udpFd < 0 || _eventFd < 0
+            || setsockopt ( _tcpFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof ( one ) ) != 0
+            || setsockopt ( _tcpFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof ( one ) ) != 0
+            || setsockopt ( _udpFd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof ( one ) ) != 0
+            || setsockopt ( _udpFd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof ( one ) ) != 0
+            || bind ( _tcpFd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0
+            || bind ( _udpFd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0
+            || ::listen ( _tcpFd, SOMAXCONN ) != 0
+            || ! setNonBlocking ( _tcpFd )
+            || ! setNonBlocking ( _udpFd ) )
+    {
+        error = format ( "Failed to listen on port %u: %s", port, strerror ( errno ) );
+        close();
+        return false;
+    }
+
+    epoll_event event;
+    memset ( &event, 0, sizeof ( event ) );
+    event.events = EPOLLIN;
+
+    for ( int fd : { _tcpFd, _udpFd, _eventFd } )
+    {
+        event.data.fd = fd;
+        epoll_ctl ( _epollFd, EPOLL_CTL_ADD, fd, &event );
+    }
+
+    return true;
+}
+
+void RelayShard::run()
+{
+    while ( ! _server._stopping.load() )
+    {
+        // Retry soon if another shard's queue was full
+        bool pending = false;
+
+        for ( const deque<RelayCommand>& outbox : _outboxes )
+            pending = pending || ! outbox.empty();
+
+        poll ( pending ? 1 : RELAY_POLL_TIMEOUT );
+    }
+}
+
+void RelayShard::poll ( int timeout )
+{
+    epoll_event events[RELAY_MAX_EVENTS];
+
+    const int count = epoll_wait ( _epollFd, events, RELAY_MAX_EVENTS, timeout );
+
+    if ( count < 0 && errno != EINTR )
+    {
+        PRINT ( "[%u] Failed to poll: %s", _shard, strerror ( errno ) );
+        _server._failed = true;
+        _server._stopping = true;
+        return;
+    }
+
+    const uint64_t start = getRelayTime();
+
+    for ( int i = 0; i < count; ++i )
+    {
+        const int fd = events[i].data.fd;
+
+        if ( fd == _tcpFd )
+            acceptAll();
+        else if ( fd == _udpFd )
+            readUdp();
+        else if ( fd == _eventFd )
+            readInboxes();
+        else if ( events[i].events & ( EPOLLERR | EPOLLHUP ) )
+            disconnect ( fd );
+        else
+            readTcp ( fd );
+    }
+
+    flush();
+
+    _metrics.add ( RelayMetrics::Polls );
+    _metrics.add ( RelayMetrics::BusyMicros, getElapsed ( start ) );
+}
+
+void RelayShard::acceptAll()
+{
+    for ( ;; )
+    {
+        sockaddr_in addr;
+        socklen_t addrLen = sizeof ( addr );
+
+        const int fd = accept4 ( _tcpFd, ( sockaddr * ) &addr, &addrLen, SOCK_NONBLOCK );
+
+        if ( fd < 0 )
+        {
+            // Out of sockets, try again on the next poll
+            if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR )
+                LOG_RELAY ( "accept failed: %s", strerror ( errno ) );
+            return;
+        }
+
+        if ( ( size_t ) fd >= _connections.size() )
+            _connections.resize ( max<size_t> ( fd + 1, 2 * _connections.size() ) );
+
+        // Sockets are reused as soon as they are closed, but connection ids never are, so commands from other
+        // shards can't reach the wrong connection.
+        Connection& connection = _connections[fd];
+        connection.open = true;
+        connection.id = ( uint64_t ( _shard ) << 48 ) | ++_lastConnSeq;
+        connection.ip = addr.sin_addr.s_addr;
+        connection.hostKey = 0;
+        connection.matchIds.clear();
+
+        _connFds[connection.id] = fd;
+        ++_numConnections;
+
+        // TunInfo closely follows MatchInfo, so don't let Nagle's algorithm wait for the delayed ACK
+        const int one = 1;
+        setsockopt ( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) );
+
+        epoll_event event;
+        memset ( &event, 0, sizeof ( event ) );
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl ( _epollFd, EPOLL_CTL_ADD, fd, &event );
+
+        LOG_RELAY ( "accepted %s", formatAddress ( connection.ip, ntohs ( addr.sin_port ) ) );
+    }
+}
+
+void RelayShard::readTcp ( int fd )
+{
+    const ssize_t len = recv ( fd, _tcpBuffer, sizeof ( _tcpBuffer ), 0 );
+
+    if ( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ) )
+        return;
+
+    Connection& connection = _connections[fd];
+
+    RelayCommand command;
+    command.conn = connection.id;
+    command.time = getRelayTime();
+
+    if ( len > 0 )
+        _metrics.add ( RelayMetrics::TcpMessages );
+
+    // Each message is read in a single recv, like the original server
+    if ( len == 3 )
+    {
+        // TypedHostingPort
+        const char type = _tcpBuffer[0];
+        uint16_t port;
+        memcpy ( &port, &_tcpBuffer[1], sizeof ( port ) );
+
+        if ( type && port )
+        {
+            const uint64_t key = RelayServer::getHostKey ( type, connection.ip, port );
+
+            // Replace the previous registration of this connection
+            if ( connection.hostKey && connection.hostKey != key )
+            {
+                command.type = RelayCommand::UnregisterHost;
+                command.key = connection.hostKey;
+                post ( _server.getKeyShard ( command.key ), command );
+            }
+
+            connection.hostKey = key;
+
+            command.type = RelayCommand::RegisterHost;
+            command.key = key;
+            post ( _server.getKeyShard ( key ), command );
+
+            LOG_RELAY ( "host %c%s", type, formatAddress ( connection.ip, port ) );
+            return;
+        }
+    }
+    else if ( len >= ( ssize_t ) MinAddressLength && len <= ( ssize_t ) MaxAddressLength )
+    {
+        // TypedConnectionAddress, the owner of the host key closes this connection if there is no such host
+        command.type = RelayCommand::Connect;
+        command.key = RelayServer::parseHostKey ( _tcpBuffer, len );
+
+        if ( command.key )
+        {
+            post ( _server.getKeyShard ( command.key ), command );
+
+            LOG_RELAY ( "connect %s", string ( _tcpBuffer, len ) );
+            return;
+        }
+    }
+
+    // Otherwise disconnect, this includes the remote closing the connection
+    disconnect ( fd );
+}
+
+void RelayShard::readUdp()
+{
+    mmsghdr msgs[RELAY_UDP_BATCH];
+    iovec iovecs[RELAY_UDP_BATCH];
+    sockaddr_in addrs[RELAY_UDP_BATCH];
+    char buffers[RELAY_UDP_BATCH][16];
+    char controls[RELAY_UDP_BATCH][CMSG_SPACE ( sizeof ( timespec ) )];
+
+    for ( ;; )
+    {
+        memset ( msgs, 0, sizeof ( msgs ) );
+
+        for ( size_t i = 0; i < RELAY_UDP_BATCH; ++i )
+        {
+            iovecs[i].iov_base = buffers[i];
+            iovecs[i].iov_len = sizeof ( buffers[i] );
+            msgs[i].msg_hdr.msg_iov = &iovecs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof ( addrs[i] );
+            msgs[i].msg_hdr.msg_control = controls[i];
+            msgs[i].msg_hdr.msg_controllen = sizeof ( controls[i] );
+        }
+
+        const int count = recvmmsg ( _udpFd, msgs, RELAY_UDP_BATCH, MSG_DONTWAIT, 0 );
+
+        if ( count <= 0 )
+            return;
+
+        const uint64_t now = getRelayTime();
+
+        for ( int i = 0; i < count; ++i )
+        {
+            _metrics.add ( RelayMetrics::UdpPackets );
+            _metrics.add ( RelayMetrics::UdpBytes, msgs[i].msg_len );
+
+            // UdpData is the isClient flag followed by the matchId, anything else is ignored
+            if ( msgs[i].msg_len != 1 + sizeof ( uint32_t ) || ( msgs[i].msg_hdr.msg_flags & MSG_TRUNC )
+                    || uint8_t ( buffers[i][0] ) > 1 )
+            {
+                _metrics.add ( RelayMetrics::UdpInvalid );
+                continue;
+            }
+
+            RelayCommand command;
+            command.type = RelayCommand::UdpData;
+            command.index = buffers[i][0];
+            command.ip = addrs[i].sin_addr.s_addr;
+            command.port = ntohs ( addrs[i].sin_port );
+            command.size = msgs[i].msg_len;
+            command.time = now;
+            memcpy ( &command.matchId, &buffers[i][1], sizeof ( command.matchId ) );
+
+            // The time the kernel received the datagram, so the latency includes the time spent in the socket buffer
+            msghdr& hdr = msgs[i].msg_hdr;
+
+            for ( cmsghdr *cmsg = CMSG_FIRSTHDR ( &hdr ); cmsg; cmsg = CMSG_NXTHDR ( &hdr, cmsg ) )
+            {
+                if ( cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS )
+                {
+                    timespec ts;
+                    memcpy ( &ts, CMSG_DATA ( cmsg ), sizeof ( ts ) );
+                    command.time = min<uint64_t> ( now, uint64_t ( ts.tv_sec ) * 1000000 + ts.tv_nsec / 1000 );
+                }
+            }
+
+            // Both sides of a match are handled by the owner of the match, whichever shard received the datagram
+            post ( _server.getMatchShard ( command.matchId ), command );
+        }
+
+        if ( count < RELAY_UDP_BATCH )
+            return;
+    }
+}
+
+void RelayShard::readInboxes()
+{
+    // Reset the eventfd counter before reading, so pushes after this wake us up again
+    uint64_t value;
+    if ( read ( _eventFd, &value, sizeof ( value ) ) < 0 && errno != EAGAIN )
+        LOG_RELAY ( "eventfd read failed: %s", strerror ( errno ) );
+
+    RelayCommand command;
+
+    for ( const unique_ptr<Queue>& inbox : _inboxes )
+    {
+        while ( inbox->pop ( command ) )
+        {
+            _metrics.add ( RelayMetrics::CommandsIn );
+            handle ( command );
+        }
+    }
+}
+
+void RelayShard::disconnect ( int fd )
+{
+    Connection& connection = _connections[fd];
+
+    if ( ! connection.open )
+        return;
+
+    RelayCommand command;
+    command.conn = connection.id;
+
+    if ( connection.hostKey )
+    {
+        // The owner only unregisters if this connection is still the registered host for the address
+        command.type = RelayCommand::UnregisterHost;
+        command.key = connection.hostKey;
+        post ( _server.getKeyShard ( command.key ), command );
+    }
+
+    for ( uint32_t matchId : connection.matchIds )
+    {
+        command.type = RelayCommand::EraseMatch;
+        command.matchId = matchId;
+        post ( _server.getMatchShard ( matchId ), command );
+    }
+
+    LOG_RELAY ( "disconnected %s; matches=%u", formatIp ( connection.ip ), connection.matchIds.size() );
+
+    _connFds.erase ( connection.id );
+
+    connection.open = false;
+    connection.id = 0;
+    connection.hostKey = 0;
+    connection.matchIds.clear();
+    --_numConnections;
+
+    epoll_ctl ( _epollFd, EPOLL_CTL_DEL, fd, 0 );
+    ::close ( fd );
+}
+
+void RelayShard::post ( uint32_t shard, const RelayCommand& command )
+{
+    _outboxes[shard].push_back ( command );
+}
+
+void RelayShard::flush()
+{
+    // Handling a command can post more commands, including to this shard
+    deque<RelayCommand>& local = _outboxes[_shard];
+
+    while ( ! local.empty() )
+    {
+        const RelayCommand command = local.front();
+        local.pop_front();
+        handle ( command );
+    }
+
+    uint64_t queued = 0;
+
+    for ( uint32_t shard = 0; shard < _outboxes.size(); ++shard )
+    {
+        deque<RelayCommand>& outbox = _outboxes[shard];
+
+        if ( shard == _shard || outbox.empty() )
+            continue;
+
+        RelayShard& other = *_server._shards[shard];
+        Queue& queue = *other._inboxes[_shard];
+
+        bool pushed = false;
+
+        // Commands that don't fit stay in order in the outbox, until the next flush
+        while ( ! outbox.empty() && queue.push ( outbox.front() ) )
+        {
+            outbox.pop_front();
+            pushed = true;
+
+            _metrics.add ( RelayMetrics::CommandsOut );
+        }
+
+        if ( ! outbox.empty() )
+        {
+            _metrics.add ( RelayMetrics::QueueFull );
+            queued += outbox.size();
+        }
+
+        // Wake up the other shard once per batch
+        const uint64_t one = 1;
+        if ( pushed && write ( other._eventFd, &one, sizeof ( one ) ) < 0 )
+            LOG_RELAY ( "eventfd write failed: %s", strerror ( errno ) );
+    }
+
+    _metrics.queued.store ( queued, std::memory_order_relaxed );
+}
+
+void RelayShard::handle ( const RelayCommand& command )
+{
+    switch ( command.type )
+    {
+        case RelayCommand::RegisterHost:
+            _hosts[command.key] = command.conn;
+            _numHosts = _hosts.size();
+            break;
+
+        case RelayCommand::UnregisterHost:
+        {
+            const uint64_t *host = _hosts.find ( command.key );
+
+            if ( host && *host == command.conn )
+                _hosts.erase ( command.key );
+
+            _numHosts = _hosts.size();
+            break;
+        }
+
+        case RelayCommand::Connect:
+        {
+            const uint64_t *host = _hosts.find ( command.key );
+
+            RelayCommand reply;
+            reply.conn = command.conn;
+            reply.time = command.time;
+
+            if ( ! host )
+            {
+                reply.type = RelayCommand::Close;
+                post ( RelayServer::getConnShard ( reply.conn ), reply );
+                break;
+            }
+
+            const uint32_t matchId = nextMatchId();
+
+            Match& match = _matches[matchId];
+            match.conns[0] = command.conn;
+            match.conns[1] = *host;
+            match.summary.matchId = matchId;
+            match.summary.shard = _shard;
+            match.summary.created = getRelayTime();
+            _numMatches = _matches.size();
+
+            reply.type = RelayCommand::SendMatchInfo;
+            reply.matchId = matchId;
+
+            for ( uint64_t conn : match.conns )
+            {
+                reply.conn = conn;
+                post ( RelayServer::getConnShard ( conn ), reply );
+            }
+
+            LOG_RELAY ( "matched; matchId=%u; matches=%u", matchId, _matches.size() );
+            break;
+        }
+
+        case RelayCommand::Close:
+        {
+            const int fd = getFd ( command.conn );
+
+            if ( fd >= 0 )
+                disconnect ( fd );
+            break;
+        }
+
+        case RelayCommand::SendMatchInfo:
+        {
+            const int fd = getFd ( command.conn );
+
+            // The connection was closed before it could learn about the match
+            if ( fd < 0 )
+            {
+                RelayCommand reply;
+                reply.type = RelayCommand::EraseMatch;
+                reply.matchId = command.matchId;
+                post ( _server.getMatchShard ( reply.matchId ), reply );
+                break;
+            }
+
+            char matchInfo[sizeof ( MatchInfoHeader ) - 1 + sizeof ( uint32_t )];
+            memcpy ( matchInfo, MatchInfoHeader, sizeof ( MatchInfoHeader ) - 1 );
+            memcpy ( &matchInfo[sizeof ( MatchInfoHeader ) - 1], &command.matchId, sizeof ( command.matchId ) );
+
+            send ( fd, matchInfo, sizeof ( matchInfo ) );
+
+            _connections[fd].matchIds.push_back ( command.matchId );
+
+            _metrics.matchLatency.add ( getElapsed ( command.time ) );
+            break;
+        }
+
+        case RelayCommand::UdpData:
+        {
+            Match *match = _matches.find ( command.matchId );
+
+            if ( ! match )
+                break;
+
+            LOG_RELAY ( "UdpData isClient=%u; matchId=%u; address=%s",
+                        command.index, command.matchId, formatAddress ( command.ip, command.port ) );
+
+            MatchSummary::Peer& peer = match->summary.peers[command.index];
+            peer.ip = command.ip;
+            peer.port = command.port;
+            peer.bytes += command.size;
+
+            // Interarrival jitter like RTP, without sender timestamps the deviation is between successive intervals
+            const uint64_t lastArrival = match->lastArrival[command.index];
+
+            if ( lastArrival && command.time >= lastArrival )
+            {
+                const uint64_t interval = command.time - lastArrival;
+
+                if ( peer.packets >= 2 )
+                {
+                    const double deviation = fabs ( double ( interval ) - match->lastInterval[command.index] );
+                    match->jitter[command.index] += ( deviation - match->jitter[command.index] ) / 16;
+                }
+
+                match->lastInterval[command.index] = interval;
+            }
+
+            match->lastArrival[command.index] = command.time;
+            ++peer.packets;
+
+            match->summary.latency = max<uint32_t> ( match->summary.latency, getElapsed ( command.time ) );
+
+            // Send the UDP address once to the other side of the match
+            if ( ! match->sent[command.index] )
+            {
+                RelayCommand reply = command;
+                reply.type = RelayCommand::SendTunInfo;
+                reply.conn = match->conns[command.index];
+                post ( RelayServer::getConnShard ( reply.conn ), reply );
+
+                match->sent[command.index] = true;
+            }
+
+            // Remove the match once both have been sent
+            if ( match->sent[0] && match->sent[1] )
+                eraseMatch ( command.matchId );
+            break;
+        }
+
+        case RelayCommand::SendTunInfo:
+        {
+            const int fd = getFd ( command.conn );
+
+            if ( fd < 0 )
+                break;
+
+            const string address = formatAddress ( command.ip, command.port );
+
+            string tunInfo ( TunInfoHeader, sizeof ( TunInfoHeader ) - 1 );
+            tunInfo.append ( ( const char * ) &command.matchId, sizeof ( command.matchId ) );
+            tunInfo.append ( address.c_str(), address.size() + 1 );
+
+            send ( fd, &tunInfo[0], tunInfo.size() );
+
+            _metrics.forwardLatency.add ( getElapsed ( command.time ) );
+            break;
+        }
+
+        case RelayCommand::EraseMatch:
+            eraseMatch ( command.matchId );
+            break;
+
+        case RelayCommand::RemoveMatch:
+        {
+            const int fd = getFd ( command.conn );
+
+            if ( fd < 0 )
+                break;
+
+            vector<uint32_t>& matchIds = _connections[fd].matchIds;
+
+            const auto it = find ( matchIds.begin(), matchIds.end(), command.matchId );
+
+            if ( it != matchIds.end() )
+            {
+                *it = matchIds.back();
+                matchIds.pop_back();
+            }
+            break;
+        }
+    }
+}
+
+uint32_t RelayShard::nextMatchId()
+{
+    // Only ids that are equal to this shard modulo the number of shards, so UdpData can find the owner
+    const uint32_t numShards = _outboxes.size();
+
+    do
+    {
+        if ( _lastMatchId > UINT32_MAX - numShards )
+            _lastMatchId = _shard;
+        else
+            _lastMatchId += numShards;
+    }
+    while ( _lastMatchId == 0 || _matches.contains ( _lastMatchId ) );
+
+    return _lastMatchId;
+}
+
+void RelayShard::eraseMatch ( uint32_t matchId )
+{
+    Match *match = _matches.find ( matchId );
+
+    if ( ! match )
+        return;
+
+    MatchSummary& summary = match->summary;
+    summary.completed = ( match->sent[0] && match->sent[1] );
+    summary.ended = getRelayTime();
+
+    _metrics.add ( summary.completed ? RelayMetrics::MatchesCompleted : RelayMetrics::MatchesAborted );
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        if ( summary.peers[i].packets < 3 )
+            continue;
+
+        summary.peers[i].jitter = uint32_t ( match->jitter[i] );
+        _metrics.jitter.add ( summary.peers[i].jitter );
+    }
+
+    if ( _server.hasStats() && ! _summaries.push ( summary ) )
+        _metrics.add ( RelayMetrics::SummariesDropped );
+
+    // Remove the match from both connections
+    RelayCommand command;
+    command.type = RelayCommand::RemoveMatch;
+    command.matchId = matchId;
+
+    for ( uint64_t conn : match->conns )
+    {
+        command.conn = conn;
+        post ( RelayServer::getConnShard ( conn ), command );
+    }
+
+    _matches.erase ( matchId );
+    _numMatches = _matches.size();
+}
+
+int RelayShard::getFd ( uint64_t conn ) const
+{
+    const int *fd = _connFds.find ( conn );
+    return ( fd ? *fd : -1 );
+}
+
+void RelayShard::send ( int fd, const char *bytes, size_t len )
+{
+    // Messages are small, so a full socket buffer means the remote isn't reading
+    if ( ::send ( fd, bytes, len, MSG_NOSIGNAL | MSG_DONTWAIT ) != ( ssize_t ) len )
+        LOG_RELAY ( "send failed: %s", strerror ( errno ) );
+}
+
+
+RelayServer::~RelayServer()
+{
+    stop();
+}
+
+bool RelayServer::listen ( uint16_t port, uint32_t numShards, string& error )
+{
+    stop();
+
+    _stats.reset();
+    _shards.clear();
+
+    // Connection ids only have 16 bits for the shard
+    numShards = max<uint32_t> ( 1, min<uint32_t> ( numShards, 0xFFFF ) );
+
+    for ( uint32_t i = 0; i < numShards; ++i )
+    {
+        _shards.emplace_back ( new RelayShard ( *this, i, numShards ) );
+
+        if ( ! _shards.back()->listen ( port, error ) )
+        {
+            _shards.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool RelayServer::listenStats ( const string& path, string& error )
+{
+    _stats.reset ( new RelayStats ( *this ) );
+
+    if ( ! _stats->listen ( path, error ) )
+    {
+        _stats.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void RelayServer::start()
+{
+    _stopping = false;
+
+    for ( const unique_ptr<RelayShard>& shard : _shards )
+        shard->start();
+
+    if ( _stats )
+        _stats->start();
+}
+
+void RelayServer::stop()
+{
+    _stopping = true;
+
+    for ( const unique_ptr<RelayShard>& shard : _shards )
+        shard->join();
+
+    if ( _stats )
+        _stats->join();
+}
+
+size_t RelayServer::numConnections() const
+{
+    size_t count = 0;
+
+    for ( const unique_ptr<RelayShard>& shard : _shards )
+        count += shard->numConnections();
+
+    return count;
+}
+
+size_t RelayServer::numHosts() const
+{
+    size_t count = 0;
+
+    for ( const unique_ptr<RelayShard>& shard : _shards )
+        count += shard->numHosts();
+
+    return count;
+}
+
+size_t RelayServer::numMatches() const
+{
+    size_t count = 0;
+
+    for ( const unique_ptr<RelayShard>& shard : _shards )
+        count += shard->numMatches();
+
+    return count;
+}
+
+uint32_t RelayServer::getKeyShard ( uint64_t key ) const
+{
+    // Mix the bits, since most hosts have the same type and similar ports
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    return uint32_t ( key % _shards.size() );
+}
+
+uint64_t RelayServer::getHostKey ( char type, uint32_t ip, uint16_t port )
+{
+    return ( uint64_t ( uint8_t ( type ) ) << 48 ) | ( uint64_t ( ntohl ( ip ) ) << 16 ) | port;
+}
+
+uint64_t RelayServer::parseHostKey ( const char *bytes, size_t len )
+{
+    const string str ( bytes, len );
+    const size_t colon = str.rfind ( ':' );
+
+    if ( colon == string::npos || colon < 2 )
+        return 0;
+
+    in_addr ip;
+
+    if ( inet_pton ( AF_INET, str.substr ( 1, colon - 1 ).c_str(), &ip ) != 1 )
+        return 0;
+
+    const string portStr = str.substr ( colon + 1 );
+
+    if ( portStr.empty() || portStr.size() > 5 || portStr.find_first_not_of ( "0123456789" ) != string::npos )
+        return 0;
+
+    const uint32_t port = stoul ( portStr );
+
+    // Only the exact same string as the host registration matches, like the original server
+    if ( port == 0 || port > 0xFFFF || str != str[0] + formatAddress ( ip.s_addr, port ) )
+        return 0;
+
+    return getHostKey ( str[0], ip.s_addr, port );
+}
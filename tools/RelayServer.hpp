@@ -0,0 +1,296 @@
+#pragma once
+
+#include "FlatHashMap.hpp"
+#include "RelayStats.hpp"
+#include "SpscQueue.hpp"
+#include "Thread.hpp"
+
+#include <cstdint>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+
+
+// Port the relay server listens on, for both TCP and UDP
+#define RELAY_DEFAULT_PORT ( 3939 )
+
+// Maximum number of TCP bytes read at once, each message is sent in a single packet
+#define RELAY_TCP_BUFFER_SIZE ( 4096 )
+
+// Maximum number of UDP datagrams read per system call
+#define RELAY_UDP_BATCH ( 64 )
+
+// Maximum number of epoll events handled per wait
+#define RELAY_MAX_EVENTS ( 256 )
+
+// Number of milliseconds each shard waits for events, and the main thread sleeps, before checking if it should stop
+#define RELAY_POLL_TIMEOUT ( 100 )
+
+// Capacity of the queue of commands from each shard to each other shard
+#define RELAY_QUEUE_SIZE ( 1024 )
+
+
+// Command sent between shards, or from a shard to itself
+struct RelayCommand
+{
+    enum Type : uint8_t
+    {
+        // To the owner of the host key: register / unregister the host connection
+        RegisterHost, UnregisterHost,
+
+        // To the owner of the host key: match the client connection with the host
+        Connect,
+
+        // To the owner of the connection: close the connection
+        Close,
+
+        // To the owner of the connection: send MatchInfo and remember the match
+        SendMatchInfo,
+
+        // To the owner of the match: UdpData was received
+        UdpData,
+
+        // To the owner of the connection: send TunInfo
+        SendTunInfo,
+
+        // To the owner of the match: a connection of the match was closed
+        EraseMatch,
+
+        // To the owner of the connection: the match was removed
+        RemoveMatch,
+    };
+
+    Type type = RegisterHost;
+
+    // isClient flag of UdpData
+    uint8_t index = 0;
+
+    uint16_t port = 0;
+
+    // Size of the UdpData datagram
+    uint16_t size = 0;
+
+    uint32_t matchId = 0;
+
+    // IPv4 address in network byte order
+    uint32_t ip = 0;
+
+    uint64_t key = 0;
+
+    // Connection id, the owner shard is in the top 16 bits
+    uint64_t conn = 0;
+
+    // When the message that caused this command was received, see getRelayTime
+    uint64_t time = 0;
+};
+
+
+class RelayServer;
+
+
+// Each shard runs on its own thread, with its own SO_REUSEPORT TCP and UDP sockets, so the kernel distributes
+// the connections and datagrams over the shards. The state is partitioned by owner instead of shared:
+//
+//  - Connections are owned by the shard that accepted them.
+//  - Host registrations are owned by the shard that the host key hashes to.
+//  - Matches are owned by the shard that allocated the match id, which is always the id modulo the number of shards,
+//    and the same shard as the host key. So both peers of a match are handled by the same shard.
+//
+// Shards only ever touch their own state, everything else is sent as a RelayCommand to the owner over lock-free
+// queues, one per pair of shards. The receiving shard is woken up with an eventfd.
+class RelayShard : public Thread
+{
+public:
+
+    RelayShard ( RelayServer& server, uint32_t shard, uint32_t numShards );
+
+    ~RelayShard();
+
+    bool listen ( uint16_t port, std::string& error );
+
+    void run() override;
+
+    size_t numConnections() const { return _numConnections.load ( std::memory_order_relaxed ); }
+
+    size_t numHosts() const { return _numHosts.load ( std::memory_order_relaxed ); }
+
+    size_t numMatches() const { return _numMatches.load ( std::memory_order_relaxed ); }
+
+    const RelayMetrics& getMetrics() const { return _metrics; }
+
+    // Get the next ended match, only call this from the stats endpoint thread
+    bool popSummary ( MatchSummary& summary ) { return _summaries.pop ( summary ); }
+
+private:
+
+    struct Connection
+    {
+        bool open = false;
+
+        uint64_t id = 0;
+
+        // Remote IPv4 address in network byte order
+        uint32_t ip = 0;
+
+        // Key of the typed hosting address this connection registered, 0 if not hosting
+        uint64_t hostKey = 0;
+
+        // Matches this connection is part of, a host can be in many matches
+        std::vector<uint32_t> matchIds;
+    };
+
+    struct Match
+    {
+        // Client and host connections. The address in the UdpData with the isClient flag i is sent to conns[i],
+        // ie the client's address goes to conns[1], the host, and the host's address goes to conns[0], the client.
+        uint64_t conns[2] = { 0, 0 };
+
+        // If the address in the UdpData with the isClient flag i has been sent to conns[i] with TunInfo
+        bool sent[2] = { false, false };
+
+        MatchSummary summary;
+
+        // Arrival time and interval of the last UdpData of each side, for the jitter
+        uint64_t lastArrival[2] = { 0, 0 };
+        uint64_t lastInterval[2] = { 0, 0 };
+        double jitter[2] = { 0, 0 };
+    };
+
+    typedef SpscQueue<RelayCommand, RELAY_QUEUE_SIZE> Queue;
+
+    RelayServer& _server;
+
+    const uint32_t _shard;
+
+    int _epollFd = -1, _tcpFd = -1, _udpFd = -1, _eventFd = -1;
+
+    // Connections indexed by socket, since sockets are small integers
+    std::vector<Connection> _connections;
+
+    // Connection id -> socket
+    FlatHashMap<uint64_t, int> _connFds;
+
+    uint64_t _lastConnSeq = 0;
+
+    // Owned host key -> host connection
+    FlatHashMap<uint64_t, uint64_t> _hosts;
+
+    // Owned match id -> match
+    FlatHashMap<uint32_t, Match> _matches;
+
+    uint32_t _lastMatchId = 0;
+
+    // Commands from each shard to this shard, indexed by the sending shard
+    std::vector<std::unique_ptr<Queue>> _inboxes;
+
+    // Commands to each shard that haven't been pushed yet, and commands to this shard
+    std::vector<std::deque<RelayCommand>> _outboxes;
+
+    std::atomic<size_t> _numConnections { 0 }, _numHosts { 0 }, _numMatches { 0 };
+
+    RelayMetrics _metrics;
+
+    // Ended matches for the stats endpoint
+    SpscQueue<MatchSummary, RELAY_SUMMARY_QUEUE_SIZE> _summaries;
+
+    char _tcpBuffer[RELAY_TCP_BUFFER_SIZE];
+
+    void close();
+
+    void poll ( int timeout );
+
+    void acceptAll();
+
+    void readTcp ( int fd );
+
+    void readUdp();
+
+    void readInboxes();
+
+    void disconnect ( int fd );
+
+    // Queue a command for the given shard, commands are pushed by flush
+    void post ( uint32_t shard, const RelayCommand& command );
+
+    // Handle the commands to this shard, and push the commands to the other shards
+    void flush();
+
+    void handle ( const RelayCommand& command );
+
+    // Allocate the next unused match id owned by this shard
+    uint32_t nextMatchId();
+
+    void eraseMatch ( uint32_t matchId );
+
+    // Get the socket of an owned connection, -1 if it was closed
+    int getFd ( uint64_t conn ) const;
+
+    void send ( int fd, const char *bytes, size_t len );
+
+    friend class RelayServer;
+};
+
+
+// Native Linux implementation of the tunnel match making server in scripts/server.py, see the tunnel protocol in
+// lib/SmartSocket.cpp. Hosts register their hosting port over TCP, clients connect over TCP with the address of the
+// host, then both are sent MatchInfo. Each side then sends UdpData to the UDP port, and the other side is sent
+// TunInfo with that UDP address, ONCE. The server only exchanges addresses, the tunnel traffic is peer to peer.
+class RelayServer
+{
+public:
+
+    // Print each protocol event
+    bool verbose = false;
+
+    ~RelayServer();
+
+    // Listen on the given port for both TCP and UDP with the given number of shards, returns false with an error
+    // message on failure.
+    bool listen ( uint16_t port, uint32_t numShards, std::string& error );
+
+    // Serve the stats on a Unix domain socket, call this after listen. Returns false with an error message on failure.
+    bool listenStats ( const std::string& path, std::string& error );
+
+    bool hasStats() const { return ( bool ) _stats; }
+
+    // Start / stop the shard threads, and the stats endpoint thread
+    void start();
+    void stop();
+
+    // If a shard stopped because it failed to poll
+    bool failed() const { return _failed.load(); }
+
+    uint32_t numShards() const { return _shards.size(); }
+
+    const RelayShard& getShard ( uint32_t shard ) const { return *_shards[shard]; }
+
+    size_t numConnections() const;
+
+    size_t numHosts() const;
+
+    size_t numMatches() const;
+
+    // Typed address key, ie 'T' or 'U', IPv4 address, and port, packed into 64 bits. Always non-zero.
+    static uint64_t getHostKey ( char type, uint32_t ip, uint16_t port );
+
+    // Parse a TypedConnectionAddress, returns 0 if invalid
+    static uint64_t parseHostKey ( const char *bytes, size_t len );
+
+    // Owner shards of a host key, match id, or connection id
+    uint32_t getKeyShard ( uint64_t key ) const;
+    uint32_t getMatchShard ( uint32_t matchId ) const { return matchId % _shards.size(); }
+    static uint32_t getConnShard ( uint64_t conn ) { return uint32_t ( conn >> 48 ); }
+
+private:
+
+    std::vector<std::unique_ptr<RelayShard>> _shards;
+
+    std::unique_ptr<RelayStats> _stats;
+
+    std::atomic<bool> _stopping { false }, _failed { false };
+
+    friend class RelayShard;
+    friend class RelayStats;
+};
@@ -0,0 +1,323 @@
+#include "RelayStats.hpp"
+#include "RelayServer.hpp"
+#include "StringUtils.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+
+using namespace std;
+
+
+uint64_t getRelayTime()
+{
+    timespec ts;
+    clock_gettime ( CLOCK_REALTIME, &ts );
+    return uint64_t ( ts.tv_sec ) * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static string formatPeer ( const MatchSummary::Peer& peer )
+{
+    if ( ! peer.packets )
+        return "none";
+
+    char buffer[INET_ADDRSTRLEN];
+    inet_ntop ( AF_INET, &peer.ip, buffer, sizeof ( buffer ) );
+
+    return format ( "%s:%u (%u packets; %u bytes; jitter %u us)",
+                    buffer, peer.port, peer.packets, peer.bytes, peer.jitter );
+}
+
+static string formatQuantiles ( const char *name, const QuantileSnapshot& snapshot )
+{
+    return format ( "%s (us): count=%llu; p50=%llu; p90=%llu; p99=%llu; p99.9=%llu; max=%llu", name,
+                    snapshot.getCount(), snapshot.getQuantile ( 0.5 ), snapshot.getQuantile ( 0.9 ),
+                    snapshot.getQuantile ( 0.99 ), snapshot.getQuantile ( 0.999 ), snapshot.getQuantile ( 1.0 ) );
+}
+
+
+string MatchSummary::str() const
+{
+    return format ( "matchId=%u; shard=%u; %s; duration=%.1f ms; latency=%u us; client=%s; host=%s",
+                    matchId, shard, ( completed ? "completed" : "aborted" ), ( ended - created ) / 1000.0, latency,
+                    formatPeer ( peers[1] ), formatPeer ( peers[0] ) );
+}
+
+
+RelayStats::RelayStats ( RelayServer& server ) : _server ( server ), _startTime ( getRelayTime() ) {}
+
+RelayStats::~RelayStats()
+{
+    join();
+    close();
+}
+
+void RelayStats::close()
+{
+    if ( _fd >= 0 )
+        ::close ( _fd );
+
+    if ( ! _path.empty() )
+        unlink ( _path.c_str() );
+
+    _fd = -1;
+    _path.clear();
+}
+
+bool RelayStats::listen ( const string& path, string& error )
+{
+    close();
+
+    sockaddr_un addr;
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sun_family = AF_UNIX;
+
+    if ( path.empty() || path.size() >= sizeof ( addr.sun_path ) )
+    {
+        error = format ( "Invalid stats socket path: %s", path );
+        return false;
+    }
+
+    strcpy ( addr.sun_path, path.c_str() );
+
+    // Remove the socket left by a previous run, but nothing else
+    struct stat st;
+    if ( lstat ( path.c_str(), &st ) == 0 && S_ISSOCK ( st.st_mode ) )
+        unlink ( path.c_str() );
+
+    _fd = socket ( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+
+    if ( _fd < 0 || bind ( _fd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0 )
+    {
+        error = format ( "Failed to listen on %s: %s", path, strerror ( errno ) );
+        close();
+        return false;
+    }
+
+    _path = path;
+
+    if ( ::listen ( _fd, SOMAXCONN ) != 0 )
+    {
+        error = format ( "Failed to listen on %s: %s", path, strerror ( errno ) );
+        close();
+        return false;
+    }
+
+    sample();
+    return true;
+}
+
+void RelayStats::run()
+{
+    while ( ! _server._stopping.load() )
+    {
+        pollfd pfd = { _fd, POLLIN, 0 };
+
+        const int count = ::poll ( &pfd, 1, RELAY_STATS_POLL_TIMEOUT );
+
+        receive();
+
+        if ( getRelayTime() >= _samples.back().time + RELAY_STATS_INTERVAL * 1000ull )
+            sample();
+
+        if ( count > 0 && ( pfd.revents & POLLIN ) )
+            serve();
+    }
+}
+
+void RelayStats::sample()
+{
+    Sample sample;
+    sample.time = getRelayTime();
+
+    for ( const unique_ptr<RelayShard>& shard : _server._shards )
+    {
+        const RelayMetrics& metrics = shard->getMetrics();
+
+        sample.counters.push_back ( metrics.load() );
+
+        sample.gauges.emplace_back();
+        sample.gauges.back().connections = shard->numConnections();
+        sample.gauges.back().hosts = shard->numHosts();
+        sample.gauges.back().matches = shard->numMatches();
+        sample.gauges.back().queued = metrics.queued.load ( std::memory_order_relaxed );
+
+        sample.forwardLatencies.emplace_back();
+        sample.forwardLatencies.back().add ( metrics.forwardLatency );
+
+        sample.forwardLatency.add ( sample.forwardLatencies.back() );
+        sample.matchLatency.add ( metrics.matchLatency );
+        sample.jitter.add ( metrics.jitter );
+    }
+
+    _samples.push_back ( sample );
+
+    while ( _samples.size() > RELAY_STATS_WINDOW + 1 )
+        _samples.pop_front();
+
+    // Forget the slowest matches that ended before the window
+    const uint64_t start = _samples.front().time;
+
+    _slowestMatches.erase ( remove_if ( _slowestMatches.begin(), _slowestMatches.end(),
+                                        [start] ( const MatchSummary& match ) { return match.ended < start; } ),
+                            _slowestMatches.end() );
+}
+
+void RelayStats::receive()
+{
+    MatchSummary summary;
+
+    for ( const unique_ptr<RelayShard>& shard : _server._shards )
+    {
+        while ( shard->popSummary ( summary ) )
+        {
+            _recentMatches.push_back ( summary );
+
+            if ( _recentMatches.size() > RELAY_RECENT_MATCHES )
+                _recentMatches.pop_front();
+
+            if ( _slowestMatches.size() < RELAY_SLOWEST_MATCHES )
+            {
+                _slowestMatches.push_back ( summary );
+                continue;
+            }
+
+            const auto fastest = min_element ( _slowestMatches.begin(), _slowestMatches.end(),
+            [] ( const MatchSummary& a, const MatchSummary& b ) { return a.latency < b.latency; } );
+
+            if ( summary.latency > fastest->latency )
+                *fastest = summary;
+        }
+    }
+}
+
+void RelayStats::serve()
+{
+    const int fd = accept4 ( _fd, 0, 0, SOCK_CLOEXEC );
+
+    if ( fd < 0 )
+        return;
+
+    // Don't let a reader that never reads block the stats
+    timeval timeout;
+    timeout.tv_sec = RELAY_STATS_SEND_TIMEOUT / 1000;
+    timeout.tv_usec = ( RELAY_STATS_SEND_TIMEOUT % 1000 ) * 1000;
+    setsockopt ( fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof ( timeout ) );
+
+    const string report = getReport();
+
+    for ( size_t sent = 0; sent < report.size(); )
+    {
+        const ssize_t len = ::send ( fd, &report[sent], report.size() - sent, MSG_NOSIGNAL );
+
+        if ( len <= 0 )
+            break;
+
+        sent += len;
+    }
+
+    ::close ( fd );
+}
+
+string RelayStats::getReport() const
+{
+    const Sample& first = _samples.front();
+    const Sample& last = _samples.back();
+
+    // Rates and quantiles are over the window, ie the difference between the first and last samples
+    const double seconds = ( last.time - first.time ) / 1000000.0;
+    const double scale = ( seconds > 0 ? 1 / seconds : 0 );
+
+    RelayMetrics::Counters totals = {}, deltas = {};
+
+    // Gauges are from the last sample too, so they are consistent with the counters
+    Gauges gauges;
+
+    for ( size_t i = 0; i < last.counters.size(); ++i )
+    {
+        for ( size_t j = 0; j < RelayMetrics::NumCounters; ++j )
+        {
+            totals[j] += last.counters[i][j];
+            deltas[j] += last.counters[i][j] - first.counters[i][j];
+        }
+
+        gauges.connections += last.gauges[i].connections;
+        gauges.hosts += last.gauges[i].hosts;
+        gauges.matches += last.gauges[i].matches;
+    }
+
+    QuantileSnapshot matchLatency = last.matchLatency, forwardLatency = last.forwardLatency, jitter = last.jitter;
+    matchLatency.subtract ( first.matchLatency );
+    forwardLatency.subtract ( first.forwardLatency );
+    jitter.subtract ( first.jitter );
+
+    string report = format ( "Relay: uptime=%.0f s; shards=%u; connections=%u; hosts=%u; matches=%u; window=%.1f s\n",
+                             ( last.time - _startTime ) / 1000000.0, _server.numShards(),
+                             gauges.connections, gauges.hosts, gauges.matches, seconds );
+
+    report += format ( "Totals: tcp=%llu; udp=%llu (%llu bytes; %llu invalid); matches=%llu completed, %llu aborted; "
+                       "queue full=%llu; summaries dropped=%llu\n",
+                       totals[RelayMetrics::TcpMessages], totals[RelayMetrics::UdpPackets],
+                       totals[RelayMetrics::UdpBytes], totals[RelayMetrics::UdpInvalid],
+                       totals[RelayMetrics::MatchesCompleted], totals[RelayMetrics::MatchesAborted],
+                       totals[RelayMetrics::QueueFull], totals[RelayMetrics::SummariesDropped] );
+
+    report += format ( "Rates: tcp=%.0f/s; udp=%.0f/s (%.0f B/s); matches=%.0f/s; commands=%.0f/s\n",
+                       deltas[RelayMetrics::TcpMessages] * scale, deltas[RelayMetrics::UdpPackets] * scale,
+                       deltas[RelayMetrics::UdpBytes] * scale,
+                       ( deltas[RelayMetrics::MatchesCompleted] + deltas[RelayMetrics::MatchesAborted] ) * scale,
+                       deltas[RelayMetrics::CommandsOut] * scale );
+
+    report += formatQuantiles ( "Match latency", matchLatency ) + "\n";
+    report += formatQuantiles ( "Forward latency", forwardLatency ) + "\n";
+    // Only matches with at least 3 UdpData from the same side have a jitter, usually there are none
+    report += formatQuantiles ( "Jitter", jitter ) + "\n";
+
+    // An overloaded shard is busy most of the time, has commands queued, and a high forward latency
+    for ( uint32_t i = 0; i < last.counters.size(); ++i )
+    {
+        const RelayMetrics::Counters& a = first.counters[i];
+        const RelayMetrics::Counters& b = last.counters[i];
+        const Gauges& shard = last.gauges[i];
+
+        QuantileSnapshot shardLatency = last.forwardLatencies[i];
+        shardLatency.subtract ( first.forwardLatencies[i] );
+
+        report += format ( "Shard %u: busy=%.1f%%; connections=%u; hosts=%u; matches=%u; tcp=%.0f/s; udp=%.0f/s; "
+                           "commands in=%.0f/s, out=%.0f/s; queued=%llu; queue full=%llu; forward p99=%llu us\n",
+                           i, ( b[RelayMetrics::BusyMicros] - a[RelayMetrics::BusyMicros] ) * scale / 10000,
+                           shard.connections, shard.hosts, shard.matches,
+                           ( b[RelayMetrics::TcpMessages] - a[RelayMetrics::TcpMessages] ) * scale,
+                           ( b[RelayMetrics::UdpPackets] - a[RelayMetrics::UdpPackets] ) * scale,
+                           ( b[RelayMetrics::CommandsIn] - a[RelayMetrics::CommandsIn] ) * scale,
+                           ( b[RelayMetrics::CommandsOut] - a[RelayMetrics::CommandsOut] ) * scale,
+                           shard.queued,
+                           b[RelayMetrics::QueueFull] - a[RelayMetrics::QueueFull],
+                           shardLatency.getQuantile ( 0.99 ) );
+    }
+
+    report += "Recent matches:\n";
+
+    for ( auto it = _recentMatches.rbegin(); it != _recentMatches.rend(); ++it )
+        report += "  " + it->str() + "\n";
+
+    vector<MatchSummary> slowest = _slowestMatches;
+    sort ( slowest.begin(), slowest.end(),
+           [] ( const MatchSummary& a, const MatchSummary& b ) { return a.latency > b.latency; } );
+
+    report += "Slowest matches:\n";
+
+    for ( const MatchSummary& match : slowest )
+        report += "  " + match.str() + "\n";
+
+    return report;
+}
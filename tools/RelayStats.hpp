@@ -0,0 +1,203 @@
+#pragma once
+
+#include "QuantileSketch.hpp"
+#include "Thread.hpp"
+
+#include <cstdint>
+#include <atomic>
+#include <array>
+#include <string>
+#include <vector>
+#include <deque>
+
+
+// Number of milliseconds between samples of the counters
+#define RELAY_STATS_INTERVAL ( 1000 )
+
+// Number of samples the rates and quantiles are reported over, the totals are since the start
+#define RELAY_STATS_WINDOW ( 10 )
+
+// Number of milliseconds the stats endpoint waits for connections, before checking if it should stop
+#define RELAY_STATS_POLL_TIMEOUT ( 100 )
+
+// Number of milliseconds to send the report, before giving up on a reader
+#define RELAY_STATS_SEND_TIMEOUT ( 1000 )
+
+// Capacity of the queue of ended matches from each shard to the stats endpoint
+#define RELAY_SUMMARY_QUEUE_SIZE ( 4096 )
+
+// Number of most recent, and slowest, ended matches that are reported
+#define RELAY_RECENT_MATCHES ( 16 )
+#define RELAY_SLOWEST_MATCHES ( 16 )
+
+
+// Microseconds since the epoch, the same clock as the kernel receive timestamps
+uint64_t getRelayTime();
+
+
+// Counters of a shard. Only the shard thread writes them, so they are incremented without an atomic
+// read-modify-write, and any thread can read them at any time.
+struct RelayMetrics
+{
+    enum Counter : uint8_t
+    {
+        Polls,
+        BusyMicros,
+        TcpMessages,
+        UdpPackets,
+        UdpBytes,
+        UdpInvalid,
+        CommandsIn,
+        CommandsOut,
+        QueueFull,
+        MatchesCompleted,
+        MatchesAborted,
+        SummariesDropped,
+        NumCounters,
+    };
+
+    typedef std::array<uint64_t, NumCounters> Counters;
+
+    std::atomic<uint64_t> counters[NumCounters];
+
+    // Commands waiting for space in the queues to other shards
+    std::atomic<uint64_t> queued { 0 };
+
+    // From receiving a client's address to sending MatchInfo, in microseconds
+    QuantileSketch matchLatency;
+
+    // From the kernel receiving UdpData to sending TunInfo, ie the latency added by the relay, in microseconds
+    QuantileSketch forwardLatency;
+
+    // Interarrival jitter of the UdpData of each side of a match, in microseconds. This needs at least 3 UdpData from
+    // the same side, but a match usually ends as soon as each side sent one, so this is mostly empty.
+    QuantileSketch jitter;
+
+    RelayMetrics()
+    {
+        for ( std::atomic<uint64_t>& counter : counters )
+            counter.store ( 0, std::memory_order_relaxed );
+    }
+
+    void add ( Counter counter, uint64_t value = 1 )
+    {
+        counters[counter].store ( counters[counter].load ( std::memory_order_relaxed ) + value,
+                                  std::memory_order_relaxed );
+    }
+
+    Counters load() const
+    {
+        Counters values;
+
+        for ( size_t i = 0; i < NumCounters; ++i )
+            values[i] = counters[i].load ( std::memory_order_relaxed );
+
+        return values;
+    }
+};
+
+
+// Accounting of a match, sent to the stats endpoint by the owner shard when the match ends
+struct MatchSummary
+{
+    uint32_t matchId = 0;
+
+    uint32_t shard = 0;
+
+    // If both sides were sent TunInfo, otherwise a connection was closed first
+    bool completed = false;
+
+    // Microseconds
+    uint64_t created = 0, ended = 0;
+
+    // Largest delay from the kernel receiving UdpData to the owner shard handling it, in microseconds
+    uint32_t latency = 0;
+
+    // Indexed by the isClient flag of the UdpData, ie 1 is the client and 0 is the host
+    struct Peer
+    {
+        uint32_t packets = 0, bytes = 0;
+
+        // UDP address in network byte order
+        uint32_t ip = 0;
+        uint16_t port = 0;
+
+        // Microseconds, only measured from the third packet, so usually 0 since a match ends after the first
+        uint32_t jitter = 0;
+    };
+
+    Peer peers[2];
+
+    std::string str() const;
+};
+
+
+class RelayServer;
+
+
+// Stats endpoint of the relay server. A thread serves a plain text report to each connection on a local socket,
+// eg "socat - UNIX-CONNECT:<path>". It only reads the lock-free counters of the shards, and receives the ended
+// matches over one lock-free queue per shard, so it never slows the shards down.
+class RelayStats : public Thread
+{
+public:
+
+    RelayStats ( RelayServer& server );
+
+    ~RelayStats();
+
+    // Listen on a Unix domain socket, returns false with an error message on failure
+    bool listen ( const std::string& path, std::string& error );
+
+    void run() override;
+
+    std::string getReport() const;
+
+private:
+
+    // Connections, hosts, matches, and commands queued on a shard when sampled
+    struct Gauges
+    {
+        uint32_t connections = 0, hosts = 0, matches = 0;
+
+        uint64_t queued = 0;
+    };
+
+    struct Sample
+    {
+        uint64_t time = 0;
+
+        // Per shard
+        std::vector<RelayMetrics::Counters> counters;
+        std::vector<Gauges> gauges;
+        std::vector<QuantileSnapshot> forwardLatencies;
+
+        // All shards
+        QuantileSnapshot matchLatency, forwardLatency, jitter;
+    };
+
+    RelayServer& _server;
+
+    std::string _path;
+
+    int _fd = -1;
+
+    uint64_t _startTime = 0;
+
+    // The last RELAY_STATS_WINDOW + 1 samples
+    std::deque<Sample> _samples;
+
+    std::deque<MatchSummary> _recentMatches;
+
+    // Slowest matches that ended during the last RELAY_STATS_WINDOW samples
+    std::vector<MatchSummary> _slowestMatches;
+
+    void close();
+
+    void sample();
+
+    // Receive the ended matches from the shards
+    void receive();
+
+    void serve();
+};
@@ -0,0 +1,115 @@
+#include "ReplayFile.hpp"
+#include "Logger.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+
+using namespace std;
+
+
+// Linux native converter from the text replays generated by scripts/sync2replay, to binary replays.
+// The converted replay is mapped back and checked, then it can be passed to the DLL like a text replay.
+
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsed ( const Clock::time_point& start )
+{
+    return chrono::duration<double, milli> ( Clock::now() - start ).count();
+}
+
+// Map the converted replay and check that it has the same columns
+static bool check ( const string& file, const ReplayFile::Columns& columns )
+{
+    const int fd = open ( file.c_str(), O_RDONLY );
+
+    if ( fd < 0 )
+        return false;
+
+    struct stat st;
+    fstat ( fd, &st );
+
+    void *data = mmap ( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close ( fd );
+
+    if ( data == MAP_FAILED )
+        return false;
+
+    ReplayFile::Reader reader;
+
+    bool good = reader.open ( ( const char * ) data, st.st_size )
+                && reader.getNumIndices() == columns.indices.size()
+                && reader.getCount ( ReplayFile::BlockType::InputsP1 ) == columns.inputsP1.size()
+                && reader.getCount ( ReplayFile::BlockType::RealInputs ) == columns.realInputs.size()
+                && reader.getCount ( ReplayFile::BlockType::Rollbacks ) == columns.rollbacks.size()
+                && reader.getCount ( ReplayFile::BlockType::Reinputs ) == columns.reinputs.size()
+                && reader.getCount ( ReplayFile::BlockType::RngStates ) == columns.rngStates.size()
+                && reader.getCount ( ReplayFile::BlockType::Players ) == columns.players.size();
+
+    const uint16_t *p1 = reader.getColumn<uint16_t> ( ReplayFile::BlockType::InputsP1 );
+    const uint16_t *p2 = reader.getColumn<uint16_t> ( ReplayFile::BlockType::InputsP2 );
+
+    for ( size_t i = 0; good && i < columns.inputsP1.size(); ++i )
+        good = ( p1[i] == columns.inputsP1[i] && p2[i] == columns.inputsP2[i] );
+
+    munmap ( data, st.st_size );
+    return good;
+}
+
+int main ( int argc, char *argv[] )
+{
+    if ( argc != 3 )
+    {
+        PRINT ( "Usage: %s replay.txt replay.bin", argv[0] );
+        return -1;
+    }
+
+    const string input = argv[1], output = argv[2];
+
+    ReplayFile::Columns columns;
+    string error;
+
+    Clock::time_point start = Clock::now();
+
+    if ( ! ReplayFile::readSyncLogReplay ( input, columns, error ) )
+    {
+        PRINT ( "Failed to read '%s': %s", input, error );
+        return -1;
+    }
+
+    const double readTime = elapsed ( start );
+
+    if ( ! ReplayFile::write ( output, columns ) )
+    {
+        PRINT ( "Failed to write '%s'", output );
+        return -1;
+    }
+
+    start = Clock::now();
+
+    if ( ! check ( output, columns ) )
+    {
+        PRINT ( "Converted replay '%s' doesn't match!", output );
+        return -1;
+    }
+
+    const double checkTime = elapsed ( start );
+
+    struct stat inputStat, outputStat;
+    stat ( input.c_str(), &inputStat );
+    stat ( output.c_str(), &outputStat );
+
+    PRINT ( "indices=%u; frames=%u; rollbacks=%u; reinputs=%u; rngStates=%u",
+            columns.indices.size(), columns.inputsP1.size(), columns.rollbacks.size(), columns.reinputs.size(),
+            columns.rngStates.size() );
+
+    PRINT ( "text=%uKB; binary=%uKB; read=%.1fms; mapAndCheck=%.1fms",
+            inputStat.st_size / 1024, outputStat.st_size / 1024, readTime, checkTime );
+
+    return 0;
+}
@@ -0,0 +1,583 @@
+#include "ReplayFile.hpp"
+#include "ReplayRecorder.hpp"
+#include "Thread.hpp"
+#include "Logger.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+
+using namespace std;
+using namespace ReplayFile;
+
+
+// Linux native validator for a corpus of replays, without the game.
+//
+// Each file is a text replay generated by scripts/sync2replay, a binary replay from tools/ReplayConverter.cpp,
+// or a session recording (replay.rec). Files are validated in parallel, one worker thread per core. Each file
+// is checked for input stream consistency, valid rollback targets and reinputs, and RngState ordering, and all
+// the anomalies are reported in the order the files were given.
+
+
+// Max number of anomalies reported per file, the rest are only counted
+#define MAX_REPORTED_ANOMALIES ( 10 )
+
+
+struct Options
+{
+    vector<string> files;
+
+    // Number of worker threads, 0 for one per core
+    uint32_t jobs = 0;
+
+    // Only report the files with anomalies
+    bool quiet = false;
+};
+
+
+// Result of validating a single file
+struct Result
+{
+    string type;
+
+    // Error that prevented reading the file, empty if it was read
+    string error;
+
+    vector<string> anomalies;
+
+    size_t numAnomalies = 0, numFrames = 0, numRollbacks = 0;
+
+    template<typename ... V>
+    void anomaly ( const char *fmt, V ... args )
+    {
+        if ( ++numAnomalies <= MAX_REPORTED_ANOMALIES )
+            anomalies.push_back ( format ( fmt, args ... ) );
+    }
+};
+
+
+// Pointers to the columns of a replay, either in a mapped binary replay or in converted text replay columns
+struct ReplayView
+{
+    const IndexRecord *indices = 0;
+    const InputsRecord *realInputs = 0;
+    const RollbackRecord *rollbacks = 0;
+    const InputsRecord *reinputs = 0;
+    const RngStateRecord *rngStates = 0;
+    const PlayerRecord *players = 0;
+
+    uint32_t numIndices = 0, numInputs = 0, numRealInputs = 0, numRollbacks = 0;
+    uint32_t numReinputs = 0, numRngStates = 0, numPlayers = 0;
+};
+
+
+static bool checkRange ( uint32_t start, uint32_t count, uint32_t total )
+{
+    return ( start <= total && count <= total - start );
+}
+
+static void validateReplay ( const ReplayView& view, Result& result )
+{
+    uint32_t inputsEnd = 0, realInputsEnd = 0, rollbacksEnd = 0, reinputsEnd = 0, playersEnd = 0;
+
+    uint32_t lastRngState = None;
+
+    result.numFrames = view.numInputs;
+    result.numRollbacks = view.numRollbacks;
+
+    for ( uint32_t index = 0; index < view.numIndices; ++index )
+    {
+        const IndexRecord& record = view.indices[index];
+
+        // Input stream consistency, each index has its own contiguous range of each column
+        if ( record.inputsStart != inputsEnd || ! checkRange ( record.inputsStart, record.numInputs, view.numInputs )
+                || record.realInputsStart != realInputsEnd
+                || ! checkRange ( record.realInputsStart, record.numRealInputs, view.numRealInputs )
+                || record.rollbacksStart != rollbacksEnd
+                || ! checkRange ( record.rollbacksStart, record.numRollbacks, view.numRollbacks )
+                || record.playersStart != playersEnd
+                || ! checkRange ( record.playersStart, record.numPlayers, view.numPlayers ) )
+        {
+            result.anomaly ( "[%u]: column ranges are not contiguous", index );
+            return;
+        }
+
+        inputsEnd += record.numInputs;
+        realInputsEnd += record.numRealInputs;
+        rollbacksEnd += record.numRollbacks;
+        playersEnd += record.numPlayers;
+
+        if ( record.state == None )
+        {
+            if ( record.numInputs || record.numRealInputs || record.numRollbacks || record.rngState != None )
+                result.anomaly ( "[%u]: index without a state has records", index );
+
+            continue;
+        }
+
+        uint32_t lastFrame = None;
+
+        for ( uint32_t i = 0; i < record.numRealInputs; ++i )
+        {
+            const IndexedFrame indexedFrame = view.realInputs[record.realInputsStart + i].indexedFrame;
+
+            if ( indexedFrame.parts.index != index )
+                result.anomaly ( "[%u]: real inputs for [%s]", index, indexedFrame );
+            else if ( lastFrame != None && indexedFrame.parts.frame <= lastFrame )
+                result.anomaly ( "[%s]: real inputs out of order", indexedFrame );
+
+            lastFrame = indexedFrame.parts.frame;
+        }
+
+        // Rollback targets must be before the rollback, which happens before the inputs of that frame are known
+        IndexedFrame lastRollback = {{ 0, 0 }};
+
+        for ( uint32_t i = 0; i < record.numRollbacks; ++i )
+        {
+            const RollbackRecord& rollback = view.rollbacks[record.rollbacksStart + i];
+
+            if ( rollback.indexedFrame.parts.index != index )
+                result.anomaly ( "[%u]: rollback from [%s]", index, rollback.indexedFrame );
+            else if ( rollback.indexedFrame.parts.frame > record.numInputs )
+                result.anomaly ( "[%s]: rollback after the last inputs [%u:%u]",
+                                 rollback.indexedFrame, index, record.numInputs );
+
+            if ( rollback.target.value > rollback.indexedFrame.value )
+                result.anomaly ( "[%s]: rollback to the future [%s]", rollback.indexedFrame, rollback.target );
+
+            if ( rollback.indexedFrame.value < lastRollback.value )
+                result.anomaly ( "[%s]: rollback out of order", rollback.indexedFrame );
+
+            lastRollback = rollback.indexedFrame;
+
+            if ( rollback.reinputsStart != reinputsEnd
+                    || ! checkRange ( rollback.reinputsStart, rollback.numReinputs, view.numReinputs ) )
+            {
+                result.anomaly ( "[%s]: reinputs range is not contiguous", rollback.indexedFrame );
+                return;
+            }
+
+            reinputsEnd += rollback.numReinputs;
+
+            // Reinputs are the frames re-run from the target up to the rollback
+            IndexedFrame lastReinputs = rollback.target;
+
+            for ( uint32_t j = 0; j < rollback.numReinputs; ++j )
+            {
+                const IndexedFrame indexedFrame = view.reinputs[rollback.reinputsStart + j].indexedFrame;
+
+                if ( indexedFrame.value < lastReinputs.value || indexedFrame.value > rollback.indexedFrame.value )
+                {
+                    result.anomaly ( "[%s]: reinputs [%s] outside of the rollback to [%s]",
+                                     rollback.indexedFrame, indexedFrame, rollback.target );
+                }
+
+                lastReinputs = indexedFrame;
+            }
+        }
+
+        // RngStates are for their own index, in index order
+        if ( record.rngState != None && record.rngState >= view.numRngStates )
+        {
+            result.anomaly ( "[%u]: invalid RngState position %u", index, record.rngState );
+        }
+        else if ( record.rngState != None )
+        {
+            const uint32_t rngStateIndex = view.rngStates[record.rngState].index;
+
+            if ( rngStateIndex != index )
+                result.anomaly ( "[%u]: RngState for index %u", index, rngStateIndex );
+
+            if ( lastRngState != None && record.rngState <= lastRngState )
+                result.anomaly ( "[%u]: RngState out of order", index );
+
+            lastRngState = record.rngState;
+        }
+
+        for ( uint32_t i = 0; i < record.numPlayers; ++i )
+        {
+            const PlayerRecord& player = view.players[record.playersStart + i];
+
+            if ( player.index != index || ( player.player != 1 && player.player != 2 ) )
+                result.anomaly ( "[%u]: invalid player %u for index %u", index, player.player, player.index );
+        }
+    }
+
+    if ( inputsEnd != view.numInputs || realInputsEnd != view.numRealInputs || rollbacksEnd != view.numRollbacks
+            || reinputsEnd != view.numReinputs || playersEnd != view.numPlayers )
+    {
+        result.anomaly ( "records not referenced by any index" );
+    }
+}
+
+static void validateTextReplay ( const string& file, Result& result )
+{
+    result.type = "text";
+
+    Columns columns;
+
+    if ( ! readSyncLogReplay ( file, columns, result.error ) )
+        return;
+
+    ReplayView view;
+    view.indices = columns.indices.data();
+    view.realInputs = columns.realInputs.data();
+    view.rollbacks = columns.rollbacks.data();
+    view.reinputs = columns.reinputs.data();
+    view.rngStates = columns.rngStates.data();
+    view.players = columns.players.data();
+    view.numIndices = columns.indices.size();
+    view.numInputs = columns.inputsP1.size();
+    view.numRealInputs = columns.realInputs.size();
+    view.numRollbacks = columns.rollbacks.size();
+    view.numReinputs = columns.reinputs.size();
+    view.numRngStates = columns.rngStates.size();
+    view.numPlayers = columns.players.size();
+
+    validateReplay ( view, result );
+}
+
+static void validateBinaryReplay ( const char *data, size_t size, Result& result )
+{
+    result.type = "binary";
+
+    Reader reader;
+
+    if ( ! reader.open ( data, size ) )
+    {
+        result.error = "Invalid binary replay";
+        return;
+    }
+
+    ReplayView view;
+    view.indices = reader.getColumn<IndexRecord> ( BlockType::Index );
+    view.realInputs = reader.getColumn<InputsRecord> ( BlockType::RealInputs );
+    view.rollbacks = reader.getColumn<RollbackRecord> ( BlockType::Rollbacks );
+    view.reinputs = reader.getColumn<InputsRecord> ( BlockType::Reinputs );
+    view.rngStates = reader.getColumn<RngStateRecord> ( BlockType::RngStates );
+    view.players = reader.getColumn<PlayerRecord> ( BlockType::Players );
+    view.numIndices = reader.getNumIndices();
+    view.numInputs = reader.getCount ( BlockType::InputsP1 );
+    view.numRealInputs = reader.getCount ( BlockType::RealInputs );
+    view.numRollbacks = reader.getCount ( BlockType::Rollbacks );
+    view.numReinputs = reader.getCount ( BlockType::Reinputs );
+    view.numRngStates = reader.getCount ( BlockType::RngStates );
+    view.numPlayers = reader.getCount ( BlockType::Players );
+
+    if ( reader.getCount ( BlockType::InputsP2 ) != view.numInputs )
+    {
+        result.anomaly ( "P1 and P2 have a different number of inputs" );
+        return;
+    }
+
+    validateReplay ( view, result );
+}
+
+static void validateRecording ( const string& file, Result& result )
+{
+    result.type = "recording";
+
+    RecordReader reader;
+
+    if ( ! reader.open ( file, result.error ) )
+        return;
+
+    RecordType type;
+    const char *payload;
+
+    IndexedFrame lastInputs = {{ 0, 0 }}, lastSyncHash = {{ 0, 0 }};
+
+    // Last rollback and reinputs, the reinputs that follow a rollback must be between its target and itself
+    RollbackFrameRecord rollback = {{{ 0, 0 }}, {{ 0, 0 }}};
+    IndexedFrame lastReinputs = {{ 0, 0 }};
+    bool inRollback = false;
+
+    uint32_t lastRngStateIndex = None;
+
+    bool hasInputs = false;
+
+    while ( reader.next ( type, payload ) )
+    {
+        switch ( type )
+        {
+            case RecordType::Inputs:
+            {
+                const IndexedFrame indexedFrame = RecordReader::get<InputsRecord> ( payload ).indexedFrame;
+
+                // Inputs are only recorded by normal frame steps, so they always move forward
+                if ( hasInputs && indexedFrame.value <= lastInputs.value )
+                    result.anomaly ( "[%s]: inputs after [%s]", indexedFrame, lastInputs );
+
+                lastInputs = indexedFrame;
+                hasInputs = true;
+                inRollback = false;
+                ++result.numFrames;
+                break;
+            }
+
+            case RecordType::Rollback:
+                rollback = RecordReader::get<RollbackFrameRecord> ( payload );
+
+                if ( rollback.target.value > rollback.indexedFrame.value )
+                    result.anomaly ( "[%s]: rollback to the future [%s]", rollback.indexedFrame, rollback.target );
+
+                lastReinputs = rollback.target;
+                inRollback = true;
+                ++result.numRollbacks;
+                break;
+
+            case RecordType::Reinputs:
+            {
+                const IndexedFrame indexedFrame = RecordReader::get<InputsRecord> ( payload ).indexedFrame;
+
+                if ( ! inRollback )
+                    result.anomaly ( "[%s]: reinputs without a rollback", indexedFrame );
+                else if ( indexedFrame.value < lastReinputs.value || indexedFrame.value > rollback.indexedFrame.value )
+                    result.anomaly ( "[%s]: reinputs [%s] outside of the rollback to [%s]",
+                                     rollback.indexedFrame, indexedFrame, rollback.target );
+
+                lastReinputs = indexedFrame;
+                break;
+            }
+
+            case RecordType::RngState:
+            {
+                const uint32_t index = RecordReader::get<RngStateRecord> ( payload ).index;
+
+                if ( lastRngStateIndex != None && index < lastRngStateIndex )
+                    result.anomaly ( "RngState for index %u after index %u", index, lastRngStateIndex );
+
+                lastRngStateIndex = index;
+                break;
+            }
+
+            case RecordType::SyncHash:
+            {
+                const IndexedFrame indexedFrame = RecordReader::get<SyncHashRecord> ( payload ).indexedFrame;
+
+                if ( indexedFrame.value < lastSyncHash.value )
+                    result.anomaly ( "[%s]: SyncHash after [%s]", indexedFrame, lastSyncHash );
+
+                lastSyncHash = indexedFrame;
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+}
+
+static void validate ( const string& file, Result& result )
+{
+    const int fd = open ( file.c_str(), O_RDONLY );
+
+    if ( fd < 0 )
+    {
+        result.error = "Cannot open file";
+        return;
+    }
+
+    struct stat st;
+    fstat ( fd, &st );
+
+    char magic[MagicSize] = { 0 };
+
+    if ( pread ( fd, magic, sizeof ( magic ), 0 ) != sizeof ( magic ) )
+    {
+        ::close ( fd );
+        validateTextReplay ( file, result );
+        return;
+    }
+
+    if ( isBinary ( magic, sizeof ( magic ) ) )
+    {
+        void *data = mmap ( 0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        ::close ( fd );
+
+        if ( data == MAP_FAILED )
+        {
+            result.error = "Cannot map file";
+            return;
+        }
+
+        validateBinaryReplay ( ( const char * ) data, st.st_size, result );
+
+        munmap ( data, st.st_size );
+        return;
+    }
+
+    ::close ( fd );
+
+    if ( isRecording ( magic, sizeof ( magic ) ) )
+        validateRecording ( file, result );
+    else
+        validateTextReplay ( file, result );
+}
+
+
+// Worker thread that validates the next file until there are none left
+class ValidatorThread : public Thread
+{
+public:
+
+    ValidatorThread ( const vector<string>& files, vector<Result>& results, atomic<size_t>& next )
+        : _files ( files ), _results ( results ), _next ( next ) {}
+
+    void run() override
+    {
+        for ( ;; )
+        {
+            const size_t i = _next++;
+
+            if ( i >= _files.size() )
+                return;
+
+            validate ( _files[i], _results[i] );
+        }
+    }
+
+private:
+
+    const vector<string>& _files;
+
+    vector<Result>& _results;
+
+    atomic<size_t>& _next;
+};
+
+
+// Add a file, or all the files under a directory, sorted by name
+static void addFiles ( const string& path, vector<string>& files )
+{
+    struct stat st;
+
+    if ( stat ( path.c_str(), &st ) != 0 || ! S_ISDIR ( st.st_mode ) )
+    {
+        files.push_back ( path );
+        return;
+    }
+
+    DIR *dir = opendir ( path.c_str() );
+
+    if ( ! dir )
+        return;
+
+    vector<string> names;
+
+    while ( dirent *entry = readdir ( dir ) )
+    {
+        if ( entry->d_name[0] != '.' )
+            names.push_back ( entry->d_name );
+    }
+
+    closedir ( dir );
+
+    sort ( names.begin(), names.end() );
+
+    for ( const string& name : names )
+        addFiles ( path + "/" + name, files );
+}
+
+
+typedef chrono::high_resolution_clock Clock;
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    bool usage = false;
+
+    for ( int i = 1; i < argc && ! usage; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-j" )
+            options.jobs = stoul ( argv[++i] );
+        else if ( arg == "-q" )
+            options.quiet = true;
+        else if ( ! arg.empty() && arg[0] != '-' )
+            addFiles ( arg, options.files );
+        else
+            usage = true;
+    }
+
+    if ( usage || options.files.empty() )
+    {
+        PRINT ( "Usage: %s [-j jobs] [-q] files or directories...", argv[0] );
+        return -1;
+    }
+
+    if ( ! options.jobs )
+        options.jobs = max<long> ( sysconf ( _SC_NPROCESSORS_ONLN ), 1 );
+
+    options.jobs = min<size_t> ( options.jobs, options.files.size() );
+
+    vector<Result> results ( options.files.size() );
+
+    atomic<size_t> next ( 0 );
+
+    const Clock::time_point start = Clock::now();
+
+    vector<shared_ptr<ValidatorThread>> threads;
+
+    for ( uint32_t i = 0; i < options.jobs; ++i )
+    {
+        threads.push_back ( make_shared<ValidatorThread> ( options.files, results, next ) );
+        threads.back()->start();
+    }
+
+    for ( const auto& thread : threads )
+        thread->join();
+
+    const double time = chrono::duration<double> ( Clock::now() - start ).count();
+
+    size_t numErrors = 0, numAnomalous = 0, numFrames = 0, numRollbacks = 0;
+
+    for ( size_t i = 0; i < results.size(); ++i )
+    {
+        const Result& result = results[i];
+
+        numFrames += result.numFrames;
+        numRollbacks += result.numRollbacks;
+
+        if ( ! result.error.empty() )
+        {
+            ++numErrors;
+            PRINT ( "%s: ERROR %s", options.files[i], result.error );
+            continue;
+        }
+
+        if ( result.numAnomalies )
+        {
+            ++numAnomalous;
+            PRINT ( "%s: %s; %u anomalies", options.files[i], result.type, result.numAnomalies );
+
+            for ( const string& anomaly : result.anomalies )
+                PRINT ( "    %s", anomaly );
+
+            if ( result.numAnomalies > result.anomalies.size() )
+                PRINT ( "    ..." );
+
+            continue;
+        }
+
+        if ( ! options.quiet )
+            PRINT ( "%s: %s; frames=%u; rollbacks=%u; OK", options.files[i], result.type,
+                    result.numFrames, result.numRollbacks );
+    }
+
+    PRINT ( "files=%u; errors=%u; anomalous=%u; frames=%u; rollbacks=%u; jobs=%u; time=%.2fs",
+            results.size(), numErrors, numAnomalous, numFrames, numRollbacks, options.jobs, time );
+
+    return ( numErrors || numAnomalous ? 1 : 0 );
+}
@@ -0,0 +1,848 @@
+#include "InputsContainer.hpp"
+#include "InputGenerator.hpp"
+#include "Compression.hpp"
+#include "Protocol.hpp"
+#include "Logger.hpp"
+
+#include <cereal/archives/binary.hpp>
+#include <cereal/types/array.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/types/string.hpp>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <array>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+
+// Linux native benchmark of the spectator relay tree, without the game.
+//
+// The host plays a synthetic session at 60 Hz, alternating between a menu and a game index. Spectators join at
+// random frames, and are placed in the tree like DllMain does: a node with the maximum number of spectators redirects
+// the new spectator to its spectator that relays the fewest spectators, like SpectatorManager::getRelayAddress.
+// Latencies are negligible over loopback, so only the number of relayed spectators matters here.
+//
+// Every node, ie the host and each spectator, sends inputs to its own spectators over loopback TCP connections with
+// the same schedule as SpectatorManager::frameStepSpectators: a round-robin broadcast of BothInputs, and
+// BothInputsBlock messages for spectators that are catching up. Messages are encoded like Protocol::encode, once per
+// position per frame on each node, and spectators keep the inputs they are sent like NetplayManager::setBothInputs.
+// Each node erases its old indices with its preserveStartIndex when entering a game. The nodes are stepped from the
+// root down every frame, so inputs can cross several levels in one frame, unlike over a real network.
+//
+// The real managers read the game's memory and use the Windows sockets, so their logic is mirrored here. The frames
+// run as fast as possible. The CPU time per frame of the host and of the relaying spectators includes the encoding
+// and the send calls. The spectator sockets are drained every frame, and the lag of each spectator behind the host
+// is sampled once per second. RngStates and retry menu indices are only sent once per index, so they aren't modelled.
+
+
+// Defaults for the constants in Constants.hpp, SpectatorManager.hpp, DllNetplayManager.cpp, and DllMain.cpp,
+// which depend on the Windows headers.
+#define DEFAULT_NUM_INPUTS ( 30 )
+#define DEFAULT_CATCH_UP_THRESHOLD ( 5 * 60 )
+#define DEFAULT_CATCH_UP_BLOCK_FRAMES ( 5 * 60 )
+#define DEFAULT_CATCH_UP_INTERVAL ( 6 )
+#define DEFAULT_PRESERVE_START_INDEX_BUFFER ( 5 )
+#define DEFAULT_MAX_SPECTATORS ( 15 )
+#define DEFAULT_MAX_ROOT_SPECTATORS ( 2 )
+
+// Default compression level of messages
+#define COMPRESSION_LEVEL ( 9 )
+
+// Size of the buffer used to drain the spectator sockets
+#define DRAIN_BUFFER_SIZE ( 64 * 1024 )
+
+
+struct Options
+{
+    // Numbers of spectators to run with
+    vector<uint32_t> counts = { 1, 10, 100, 1000 };
+
+    // Number of games, each game has a menu index and a game index
+    uint32_t games = 3;
+
+    // Number of frames of each game and menu index
+    uint32_t gameFrames = 5400;
+    uint32_t menuFrames = 600;
+
+    // Spectators join at random frames before this fraction of the session
+    double joinSpread = 0.5;
+
+    // Maximum number of spectators of the host, and of each spectator
+    uint32_t rootSpectators = DEFAULT_MAX_ROOT_SPECTATORS;
+    uint32_t maxSpectators = DEFAULT_MAX_SPECTATORS;
+};
+
+
+// Inputs encoded once per position per frame, and sent as is to every spectator at that position
+struct Encoded
+{
+    string buffer;
+
+    // Start of the inputs, and the inputs of both players
+    IndexedFrame start = {{ 0, 0 }};
+
+    array<vector<uint16_t>, 2> inputs;
+
+    // Spectator position after sending the inputs
+    IndexedFrame next = {{ 0, 0 }};
+};
+
+
+// Spectator of a node, from the side of the node
+struct Child
+{
+    uint32_t node = 0;
+
+    IndexedFrame pos = {{ 0, 0 }};
+};
+
+
+// The host or a spectator, each relays inputs to its own spectators
+struct Node
+{
+    // Parent and spectator sides of the loopback connection to the parent
+    int parentFd = -1, fd = -1;
+
+    // Bytes that didn't fit in the socket buffer, sent before anything else like TcpSocket does
+    string pending;
+
+    uint32_t parent = UINT_MAX, depth = 0;
+
+    // Number of spectators in the tree below this node
+    uint32_t relayed = 0;
+
+    bool joined = false;
+
+    uint32_t joinFrame = 0;
+
+    // Number of frames from joining until the spectator was within the catch up threshold, UINT_MAX if not yet
+    uint32_t catchUpFrames = UINT_MAX;
+
+    InputsContainer<uint16_t> inputs[2];
+
+    // Current index and frame, a spectator is at the last frame it received
+    uint32_t index = 0, frame = 0, startIndex = 0;
+
+    uint32_t preserveStartIndex = UINT_MAX, currentMinIndex = UINT_MAX;
+
+    // Spectators in broadcast order, and the position of the next broadcast
+    vector<Child> children;
+
+    size_t childPos = 0;
+
+    unordered_map<uint64_t, Encoded> encodedBothInputs, encodedBlocks;
+
+    uint32_t getEndFrame ( uint32_t i ) const
+    {
+        if ( i < startIndex )
+            return 0;
+
+        return min ( inputs[0].getEndFrame ( i - startIndex ), inputs[1].getEndFrame ( i - startIndex ) );
+    }
+};
+
+
+struct Result
+{
+    vector<double> hostTimes, relayTimes;
+
+    vector<uint32_t> lags, catchUps;
+
+    uint64_t bytes = 0, hostBytes = 0, messages = 0, frames = 0;
+
+    size_t peakAllocated = 0;
+
+    uint32_t peakIndices = 0, maxDepth = 0;
+};
+
+
+class Tree
+{
+public:
+
+    Tree ( const Options& options ) : _options ( options ) {}
+
+    ~Tree()
+    {
+        for ( Node& node : _nodes )
+        {
+            close ( node.parentFd );
+            close ( node.fd );
+        }
+    }
+
+    bool connect ( uint32_t count, mt19937& rng, string& error );
+
+    void run ( mt19937& rng, Result& result );
+
+private:
+
+    const Options& _options;
+
+    InputGenerator _generators[2];
+
+    // The host is the first node, followed by the spectators
+    vector<Node> _nodes;
+
+    // First absolute frame of each index, for the lag across indices
+    vector<uint64_t> _indexStart;
+
+    // Number of frames since the start, which schedules the broadcasts of every node like the game's world timer
+    uint64_t _frames = 0;
+
+    vector<char> _drainBuffer = vector<char> ( DRAIN_BUFFER_SIZE );
+
+    uint32_t numFrames ( uint32_t index ) const
+    {
+        return ( index % 2 ? _options.gameFrames : _options.menuFrames );
+    }
+
+    uint64_t absoluteFrame ( uint32_t index, uint32_t frame ) const
+    {
+        return _indexStart[index] + frame;
+    }
+
+    bool isCatchingUp ( const Node& node, const Child& child ) const;
+
+    string encode ( MsgType type, IndexedFrame indexedFrame, const array<vector<uint16_t>, 2>& inputs ) const;
+
+    const Encoded& getBothInputs ( Node& node, IndexedFrame pos );
+
+    const Encoded& getBothInputsBlock ( Node& node, IndexedFrame pos );
+
+    void send ( Node& node, const string& buffer, Result& result );
+
+    void received ( Node& node, const Encoded& encoded );
+
+    void sendInputs ( Node& node, Child& child, bool catchUp, Result& result );
+
+    void frameStepSpectators ( Node& node, Result& result );
+
+    void setIndex ( Node& node, uint32_t index );
+
+    void join ( uint32_t id );
+
+    void drain();
+};
+
+
+bool Tree::connect ( uint32_t count, mt19937& rng, string& error )
+{
+    const int listenFd = socket ( AF_INET, SOCK_STREAM, 0 );
+
+    sockaddr_in addr;
+    memset ( &addr, 0, sizeof ( addr ) );
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+    socklen_t addrLen = sizeof ( addr );
+
+    if ( listenFd < 0
+            || bind ( listenFd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0
+            || listen ( listenFd, SOMAXCONN ) != 0
+            || getsockname ( listenFd, ( sockaddr * ) &addr, &addrLen ) != 0 )
+    {
+        error = format ( "listen failed: %s", strerror ( errno ) );
+        close ( listenFd );
+        return false;
+    }
+
+    const uint32_t totalFrames = _options.games * ( _options.gameFrames + _options.menuFrames );
+    const uint32_t maxJoinFrame = max<uint32_t> ( 1, totalFrames * _options.joinSpread );
+
+    _nodes.resize ( count + 1 );
+    _nodes[0].joined = true;
+
+    // Each spectator is only connected to one parent, so its connection is made upfront
+    for ( uint32_t i = 1; i < _nodes.size(); ++i )
+    {
+        Node& node = _nodes[i];
+
+        node.fd = socket ( AF_INET, SOCK_STREAM, 0 );
+
+        if ( node.fd < 0 || ::connect ( node.fd, ( sockaddr * ) &addr, sizeof ( addr ) ) != 0 )
+        {
+            error = format ( "connect failed: %s", strerror ( errno ) );
+            close ( listenFd );
+            return false;
+        }
+
+        node.parentFd = accept ( listenFd, 0, 0 );
+
+        if ( node.parentFd < 0 )
+        {
+            error = format ( "accept failed: %s", strerror ( errno ) );
+            close ( listenFd );
+            return false;
+        }
+
+        const int one = 1;
+        setsockopt ( node.parentFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) );
+
+        fcntl ( node.parentFd, F_SETFL, fcntl ( node.parentFd, F_GETFL ) | O_NONBLOCK );
+        fcntl ( node.fd, F_SETFL, fcntl ( node.fd, F_GETFL ) | O_NONBLOCK );
+
+        node.joinFrame = rng() % maxJoinFrame;
+    }
+
+    close ( listenFd );
+    return true;
+}
+
+bool Tree::isCatchingUp ( const Node& node, const Child& child ) const
+{
+    if ( child.pos.parts.index + 1 < node.index )
+        return true;
+
+    if ( child.pos.parts.index + 1 == node.index )
+        return ( node.frame >= DEFAULT_CATCH_UP_THRESHOLD );
+
+    return ( child.pos.parts.index == node.index
+             && node.frame >= child.pos.parts.frame + DEFAULT_CATCH_UP_THRESHOLD );
+}
+
+string Tree::encode ( MsgType type, IndexedFrame indexedFrame, const array<vector<uint16_t>, 2>& inputs ) const
+{
+    ostringstream ss ( stringstream::binary );
+    cereal::BinaryOutputArchive archive ( ss );
+
+    // Sequence, then the message data
+    archive ( uint32_t ( 0 ), indexedFrame.value );
+
+    // BothInputs has fixed size arrays, and BothInputsBlock has vectors
+    if ( type == MsgType::BothInputs )
+        archive ( cereal::binary_data ( &inputs[0][0], inputs[0].size() * sizeof ( uint16_t ) ),
+                  cereal::binary_data ( &inputs[1][0], inputs[1].size() * sizeof ( uint16_t ) ) );
+    else
+        archive ( inputs );
+
+    string data = ss.str();
+
+    char hash[16];
+    getMD5 ( data, hash );
+    data.append ( hash, sizeof ( hash ) );
+
+    string buffer ( compressBound ( data.size() ), ( char ) 0 );
+    buffer.resize ( compress ( &data[0], data.size(), &buffer[0], buffer.size(), COMPRESSION_LEVEL ) );
+
+    ostringstream out ( stringstream::binary );
+    cereal::BinaryOutputArchive outArchive ( out );
+
+    outArchive ( type );
+
+    // Only use compressed message data if actually smaller after the overhead
+    if ( sizeof ( size_t ) + sizeof ( size_t ) + buffer.size() < data.size() )
+    {
+        outArchive ( uint8_t ( COMPRESSION_LEVEL ), data.size(), buffer );
+        return out.str();
+    }
+
+    outArchive ( uint8_t ( 0 ) );
+    return out.str() + data;
+}
+
+const Encoded& Tree::getBothInputs ( Node& node, IndexedFrame pos )
+{
+    const auto it = node.encodedBothInputs.find ( pos.value );
+
+    if ( it != node.encodedBothInputs.end() )
+        return it->second;
+
+    Encoded& encoded = node.encodedBothInputs[pos.value];
+
+    IndexedFrame orig = pos;
+
+    const uint32_t endFrame = node.getEndFrame ( orig.parts.index );
+
+    // Same as NetplayManager::getBothInputs, without rollback
+    if ( orig.parts.frame + 1 <= endFrame )
+    {
+        pos.parts.frame += DEFAULT_NUM_INPUTS;
+    }
+    else if ( orig.parts.index == node.index || endFrame == 0 )
+    {
+        if ( orig.parts.index < node.index )
+        {
+            pos.parts.frame = DEFAULT_NUM_INPUTS - 1;
+            ++pos.parts.index;
+        }
+
+        encoded.next = pos;
+        return encoded;
+    }
+    else
+    {
+        pos.parts.frame = DEFAULT_NUM_INPUTS - 1;
+        ++pos.parts.index;
+        orig.parts.frame = endFrame - 1;
+    }
+
+    encoded.start.parts.index = orig.parts.index;
+    encoded.start.parts.frame = orig.parts.frame + 1 - DEFAULT_NUM_INPUTS;
+
+    for ( uint8_t i = 0; i < 2; ++i )
+    {
+        encoded.inputs[i].resize ( DEFAULT_NUM_INPUTS );
+
+        node.inputs[i].get ( orig.parts.index - node.startIndex, encoded.start.parts.frame,
+                             &encoded.inputs[i][0], DEFAULT_NUM_INPUTS );
+    }
+
+    encoded.buffer = encode ( MsgType::BothInputs, orig, encoded.inputs );
+    encoded.next = pos;
+    return encoded;
+}
+
+const Encoded& Tree::getBothInputsBlock ( Node& node, IndexedFrame pos )
+{
+    const auto it = node.encodedBlocks.find ( pos.value );
+
+    if ( it != node.encodedBlocks.end() )
+        return it->second;
+
+    Encoded& encoded = node.encodedBlocks[pos.value];
+
+    // Same as NetplayManager::getBothInputsBlock, without rollback
+    const uint32_t commonEndFrame = node.getEndFrame ( pos.parts.index );
+    const uint32_t startFrame = pos.parts.frame + 1 - DEFAULT_NUM_INPUTS;
+    const uint32_t endFrame = min<uint32_t> ( commonEndFrame, startFrame + DEFAULT_CATCH_UP_BLOCK_FRAMES );
+
+    if ( endFrame <= startFrame )
+    {
+        if ( pos.parts.index < node.index )
+        {
+            pos.parts.frame = DEFAULT_NUM_INPUTS - 1;
+            ++pos.parts.index;
+        }
+
+        encoded.next = pos;
+        return encoded;
+    }
+
+    encoded.start.parts.index = pos.parts.index;
+    encoded.start.parts.frame = startFrame;
+
+    for ( uint8_t i = 0; i < 2; ++i )
+    {
+        encoded.inputs[i].resize ( endFrame - startFrame );
+
+        node.inputs[i].get ( pos.parts.index - node.startIndex, startFrame,
+                             &encoded.inputs[i][0], encoded.inputs[i].size() );
+    }
+
+    encoded.buffer = encode ( MsgType::BothInputsBlock, encoded.start, encoded.inputs );
+
+    pos.parts.frame = endFrame + DEFAULT_NUM_INPUTS - 1;
+
+    if ( pos.parts.index < node.index && endFrame == commonEndFrame )
+    {
+        pos.parts.frame = DEFAULT_NUM_INPUTS - 1;
+        ++pos.parts.index;
+    }
+
+    encoded.next = pos;
+    return encoded;
+}
+
+void Tree::send ( Node& node, const string& buffer, Result& result )
+{
+    result.bytes += buffer.size();
+    ++result.messages;
+
+    if ( node.parent == 0 )
+        result.hostBytes += buffer.size();
+
+    if ( ! node.pending.empty() )
+    {
+        node.pending += buffer;
+        return;
+    }
+
+    const ssize_t sent = ::send ( node.parentFd, &buffer[0], buffer.size(), MSG_NOSIGNAL );
+
+    if ( sent < ( ssize_t ) buffer.size() )
+        node.pending = buffer.substr ( max<ssize_t> ( sent, 0 ) );
+}
+
+void Tree::received ( Node& node, const Encoded& encoded )
+{
+    const uint32_t index = encoded.start.parts.index;
+
+    // Same as NetplayManager::setBothInputs
+    if ( index + 1 < node.index || index < node.startIndex )
+        return;
+
+    for ( uint8_t i = 0; i < 2; ++i )
+    {
+        node.inputs[i].set ( index - node.startIndex, encoded.start.parts.frame,
+                             &encoded.inputs[i][0], encoded.inputs[i].size() );
+    }
+
+    if ( index > node.index )
+        setIndex ( node, index );
+
+    if ( index == node.index )
+        node.frame = node.getEndFrame ( index ) - 1;
+}
+
+void Tree::sendInputs ( Node& node, Child& child, bool catchUp, Result& result )
+{
+    const Encoded& encoded = ( catchUp ? getBothInputsBlock ( node, child.pos ) : getBothInputs ( node, child.pos ) );
+
+    child.pos = encoded.next;
+
+    if ( encoded.buffer.empty() )
+        return;
+
+    send ( _nodes[child.node], encoded.buffer, result );
+    received ( _nodes[child.node], encoded );
+}
+
+void Tree::frameStepSpectators ( Node& node, Result& result )
+{
+    node.encodedBothInputs.clear();
+    node.encodedBlocks.clear();
+
+    // Flush the bytes that didn't fit in the socket buffers
+    for ( const Child& child : node.children )
+    {
+        Node& spectator = _nodes[child.node];
+
+        if ( spectator.pending.empty() )
+            continue;
+
+        const ssize_t sent = ::send ( spectator.parentFd, &spectator.pending[0], spectator.pending.size(),
+                                      MSG_NOSIGNAL );
+
+        if ( sent > 0 )
+            spectator.pending.erase ( 0, sent );
+    }
+
+    if ( node.children.empty() )
+    {
+        node.preserveStartIndex = node.currentMinIndex = UINT_MAX;
+        return;
+    }
+
+    if ( _frames % DEFAULT_CATCH_UP_INTERVAL == 0 )
+    {
+        for ( Child& child : node.children )
+        {
+            if ( isCatchingUp ( node, child ) )
+                sendInputs ( node, child, true, result );
+        }
+    }
+
+    const uint32_t multiplier = 1 + ( node.children.size() * 2 ) / ( DEFAULT_NUM_INPUTS + 1 );
+    const uint32_t interval = max<uint32_t> ( 1, ( multiplier * DEFAULT_NUM_INPUTS / 2 ) / node.children.size() );
+
+    if ( _frames % interval )
+        return;
+
+    for ( uint32_t i = 0; i < multiplier; ++i )
+    {
+        if ( node.childPos >= node.children.size() )
+        {
+            node.childPos = 0;
+            node.preserveStartIndex = node.currentMinIndex;
+            node.currentMinIndex = UINT_MAX;
+        }
+
+        Child& child = node.children[node.childPos];
+
+        sendInputs ( node, child, isCatchingUp ( node, child ), result );
+
+        ++node.childPos;
+
+        node.currentMinIndex = min ( node.currentMinIndex, child.pos.parts.index );
+    }
+}
+
+void Tree::setIndex ( Node& node, uint32_t index )
+{
+    node.index = index;
+    node.frame = 0;
+
+    // Entering a game erases the indices that no spectator needs anymore
+    if ( index % 2 == 0 )
+        return;
+
+    const uint32_t buffered = ( node.preserveStartIndex == UINT_MAX ? UINT_MAX
+                                : ( node.preserveStartIndex <= DEFAULT_PRESERVE_START_INDEX_BUFFER ? 0
+                                    : node.preserveStartIndex - DEFAULT_PRESERVE_START_INDEX_BUFFER ) );
+
+    const uint32_t newStartIndex = min ( buffered, index );
+
+    if ( newStartIndex > node.startIndex )
+    {
+        node.inputs[0].eraseIndexOlderThan ( newStartIndex - node.startIndex );
+        node.inputs[1].eraseIndexOlderThan ( newStartIndex - node.startIndex );
+        node.startIndex = newStartIndex;
+    }
+}
+
+void Tree::join ( uint32_t id )
+{
+    // Follow the redirects from the host, each full node redirects to its spectator that relays the fewest
+    uint32_t parent = 0;
+
+    while ( _nodes[parent].children.size() >= ( parent == 0 ? _options.rootSpectators : _options.maxSpectators ) )
+    {
+        const vector<Child>& children = _nodes[parent].children;
+
+        parent = min_element ( children.begin(), children.end(), [this] ( const Child& a, const Child& b )
+        {
+            return _nodes[a.node].relayed < _nodes[b.node].relayed;
+        } )->node;
+    }
+
+    Node& node = _nodes[id];
+    Node& parentNode = _nodes[parent];
+
+    node.joined = true;
+    node.parent = parent;
+    node.depth = parentNode.depth + 1;
+
+    // Spectators start from the current index of their parent, like getSpectateStartIndex
+    node.index = node.startIndex = parentNode.index;
+
+    Child child;
+    child.node = id;
+    child.pos.parts.frame = DEFAULT_NUM_INPUTS - 1;
+    child.pos.parts.index = parentNode.index;
+
+    // Add new spectators just after the current broadcast position, like SpectatorManager::pushSpectator
+    const size_t pos = min ( parentNode.childPos + 1, parentNode.children.size() );
+    parentNode.children.insert ( parentNode.children.begin() + pos, child );
+
+    parentNode.preserveStartIndex = min ( parentNode.preserveStartIndex, parentNode.index );
+
+    for ( uint32_t i = parent; i != UINT_MAX; i = _nodes[i].parent )
+        ++_nodes[i].relayed;
+}
+
+void Tree::drain()
+{
+    for ( uint32_t i = 1; i < _nodes.size(); ++i )
+    {
+        while ( recv ( _nodes[i].fd, &_drainBuffer[0], _drainBuffer.size(), 0 ) > 0 )
+            ;
+    }
+}
+
+
+typedef chrono::high_resolution_clock Clock;
+
+static double elapsed ( const Clock::time_point& start )
+{
+    return chrono::duration<double, micro> ( Clock::now() - start ).count();
+}
+
+void Tree::run ( mt19937& rng, Result& result )
+{
+    const uint32_t numIndices = 2 * _options.games;
+
+    Node& host = _nodes[0];
+
+    // Nodes from the root down, so spectators always join after their parent
+    vector<uint32_t> order = { 0 };
+
+    for ( _indexStart.push_back ( 0 ); host.index < numIndices; )
+    {
+        Clock::time_point start = Clock::now();
+
+        for ( uint8_t i = 0; i < 2; ++i )
+            host.inputs[i].set ( host.index - host.startIndex, host.frame, _generators[i].next ( rng ) );
+
+        frameStepSpectators ( host, result );
+
+        result.hostTimes.push_back ( elapsed ( start ) );
+
+        for ( size_t i = 1; i < order.size(); ++i )
+        {
+            Node& node = _nodes[order[i]];
+
+            if ( node.children.empty() )
+                continue;
+
+            start = Clock::now();
+
+            frameStepSpectators ( node, result );
+
+            result.relayTimes.push_back ( elapsed ( start ) );
+        }
+
+        // Spectators join after the frame, and are first sent inputs on the next frame
+        for ( uint32_t i = 1; i < _nodes.size(); ++i )
+        {
+            if ( _nodes[i].joined || _nodes[i].joinFrame != _frames )
+                continue;
+
+            join ( i );
+            order.push_back ( i );
+
+            result.maxDepth = max ( result.maxDepth, _nodes[i].depth );
+        }
+
+        stable_sort ( order.begin(), order.end(),
+                      [this] ( uint32_t a, uint32_t b ) { return _nodes[a].depth < _nodes[b].depth; } );
+
+        drain();
+
+        const uint64_t now = absoluteFrame ( host.index, host.frame );
+
+        for ( size_t i = 1; i < order.size(); ++i )
+        {
+            Node& node = _nodes[order[i]];
+
+            // The spectator has the inputs before the end frame of its current index
+            const uint64_t received = absoluteFrame ( node.index, node.getEndFrame ( node.index ) );
+            const uint64_t lag = now - min ( received, now );
+
+            if ( node.catchUpFrames == UINT_MAX && lag < DEFAULT_CATCH_UP_THRESHOLD )
+            {
+                node.catchUpFrames = _frames - node.joinFrame;
+                result.catchUps.push_back ( node.catchUpFrames );
+            }
+
+            if ( _frames % 60 == 0 )
+                result.lags.push_back ( lag );
+        }
+
+        result.peakAllocated = max ( result.peakAllocated,
+                                     host.inputs[0].getAllocatedSize() + host.inputs[1].getAllocatedSize() );
+
+        result.peakIndices = max ( result.peakIndices, host.index + 1 - host.startIndex );
+
+        ++_frames;
+
+        if ( ++host.frame >= numFrames ( host.index ) )
+        {
+            _indexStart.push_back ( _frames );
+            setIndex ( host, host.index + 1 );
+        }
+    }
+
+    result.frames = _frames;
+}
+
+
+template<typename T>
+static T percentile ( vector<T>& values, double p )
+{
+    if ( values.empty() )
+        return T();
+
+    const size_t i = min ( values.size() - 1, size_t ( p * values.size() ) );
+
+    nth_element ( values.begin(), values.begin() + i, values.end() );
+    return values[i];
+}
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-n" )
+        {
+            options.counts.clear();
+
+            for ( const string& count : split ( argv[++i], "," ) )
+                options.counts.push_back ( stoul ( count ) );
+        }
+        else if ( i + 1 < argc && arg == "-g" )
+            options.games = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-f" )
+            options.gameFrames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-m" )
+            options.menuFrames = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-j" )
+            options.joinSpread = stod ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-r" )
+            options.rootSpectators = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-s" )
+            options.maxSpectators = stoul ( argv[++i] );
+        else
+        {
+            PRINT ( "Usage: %s [-n count,...] [-g games] [-f gameFrames] [-m menuFrames] [-j joinSpread] "
+                    "[-r rootSpectators] [-s maxSpectators]", argv[0] );
+            return -1;
+        }
+    }
+
+    options.games = max<uint32_t> ( options.games, 1 );
+    options.gameFrames = max<uint32_t> ( options.gameFrames, DEFAULT_NUM_INPUTS );
+    options.menuFrames = max<uint32_t> ( options.menuFrames, DEFAULT_NUM_INPUTS );
+    options.joinSpread = min ( max ( options.joinSpread, 0.0 ), 1.0 );
+    options.rootSpectators = max<uint32_t> ( options.rootSpectators, 1 );
+    options.maxSpectators = max<uint32_t> ( options.maxSpectators, 1 );
+
+    // Each spectator needs two sockets
+    rlimit limit;
+
+    if ( getrlimit ( RLIMIT_NOFILE, &limit ) == 0 )
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit ( RLIMIT_NOFILE, &limit );
+    }
+
+    PRINT ( "games=%u; gameFrames=%u; menuFrames=%u; joinSpread=%.2f; rootSpectators=%u; maxSpectators=%u",
+            options.games, options.gameFrames, options.menuFrames, options.joinSpread,
+            options.rootSpectators, options.maxSpectators );
+
+    PRINT ( "%6s %6s %10s %10s %10s %10s %10s %10s %8s %8s %8s %10s %10s %8s", "count", "depth", "us/frame",
+            "p99(us)", "relay99", "host KB/s", "KB/s", "msgs/s", "lag50", "lag99", "lagMax", "catchUp(s)",
+            "peak(KB)", "indices" );
+
+    for ( uint32_t count : options.counts )
+    {
+        mt19937 rng ( count );
+
+        Tree tree ( options );
+        string error;
+
+        if ( ! tree.connect ( count, rng, error ) )
+        {
+            PRINT ( "%6u %s", count, error );
+            return -1;
+        }
+
+        Result result;
+        tree.run ( rng, result );
+
+        double total = 0;
+
+        for ( double t : result.hostTimes )
+            total += t;
+
+        const double seconds = result.frames / 60.0;
+
+        PRINT ( "%6u %6u %10.2f %10.2f %10.2f %10.1f %10.1f %10.1f %8u %8u %8u %10.2f %10u %8u", count,
+                result.maxDepth, total / max<uint64_t> ( result.frames, 1 ), percentile ( result.hostTimes, 0.99 ),
+                percentile ( result.relayTimes, 0.99 ), result.hostBytes / 1024.0 / seconds,
+                result.bytes / 1024.0 / seconds, result.messages / seconds, percentile ( result.lags, 0.5 ),
+                percentile ( result.lags, 0.99 ), percentile ( result.lags, 1.0 ),
+                percentile ( result.catchUps, 1.0 ) / 60.0, ( uint32_t ) ( result.peakAllocated / 1024 ),
+                result.peakIndices );
+    }
+
+    return 0;
+}
@@ -0,0 +1,769 @@
+#include "IndexedFrame.hpp"
+#include "NetplayStates.hpp"
+#include "Thread.hpp"
+#include "Logger.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+
+// Linux native sync log differ, replacing scripts/diff.py and scripts/3waydiff.py.
+//
+// The first sync log is compared against each of the other ones, with the same rules as diff.py: lines are aligned
+// by [index:frame], states that aren't kept in sync are skipped, and RngStates are skipped against dummy logs from
+// MainApp. The logs are mapped instead of read, and each pair is split into chunks that start at the same
+// transition index in both logs, which are compared in parallel. So memory stays constant, and gigabyte logs take
+// about as long as reading them. With three logs, the log that disagrees with the other two is also reported.
+
+
+// Default number of lines of context shown around the first mismatch
+#define DEFAULT_CONTEXT ( 5 )
+
+// Number of chunks per worker thread, so workers that finish early can take more chunks
+#define CHUNKS_PER_JOB ( 4 )
+
+// Number of lines between checks for a mismatch in an earlier chunk
+#define CANCEL_CHECK_LINES ( 4096 )
+
+// Distance in bytes at which the binary search for the start of an index switches to a linear scan
+#define LINEAR_SCAN_SIZE ( 64 * 1024 )
+
+
+struct Options
+{
+    vector<string> files;
+
+    uint32_t context = DEFAULT_CONTEXT;
+
+    // Number of worker threads, 0 for one per core
+    uint32_t jobs = 0;
+};
+
+
+// A parsed line of a sync log, the state, tag, and data point into the mapped log
+struct Line
+{
+    const char *begin = 0, *end = 0;
+
+    const char *state = 0;
+    size_t stateLen = 0;
+
+    // Parsed state, Unknown for states that aren't a NetplayState, ie Dummy
+    NetplayState::Enum stateValue = NetplayState::Unknown;
+
+    IndexedFrame indexedFrame = {{ 0, 0 }};
+
+    // Tag and data, ie everything after [index:frame]
+    const char *data = 0;
+    size_t dataLen = 0;
+
+    bool isState ( const char *str ) const
+    {
+        return ( stateLen == strlen ( str ) && ! memcmp ( state, str, stateLen ) );
+    }
+
+    bool isTag ( const char *str ) const
+    {
+        const size_t len = strlen ( str );
+        return ( dataLen > len && ! memcmp ( data, str, len ) && data[len] == ':' );
+    }
+
+    string str() const
+    {
+        return string ( begin, end );
+    }
+};
+
+
+static bool parseNumber ( const char *& ptr, const char *end, uint32_t& value )
+{
+    const char *start = ptr;
+
+    for ( value = 0; ptr < end && *ptr >= '0' && *ptr <= '9'; ++ptr )
+        value = value * 10 + ( *ptr - '0' );
+
+    return ( ptr != start );
+}
+
+static bool parseChar ( const char *& ptr, const char *end, char c )
+{
+    if ( ptr >= end || *ptr != c )
+        return false;
+
+    ++ptr;
+    return true;
+}
+
+static bool parseWord ( const char *& ptr, const char *end, const char *& word, size_t& len )
+{
+    word = ptr;
+
+    while ( ptr < end && *ptr != ' ' )
+        ++ptr;
+
+    len = ptr - word;
+    return ( len > 0 );
+}
+
+// Parse a line in the full format: "gameMode [gameMode] NetplayState::state [index:frame] tag: data",
+// or in the short format of dummy logs: "state [index:frame] tag: data".
+static bool parseLine ( const char *begin, const char *end, bool dummy, Line& line )
+{
+    line.begin = begin;
+    line.end = end;
+
+    const char *ptr = begin;
+    const char *word;
+    size_t len;
+    uint32_t value;
+
+    if ( ! dummy )
+    {
+        static const char prefix[] = "NetplayState::";
+
+        if ( ! parseWord ( ptr, end, word, len ) || ! parseChar ( ptr, end, ' ' ) || ! parseChar ( ptr, end, '[' )
+                || ! parseNumber ( ptr, end, value ) || ! parseChar ( ptr, end, ']' ) || ! parseChar ( ptr, end, ' ' )
+                || size_t ( end - ptr ) < sizeof ( prefix ) - 1 || memcmp ( ptr, prefix, sizeof ( prefix ) - 1 ) )
+        {
+            return false;
+        }
+
+        ptr += sizeof ( prefix ) - 1;
+    }
+
+    if ( ! parseWord ( ptr, end, line.state, line.stateLen ) || ! parseChar ( ptr, end, ' ' )
+            || ! parseChar ( ptr, end, '[' ) || ! parseNumber ( ptr, end, line.indexedFrame.parts.index )
+            || ! parseChar ( ptr, end, ':' ) || ! parseNumber ( ptr, end, line.indexedFrame.parts.frame )
+            || ! parseChar ( ptr, end, ']' ) || ! parseChar ( ptr, end, ' ' ) )
+    {
+        return false;
+    }
+
+    line.stateValue = NetplayState::Unknown;
+    NetplayState::parse ( line.state, line.stateLen, line.stateValue );
+
+    line.data = ptr;
+    line.dataLen = end - ptr;
+
+    // The data must start with "tag: "
+    const char *colon = ( const char * ) memchr ( ptr, ':', end - ptr );
+    return ( colon && colon > ptr && colon + 1 < end && colon[1] == ' ' );
+}
+
+
+// A sync log mapped in memory
+class SyncLog
+{
+public:
+
+    string file;
+
+    // True if this is a dummy log from MainApp, which uses the short format without RngStates
+    bool dummy = false;
+
+    string sessionId;
+
+    ~SyncLog()
+    {
+        if ( _data )
+            munmap ( ( void * ) _data, _size );
+    }
+
+    bool open ( const string& file, string& error )
+    {
+        this->file = file;
+
+        const int fd = ::open ( file.c_str(), O_RDONLY );
+
+        if ( fd < 0 )
+        {
+            error = "Cannot open file";
+            return false;
+        }
+
+        struct stat st;
+        fstat ( fd, &st );
+
+        _size = st.st_size;
+
+        if ( _size == 0 )
+        {
+            ::close ( fd );
+            error = "Empty file";
+            return false;
+        }
+
+        void *data = mmap ( 0, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+        ::close ( fd );
+
+        if ( data == MAP_FAILED )
+        {
+            error = "Cannot map file";
+            return false;
+        }
+
+        _data = ( const char * ) data;
+
+        madvise ( data, _size, MADV_SEQUENTIAL );
+
+        return readHeader ( error );
+    }
+
+    const char *begin() const { return _start; }
+
+    const char *end() const { return _data + _size; }
+
+    // Get the line starting at ptr, and advance ptr to the next line
+    const char *nextLine ( const char *& ptr ) const
+    {
+        const char *begin = ptr;
+        const char *newline = ( const char * ) memchr ( ptr, '\n', end() - ptr );
+
+        ptr = ( newline ? newline + 1 : end() );
+
+        if ( newline && newline > begin && newline[-1] == '\r' )
+            --newline;
+
+        return ( newline ? newline : end() );
+    }
+
+    // Parse the next line that is a sync line, returns false at the end of the log
+    bool next ( const char *& ptr, const char *end, Line& line ) const
+    {
+        while ( ptr < end )
+        {
+            const char *begin = ptr;
+            const char *lineEnd = nextLine ( ptr );
+
+            if ( parseLine ( begin, lineEnd, dummy, line ) )
+                return true;
+        }
+
+        return false;
+    }
+
+    // Get the start of the line containing ptr
+    const char *lineStart ( const char *ptr ) const
+    {
+        while ( ptr > _data && ptr[-1] != '\n' )
+            --ptr;
+
+        return ptr;
+    }
+
+    // Find the first sync line with at least the given index, assuming indices mostly increase through the log
+    const char *findIndex ( uint32_t index ) const
+    {
+        const char *lo = _start, *hi = end();
+        Line line;
+
+        while ( size_t ( hi - lo ) > LINEAR_SCAN_SIZE )
+        {
+            const char *mid = lineStart ( lo + ( hi - lo ) / 2 );
+            const char *ptr = mid;
+
+            if ( ! next ( ptr, hi, line ) || line.indexedFrame.parts.index >= index )
+                hi = mid;
+            else
+                lo = ptr;
+        }
+
+        for ( const char *ptr = lo; ptr < end(); )
+        {
+            const char *begin = ptr;
+
+            if ( ! next ( ptr, end(), line ) )
+                break;
+
+            if ( line.indexedFrame.parts.index >= index )
+                return begin;
+        }
+
+        return end();
+    }
+
+    size_t getLineNumber ( const char *ptr ) const
+    {
+        size_t lines = 1;
+
+        for ( const char *p = _data; ( p = ( const char * ) memchr ( p, '\n', ptr - p ) ); ++p )
+            ++lines;
+
+        return lines;
+    }
+
+private:
+
+    const char *_data = 0;
+
+    size_t _size = 0;
+
+    // Start of the sync lines after the header
+    const char *_start = 0;
+
+    // Read the header lines before the first sync line, and detect the log format
+    bool readHeader ( string& error )
+    {
+        const char *ptr = _data;
+        Line line;
+
+        while ( ptr < end() )
+        {
+            const char *begin = ptr;
+            const char *lineEnd = nextLine ( ptr );
+
+            static const char prefix[] = "SessionId ";
+
+            if ( size_t ( lineEnd - begin ) > sizeof ( prefix ) && ! memcmp ( begin, prefix, sizeof ( prefix ) - 1 ) )
+            {
+                sessionId.assign ( begin + sizeof ( prefix ) - 1, lineEnd );
+                continue;
+            }
+
+            if ( parseLine ( begin, lineEnd, false, line ) )
+            {
+                dummy = false;
+            }
+            else if ( parseLine ( begin, lineEnd, true, line ) )
+            {
+                dummy = true;
+            }
+            else
+            {
+                continue;
+            }
+
+            _start = begin;
+            break;
+        }
+
+        if ( ! _start )
+        {
+            error = "No sync lines";
+            return false;
+        }
+
+        // Like diff.py, full logs are compared starting from character select
+        if ( ! dummy )
+        {
+            ptr = _start;
+
+            while ( next ( ptr, end(), line ) && line.stateValue != NetplayState::CharaSelect )
+                _start = ptr;
+        }
+
+        return true;
+    }
+};
+
+
+// Range of the two logs compared by a chunk, chunks are ordered by their transition index
+struct Chunk
+{
+    const char *begin[2], *end[2];
+
+    // Matched lines, and the mismatched lines if any
+    size_t matched = 0;
+    Line mismatch[2];
+    bool hasMismatch = false;
+};
+
+
+// Comparison of the first log against another one
+struct Pair
+{
+    const SyncLog *log[2];
+
+    vector<Chunk> chunks;
+
+    // Position of the first chunk with a mismatch, later chunks stop early
+    atomic<size_t> firstMismatch { SIZE_MAX };
+};
+
+
+static bool isSkippedState ( const Line& line )
+{
+    return ( line.stateValue == NetplayState::Loading || line.stateValue == NetplayState::Skippable
+             || line.stateValue == NetplayState::RetryMenu );
+}
+
+// Compare a chunk like diff.py, until the first mismatch or the end of either log
+static void compareChunk ( Pair& pair, size_t position )
+{
+    Chunk& chunk = pair.chunks[position];
+
+    const SyncLog& a = *pair.log[0];
+    const SyncLog& b = *pair.log[1];
+
+    const char *ptr[2] = { chunk.begin[0], chunk.begin[1] };
+
+    Line line[2];
+    bool have[2] = { false, false };
+
+    // Only the first chunk skips the initial frames before the first matched line
+    const bool skipInitialFrames = ( position == 0 );
+
+    size_t lines = 0;
+
+    for ( ;; )
+    {
+        if ( ++lines % CANCEL_CHECK_LINES == 0 && pair.firstMismatch.load() < position )
+            return;
+
+        for ( int i = 0; i < 2; ++i )
+        {
+            if ( ! have[i] && ! ( have[i] = pair.log[i]->next ( ptr[i], chunk.end[i], line[i] ) ) )
+                return;
+        }
+
+        Line& l = line[0];
+        Line& r = line[1];
+
+        // Dummy logs use the state of the other log for the same index
+        const bool sameIndex = ( l.indexedFrame.parts.index == r.indexedFrame.parts.index );
+
+        if ( l.isState ( "Dummy" ) && sameIndex )
+            l.state = r.state, l.stateLen = r.stateLen, l.stateValue = r.stateValue;
+
+        if ( r.isState ( "Dummy" ) && sameIndex )
+            r.state = l.state, r.stateLen = l.stateLen, r.stateValue = l.stateValue;
+
+        // States that aren't kept in sync, and RngStates that aren't in dummy logs
+        if ( isSkippedState ( l ) || ( b.dummy && l.isTag ( "RngState" ) ) )
+        {
+            have[0] = false;
+            continue;
+        }
+
+        if ( isSkippedState ( r ) || ( a.dummy && r.isTag ( "RngState" ) ) )
+        {
+            have[1] = false;
+            continue;
+        }
+
+        // Skip older transition indices
+        if ( l.indexedFrame.parts.index != r.indexedFrame.parts.index )
+        {
+            have[l.indexedFrame.parts.index < r.indexedFrame.parts.index ? 0 : 1] = false;
+            continue;
+        }
+
+        // Skip initial frames before we match the first line
+        if ( skipInitialFrames && chunk.matched == 0 && l.indexedFrame.parts.frame != r.indexedFrame.parts.frame )
+        {
+            have[l.indexedFrame.parts.frame < r.indexedFrame.parts.frame ? 0 : 1] = false;
+            continue;
+        }
+
+        if ( l.stateLen == r.stateLen && ! memcmp ( l.state, r.state, l.stateLen )
+                && l.indexedFrame.value == r.indexedFrame.value
+                && l.dataLen == r.dataLen && ! memcmp ( l.data, r.data, l.dataLen ) )
+        {
+            ++chunk.matched;
+            have[0] = have[1] = false;
+            continue;
+        }
+
+        chunk.mismatch[0] = l;
+        chunk.mismatch[1] = r;
+        chunk.hasMismatch = true;
+
+        // Record the earliest chunk with a mismatch
+        size_t first = pair.firstMismatch.load();
+
+        while ( position < first && ! pair.firstMismatch.compare_exchange_weak ( first, position ) )
+            ;
+
+        return;
+    }
+}
+
+// Split a pair into chunks that start at the same transition index in both logs
+static void splitChunks ( Pair& pair, size_t numChunks )
+{
+    const SyncLog& a = *pair.log[0];
+    const SyncLog& b = *pair.log[1];
+
+    vector<uint32_t> indices;
+
+    for ( size_t i = 1; i < numChunks; ++i )
+    {
+        const char *ptr = a.lineStart ( a.begin() + ( a.end() - a.begin() ) * i / numChunks );
+        Line line;
+
+        if ( ptr < a.begin() || ! a.next ( ptr, a.end(), line ) )
+            continue;
+
+        // The chunk starts at the next transition index
+        const uint32_t index = line.indexedFrame.parts.index + 1;
+
+        if ( indices.empty() || index > indices.back() )
+            indices.push_back ( index );
+    }
+
+    pair.chunks.resize ( indices.size() + 1 );
+
+    for ( int i = 0; i < 2; ++i )
+    {
+        pair.chunks.front().begin[i] = pair.log[i]->begin();
+        pair.chunks.back().end[i] = pair.log[i]->end();
+    }
+
+    for ( size_t i = 0; i < indices.size(); ++i )
+    {
+        const char *start[2] = { a.findIndex ( indices[i] ), b.findIndex ( indices[i] ) };
+
+        for ( int j = 0; j < 2; ++j )
+        {
+            // Keep the chunks in order even if the indices aren't increasing through a log
+            start[j] = max ( start[j], pair.chunks[i].begin[j] );
+
+            pair.chunks[i].end[j] = start[j];
+            pair.chunks[i + 1].begin[j] = start[j];
+        }
+    }
+}
+
+
+// Worker thread that compares the next chunk until there are none left
+class DiffThread : public Thread
+{
+public:
+
+    DiffThread ( vector<pair<Pair *, size_t>>& tasks, atomic<size_t>& next )
+        : _tasks ( tasks ), _next ( next ) {}
+
+    void run() override
+    {
+        for ( ;; )
+        {
+            const size_t i = _next++;
+
+            if ( i >= _tasks.size() )
+                return;
+
+            Pair& pair = *_tasks[i].first;
+
+            if ( pair.firstMismatch.load() > _tasks[i].second )
+                compareChunk ( pair, _tasks[i].second );
+        }
+    }
+
+private:
+
+    vector<pair<Pair *, size_t>>& _tasks;
+
+    atomic<size_t>& _next;
+};
+
+
+// Print the lines around a line of a log, with the given prefix for the line itself
+static void printContext ( const SyncLog& log, const Line& line, const char *prefix, uint32_t context, bool before )
+{
+    if ( before )
+    {
+        vector<string> lines;
+
+        for ( const char *ptr = line.begin; lines.size() < context && ptr > log.begin(); )
+        {
+            ptr = log.lineStart ( ptr - 1 );
+
+            const char *p = ptr;
+            const char *end = log.nextLine ( p );
+
+            lines.push_back ( string ( ptr, end ) );
+        }
+
+        for ( auto it = lines.rbegin(); it != lines.rend(); ++it )
+            PRINT ( "  %s", *it );
+
+        PRINT ( "%s %s", prefix, line.str() );
+        return;
+    }
+
+    const char *ptr = line.begin;
+    log.nextLine ( ptr );
+
+    for ( uint32_t i = 0; i < context && ptr < log.end(); ++i )
+    {
+        const char *begin = ptr;
+        const char *end = log.nextLine ( ptr );
+
+        PRINT ( "  %s", string ( begin, end ) );
+    }
+}
+
+
+typedef chrono::high_resolution_clock Clock;
+
+int main ( int argc, char *argv[] )
+{
+    Options options;
+
+    bool usage = false;
+
+    for ( int i = 1; i < argc && ! usage; ++i )
+    {
+        const string arg = argv[i];
+
+        if ( i + 1 < argc && arg == "-c" )
+            options.context = stoul ( argv[++i] );
+        else if ( i + 1 < argc && arg == "-j" )
+            options.jobs = stoul ( argv[++i] );
+        else if ( ! arg.empty() && arg[0] != '-' )
+            options.files.push_back ( arg );
+        else
+            usage = true;
+    }
+
+    if ( usage || options.files.size() < 2 )
+    {
+        PRINT ( "Usage: %s [-c context] [-j jobs] sync.log other.log [third.log ...]", argv[0] );
+        return -1;
+    }
+
+    if ( ! options.jobs )
+        options.jobs = max<long> ( sysconf ( _SC_NPROCESSORS_ONLN ), 1 );
+
+    const Clock::time_point start = Clock::now();
+
+    vector<shared_ptr<SyncLog>> logs;
+
+    for ( const string& file : options.files )
+    {
+        logs.push_back ( make_shared<SyncLog>() );
+
+        string error;
+
+        if ( ! logs.back()->open ( file, error ) )
+        {
+            PRINT ( "%s: %s", file, error );
+            return -1;
+        }
+    }
+
+    vector<shared_ptr<Pair>> pairs;
+
+    vector<pair<Pair *, size_t>> tasks;
+
+    for ( size_t i = 1; i < logs.size(); ++i )
+    {
+        if ( ! logs[0]->sessionId.empty() && ! logs[i]->sessionId.empty()
+                && logs[0]->sessionId != logs[i]->sessionId )
+        {
+            PRINT ( "SessionId mismatch" );
+            PRINT ( "< %s", logs[0]->sessionId );
+            PRINT ( "> %s", logs[i]->sessionId );
+            return -1;
+        }
+
+        pairs.push_back ( make_shared<Pair>() );
+        pairs.back()->log[0] = logs[0].get();
+        pairs.back()->log[1] = logs[i].get();
+
+        splitChunks ( *pairs.back(), options.jobs * CHUNKS_PER_JOB );
+    }
+
+    // Interleave the chunks of each pair, so the earliest chunks are compared first
+    for ( size_t i = 0; ; ++i )
+    {
+        bool any = false;
+
+        for ( const auto& pair : pairs )
+        {
+            if ( i < pair->chunks.size() )
+            {
+                tasks.push_back ( { pair.get(), i } );
+                any = true;
+            }
+        }
+
+        if ( ! any )
+            break;
+    }
+
+    atomic<size_t> next ( 0 );
+
+    vector<shared_ptr<DiffThread>> threads;
+
+    for ( uint32_t i = 0; i < min<size_t> ( options.jobs, tasks.size() ); ++i )
+    {
+        threads.push_back ( make_shared<DiffThread> ( tasks, next ) );
+        threads.back()->start();
+    }
+
+    for ( const auto& thread : threads )
+        thread->join();
+
+    // Earliest mismatch of each pair, MaxIndexedFrame if none
+    vector<IndexedFrame> mismatches;
+
+    int result = 0;
+
+    for ( const auto& pair : pairs )
+    {
+        const SyncLog& a = *pair->log[0];
+        const SyncLog& b = *pair->log[1];
+
+        size_t matched = 0;
+
+        mismatches.push_back ( MaxIndexedFrame );
+
+        for ( const Chunk& chunk : pair->chunks )
+        {
+            matched += chunk.matched;
+
+            if ( ! chunk.hasMismatch )
+                continue;
+
+            const Line *mismatch = chunk.mismatch;
+
+            mismatches.back() = mismatch[0].indexedFrame;
+
+            PRINT ( "First mismatch at [%s]", mismatch[0].indexedFrame );
+            PRINT ( "Line %u in %s", a.getLineNumber ( mismatch[0].begin ), a.file );
+            printContext ( a, mismatch[0], "<", options.context, true );
+            printContext ( a, mismatch[0], "<", options.context, false );
+            PRINT ( "Line %u in %s", b.getLineNumber ( mismatch[1].begin ), b.file );
+            printContext ( b, mismatch[1], ">", options.context, true );
+            printContext ( b, mismatch[1], ">", options.context, false );
+
+            result = 1;
+            break;
+        }
+
+        PRINT ( "Successfully matched %u lines (%s vs %s)", matched, a.file, b.file );
+    }
+
+    // With more than two logs, the log that disagrees first is the one that diverged
+    if ( mismatches.size() > 1 )
+    {
+        const auto first = min_element ( mismatches.begin(), mismatches.end(),
+                                         [] ( IndexedFrame a, IndexedFrame b ) { return a.value < b.value; } );
+
+        if ( first->value == MaxIndexedFrame.value )
+            PRINT ( "All logs match" );
+        else if ( all_of ( mismatches.begin(), mismatches.end(),
+                           [&] ( IndexedFrame a ) { return a.value == first->value; } ) )
+            PRINT ( "%s diverges first at [%s]", options.files[0], *first );
+        else
+            PRINT ( "%s diverges first at [%s]", options.files[1 + ( first - mismatches.begin() )], *first );
+    }
+
+    PRINT ( "time=%.2fs; jobs=%u; chunks=%u",
+            chrono::duration<double> ( Clock::now() - start ).count(), options.jobs, tasks.size() );
+
+    return result;
+}